@@ -0,0 +1,931 @@
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "hex-arena.h"
+#include "hex-book.h"
+#include "hex-clock.h"
+#include "hex-htp.h"
+#include "hex-percolation.h"
+#include "hex-record.h"
+#include "hex-resistance.h"
+#include "hex-selfplay.h"
+#include "hex-server.h"
+#include "hex-solve.h"
+#include "hex-twodistance.h"
+#include "hex-vc.h"
+
+/* Headless front end: the experiments that need no display. */
+
+enum cli_mode {
+    MODE_NONE = 0,
+    MODE_PERCOLATION,
+    MODE_REPLAY,
+    MODE_SOLVE,
+    MODE_VC_BENCH,
+    MODE_UF_BENCH,
+    MODE_EVAL_BENCH,
+    MODE_BOOK,
+    MODE_HTP,
+    MODE_ARENA,
+    MODE_SERVER,
+    MODE_SERVER_LOAD,
+    MODE_SELFPLAY,
+    MODE_SHARD
+};
+
+static void usage(FILE *f) {
+    fprintf(f,
+            "usage: chex-cli --percolation N [--trials T] [--threads K] "
+            "[--seed S]\n"
+            "       chex-cli --replay ARCHIVE [--threads K]\n"
+            "       chex-cli --solve N [--position MOVES] [--tt MB] "
+            "[--nodes N] [--seconds S]\n"
+            "                [--patterns 0|1]\n"
+            "       chex-cli --vc-bench ARCHIVE\n"
+            "       chex-cli --uf-bench N [--seconds S]\n"
+            "       chex-cli --eval-bench N [--seconds S]\n"
+            "       chex-cli --book FILE [--board N] [--depth D] "
+            "[--playouts P] [--threads K]\n"
+            "       chex-cli --htp [--threads K] [--seconds S] [--playouts P] "
+            "[--tt MB] [--ponder 0|1]\n"
+            "       chex-cli --arena GAMES [--board N] [--threads K] "
+            "[--seed S]\n"
+            "                [--a-playouts P] [--b-playouts P] "
+            "[--a-exploration C] [--b-exploration C]\n"
+            "       chex-cli --server PORT|unix:PATH [--games G] [--board N] "
+            "[--connections C]\n"
+            "       chex-cli --server-load PORT|unix:PATH [--games G] "
+            "[--board N] [--connections C]\n"
+            "                [--seed S]\n"
+            "       chex-cli --selfplay GAMES [--board N] [--playouts P] "
+            "[--threads K] [--seed S]\n"
+            "                [--output PREFIX] [--shard-samples N] "
+            "[--compress 0|1]\n"
+            "       chex-cli --shard FILE\n"
+            "--solve proves empty boards up to 6x6; larger ones need a few "
+            "stones;\n--nodes and --seconds bound all of it.\n");
+}
+
+static int parse_size(const char *arg, size_t *out) {
+    char *end;
+    errno = 0;
+    unsigned long long v = strtoull(arg, &end, 0);
+    if (errno || end == arg || *end || arg[0] == '-')
+        return 0;
+    *out = (size_t)v;
+    return 1;
+}
+
+static int parse_seconds(const char *arg, double *out) {
+    char *end;
+    errno = 0;
+    double v = strtod(arg, &end);
+    if (errno || end == arg || *end || !(v >= 0))
+        return 0;
+    *out = v;
+    return 1;
+}
+
+static unsigned cpu_count(void) {
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (unsigned)n : 1;
+}
+
+static int run_replay(const char *path, unsigned threads) {
+    struct hex_record_archive archive;
+    if (!hex_record_open(&archive, path)) {
+        fprintf(stderr, "chex-cli: %s is not a game archive\n", path);
+        return 1;
+    }
+    struct hex_replay_stats stats;
+    int ok = hex_record_replay(&archive, threads, &stats);
+    hex_record_close(&archive);
+    if (!ok) {
+        fprintf(stderr, "chex-cli: out of memory\n");
+        return 1;
+    }
+    printf("%zu games, %zu moves on %u threads in %.2fs (%.0f games/s)\n",
+           stats.games, stats.moves, threads, stats.seconds,
+           stats.seconds > 0 ? (double)stats.games / stats.seconds : 0.0);
+    printf("red wins   %zu\n", stats.red_wins);
+    printf("blue wins  %zu\n", stats.blue_wins);
+    printf("unfinished %zu\n", stats.unfinished);
+    printf("mean length %.1f, longest %zu\n",
+           stats.games ? (double)stats.moves / (double)stats.games : 0.0,
+           stats.longest);
+    printf("mismatched results %zu, invalid games %zu\n", stats.mismatches,
+           stats.invalid);
+    return stats.mismatches || stats.invalid ? 3 : 0;
+}
+
+/* Replays the games of an archive through the virtual-connection engine,
+   timing its updates against recomputing from scratch (every REBUILD_EVERY
+   moves, which is slow enough) and measuring how much earlier than
+   hex_grid_get_winner() it sees who has won. */
+#define REBUILD_EVERY 8
+
+struct vc_board {
+    hex_grid grid;
+    struct hex_vc_engine vc;
+};
+
+static int vc_board_init(struct vc_board *b, size_t size) {
+    if (!hex_grid_init(&b->grid, size, HEX_GRID_UNION_FIND))
+        return 0;
+    if (!hex_vc_init(&b->vc, &b->grid)) {
+        hex_grid_destroy(&b->grid);
+        return 0;
+    }
+    return 1;
+}
+
+static void vc_board_destroy(struct vc_board *b) {
+    hex_vc_destroy(&b->vc);
+    hex_grid_destroy(&b->grid);
+}
+
+static int run_vc_bench(const char *path) {
+    struct hex_record_archive archive;
+    if (!hex_record_open(&archive, path)) {
+        fprintf(stderr, "chex-cli: %s is not a game archive\n", path);
+        return 1;
+    }
+    struct vc_board live, full;
+    hex_grid *g = &live.grid;
+    size_t size = 0;
+    size_t games = 0, moves = 0, rebuilds = 0, skipped = 0;
+    size_t won = 0, lead = 0, overturned = 0, update_only = 0, rebuild_only = 0;
+    double update_seconds = 0, rebuild_seconds = 0;
+    int ok = 1;
+
+    for (size_t k = 0; ok && k < archive.count; k++) {
+        struct hex_record_game game;
+        if (!hex_record_get(&archive, k, &game))
+            break;
+        if (game.size < 1 || game.size * game.size > HEX_VC_MAX_CELLS) {
+            skipped++;
+            continue;
+        }
+        if (game.size != size) {
+            if (size) {
+                vc_board_destroy(&live);
+                vc_board_destroy(&full);
+            }
+            size = game.size;
+            ok = vc_board_init(&live, size);
+            if (ok && !(ok = vc_board_init(&full, size)))
+                vc_board_destroy(&live);
+            if (!ok) {
+                size = 0;
+                break;
+            }
+        } else {
+            hex_grid_clear(g);
+            hex_vc_rebuild(&live.vc);
+        }
+
+        games++;
+        cell_color player = RED;
+        cell_color called = NEUTRAL;
+        size_t called_at = 0;
+        for (size_t m = 0; m < game.move_count; m++) {
+            size_t cell = hex_record_move(&game, m);
+            if (cell >= size * size || g->cells[cell].color != NEUTRAL)
+                break;
+            double start = hex_clock_now();
+            hex_vc_play(&live.vc, cell, player);
+            update_seconds += hex_clock_now() - start;
+            moves++;
+            player = player == RED ? BLUE : RED;
+
+            cell_color vc_winner = hex_vc_winner(&live.vc, player);
+            if (called == NEUTRAL && vc_winner != NEUTRAL) {
+                called = vc_winner;
+                called_at = m;
+            }
+            if (m % REBUILD_EVERY == 0) {
+                hex_grid_copy(&full.grid, g);
+                start = hex_clock_now();
+                hex_vc_rebuild(&full.vc);
+                rebuild_seconds += hex_clock_now() - start;
+                rebuilds++;
+                cell_color rebuilt = hex_vc_winner(&full.vc, player);
+                update_only += rebuilt == NEUTRAL && vc_winner != NEUTRAL;
+                rebuild_only += rebuilt != NEUTRAL && vc_winner == NEUTRAL;
+            }
+
+            cell_color winner = hex_grid_get_winner(g);
+            if (winner != NEUTRAL) {
+                /* the win itself is a virtual connection, so it is called */
+                won++;
+                lead += m - called_at;
+                overturned += called != winner;
+                break;
+            }
+        }
+    }
+    if (size) {
+        vc_board_destroy(&live);
+        vc_board_destroy(&full);
+    }
+    hex_record_close(&archive);
+    if (!ok) {
+        fprintf(stderr, "chex-cli: out of memory\n");
+        return 1;
+    }
+
+    printf("%zu games, %zu moves (%zu games too large to track)\n", games,
+           moves, skipped);
+    printf("update  %8.1f us/move\n",
+           moves ? update_seconds * 1e6 / (double)moves : 0.0);
+    printf("rebuild %8.1f us/move, every %d moves\n",
+           rebuilds ? rebuild_seconds * 1e6 / (double)rebuilds : 0.0,
+           REBUILD_EVERY);
+    printf("winner called %.1f moves before it connected, over %zu games\n",
+           won ? (double)lead / (double)won : 0.0, won);
+    printf("called for the side that then lost %zu\n", overturned);
+    printf("called by the update only %zu, by the rebuild only %zu\n",
+           update_only, rebuild_only);
+    return 0;
+}
+
+/* Plays random games on an N x N grid until one side wins, for `seconds`
+   with each union-find mode, and reports the time per move (open_cell and
+   get_winner) and how deep the trees are when the games end. */
+static int run_uf_bench(size_t size, double seconds) {
+    static const struct {
+        const char *name;
+        enum hex_grid_backend backend;
+    } modes[] = {{"compress", HEX_GRID_UNION_FIND},
+                 {"undoable", HEX_GRID_UNDOABLE_UNION_FIND}};
+    const size_t cells = size * size;
+    size_t *order = malloc(cells * sizeof(size_t));
+    if (size < 1 || !order) {
+        fprintf(stderr, "chex-cli: cannot play %zux%zu games\n", size, size);
+        free(order);
+        return 1;
+    }
+    for (size_t i = 0; i < cells; i++)
+        order[i] = i;
+
+    printf("%zux%zu random games, %.1fs per mode\n", size, size, seconds);
+    printf("mode      ns/move  mean depth  max depth\n");
+    for (size_t k = 0; k < sizeof(modes) / sizeof(modes[0]); k++) {
+        hex_grid g;
+        struct hex_rng rng;
+        if (!hex_grid_init(&g, size, modes[k].backend)) {
+            fprintf(stderr, "chex-cli: out of memory\n");
+            free(order);
+            return 1;
+        }
+        hex_rng_seed(&rng, size);
+        size_t games = 0, moves = 0, max_depth = 0;
+        double played = 0, mean_depth = 0;
+        const double end = hex_clock_now() + seconds;
+        do {
+            hex_grid_clear(&g);
+            for (size_t m = 0; m + 1 < cells; m++) {
+                size_t r = m + hex_rng_below(&rng, (uint32_t)(cells - m));
+                size_t i = order[r];
+                order[r] = order[m];
+                order[m] = i;
+            }
+            const double start = hex_clock_now();
+            size_t m = 0;
+            while (m < cells) {
+                hex_grid_open_cell(&g, order[m], m % 2 ? BLUE : RED);
+                m++;
+                if (hex_grid_get_winner(&g) != NEUTRAL)
+                    break;
+            }
+            played += hex_clock_now() - start;
+            moves += m;
+            games++;
+
+            const struct wqu_uf *uf = &g.disjoint_set;
+            size_t total = 0;
+            for (size_t p = 0; p < uf->size; p++) {
+                size_t depth = 0;
+                for (size_t q = p; uf->parent[q] != q; q = uf->parent[q])
+                    depth++;
+                total += depth;
+                if (depth > max_depth)
+                    max_depth = depth;
+            }
+            mean_depth += (double)total / (double)uf->size;
+        } while (hex_clock_now() < end);
+        hex_grid_destroy(&g);
+        printf("%-8s  %7.0f  %10.2f  %9zu\n", modes[k].name,
+               played * 1e9 / (double)moves, mean_depth / (double)games,
+               max_depth);
+    }
+    free(order);
+    return 0;
+}
+
+/* Times the evaluations on every position of random games: resistance
+   warm-started from the position before as in a search, resistance started
+   over for each position, and two-distance. */
+static int run_eval_bench(size_t size, double seconds) {
+    const size_t cells = size * size;
+    size_t *order = malloc(cells * sizeof(size_t));
+    struct hex_resistance warm, cold;
+    struct hex_twodistance two;
+    hex_grid g;
+    if (size < 1 || !order || !hex_grid_init(&g, size, HEX_GRID_UNION_FIND)) {
+        fprintf(stderr, "chex-cli: cannot play %zux%zu games\n", size, size);
+        free(order);
+        return 1;
+    }
+    if (!hex_resistance_init(&warm, size)) {
+        fprintf(stderr, "chex-cli: out of memory\n");
+        hex_grid_destroy(&g);
+        free(order);
+        return 1;
+    }
+    if (!hex_resistance_init(&cold, size)) {
+        fprintf(stderr, "chex-cli: out of memory\n");
+        hex_resistance_destroy(&warm);
+        hex_grid_destroy(&g);
+        free(order);
+        return 1;
+    }
+    if (!hex_twodistance_init(&two, size)) {
+        fprintf(stderr, "chex-cli: cannot evaluate %zux%zu boards\n", size,
+                size);
+        hex_resistance_destroy(&cold);
+        hex_resistance_destroy(&warm);
+        hex_grid_destroy(&g);
+        free(order);
+        return 1;
+    }
+    for (size_t i = 0; i < cells; i++)
+        order[i] = i;
+
+    struct hex_rng rng;
+    hex_rng_seed(&rng, size);
+    size_t evaluations = 0, warm_iterations = 0, cold_iterations = 0;
+    double warm_time = 0, cold_time = 0, two_time = 0;
+    const double end = hex_clock_now() + seconds;
+    do {
+        hex_grid_clear(&g);
+        hex_resistance_forget(&warm);
+        for (size_t m = 0; m + 1 < cells; m++) {
+            size_t r = m + hex_rng_below(&rng, (uint32_t)(cells - m));
+            size_t i = order[r];
+            order[r] = order[m];
+            order[m] = i;
+        }
+        for (size_t m = 0; m < cells && hex_grid_get_winner(&g) == NEUTRAL;
+             m++) {
+            hex_grid_open_cell(&g, order[m], m % 2 ? BLUE : RED);
+            double start = hex_clock_now();
+            hex_resistance_evaluate(&warm, &g);
+            warm_time += hex_clock_now() - start;
+            warm_iterations += warm.iterations;
+
+            hex_resistance_forget(&cold);
+            start = hex_clock_now();
+            hex_resistance_evaluate(&cold, &g);
+            cold_time += hex_clock_now() - start;
+            cold_iterations += cold.iterations;
+
+            start = hex_clock_now();
+            hex_twodistance_evaluate(&two, &g);
+            two_time += hex_clock_now() - start;
+            evaluations++;
+        }
+    } while (hex_clock_now() < end);
+
+    printf("%zux%zu random games, %zu positions\n", size, size, evaluations);
+    printf("evaluation         us/eval  positions/s  iterations\n");
+    printf("resistance, warm   %7.2f  %11.0f  %10.1f\n",
+           warm_time * 1e6 / (double)evaluations,
+           (double)evaluations / warm_time,
+           (double)warm_iterations / (double)evaluations);
+    printf("resistance, cold   %7.2f  %11.0f  %10.1f\n",
+           cold_time * 1e6 / (double)evaluations,
+           (double)evaluations / cold_time,
+           (double)cold_iterations / (double)evaluations);
+    printf("two-distance       %7.2f  %11.0f\n",
+           two_time * 1e6 / (double)evaluations,
+           (double)evaluations / two_time);
+    hex_twodistance_destroy(&two);
+    hex_resistance_destroy(&cold);
+    hex_resistance_destroy(&warm);
+    hex_grid_destroy(&g);
+    free(order);
+    return 0;
+}
+
+/* Cells are named as on a hex board: column letter, then row from 1. */
+static void print_cell(size_t i, size_t size) {
+    printf("%c%zu", (char)('a' + i % size), i / size + 1);
+}
+
+/* Plays MOVES, comma separated cell names with red moving first, on g.
+   Returns the side to move, or NEUTRAL if a move is not a free cell. */
+static cell_color play_moves(hex_grid *g, const char *moves) {
+    cell_color player = RED;
+    while (moves && *moves) {
+        char *end;
+        size_t x = (size_t)(*moves - 'a');
+        if (*moves < 'a' || x >= g->size || moves[1] < '1' || moves[1] > '9')
+            return NEUTRAL;
+        size_t y = strtoul(moves + 1, &end, 10) - 1;
+        if (y >= g->size || (*end && *end != ','))
+            return NEUTRAL;
+        if (!hex_grid_open_cell(g, y * g->size + x, player))
+            return NEUTRAL;
+        player = player == RED ? BLUE : RED;
+        moves = *end ? end + 1 : end;
+    }
+    return player;
+}
+
+static void print_solve_stats(const struct hex_solve_stats *stats) {
+    printf("%llu nodes in %.2fs (%.0f nodes/s), %.1f MB",
+           (unsigned long long)stats->nodes, stats->seconds,
+           stats->nodes_per_second, (double)stats->memory / (1 << 20));
+    if (stats->proof_size)
+        printf(", proof of %zu positions", stats->proof_size);
+    printf("\n");
+}
+
+/* Shares what is left of the command's budget out to the next solve.
+   Returns 0 if nothing is left. */
+static int solve_budget(struct hex_solver *solver,
+                        const struct hex_solve_config *config,
+                        double deadline,
+                        uint64_t nodes) {
+    if (config->max_nodes) {
+        if (nodes >= config->max_nodes)
+            return 0;
+        solver->config.max_nodes = config->max_nodes - (size_t)nodes;
+    }
+    if (deadline > 0) {
+        solver->config.max_seconds = deadline - hex_clock_now();
+        if (solver->config.max_seconds <= 0)
+            return 0;
+    }
+    return 1;
+}
+
+/* Solves the position, then every move of the side to move if it wins, to
+   list all the winning moves. The node and time limits are for all of it:
+   the moves left when they run out are listed with a "?". */
+static int run_solve(size_t size,
+                     const char *moves,
+                     const struct hex_solve_config *config) {
+    static const char *names[] = {[RED] = "red", [BLUE] = "blue"};
+    struct hex_solver solver;
+    hex_grid g;
+    if (size < 1 || size > 26 ||
+        !hex_grid_init(&g, size, HEX_GRID_UNDOABLE_UNION_FIND)) {
+        fprintf(stderr, "chex-cli: cannot solve %zux%zu boards\n", size, size);
+        return 1;
+    }
+    cell_color to_move = play_moves(&g, moves);
+    if (to_move == NEUTRAL) {
+        fprintf(stderr, "chex-cli: bad position %s\n", moves);
+        hex_grid_destroy(&g);
+        return 2;
+    }
+    if (!hex_solver_init(&solver, config, size)) {
+        fprintf(stderr, "chex-cli: out of memory\n");
+        hex_grid_destroy(&g);
+        return 1;
+    }
+
+    const double deadline =
+        config->max_seconds > 0 ? hex_clock_now() + config->max_seconds : 0;
+    struct hex_solve_stats stats;
+    cell_color winner = hex_solve(&solver, &g, to_move, true, &stats);
+    printf("%zux%zu, %s to move: ", size, size, names[to_move]);
+    if (winner == NEUTRAL)
+        printf("unsolved within the budget\n");
+    else
+        printf("%s wins\n", names[winner]);
+    print_solve_stats(&stats);
+
+    if (winner == to_move && hex_grid_get_winner(&g) == NEUTRAL) {
+        struct hex_solve_stats total = stats;
+        printf("winning moves:");
+        for (size_t i = 0; i < size * size; i++) {
+            if (g.cells[i].color != NEUTRAL)
+                continue;
+            cell_color w = NEUTRAL;
+            if (solve_budget(&solver, config, deadline, total.nodes)) {
+                hex_grid_open_cell(&g, i, to_move);
+                w = hex_solve(&solver, &g, to_move == RED ? BLUE : RED,
+                              false, &stats);
+                hex_grid_undo(&g);
+                total.nodes += stats.nodes;
+                total.seconds += stats.seconds;
+            }
+            if (w == to_move) {
+                printf(" ");
+                print_cell(i, size);
+            } else if (w == NEUTRAL) {
+                printf(" ");
+                print_cell(i, size);
+                printf("?");
+            }
+        }
+        printf("\n");
+        total.proof_size = 0;
+        total.memory = stats.memory;
+        total.nodes_per_second =
+            total.seconds > 0 ? (double)total.nodes / total.seconds : 0;
+        printf("in total: ");
+        print_solve_stats(&total);
+    }
+    hex_solver_destroy(&solver);
+    hex_grid_destroy(&g);
+    return winner == NEUTRAL ? 3 : 0;
+}
+
+static int run_book(const char *path, const struct hex_book_config *config) {
+    struct hex_book_stats stats;
+    if (!hex_book_build(config, path, &stats)) {
+        fprintf(stderr, "chex-cli: cannot build the book %s\n", path);
+        return 1;
+    }
+    printf("%zu positions searched on %u threads in %.2fs, %zu in the "
+           "book\n",
+           stats.positions, config->threads, stats.seconds, stats.entries);
+    return 0;
+}
+
+static int run_htp(const struct hex_htp_config *config) {
+    struct hex_htp h;
+    if (!hex_htp_init(&h, config)) {
+        fprintf(stderr, "chex-cli: cannot start the HTP engine\n");
+        return 1;
+    }
+    hex_htp_run(&h, stdin, stdout);
+    hex_htp_destroy(&h);
+    return 0;
+}
+
+static int run_arena(const struct hex_arena_config *config) {
+    struct hex_arena_stats stats;
+    if (!hex_arena_run(config, &stats)) {
+        fprintf(stderr, "chex-cli: cannot run the arena\n");
+        return 1;
+    }
+    printf("%zu games, %zu moves on %u threads in %.2fs (%.1f games/s)\n",
+           stats.games, stats.moves, config->threads, stats.seconds,
+           stats.games_per_second);
+    printf("A wins %zu, B wins %zu, red wins %zu\n", stats.wins[0],
+           stats.wins[1], stats.red_wins);
+    for (size_t k = 0; k < config->size_count; k++) {
+        printf("%zux%zu: A wins %zu of %zu\n", config->sizes[k],
+               config->sizes[k], stats.size_wins[k], stats.size_games[k]);
+    }
+    printf("Elo of A over B: %+.0f, 95%% interval [%+.0f, %+.0f]\n",
+           stats.elo, stats.elo_low, stats.elo_high);
+    printf("ms per move       p50       p90       p99\n");
+    for (unsigned e = 0; e < 2; e++) {
+        printf("%c          %9.3f %9.3f %9.3f\n", 'A' + e,
+               stats.move_ms[e][0], stats.move_ms[e][1], stats.move_ms[e][2]);
+    }
+    return 0;
+}
+
+static int run_selfplay(const struct hex_selfplay_config *config) {
+    struct hex_selfplay_stats stats;
+    if (!hex_selfplay_run(config, &stats)) {
+        fprintf(stderr, "chex-cli: cannot play or write %s-*.shard\n",
+                config->prefix);
+        return 1;
+    }
+    printf("%zu games, %zu samples in %zu shards (%.1f MB) on %u threads in "
+           "%.2fs (%.0f samples/s)\n",
+           stats.games, stats.samples, stats.shards,
+           (double)stats.bytes / (1 << 20), config->threads, stats.seconds,
+           stats.samples_per_second);
+    printf("%.3fs spent waiting for the writer\n", stats.writer_wait);
+    return 0;
+}
+
+/* Reads a shard through both symmetries, as training would. */
+static int run_shard(const char *path) {
+    struct hex_selfplay_shard s;
+    struct hex_selfplay_sample sample;
+    if (!hex_selfplay_shard_open(&s, path, true)) {
+        fprintf(stderr, "chex-cli: cannot read %s\n", path);
+        return 1;
+    }
+    const size_t cells = s.size * s.size;
+    const double start = hex_clock_now();
+    size_t samples = 0, red_won = 0;
+    double policy = 0;
+    while (hex_selfplay_shard_next(&s, &sample)) {
+        samples++;
+        red_won += hex_selfplay_winner(&sample) == RED;
+        for (size_t i = 0; i < cells; i++)
+            policy += hex_selfplay_policy(&sample, i);
+    }
+    const double seconds = hex_clock_now() - start;
+    const bool complete = s.next == s.count && !s.rotated;
+    printf("%zux%zu, %zu samples%s, %zu stored, %s\n", s.size, s.size,
+           samples, complete ? "" : " before a broken block", s.count,
+           s.compressed ? "compressed" : "uncompressed");
+    if (samples) {
+        printf("red won %.1f%%, visit shares add up to %.4f\n",
+               100.0 * (double)red_won / (double)samples,
+               policy / (double)samples);
+    }
+    printf("read in %.3fs (%.0f samples/s)\n", seconds,
+           seconds > 0 ? (double)samples / seconds : 0);
+    hex_selfplay_shard_close(&s);
+    return complete ? 0 : 1;
+}
+
+static struct hex_server *serving;
+
+static void stop_serving(int sig) {
+    (void)sig;
+    hex_server_stop(serving);
+}
+
+static int run_server(const struct hex_server_config *config) {
+    struct hex_server s;
+    if (!hex_server_init(&s, config)) {
+        fprintf(stderr, "chex-cli: cannot serve on %s\n", config->address);
+        return 1;
+    }
+    serving = &s;
+    signal(SIGINT, stop_serving);
+    signal(SIGTERM, stop_serving);
+    printf("serving up to %zu games of up to %zux%zu on %s\n",
+           config->max_games, config->max_size, config->max_size,
+           config->address);
+    fflush(stdout);
+    int ok = hex_server_run(&s);
+    signal(SIGINT, SIG_DFL);
+    signal(SIGTERM, SIG_DFL);
+    printf("%llu commands\n", (unsigned long long)s.commands);
+    hex_server_destroy(&s);
+    return ok ? 0 : 1;
+}
+
+static int run_server_load(const struct hex_server_load_config *config) {
+    struct hex_server_load_stats stats;
+    int ok = hex_server_load(config, &stats);
+    printf("%zu games, %zu moves over %u connections in %.2fs "
+           "(%.0f moves/s)\n",
+           stats.games, stats.moves, config->connections, stats.seconds,
+           stats.moves_per_second);
+    printf("answer latency p50 %.1fus, p99 %.1fus; %zu errors\n",
+           stats.p50_us, stats.p99_us, stats.errors);
+    if (!ok) {
+        fprintf(stderr, "chex-cli: the load against %s did not finish\n",
+                config->address);
+        return 1;
+    }
+    return 0;
+}
+
+static int run_percolation(const struct hex_percolation_config *config) {
+    struct hex_percolation_stats stats;
+    if (!hex_percolation_run(config, &stats)) {
+        fprintf(stderr, "chex-cli: cannot run %zux%zu percolation trials\n",
+                config->size, config->size);
+        return 1;
+    }
+    printf("%zux%zu hex lattice, %zu trials on %u threads in %.2fs\n",
+           config->size, config->size, stats.trials, config->threads,
+           stats.seconds);
+    printf("mean                    = %.6f\n", stats.mean);
+    printf("stddev                  = %.6f\n", stats.stddev);
+    printf("95%% confidence interval = [%.6f, %.6f]\n", stats.confidence_low,
+           stats.confidence_high);
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    enum cli_mode mode = MODE_NONE;
+    const char *archive = NULL;
+    const char *position = NULL;
+    size_t solve_size = 0;
+    size_t bench_size = 0;
+    double seconds = 0;
+    struct hex_percolation_config percolation;
+    hex_percolation_default_config(&percolation);
+    percolation.threads = cpu_count();
+    struct hex_solve_config solve;
+    hex_solve_default_config(&solve);
+    const char *book_path = NULL;
+    struct hex_book_config book;
+    hex_book_default_config(&book);
+    bool book_board = false;
+    struct hex_htp_config htp;
+    hex_htp_default_config(&htp);
+    struct hex_arena_config arena;
+    hex_arena_default_config(&arena);
+    struct hex_server_config server;
+    hex_server_default_config(&server);
+    struct hex_server_load_config load = {NULL, 1000, 4, 11, 1};
+    struct hex_selfplay_config selfplay;
+    hex_selfplay_default_config(&selfplay);
+
+    for (int a = 1; a < argc; a++) {
+        const char *opt = argv[a];
+        size_t n;
+        if (!strcmp(opt, "--help") || !strcmp(opt, "-h")) {
+            usage(stdout);
+            return 0;
+        }
+        if (!strcmp(opt, "--htp")) {
+            mode = MODE_HTP;
+            continue;
+        }
+        if (a + 1 == argc) {
+            usage(stderr);
+            return 2;
+        }
+        if (!strcmp(opt, "--replay")) {
+            mode = MODE_REPLAY;
+            archive = argv[++a];
+            continue;
+        }
+        if (!strcmp(opt, "--vc-bench")) {
+            mode = MODE_VC_BENCH;
+            archive = argv[++a];
+            continue;
+        }
+        if (!strcmp(opt, "--book")) {
+            mode = MODE_BOOK;
+            book_path = argv[++a];
+            continue;
+        }
+        if (!strcmp(opt, "--server") || !strcmp(opt, "--server-load")) {
+            mode = opt[8] ? MODE_SERVER_LOAD : MODE_SERVER;
+            server.address = load.address = argv[++a];
+            continue;
+        }
+        if (!strcmp(opt, "--shard")) {
+            mode = MODE_SHARD;
+            archive = argv[++a];
+            continue;
+        }
+        if (!strcmp(opt, "--output")) {
+            selfplay.prefix = argv[++a];
+            continue;
+        }
+        if (!strcmp(opt, "--position")) {
+            position = argv[++a];
+            continue;
+        }
+        if (!strcmp(opt, "--a-exploration") ||
+            !strcmp(opt, "--b-exploration")) {
+            if (!parse_seconds(argv[++a],
+                               &arena.engines[opt[2] == 'b'].exploration)) {
+                usage(stderr);
+                return 2;
+            }
+            continue;
+        }
+        if (!strcmp(opt, "--seconds")) {
+            if (!parse_seconds(argv[++a], &seconds)) {
+                usage(stderr);
+                return 2;
+            }
+            continue;
+        }
+        /* the other options take a number */
+        if (!parse_size(argv[++a], &n)) {
+            usage(stderr);
+            return 2;
+        }
+        if (!strcmp(opt, "--percolation")) {
+            mode = MODE_PERCOLATION;
+            percolation.size = n;
+        } else if (!strcmp(opt, "--trials")) {
+            percolation.trials = n;
+        } else if (!strcmp(opt, "--threads") && n > 0) {
+            percolation.threads = (unsigned)n;
+        } else if (!strcmp(opt, "--seed")) {
+            percolation.seed = n;
+            arena.seed = n;
+            load.seed = n;
+            selfplay.seed = n;
+        } else if (!strcmp(opt, "--solve")) {
+            mode = MODE_SOLVE;
+            solve_size = n;
+        } else if (!strcmp(opt, "--tt")) {
+            solve.tt_megabytes = n;
+            htp.tt_megabytes = n;
+        } else if (!strcmp(opt, "--nodes")) {
+            solve.max_nodes = n;
+        } else if (!strcmp(opt, "--patterns")) {
+            solve.patterns = n != 0;
+        } else if (!strcmp(opt, "--board") && n > 0) {
+            /* the first --board replaces the default sizes */
+            if (!book_board)
+                book.size_count = 0;
+            book_board = true;
+            if (book.size_count == HEX_BOOK_MAX_SIZES) {
+                usage(stderr);
+                return 2;
+            }
+            book.sizes[book.size_count++] = n;
+        } else if (!strcmp(opt, "--depth") && n > 0) {
+            book.depth = (unsigned)n;
+        } else if (!strcmp(opt, "--playouts") && n > 0) {
+            book.playouts = n;
+            htp.max_playouts = n;
+            selfplay.engine.max_playouts = n;
+        } else if (!strcmp(opt, "--ponder")) {
+            htp.ponder = n != 0;
+        } else if (!strcmp(opt, "--arena") && n > 0) {
+            mode = MODE_ARENA;
+            arena.games = n;
+        } else if (!strcmp(opt, "--a-playouts") && n > 0) {
+            arena.engines[0].max_playouts = n;
+        } else if (!strcmp(opt, "--b-playouts") && n > 0) {
+            arena.engines[1].max_playouts = n;
+        } else if (!strcmp(opt, "--games") && n > 0) {
+            server.max_games = n;
+            load.games = n;
+        } else if (!strcmp(opt, "--connections") && n > 0) {
+            server.max_connections = n;
+            load.connections = (unsigned)n;
+        } else if (!strcmp(opt, "--selfplay") && n > 0) {
+            mode = MODE_SELFPLAY;
+            selfplay.games = n;
+        } else if (!strcmp(opt, "--shard-samples") && n > 0) {
+            selfplay.shard_samples = n;
+        } else if (!strcmp(opt, "--compress")) {
+            selfplay.compress = n != 0;
+        } else if (!strcmp(opt, "--uf-bench")) {
+            mode = MODE_UF_BENCH;
+            bench_size = n;
+        } else if (!strcmp(opt, "--eval-bench")) {
+            mode = MODE_EVAL_BENCH;
+            bench_size = n;
+        } else {
+            usage(stderr);
+            return 2;
+        }
+    }
+
+    switch (mode) {
+        case MODE_PERCOLATION:
+            return run_percolation(&percolation);
+        case MODE_REPLAY:
+            return run_replay(archive, percolation.threads);
+        case MODE_SOLVE:
+            solve.max_seconds = seconds;
+            return run_solve(solve_size, position, &solve);
+        case MODE_VC_BENCH:
+            return run_vc_bench(archive);
+        case MODE_UF_BENCH:
+            return run_uf_bench(bench_size, seconds > 0 ? seconds : 2.0);
+        case MODE_EVAL_BENCH:
+            return run_eval_bench(bench_size, seconds > 0 ? seconds : 2.0);
+        case MODE_BOOK:
+            book.threads = percolation.threads;
+            return run_book(book_path, &book);
+        case MODE_HTP:
+            htp.threads = percolation.threads;
+            if (seconds > 0)
+                htp.move_seconds = seconds;
+            return run_htp(&htp);
+        case MODE_ARENA:
+            arena.threads = percolation.threads;
+            /* --board replaces the sizes here as for the book */
+            if (book_board) {
+                memcpy(arena.sizes, book.sizes, sizeof(book.sizes));
+                arena.size_count = book.size_count;
+            }
+            return run_arena(&arena);
+        case MODE_SERVER:
+            /* the largest --board is the largest board served */
+            for (size_t k = 0; book_board && k < book.size_count; k++) {
+                if (k == 0 || book.sizes[k] > server.max_size)
+                    server.max_size = book.sizes[k];
+            }
+            return run_server(&server);
+        case MODE_SERVER_LOAD:
+            if (book_board)
+                load.size = book.sizes[0];
+            return run_server_load(&load);
+        case MODE_SELFPLAY:
+            selfplay.threads = percolation.threads;
+            if (book_board)
+                selfplay.size = book.sizes[0];
+            return run_selfplay(&selfplay);
+        case MODE_SHARD:
+            return run_shard(archive);
+        default:
+            usage(stderr);
+            return 2;
+    }
+}
@@ -0,0 +1,288 @@
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "hex-analysis.h"
+#include "hex-clock.h"
+
+void hex_analysis_default_config(struct hex_analysis_config *config) {
+    config->threads = 2;
+    config->batch = HEX_PLAYOUT_LANES;
+    config->max_playouts = 1 << 14;
+    config->publish_seconds = 0.1;
+    config->seed = 1;
+}
+
+/* Sums the counts of the workers on `epoch` into the back buffer and makes
+   it the front one. Only worker 0 publishes. */
+static void publish(struct hex_analysis *a, uint32_t epoch) {
+    const size_t cells = a->size * a->size;
+    const unsigned back =
+        1 - atomic_load_explicit(&a->front, memory_order_relaxed);
+    struct hex_analysis_buffer *b = &a->buffers[back];
+    const hex_grid *g = &a->workers[0].grid;
+    size_t fewest = SIZE_MAX;
+
+    atomic_fetch_add_explicit(&b->sequence, 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    for (size_t i = 0; i < cells; i++) {
+        uint64_t wins = 0, games = 0;
+        for (unsigned t = 0; t < a->running; t++) {
+            struct hex_analysis_worker *w = &a->workers[t];
+            if (atomic_load_explicit(&w->epoch, memory_order_acquire) !=
+                epoch)
+                continue;
+            wins += atomic_load_explicit(&w->wins[i], memory_order_relaxed);
+            games += atomic_load_explicit(&w->games[i], memory_order_relaxed);
+        }
+        atomic_store_explicit(
+            &b->win[i],
+            games ? (float)((double)wins / (double)games) : -1.0f,
+            memory_order_relaxed);
+        if (g->cells[i].color == NEUTRAL && games < fewest)
+            fewest = (size_t)games;
+    }
+    atomic_store_explicit(&b->epoch, epoch, memory_order_relaxed);
+    atomic_store_explicit(&b->playouts, fewest == SIZE_MAX ? 0 : fewest,
+                          memory_order_relaxed);
+    atomic_fetch_add_explicit(&b->sequence, 1, memory_order_release);
+    atomic_store_explicit(&a->front, back, memory_order_release);
+}
+
+/* Plays batches after every empty cell in turn until the position changes
+   or each cell has had its share of the playouts. */
+static void analyse(struct hex_analysis_worker *w,
+                    uint32_t epoch,
+                    cell_color to_move) {
+    struct hex_analysis *a = w->a;
+    const size_t cells = a->size * a->size;
+    const size_t batch = a->config.batch;
+    const size_t share = a->config.max_playouts / a->running + batch - 1;
+    /* the workers start on different cells, so the first publications
+       already cover most of the board */
+    const size_t start = cells * w->index / a->running;
+    double published = hex_clock_now();
+
+    for (size_t i = 0; i < cells; i++) {
+        atomic_store_explicit(&w->wins[i], 0, memory_order_relaxed);
+        atomic_store_explicit(&w->games[i], 0, memory_order_relaxed);
+    }
+    atomic_store_explicit(&w->epoch, epoch, memory_order_release);
+    if (hex_grid_get_winner(&w->grid) != NEUTRAL) {
+        if (w->index == 0)
+            publish(a, epoch);
+        return;
+    }
+    for (size_t played = 0; played + batch <= share; played += batch) {
+        for (size_t k = 0; k < cells; k++) {
+            const size_t i = (start + k) % cells;
+            if (w->grid.cells[i].color != NEUTRAL)
+                continue;
+            if (atomic_load_explicit(&a->current, memory_order_relaxed) !=
+                epoch)
+                return;
+            hex_grid_open_cell(&w->grid, i, to_move);
+            hex_playout_set_position(&w->playout, &w->grid, 3 - to_move);
+            const size_t red = hex_playout_run(&w->playout, batch, &w->rng);
+            hex_grid_undo(&w->grid);
+            atomic_fetch_add_explicit(&w->wins[i],
+                                      to_move == RED ? red : batch - red,
+                                      memory_order_relaxed);
+            atomic_fetch_add_explicit(&w->games[i], batch,
+                                      memory_order_relaxed);
+            if (w->index == 0 &&
+                hex_clock_now() - published >= a->config.publish_seconds) {
+                publish(a, epoch);
+                published = hex_clock_now();
+            }
+        }
+        if (w->index == 0) {
+            publish(a, epoch);
+            published = hex_clock_now();
+        }
+    }
+    atomic_store_explicit(&w->finished, epoch, memory_order_release);
+    if (w->index != 0)
+        return;
+    /* the last totals are published once the others are done too */
+    for (unsigned t = 1; t < a->running; t++) {
+        while (atomic_load_explicit(&a->workers[t].finished,
+                                    memory_order_acquire) != epoch) {
+            if (atomic_load_explicit(&a->current, memory_order_relaxed) !=
+                epoch)
+                return;
+            nanosleep(&(struct timespec){0, 1000000}, NULL);
+            if (hex_clock_now() - published >= a->config.publish_seconds) {
+                publish(a, epoch);
+                published = hex_clock_now();
+            }
+        }
+    }
+    publish(a, epoch);
+}
+
+static void *analysis_run(void *arg) {
+    struct hex_analysis_worker *w = arg;
+    struct hex_analysis *a = w->a;
+    const size_t cells = a->size * a->size;
+    uint32_t epoch = 0;
+
+    for (;;) {
+        pthread_mutex_lock(&a->lock);
+        while (!a->quit && (a->epoch == 0 || a->epoch == epoch))
+            pthread_cond_wait(&a->wake, &a->lock);
+        if (a->quit) {
+            pthread_mutex_unlock(&a->lock);
+            return NULL;
+        }
+        epoch = a->epoch;
+        const cell_color to_move = a->to_move;
+        hex_grid_clear(&w->grid);
+        for (size_t i = 0; i < cells; i++) {
+            if (a->position[i] != NEUTRAL)
+                hex_grid_open_cell(&w->grid, i, a->position[i]);
+        }
+        pthread_mutex_unlock(&a->lock);
+        analyse(w, epoch, to_move);
+    }
+}
+
+int hex_analysis_init(struct hex_analysis *a,
+                      const struct hex_analysis_config *config,
+                      size_t size) {
+    const size_t cells = size * size;
+    const unsigned n = config->threads ? config->threads : 1;
+    struct hex_rng rng;
+
+    memset(a, 0, sizeof(*a));
+    a->config = *config;
+    a->config.threads = n;
+    if (a->config.batch < HEX_PLAYOUT_LANES)
+        a->config.batch = HEX_PLAYOUT_LANES;
+    a->config.batch -= a->config.batch % HEX_PLAYOUT_LANES;
+    a->size = size;
+    a->to_move = RED;
+    if (pthread_mutex_init(&a->lock, NULL) != 0)
+        return 0;
+    if (pthread_cond_init(&a->wake, NULL) != 0) {
+        pthread_mutex_destroy(&a->lock);
+        return 0;
+    }
+    a->position = calloc(cells, sizeof(cell_color));
+    a->workers = calloc(n, sizeof(struct hex_analysis_worker));
+    a->threads = calloc(n, sizeof(pthread_t));
+    a->buffers[0].win = calloc(cells, sizeof(*a->buffers[0].win));
+    a->buffers[1].win = calloc(cells, sizeof(*a->buffers[1].win));
+    int ok = a->position && a->workers && a->threads && a->buffers[0].win &&
+             a->buffers[1].win;
+
+    hex_rng_seed(&rng, config->seed);
+    for (unsigned t = 0; ok && t < n; t++) {
+        struct hex_analysis_worker *w = &a->workers[t];
+        w->a = a;
+        w->index = t;
+        hex_rng_seed(&w->rng, hex_rng_next(&rng));
+        w->wins = calloc(cells, sizeof(*w->wins));
+        w->games = calloc(cells, sizeof(*w->games));
+        ok = w->wins && w->games &&
+             hex_grid_init(&w->grid, size, HEX_GRID_UNDOABLE_UNION_FIND);
+        if (ok && !hex_playout_init(&w->playout, size)) {
+            hex_grid_destroy(&w->grid);
+            memset(&w->grid, 0, sizeof(w->grid));
+            ok = 0;
+        }
+    }
+    /* no worker reads `running` before there is a position */
+    a->running = ok ? n : 0;
+    unsigned started = 0;
+    while (started < a->running &&
+           pthread_create(&a->threads[started], NULL, analysis_run,
+                          &a->workers[started]) == 0)
+        started++;
+    a->running = started;
+    if (!ok || started == 0) {
+        hex_analysis_destroy(a);
+        return 0;
+    }
+    return 1;
+}
+
+void hex_analysis_destroy(struct hex_analysis *a) {
+    pthread_mutex_lock(&a->lock);
+    a->quit = true;
+    atomic_store(&a->current, 0);
+    pthread_cond_broadcast(&a->wake);
+    pthread_mutex_unlock(&a->lock);
+    for (unsigned t = 0; t < a->running; t++)
+        pthread_join(a->threads[t], NULL);
+
+    for (unsigned t = 0; a->workers && t < a->config.threads; t++) {
+        struct hex_analysis_worker *w = &a->workers[t];
+        if (w->grid.cells) {
+            hex_grid_destroy(&w->grid);
+            hex_playout_destroy(&w->playout);
+        }
+        free(w->wins);
+        free(w->games);
+    }
+    free(a->workers);
+    free(a->threads);
+    free(a->position);
+    free(a->buffers[0].win);
+    free(a->buffers[1].win);
+    pthread_cond_destroy(&a->wake);
+    pthread_mutex_destroy(&a->lock);
+    memset(a, 0, sizeof(*a));
+}
+
+uint32_t hex_analysis_set_position(struct hex_analysis *a,
+                                   const hex_grid *g,
+                                   cell_color to_move) {
+    const size_t cells = a->size * a->size;
+    pthread_mutex_lock(&a->lock);
+    for (size_t i = 0; i < cells; i++)
+        a->position[i] = g->cells[i].color;
+    a->to_move = to_move;
+    /* 0 means no position */
+    if (++a->epoch == 0)
+        a->epoch = 1;
+    const uint32_t epoch = a->epoch;
+    atomic_store_explicit(&a->current, epoch, memory_order_relaxed);
+    pthread_cond_broadcast(&a->wake);
+    pthread_mutex_unlock(&a->lock);
+    return epoch;
+}
+
+void hex_analysis_stop(struct hex_analysis *a) {
+    atomic_store_explicit(&a->current, 0, memory_order_relaxed);
+}
+
+uint32_t hex_analysis_read(struct hex_analysis *a,
+                           float *win,
+                           size_t *playouts) {
+    const size_t cells = a->size * a->size;
+    /* a second try, in case a publication came in between */
+    for (unsigned attempt = 0; attempt < 2; attempt++) {
+        const unsigned f =
+            atomic_load_explicit(&a->front, memory_order_acquire);
+        struct hex_analysis_buffer *b = &a->buffers[f];
+        const uint32_t sequence =
+            atomic_load_explicit(&b->sequence, memory_order_acquire);
+        if (sequence & 1)
+            continue;
+        for (size_t i = 0; i < cells; i++)
+            win[i] = atomic_load_explicit(&b->win[i], memory_order_relaxed);
+        const uint32_t epoch =
+            atomic_load_explicit(&b->epoch, memory_order_relaxed);
+        const size_t n =
+            atomic_load_explicit(&b->playouts, memory_order_relaxed);
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(&b->sequence, memory_order_relaxed) !=
+            sequence)
+            continue;
+        if (playouts)
+            *playouts = n;
+        return epoch;
+    }
+    return 0;
+}
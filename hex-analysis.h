@@ -0,0 +1,97 @@
+#if !defined(HEX_ANALYSIS_H)
+#define HEX_ANALYSIS_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "hex-grid.h"
+#include "hex-playout.h"
+#include "hex-random.h"
+
+/* Background estimates of how good each empty cell is for the side to
+   move: the share of random playouts it wins after playing there. Worker
+   threads keep refining them from their own copy of the position, and the
+   first of them publishes the totals through a double buffer, so readers
+   never wait for a worker and workers never wait for a reader. A new
+   position takes effect after the batch of playouts each worker is on. */
+
+struct hex_analysis_config {
+    unsigned threads;
+    size_t batch;        // playouts per cell at a time, a HEX_PLAYOUT_LANES
+                         // multiple
+    size_t max_playouts; // per cell, after which the workers rest
+    double publish_seconds; // between publications in the middle of a sweep
+    uint64_t seed;
+};
+
+/* One side of the double buffer: the seqlock count is odd while it is
+   being written. The fields are relaxed atomics only so that a read racing
+   a write is defined; the count tells the reader to discard it. */
+struct hex_analysis_buffer {
+    _Atomic uint32_t sequence;
+    _Atomic uint32_t epoch;
+    _Atomic size_t playouts; // the fewest played after any empty cell
+    _Atomic float *win; // per cell, -1 for stones and cells not played yet
+};
+
+struct hex_analysis_worker {
+    struct hex_analysis *a;
+    unsigned index;
+    hex_grid grid;
+    struct hex_playout playout;
+    struct hex_rng rng;
+    _Atomic uint32_t epoch;    // the position the counts below are for
+    _Atomic uint32_t finished; // the last position it played out its share
+    _Atomic uint64_t *wins;
+    _Atomic uint64_t *games;
+};
+
+struct hex_analysis {
+    struct hex_analysis_config config;
+    size_t size;
+    pthread_mutex_t lock; // guards the pending position and wakes workers
+    pthread_cond_t wake;
+    cell_color *position;
+    cell_color to_move;
+    uint32_t epoch;   // of the pending position, 0 for none
+    bool quit;
+    _Atomic uint32_t current; // the epoch workers give up on when it changes
+    struct hex_analysis_worker *workers;
+    pthread_t *threads;
+    unsigned running;
+    struct hex_analysis_buffer buffers[2];
+    _Atomic unsigned front;
+};
+
+void hex_analysis_default_config(struct hex_analysis_config *config);
+
+/* Starts the workers, idle until there is a position. Returns 0 on
+   failure. */
+int hex_analysis_init(struct hex_analysis *a,
+                      const struct hex_analysis_config *config,
+                      size_t size);
+
+void hex_analysis_destroy(struct hex_analysis *a);
+
+/* Analyses g, of the size given to hex_analysis_init(), with `to_move` to
+   play from now on, dropping what was found for the last position. Returns
+   the epoch the results for it will carry. */
+uint32_t hex_analysis_set_position(struct hex_analysis *a,
+                                   const hex_grid *g,
+                                   cell_color to_move);
+
+/* Idles the workers. */
+void hex_analysis_stop(struct hex_analysis *a);
+
+/* Copies the latest published win rates into `win` (size * size floats)
+   and the fewest playouts behind them into `playouts`, which may be NULL.
+   Returns their epoch, or 0 if nothing was published yet or the copy was
+   overtaken by a publication. Never blocks. */
+uint32_t hex_analysis_read(struct hex_analysis *a,
+                           float *win,
+                           size_t *playouts);
+
+#endif /* HEX_ANALYSIS_H */
@@ -0,0 +1,285 @@
+#include <math.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hex-arena.h"
+#include "hex-clock.h"
+#include "hex-random.h"
+
+/* Search times of one engine, in milliseconds. */
+struct times {
+    float *ms;
+    size_t count;
+    size_t capacity;
+};
+
+struct arena_worker {
+    const struct hex_arena_config *config;
+    _Atomic size_t *next_game;
+    size_t per_size;
+    size_t total;
+    uint8_t *a_won; // one slot per game, shared
+    uint8_t *red_won;
+    size_t size; // of the board and the searches, 0 before the first game
+    hex_grid grid;
+    struct hex_mcts engines[2];
+    struct times times[2];
+    size_t moves;
+    int ok;
+};
+
+static cell_color other(cell_color player) {
+    return 1 + (player % 2);
+}
+
+void hex_arena_default_config(struct hex_arena_config *config) {
+    memset(config, 0, sizeof(*config));
+    config->sizes[0] = 7;
+    config->sizes[1] = 9;
+    config->size_count = 2;
+    config->games = 100;
+    config->threads = 1;
+    config->seed = 0x68657861726e61;
+    for (unsigned e = 0; e < 2; e++) {
+        hex_mcts_default_config(&config->engines[e]);
+        config->engines[e].max_seconds = 0;
+        config->engines[e].max_playouts = 2000;
+    }
+}
+
+static void release(struct arena_worker *w) {
+    if (!w->size)
+        return;
+    hex_mcts_destroy(&w->engines[0]);
+    hex_mcts_destroy(&w->engines[1]);
+    hex_grid_destroy(&w->grid);
+    w->size = 0;
+}
+
+/* Sets the board and both searches up for `size`. */
+static int setup(struct arena_worker *w, size_t size) {
+    release(w);
+    if (!hex_grid_init(&w->grid, size, HEX_GRID_UNION_FIND))
+        return 0;
+    for (unsigned e = 0; e < 2; e++) {
+        struct hex_mcts_config config = w->config->engines[e];
+        config.threads = 1;
+        config.tt = NULL;
+        hex_mcts_fit_nodes(&config, size);
+        if (!hex_mcts_init(&w->engines[e], &config, size)) {
+            if (e)
+                hex_mcts_destroy(&w->engines[0]);
+            hex_grid_destroy(&w->grid);
+            return 0;
+        }
+    }
+    w->size = size;
+    return 1;
+}
+
+static int times_push(struct times *t, double ms) {
+    if (t->count == t->capacity) {
+        size_t capacity = t->capacity ? t->capacity * 2 : 4096;
+        float *ms2 = realloc(t->ms, capacity * sizeof(float));
+        if (!ms2)
+            return 0;
+        t->ms = ms2;
+        t->capacity = capacity;
+    }
+    t->ms[t->count++] = (float)ms;
+    return 1;
+}
+
+/* Plays game g: games 2k and 2k + 1 share their opening, with the engines
+   on opposite sides. */
+static int play_game(struct arena_worker *w, size_t g) {
+    const struct hex_arena_config *config = w->config;
+    const size_t size = config->sizes[g / w->per_size];
+    const size_t cells = size * size;
+    const bool a_red = g % 2 == 0;
+    if (w->size != size && !setup(w, size))
+        return 0;
+
+    struct hex_rng rng;
+    hex_rng_seed(&rng, config->seed ^ (g / 2 + 1) * 0x9e3779b97f4a7c15);
+    size_t first = hex_rng_below(&rng, (uint32_t)cells);
+    size_t reply = hex_rng_below(&rng, (uint32_t)cells - 1);
+    if (reply >= first)
+        reply++;
+    hex_grid_clear(&w->grid);
+    hex_grid_open_cell(&w->grid, first, RED);
+    hex_grid_open_cell(&w->grid, reply, BLUE);
+    for (unsigned e = 0; e < 2; e++)
+        hex_rng_seed(&w->engines[e].rng, hex_rng_next(&rng));
+
+    cell_color player = RED, winner;
+    while ((winner = hex_grid_get_winner(&w->grid)) == NEUTRAL) {
+        const unsigned e = (player == RED) != a_red;
+        const double start = hex_clock_now();
+        hex_mcts_set_position(&w->engines[e], &w->grid, player);
+        size_t i = hex_mcts_search(&w->engines[e], NULL);
+        if (!times_push(&w->times[e], (hex_clock_now() - start) * 1e3) ||
+            i == (size_t)-1 || !hex_grid_open_cell(&w->grid, i, player))
+            return 0;
+        w->moves++;
+        player = other(player);
+    }
+    w->a_won[g] = (winner == RED) == a_red;
+    w->red_won[g] = winner == RED;
+    return 1;
+}
+
+static void *arena_run(void *arg) {
+    struct arena_worker *w = arg;
+    while (w->ok) {
+        size_t g = atomic_fetch_add_explicit(w->next_game, 1,
+                                             memory_order_relaxed);
+        if (g >= w->total)
+            break;
+        w->ok = play_game(w, g);
+    }
+    return NULL;
+}
+
+static int compare_ms(const void *a, const void *b) {
+    const float x = *(const float *)a, y = *(const float *)b;
+    return (x > y) - (x < y);
+}
+
+/* The 50th, 90th and 99th percentile of the times of engine e. */
+static int percentiles(struct arena_worker *workers,
+                       unsigned n,
+                       unsigned e,
+                       double out[3]) {
+    static const double ranks[3] = {0.5, 0.9, 0.99};
+    size_t count = 0;
+    for (unsigned t = 0; t < n; t++)
+        count += workers[t].times[e].count;
+    memset(out, 0, 3 * sizeof(double));
+    if (!count)
+        return 1;
+    float *all = malloc(count * sizeof(float));
+    if (!all)
+        return 0;
+    count = 0;
+    for (unsigned t = 0; t < n; t++) {
+        memcpy(all + count, workers[t].times[e].ms,
+               workers[t].times[e].count * sizeof(float));
+        count += workers[t].times[e].count;
+    }
+    qsort(all, count, sizeof(float), compare_ms);
+    for (unsigned r = 0; r < 3; r++)
+        out[r] = all[(size_t)(ranks[r] * (double)(count - 1))];
+    free(all);
+    return 1;
+}
+
+/* Elo difference for an expected score, kept finite by keeping the score
+   half a game away from a whitewash. */
+static double elo(double score, size_t games) {
+    const double margin = 0.5 / (double)games;
+    if (score < margin)
+        score = margin;
+    if (score > 1 - margin)
+        score = 1 - margin;
+    return 400.0 * log10(score / (1 - score));
+}
+
+int hex_arena_run(const struct hex_arena_config *config,
+                  struct hex_arena_stats *stats) {
+    const unsigned n = config->threads ? config->threads : 1;
+    const size_t per_size = (config->games + 1) / 2 * 2;
+    const size_t total = per_size * config->size_count;
+    const double start = hex_clock_now();
+    int ok = per_size > 0 && config->size_count > 0 &&
+             config->size_count <= HEX_ARENA_MAX_SIZES;
+
+    memset(stats, 0, sizeof(*stats));
+    for (size_t k = 0; ok && k < config->size_count; k++) {
+        const size_t size = config->sizes[k];
+        ok = size >= 2 && size <= HEX_ARENA_MAX_BOARD;
+    }
+    if (!ok)
+        return 0;
+    uint8_t *a_won = calloc(total, 1), *red_won = calloc(total, 1);
+    struct arena_worker *workers = calloc(n, sizeof(struct arena_worker));
+    pthread_t *threads = calloc(n, sizeof(pthread_t));
+    _Atomic size_t next_game = 0;
+    ok = a_won && red_won && workers && threads;
+
+    if (ok) {
+        for (unsigned t = 0; t < n; t++) {
+            workers[t].config = config;
+            workers[t].next_game = &next_game;
+            workers[t].per_size = per_size;
+            workers[t].total = total;
+            workers[t].a_won = a_won;
+            workers[t].red_won = red_won;
+            workers[t].ok = 1;
+        }
+        /* games go to whichever worker asks next, as in the replay */
+        unsigned running = 1;
+        while (running < n && pthread_create(&threads[running], NULL,
+                                              arena_run,
+                                              &workers[running]) == 0)
+            running++;
+        arena_run(&workers[0]);
+        for (unsigned t = 1; t < running; t++)
+            pthread_join(threads[t], NULL);
+        for (unsigned t = 0; t < running; t++) {
+            ok = ok && workers[t].ok;
+            stats->moves += workers[t].moves;
+        }
+    }
+
+    if (ok) {
+        double sum = 0, squares = 0;
+        for (size_t g = 0; g < total; g++) {
+            stats->wins[!a_won[g]]++;
+            stats->red_wins += red_won[g];
+            stats->size_games[g / per_size]++;
+            stats->size_wins[g / per_size] += a_won[g];
+        }
+        /* the pairs are the independent samples: each scores 0, 1/2 or 1 */
+        for (size_t p = 0; p < total / 2; p++) {
+            const double s = (a_won[2 * p] + a_won[2 * p + 1]) / 2.0;
+            sum += s;
+            squares += s * s;
+        }
+        const double pairs = (double)(total / 2);
+        const double mean = sum / pairs;
+        double variance = pairs > 1 ? (squares - sum * mean) / (pairs - 1) : 0;
+        /* all pairs alike says little about the next one: fall back on
+           two independent games at the (clamped) score */
+        if (variance <= 0) {
+            const double margin = 0.5 / (double)total;
+            const double s = mean < margin       ? margin
+                             : mean > 1 - margin ? 1 - margin
+                                                 : mean;
+            variance = s * (1 - s) / 2;
+        }
+        const double error = 1.96 * sqrt(variance / pairs);
+        stats->games = total;
+        stats->elo = elo(mean, total);
+        stats->elo_low = elo(mean - error, total);
+        stats->elo_high = elo(mean + error, total);
+        for (unsigned e = 0; e < 2 && ok; e++)
+            ok = percentiles(workers, n, e, stats->move_ms[e]);
+    }
+
+    for (unsigned t = 0; workers && t < n; t++) {
+        release(&workers[t]);
+        free(workers[t].times[0].ms);
+        free(workers[t].times[1].ms);
+    }
+    free(workers);
+    free(threads);
+    free(a_won);
+    free(red_won);
+    stats->seconds = hex_clock_now() - start;
+    stats->games_per_second =
+        stats->seconds > 0 ? (double)stats->games / stats->seconds : 0;
+    return ok;
+}
@@ -0,0 +1,54 @@
+#if !defined(HEX_ARENA_H)
+#define HEX_ARENA_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "hex-mcts.h"
+
+/* Matches between two engine configurations, A and B, to tell whether a
+   change made the engine stronger. Games are played in pairs from the same
+   random two-stone opening, A taking red in one and blue in the other, so
+   the first-move advantage and the openings cancel out. The games are
+   shared out between threads, each with its own board and pair of
+   single-threaded searches, set up once per board size. */
+
+#define HEX_ARENA_MAX_SIZES 8
+#define HEX_ARENA_MAX_BOARD 100 // as far as the game lets the computer play
+
+struct hex_arena_config {
+    size_t sizes[HEX_ARENA_MAX_SIZES];
+    size_t size_count;
+    size_t games; // per board size, rounded up to a whole pair
+    unsigned threads;
+    uint64_t seed;
+    /* threads and tt are ignored: each engine searches on one thread */
+    struct hex_mcts_config engines[2];
+};
+
+struct hex_arena_stats {
+    size_t games;
+    size_t wins[2]; // by engine
+    size_t red_wins;
+    size_t size_games[HEX_ARENA_MAX_SIZES];
+    size_t size_wins[HEX_ARENA_MAX_SIZES]; // of engine A
+    size_t moves;
+    double seconds;
+    double games_per_second;
+    /* Elo of A over B, with a 95% interval from the spread of the pairs */
+    double elo;
+    double elo_low;
+    double elo_high;
+    double move_ms[2][3]; // 50th, 90th and 99th percentile, by engine
+};
+
+/* 100 games of 2000-playout searches a side on 7x7 and 9x9. */
+void hex_arena_default_config(struct hex_arena_config *config);
+
+/* Returns 0 on bad sizes or if memory runs out. The results only depend on
+   the seed, not on the number of threads, unless the engines have a time
+   limit. */
+int hex_arena_run(const struct hex_arena_config *config,
+                  struct hex_arena_stats *stats);
+
+#endif /* HEX_ARENA_H */
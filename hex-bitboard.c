@@ -0,0 +1,199 @@
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#include "hex-bitboard.h"
+
+#define REGIONS 8
+
+static uint64_t *region(struct hex_bitboard *bb, size_t k) {
+    return bb->storage + k * (bb->words + 2 * bb->pad) + bb->pad;
+}
+
+static void set_bit(uint64_t *plane, size_t bit) {
+    plane[bit / 64] |= (uint64_t)1 << (bit % 64);
+}
+
+int hex_bitboard_init(struct hex_bitboard *bb, size_t size) {
+    bb->size = size;
+    bb->stride = size + 1;
+    bb->words = ((size * bb->stride + 63) / 64 + 3) & ~(size_t)3;
+    bb->pad = bb->stride / 64 + 2;
+    bb->storage =
+        calloc(REGIONS * (bb->words + 2 * bb->pad), sizeof(uint64_t));
+    if (!bb->storage)
+        return 0;
+
+    bb->planes[HEX_BITBOARD_RED] = region(bb, 0);
+    bb->planes[HEX_BITBOARD_BLUE] = region(bb, 1);
+    for (size_t e = 0; e < 4; e++)
+        bb->edges[e] = region(bb, 2 + e);
+    bb->scratch[0] = region(bb, 6);
+    bb->scratch[1] = region(bb, 7);
+
+    for (size_t j = 0; j < size; j++) {
+        set_bit(bb->edges[HEX_BITBOARD_TOP], j);
+        set_bit(bb->edges[HEX_BITBOARD_BOTTOM], (size - 1) * bb->stride + j);
+        set_bit(bb->edges[HEX_BITBOARD_LEFT], j * bb->stride);
+        set_bit(bb->edges[HEX_BITBOARD_RIGHT], j * bb->stride + size - 1);
+    }
+    return 1;
+}
+
+void hex_bitboard_destroy(struct hex_bitboard *bb) {
+    free(bb->storage);
+    memset(bb, 0, sizeof(*bb));
+}
+
+void hex_bitboard_clear(struct hex_bitboard *bb) {
+    memset(bb->planes[HEX_BITBOARD_RED], 0, bb->words * sizeof(uint64_t));
+    memset(bb->planes[HEX_BITBOARD_BLUE], 0, bb->words * sizeof(uint64_t));
+}
+
+void hex_bitboard_set(struct hex_bitboard *bb,
+                      enum hex_bitboard_plane plane,
+                      size_t i) {
+    set_bit(bb->planes[plane], HEX_BITBOARD_BIT(bb, i));
+}
+
+void hex_bitboard_unset(struct hex_bitboard *bb,
+                        enum hex_bitboard_plane plane,
+                        size_t i) {
+    size_t bit = HEX_BITBOARD_BIT(bb, i);
+    bb->planes[plane][bit / 64] &= ~((uint64_t)1 << (bit % 64));
+}
+
+/* One flood fill step: out = mask & (x | the six neighbour shifts of x).
+   A shift by k bits is split into a word offset q and a bit offset r so that
+   boards wider than 63 cells work too. Returns whether anything changed. */
+static bool flood_step(const struct hex_bitboard *bb,
+                       const uint64_t *x,
+                       const uint64_t *mask,
+                       uint64_t *out) {
+    const size_t k[3] = {1, bb->stride - 1, bb->stride};
+    size_t q[3];
+    unsigned r[3];
+    for (size_t s = 0; s < 3; s++) {
+        q[s] = k[s] / 64;
+        r[s] = k[s] % 64;
+    }
+    size_t w = 0;
+    bool changed = false;
+
+#if defined(__AVX2__)
+    __m256i diff = _mm256_setzero_si256();
+    for (; w < bb->words; w += 4) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(x + w));
+        __m256i acc = v;
+        for (size_t s = 0; s < 3; s++) {
+            __m128i cr = _mm_cvtsi32_si128((int)r[s]);
+            __m128i cl = _mm_cvtsi32_si128(64 - (int)r[s]);
+            const uint64_t *lo = x - q[s] + w;
+            const uint64_t *hi = x + q[s] + w;
+            acc = _mm256_or_si256(
+                acc, _mm256_sll_epi64(
+                         _mm256_loadu_si256((const __m256i *)lo), cr));
+            acc = _mm256_or_si256(
+                acc, _mm256_srl_epi64(
+                         _mm256_loadu_si256((const __m256i *)(lo - 1)), cl));
+            acc = _mm256_or_si256(
+                acc, _mm256_srl_epi64(
+                         _mm256_loadu_si256((const __m256i *)hi), cr));
+            acc = _mm256_or_si256(
+                acc, _mm256_sll_epi64(
+                         _mm256_loadu_si256((const __m256i *)(hi + 1)), cl));
+        }
+        acc = _mm256_and_si256(
+            acc, _mm256_loadu_si256((const __m256i *)(mask + w)));
+        diff = _mm256_or_si256(diff, _mm256_xor_si256(acc, v));
+        _mm256_storeu_si256((__m256i *)(out + w), acc);
+    }
+    changed = !_mm256_testz_si256(diff, diff);
+#elif defined(__SSE2__)
+    __m128i diff = _mm_setzero_si128();
+    for (; w < bb->words; w += 2) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(x + w));
+        __m128i acc = v;
+        for (size_t s = 0; s < 3; s++) {
+            __m128i cr = _mm_cvtsi32_si128((int)r[s]);
+            __m128i cl = _mm_cvtsi32_si128(64 - (int)r[s]);
+            const uint64_t *lo = x - q[s] + w;
+            const uint64_t *hi = x + q[s] + w;
+            acc = _mm_or_si128(
+                acc, _mm_sll_epi64(_mm_loadu_si128((const __m128i *)lo), cr));
+            acc = _mm_or_si128(
+                acc,
+                _mm_srl_epi64(_mm_loadu_si128((const __m128i *)(lo - 1)), cl));
+            acc = _mm_or_si128(
+                acc, _mm_srl_epi64(_mm_loadu_si128((const __m128i *)hi), cr));
+            acc = _mm_or_si128(
+                acc,
+                _mm_sll_epi64(_mm_loadu_si128((const __m128i *)(hi + 1)), cl));
+        }
+        acc = _mm_and_si128(acc, _mm_loadu_si128((const __m128i *)(mask + w)));
+        diff = _mm_or_si128(diff, _mm_xor_si128(acc, v));
+        _mm_storeu_si128((__m128i *)(out + w), acc);
+    }
+    changed = _mm_movemask_epi8(_mm_cmpeq_epi8(diff, _mm_setzero_si128())) !=
+              0xffff;
+#else
+    for (; w < bb->words; w++) {
+        uint64_t acc = x[w];
+        for (size_t s = 0; s < 3; s++) {
+            const uint64_t *lo = x - q[s] + w;
+            const uint64_t *hi = x + q[s] + w;
+            acc |= lo[0] << r[s];
+            acc |= hi[0] >> r[s];
+            if (r[s]) {
+                acc |= lo[-1] >> (64 - r[s]);
+                acc |= hi[1] << (64 - r[s]);
+            }
+        }
+        acc &= mask[w];
+        changed |= acc != x[w];
+        out[w] = acc;
+    }
+#endif
+    return changed;
+}
+
+static bool intersects(const uint64_t *a, const uint64_t *b, size_t words) {
+    uint64_t any = 0;
+    for (size_t w = 0; w < words; w++)
+        any |= a[w] & b[w];
+    return any != 0;
+}
+
+bool hex_bitboard_connects(struct hex_bitboard *bb,
+                           const uint64_t *stones,
+                           enum hex_bitboard_edge from,
+                           enum hex_bitboard_edge to) {
+    uint64_t *reach = bb->scratch[0];
+    uint64_t *next = bb->scratch[1];
+    const uint64_t *start = bb->edges[from];
+    const uint64_t *goal = bb->edges[to];
+
+    for (size_t w = 0; w < bb->words; w++)
+        reach[w] = stones[w] & start[w];
+
+    while (!intersects(reach, goal, bb->words)) {
+        if (!flood_step(bb, reach, stones, next))
+            return false;
+        uint64_t *tmp = reach;
+        reach = next;
+        next = tmp;
+    }
+    return true;
+}
+
+bool hex_bitboard_is_connected(struct hex_bitboard *bb,
+                               enum hex_bitboard_plane plane) {
+    if (plane == HEX_BITBOARD_RED)
+        return hex_bitboard_connects(bb, bb->planes[plane], HEX_BITBOARD_TOP,
+                                     HEX_BITBOARD_BOTTOM);
+    return hex_bitboard_connects(bb, bb->planes[plane], HEX_BITBOARD_LEFT,
+                                 HEX_BITBOARD_RIGHT);
+}
@@ -0,0 +1,60 @@
+#if !defined(HEX_BITBOARD_H)
+#define HEX_BITBOARD_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Packed stone sets, one bit per cell. Rows are stored with one extra zero
+   guard column so that the six hex neighbours of bit p are always
+   p +- 1, p +- stride and p +- (stride - 1), without any per-column masks. */
+
+enum hex_bitboard_plane { HEX_BITBOARD_RED = 0, HEX_BITBOARD_BLUE = 1 };
+
+enum hex_bitboard_edge {
+    HEX_BITBOARD_TOP = 0,
+    HEX_BITBOARD_BOTTOM,
+    HEX_BITBOARD_LEFT,
+    HEX_BITBOARD_RIGHT
+};
+
+struct hex_bitboard {
+    uint64_t *planes[2];  // stones of each player
+    uint64_t *edges[4];   // cells touching each board edge
+    uint64_t *scratch[2]; // flood fill buffers
+    uint64_t *storage;
+    size_t size;
+    size_t stride; // bits per row, size + 1 guard bit
+    size_t words;  // words per plane, a multiple of 4
+    size_t pad;    // zero words before and after every plane
+};
+
+#define HEX_BITBOARD_BIT(bb, i) \
+    (((i) / (bb)->size) * (bb)->stride + (i) % (bb)->size)
+
+int hex_bitboard_init(struct hex_bitboard *bb, size_t size);
+
+void hex_bitboard_destroy(struct hex_bitboard *bb);
+
+void hex_bitboard_clear(struct hex_bitboard *bb);
+
+void hex_bitboard_set(struct hex_bitboard *bb,
+                      enum hex_bitboard_plane plane,
+                      size_t i);
+
+void hex_bitboard_unset(struct hex_bitboard *bb,
+                        enum hex_bitboard_plane plane,
+                        size_t i);
+
+/* Flood fills the stones in `stones` (a plane laid out like `bb`, including
+   the zero padding) from edge `from` and reports whether edge `to` is
+   reached. */
+bool hex_bitboard_connects(struct hex_bitboard *bb,
+                           const uint64_t *stones,
+                           enum hex_bitboard_edge from,
+                           enum hex_bitboard_edge to);
+
+bool hex_bitboard_is_connected(struct hex_bitboard *bb,
+                               enum hex_bitboard_plane plane);
+
+#endif /* HEX_BITBOARD_H */
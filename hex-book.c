@@ -0,0 +1,389 @@
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "hex-book.h"
+#include "hex-clock.h"
+#include "hex-mcts.h"
+#include "hex-random.h"
+
+#define HEADER 16
+#define ENTRY 16
+
+static const char book_magic[8] = "CHEXBOK";
+
+static void put_le(uint8_t *p, uint64_t v, unsigned bytes) {
+    for (unsigned b = 0; b < bytes; b++)
+        p[b] = (uint8_t)(v >> (8 * b));
+}
+
+static uint64_t get_le(const uint8_t *p, unsigned bytes) {
+    uint64_t v = 0;
+    for (unsigned b = 0; b < bytes; b++)
+        v |= (uint64_t)p[b] << (8 * b);
+    return v;
+}
+
+int hex_book_open(struct hex_book *b, const char *path) {
+    memset(b, 0, sizeof(*b));
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return 0;
+    struct stat st;
+    if (fstat(fd, &st) < 0 || (uint64_t)st.st_size < HEADER) {
+        close(fd);
+        return 0;
+    }
+    b->length = (size_t)st.st_size;
+    void *data = mmap(NULL, b->length, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+        return 0;
+    b->data = data;
+    b->count = (size_t)get_le(b->data + 12, 4);
+    if (memcmp(b->data, book_magic, 8) != 0 ||
+        get_le(b->data + 8, 4) != HEX_BOOK_VERSION ||
+        b->length != HEADER + (uint64_t)b->count * ENTRY) {
+        hex_book_close(b);
+        return 0;
+    }
+    return 1;
+}
+
+void hex_book_close(struct hex_book *b) {
+    if (b->data)
+        munmap((void *)b->data, b->length);
+    memset(b, 0, sizeof(*b));
+}
+
+int hex_book_lookup(const struct hex_book *b,
+                    const hex_grid *g,
+                    cell_color to_move,
+                    size_t *move,
+                    double *value) {
+    const uint64_t key = hex_grid_key(g, to_move);
+    size_t lo = 0, hi = b->count;
+    while (lo < hi) {
+        const size_t mid = lo + (hi - lo) / 2;
+        const uint8_t *e = b->data + HEADER + mid * ENTRY;
+        const uint64_t k = get_le(e, 8);
+        if (k < key || (k == key && get_le(e + 8, 2) < g->size)) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    if (lo == b->count)
+        return 0;
+    const uint8_t *e = b->data + HEADER + lo * ENTRY;
+    const size_t cell = (size_t)get_le(e + 10, 2);
+    if (get_le(e, 8) != key || get_le(e + 8, 2) != g->size ||
+        cell >= g->size * g->size)
+        return 0;
+    *move = cell;
+    if (value)
+        *value = (double)get_le(e + 12, 2) / 65535.0;
+    return 1;
+}
+
+void hex_book_default_config(struct hex_book_config *config) {
+    static const size_t sizes[] = {11, 13, 14, 19};
+    memset(config, 0, sizeof(*config));
+    memcpy(config->sizes, sizes, sizeof(sizes));
+    config->size_count = sizeof(sizes) / sizeof(sizes[0]);
+    config->depth = 2;
+    config->playouts = 10000;
+    config->threads = 1;
+    config->seed = 0x686578626f6f6b;
+}
+
+struct entry {
+    uint64_t key;
+    uint16_t size;
+    uint16_t move;
+    uint16_t value;
+};
+
+/* The positions of one depth of the book, as the moves that lead to them,
+   red first, `stride` slots per line. */
+struct level {
+    size_t stride;
+    uint16_t *moves;
+    uint8_t *length;
+    size_t count;
+    size_t capacity;
+    /* filled in by the search */
+    uint16_t *book_move;
+    uint16_t *value;
+};
+
+static int level_push(struct level *l, const uint16_t *moves, size_t n) {
+    if (l->count == l->capacity) {
+        size_t capacity = l->capacity ? l->capacity * 2 : 1024;
+        uint16_t *moves2 =
+            realloc(l->moves, capacity * l->stride * sizeof(uint16_t));
+        if (!moves2)
+            return 0;
+        l->moves = moves2;
+        uint8_t *length2 = realloc(l->length, capacity);
+        if (!length2)
+            return 0;
+        l->length = length2;
+        l->capacity = capacity;
+    }
+    memcpy(l->moves + l->count * l->stride, moves, n * sizeof(uint16_t));
+    l->length[l->count++] = (uint8_t)n;
+    return 1;
+}
+
+static void level_free(struct level *l) {
+    free(l->moves);
+    free(l->length);
+    free(l->book_move);
+    free(l->value);
+    memset(l, 0, sizeof(*l));
+}
+
+/* Plays line k of l on g, and returns the side to move. */
+static cell_color replay(hex_grid *g, const struct level *l, size_t k) {
+    cell_color player = RED;
+    hex_grid_clear(g);
+    for (size_t m = 0; m < l->length[k]; m++) {
+        hex_grid_open_cell(g, l->moves[k * l->stride + m], player);
+        player = player == RED ? BLUE : RED;
+    }
+    return player;
+}
+
+struct book_worker {
+    const struct level *level;
+    _Atomic size_t *next_line;
+    struct hex_mcts mcts;
+    hex_grid grid;
+};
+
+static void *book_run(void *arg) {
+    struct book_worker *w = arg;
+    const struct level *l = w->level;
+    for (;;) {
+        size_t k = atomic_fetch_add_explicit(w->next_line, 1,
+                                             memory_order_relaxed);
+        if (k >= l->count)
+            break;
+        cell_color to_move = replay(&w->grid, l, k);
+        struct hex_mcts_stats stats;
+        hex_mcts_set_position(&w->mcts, &w->grid, to_move);
+        size_t move = hex_mcts_search(&w->mcts, &stats);
+        l->book_move[k] = (uint16_t)move;
+        l->value[k] = (uint16_t)(stats.value * 65535.0 + 0.5);
+    }
+    return NULL;
+}
+
+/* Searches every line of l on the workers. */
+static void search_level(struct level *l,
+                         struct book_worker *workers,
+                         pthread_t *threads,
+                         unsigned n) {
+    _Atomic size_t next_line = 0;
+    for (unsigned t = 0; t < n; t++) {
+        workers[t].level = l;
+        workers[t].next_line = &next_line;
+    }
+    /* lines go to whichever worker asks next, as in the replay */
+    unsigned running = 1;
+    while (running < n && pthread_create(&threads[running], NULL, book_run,
+                                          &workers[running]) == 0)
+        running++;
+    book_run(&workers[0]);
+    for (unsigned t = 1; t < running; t++)
+        pthread_join(threads[t], NULL);
+}
+
+static int compare_entries(const void *a, const void *b) {
+    const struct entry *x = a, *y = b;
+    if (x->key != y->key)
+        return x->key < y->key ? -1 : 1;
+    return (x->size > y->size) - (x->size < y->size);
+}
+
+/* Builds the book of one board size into *entries. */
+static int build_size(const struct hex_book_config *config,
+                      size_t size,
+                      struct book_worker *workers,
+                      pthread_t *threads,
+                      unsigned n,
+                      struct entry **entries,
+                      size_t *count,
+                      size_t *capacity,
+                      size_t *positions) {
+    const size_t cells = size * size;
+    const size_t stride = 2 * (size_t)config->depth;
+    struct level level = {.stride = stride};
+    uint16_t line[2 * HEX_BOOK_MAX_DEPTH];
+    hex_grid g;
+    int ok = 1;
+
+    if (!hex_grid_init(&g, size, HEX_GRID_UNDOABLE_UNION_FIND))
+        return 0;
+    for (unsigned t = 0; t < n && ok; t++) {
+        struct hex_mcts_config mcts;
+        hex_mcts_default_config(&mcts);
+        mcts.max_seconds = 0;
+        mcts.max_playouts = config->playouts;
+        mcts.seed = config->seed + t;
+        hex_mcts_fit_nodes(&mcts, size);
+        ok = hex_grid_init(&workers[t].grid, size, HEX_GRID_BITBOARD);
+        if (ok && !(ok = hex_mcts_init(&workers[t].mcts, &mcts, size)))
+            hex_grid_destroy(&workers[t].grid);
+        if (!ok) {
+            while (t-- > 0) {
+                hex_mcts_destroy(&workers[t].mcts);
+                hex_grid_destroy(&workers[t].grid);
+            }
+        }
+    }
+    if (!ok) {
+        hex_grid_destroy(&g);
+        return 0;
+    }
+
+    /* the book plays red on the empty board, blue after any first move */
+    ok = level_push(&level, line, 0);
+    for (size_t i = 0; i < cells && ok; i++) {
+        line[0] = (uint16_t)i;
+        ok = level_push(&level, line, 1);
+    }
+    for (unsigned d = 0; ok && level.count; d++) {
+        level.book_move = malloc(level.count * sizeof(uint16_t));
+        level.value = malloc(level.count * sizeof(uint16_t));
+        if (!level.book_move || !level.value) {
+            ok = 0;
+            break;
+        }
+        search_level(&level, workers, threads, n);
+        *positions += level.count;
+
+        for (size_t k = 0; k < level.count && ok; k++) {
+            if (level.book_move[k] >= cells)
+                continue;
+            if (*count == *capacity) {
+                size_t capacity2 = *capacity ? *capacity * 2 : 1024;
+                struct entry *entries2 =
+                    realloc(*entries, capacity2 * sizeof(struct entry));
+                if (!entries2) {
+                    ok = 0;
+                    break;
+                }
+                *entries = entries2;
+                *capacity = capacity2;
+            }
+            cell_color to_move = replay(&g, &level, k);
+            (*entries)[(*count)++] =
+                (struct entry){hex_grid_key(&g, to_move), (uint16_t)size,
+                               level.book_move[k], level.value[k]};
+        }
+
+        /* every reply to each book move, unless the game is over */
+        struct level next = {.stride = stride};
+        for (size_t k = 0; d + 1 < config->depth && k < level.count && ok;
+             k++) {
+            const size_t len = level.length[k];
+            const size_t book_move = level.book_move[k];
+            cell_color to_move = replay(&g, &level, k);
+            if (book_move >= cells ||
+                !hex_grid_open_cell(&g, book_move, to_move) ||
+                hex_grid_get_winner(&g) != NEUTRAL)
+                continue;
+            memcpy(line, level.moves + k * stride, len * sizeof(uint16_t));
+            line[len] = (uint16_t)book_move;
+            for (size_t i = 0; i < cells && ok; i++) {
+                if (g.cells[i].color != NEUTRAL ||
+                    !hex_grid_open_cell(&g, i, to_move == RED ? BLUE : RED))
+                    continue;
+                if (hex_grid_get_winner(&g) == NEUTRAL) {
+                    line[len + 1] = (uint16_t)i;
+                    ok = level_push(&next, line, len + 2);
+                }
+                hex_grid_undo(&g);
+            }
+        }
+        level_free(&level);
+        level = next;
+    }
+    level_free(&level);
+
+    for (unsigned t = 0; t < n; t++) {
+        hex_mcts_destroy(&workers[t].mcts);
+        hex_grid_destroy(&workers[t].grid);
+    }
+    hex_grid_destroy(&g);
+    return ok;
+}
+
+int hex_book_build(const struct hex_book_config *config,
+                   const char *path,
+                   struct hex_book_stats *stats) {
+    const unsigned n = config->threads ? config->threads : 1;
+    const double start = hex_clock_now();
+    struct entry *entries = NULL;
+    size_t count = 0, capacity = 0;
+    int ok = config->depth >= 1 && config->depth <= HEX_BOOK_MAX_DEPTH &&
+             config->size_count <= HEX_BOOK_MAX_SIZES;
+
+    memset(stats, 0, sizeof(*stats));
+    for (size_t k = 0; ok && k < config->size_count; k++) {
+        const size_t size = config->sizes[k];
+        ok = size >= 1 && size * size <= UINT16_MAX;
+    }
+    struct book_worker *workers = calloc(n, sizeof(struct book_worker));
+    pthread_t *threads = calloc(n, sizeof(pthread_t));
+    ok = ok && workers && threads;
+    for (size_t k = 0; ok && k < config->size_count; k++) {
+        ok = build_size(config, config->sizes[k], workers, threads, n,
+                        &entries, &count, &capacity, &stats->positions);
+    }
+    free(workers);
+    free(threads);
+
+    /* transpositions were searched more than once; the first one stays */
+    if (ok && count) {
+        qsort(entries, count, sizeof(struct entry), compare_entries);
+        size_t unique = 1;
+        for (size_t k = 1; k < count; k++) {
+            if (compare_entries(&entries[k], &entries[unique - 1]) != 0)
+                entries[unique++] = entries[k];
+        }
+        count = unique;
+    }
+
+    FILE *f = ok ? fopen(path, "wb") : NULL;
+    if (f) {
+        uint8_t buf[HEADER];
+        memcpy(buf, book_magic, 8);
+        put_le(buf + 8, HEX_BOOK_VERSION, 4);
+        put_le(buf + 12, count, 4);
+        ok = fwrite(buf, HEADER, 1, f) == 1;
+        for (size_t k = 0; ok && k < count; k++) {
+            put_le(buf, entries[k].key, 8);
+            put_le(buf + 8, entries[k].size, 2);
+            put_le(buf + 10, entries[k].move, 2);
+            put_le(buf + 12, entries[k].value, 2);
+            put_le(buf + 14, 0, 2);
+            ok = fwrite(buf, ENTRY, 1, f) == 1;
+        }
+        ok = fclose(f) == 0 && ok;
+    } else {
+        ok = 0;
+    }
+    free(entries);
+    stats->entries = count;
+    stats->seconds = hex_clock_now() - start;
+    return ok;
+}
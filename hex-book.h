@@ -0,0 +1,71 @@
+#if !defined(HEX_BOOK_H)
+#define HEX_BOOK_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "hex-grid.h"
+
+/* Opening books. All numbers are little-endian.
+
+     header  "CHEXBOK" 0, u32 version, u32 entry count
+     entry   u64 position key (hex_grid_key()), u16 board size, u16 move,
+             u16 value (the win rate the search gave the move, in 65535ths),
+             u16 reserved
+     ...
+
+   Entries are sorted by key and then board size, so the game can map the
+   file and binary-search it where it lies.
+
+   A book covers the lines where its side always played the book move and
+   the opponent anything: the empty board and every first move, then after
+   each book move every reply, `depth` book moves deep. */
+
+#define HEX_BOOK_VERSION 1
+#define HEX_BOOK_MAX_SIZES 8
+#define HEX_BOOK_MAX_DEPTH 64
+
+struct hex_book {
+    const uint8_t *data; // the whole file, memory-mapped
+    size_t length;
+    size_t count;
+};
+
+/* Maps a book. Returns 0 if it cannot be read or is not a book. */
+int hex_book_open(struct hex_book *b, const char *path);
+
+void hex_book_close(struct hex_book *b);
+
+/* Finds the book move of g with `to_move` to play. Returns 0 if the
+   position is not in the book; `value` may be NULL. */
+int hex_book_lookup(const struct hex_book *b,
+                    const hex_grid *g,
+                    cell_color to_move,
+                    size_t *move,
+                    double *value);
+
+struct hex_book_config {
+    size_t sizes[HEX_BOOK_MAX_SIZES];
+    size_t size_count;
+    unsigned depth;  // book moves per line, up to HEX_BOOK_MAX_DEPTH
+    size_t playouts; // of the search at each position
+    unsigned threads;
+    uint64_t seed;
+};
+
+struct hex_book_stats {
+    size_t positions; // searched, transpositions included
+    size_t entries;
+    double seconds;
+};
+
+/* The board sizes of the game's menu that the computer plays. */
+void hex_book_default_config(struct hex_book_config *config);
+
+/* Searches every position of the book with a single-threaded hex_mcts per
+   thread and writes the book to `path`. Returns 0 on failure. */
+int hex_book_build(const struct hex_book_config *config,
+                   const char *path,
+                   struct hex_book_stats *stats);
+
+#endif /* HEX_BOOK_H */
@@ -0,0 +1,13 @@
+#if !defined(HEX_CLOCK_H)
+#define HEX_CLOCK_H
+
+#include <time.h>
+
+/* Seconds on the monotonic clock, for timings and deadlines. */
+static inline double hex_clock_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+#endif /* HEX_CLOCK_H */
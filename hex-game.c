@@ -1,6 +1,6 @@
-#include <assert.h>
 #include <math.h>
 #include <stdbool.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -11,9 +11,12 @@
 #include <allegro5/allegro_primitives.h>
 #include <allegro5/allegro_ttf.h>
 
-#include "weighted-quick-union.h"
-
-typedef enum cell_color { NEUTRAL = 0, RED = 1, BLUE = 2 } cell_color;
+#include "hex-analysis.h"
+#include "hex-book.h"
+#include "hex-grid.h"
+#include "hex-mcts.h"
+#include "hex-record.h"
+#include "hex-trace.h"
 
 typedef enum hexgame_scene {
     main_menu_scene = 0,
@@ -22,16 +25,28 @@ typedef enum hexgame_scene {
     result_scene
 } hexgame_scene;
 
+/* The board is laid out to fit the display, then scaled by `zoom` and moved
+   by (x, y) pixels. */
+struct board_view {
+    float zoom;
+    float x, y;
+};
+
 struct hexgame {
     unsigned short redraw : 1;
     unsigned short reset : 1;
     unsigned short fullscreen : 1;
+    unsigned short panning : 1;
+    unsigned short recorded : 1; // the game as it stands is in the archive
     size_t user_chosen_board_size;
     size_t hovered_button;
     size_t hovered_cell;
     cell_color current_player;
     cell_color winner;
+    cell_color ai_player; // NEUTRAL when both sides are human
     hexgame_scene scene;
+    struct board_view view;
+    double input_time; // timestamp of the oldest event not yet on screen
 };
 
 #define HEXGAME_FLAG_ON(flags, member) \
@@ -42,46 +57,45 @@ struct hexgame {
 
 #define AL_RED al_map_rgb(255, 0, 0)
 #define AL_BLUE al_map_rgb(0, 0, 255)
-#define AL_RED_HOVERED al_map_rgba(255, 0, 0, 51)
-#define AL_BLUE_HOVERED al_map_rgba(0, 0, 255, 51)
+/* 20% red or blue over white, opaque so cells can be drawn in any order */
+#define AL_RED_HOVERED al_map_rgb(255, 204, 204)
+#define AL_BLUE_HOVERED al_map_rgb(204, 204, 255)
 #define AL_BLACK al_map_rgb(0, 0, 0)
 #define AL_WHITE al_map_rgb(255, 255, 255)
 
-struct hexgrid_cell {
-    cell_color color;
-    bool hovered;
-};
-
-typedef struct hex_grid {
-    struct wqu_uf disjoint_set;
-    struct hexgrid_cell *cells;
-    size_t size;
-
-} hex_grid;
-
 #define HEXGAME_FIRST_PLAYER RED
 
-#define RED_VIRTUAL_CELLS_START(g) ((g)->size * (g)->size)
-#define BLUE_VIRTUAL_CELLS_START(g) (RED_VIRTUAL_CELLS_START((g)) + 2)
-
-#define DEF_GRID_SIZE 19
-static struct wqu_node def_grid_nodes[DEF_GRID_SIZE * DEF_GRID_SIZE + 4];
-static struct hexgrid_cell def_grid_cells[DEF_GRID_SIZE * DEF_GRID_SIZE];
-
-static hex_grid def_grid = {
-    .disjoint_set.nodes = def_grid_nodes,
-    .disjoint_set.size = DEF_GRID_SIZE * DEF_GRID_SIZE + 4,
-    .disjoint_set.count = DEF_GRID_SIZE * DEF_GRID_SIZE + 4,
-    .size = DEF_GRID_SIZE,
-    .cells = def_grid_cells};
-
-static void hex_def_grid_init() {
-    for (size_t i = 0; i < def_grid.size * def_grid.size + 4; i++) {
-        def_grid_nodes[i].id = i;
-        def_grid_nodes[i].size = 1;
+/* Build with -DHEXGAME_GRID_BACKEND=HEX_GRID_BITBOARD to track connections
+   with packed bitsets instead of the union-find. */
+#if !defined(HEXGAME_GRID_BACKEND)
+#define HEXGAME_GRID_BACKEND HEX_GRID_UNDOABLE_UNION_FIND
+#endif
+
+/* Above this size the undoable union-find gives way to the compressing
+   one, which keeps no undo log or checkpoints: a takeback replays the game
+   instead, which is fine for a key press. The computer only plays boards
+   up to HEXGAME_AI_MAX_SIZE; its search keeps a playout board per thread
+   and expands the root into a node per empty cell. */
+#define HEXGAME_UNDO_MAX_SIZE 100
+#define HEXGAME_AI_MAX_SIZE 100
+
+static hex_grid def_grid;
+
+/* Gives def_grid an empty board of the given size, on the heap, so that
+   boards of any size fit. */
+static void hex_def_grid_init(size_t size) {
+    if (def_grid.cells && def_grid.size == size) {
+        hex_grid_clear(&def_grid);
+        return;
     }
-    memset(def_grid.cells, 0,
-           sizeof(struct hexgrid_cell) * def_grid.size * def_grid.size);
+    if (def_grid.cells)
+        hex_grid_destroy(&def_grid);
+    enum hex_grid_backend backend = HEXGAME_GRID_BACKEND;
+    if (backend == HEX_GRID_UNDOABLE_UNION_FIND &&
+        size > HEXGAME_UNDO_MAX_SIZE)
+        backend = HEX_GRID_UNION_FIND;
+    if (!hex_grid_init(&def_grid, size, backend))
+        abort();
 }
 
 struct point {
@@ -96,57 +110,21 @@ struct point {
 static struct point pointy_hex_corner(const struct point *center,
                                       float size,
                                       unsigned i) {
-    float angle_deg = 60.0f * i - 30.0f;
-    float angle_rad = PI / 180.0f * angle_deg;
-    return (struct point){.x = center->x + size * cosf(angle_rad),
-                          .y = center->y + size * sinf(angle_rad)};
-}
-
-static void draw_filled_hexagon(float x,
-                                float y,
-                                float r,
-                                ALLEGRO_COLOR color) {
-    float vertices[22];
-
-    struct point center = {.x = x, .y = y};
-    struct point corners[6];
-    for (unsigned i = 0; i < 6; i++) {
-        corners[5 - i] = pointy_hex_corner(&center, r, i);
-    }
-    for (unsigned i = 0; i <= 16; i += 4) {
-        vertices[i] = corners[i / 4].x;
-        vertices[i + 1] = corners[i / 4].y;
-        vertices[i + 2] = corners[i / 4 + 1].x;
-        vertices[i + 3] = corners[i / 4 + 1].y;
+    /* the corners of the unit hexagon, so cosf/sinf run once per corner
+       rather than once per corner of every cell drawn */
+    static struct point unit[6];
+    static bool unit_ready;
+    if (!unit_ready) {
+        for (unsigned k = 0; k < 6; k++) {
+            float angle_deg = 60.0f * k - 30.0f;
+            float angle_rad = PI / 180.0f * angle_deg;
+            unit[k] =
+                (struct point){.x = cosf(angle_rad), .y = sinf(angle_rad)};
+        }
+        unit_ready = true;
     }
-    vertices[20] = corners[5].x;
-    vertices[21] = corners[5].y;
-
-    al_draw_filled_polygon(vertices, (sizeof(vertices) / sizeof(float)) / 2,
-                           color);
-}
-
-static void draw_hexagon(float x, float y, float r, ALLEGRO_COLOR color) {
-    float vertices[24];
-
-    struct point center = {.x = x, .y = y};
-    struct point corners[6];
-    for (unsigned i = 0; i < 6; i++) {
-        corners[i] = pointy_hex_corner(&center, r, i);
-    }
-    for (unsigned i = 0; i <= 16; i += 4) {
-        vertices[i] = corners[i / 4].x;
-        vertices[i + 1] = corners[i / 4].y;
-        vertices[i + 2] = corners[i / 4 + 1].x;
-        vertices[i + 3] = corners[i / 4 + 1].y;
-    }
-    vertices[20] = corners[5].x;
-    vertices[21] = corners[5].y;
-    vertices[22] = corners[0].x;
-    vertices[23] = corners[0].y;
-
-    al_draw_polygon(vertices, (sizeof(vertices) / sizeof(float)) / 2,
-                    ALLEGRO_LINE_JOIN_BEVEL, color, 1.5f, 1.0f);
+    return (struct point){.x = center->x + size * unit[i].x,
+                          .y = center->y + size * unit[i].y};
 }
 
 #define GRID_REGION_WIDTH(display) (al_get_display_width(display))
@@ -163,30 +141,496 @@ static void draw_hexagon(float x, float y, float r, ALLEGRO_COLOR color) {
 #define CELL_Y(v_offset, cell_height, i) \
     ((v_offset) + 0.75f * (cell_height) * (i))
 
-static void hex_grid_draw(struct hexgame *game,
-                          ALLEGRO_DISPLAY *display,
-                          const hex_grid *g) {
+struct board_layout {
+    float h_offset, v_offset;
+    float cell_width, cell_size, cell_height;
+};
+
+/* Where the cells go before the view is applied. */
+static struct board_layout board_layout(ALLEGRO_DISPLAY *display,
+                                        const hex_grid *g) {
+    const float width = GRID_REGION_WIDTH(display);
+    const float height = GRID_REGION_HEIGHT(display);
+    struct board_layout l;
+    l.h_offset = H_OFFSET(g->size, width);
+    l.v_offset = V_OFFSET(g->size, height);
+    l.cell_width = CELL_WIDTH(g->size, width, l.h_offset);
+    l.cell_size = CELL_SIZE(l.cell_width);
+    l.cell_height = CELL_HEIGHT(l.cell_size);
+    return l;
+}
+
+/* Cells are never drawn smaller than VIEW_MIN_CELL or larger than
+   VIEW_MAX_CELL pixels across, which also bounds how many are on screen. */
+#define VIEW_MIN_CELL 4.0f
+#define VIEW_MAX_CELL 120.0f
+
+static void view_clamp(struct board_view *view,
+                       ALLEGRO_DISPLAY *display,
+                       const hex_grid *g) {
+    const float width = GRID_REGION_WIDTH(display);
+    const float height = GRID_REGION_HEIGHT(display);
+    const struct board_layout l = board_layout(display, g);
+    const float min_zoom = fmaxf(1.0f, VIEW_MIN_CELL / l.cell_size);
+    const float max_zoom = fmaxf(min_zoom, VIEW_MAX_CELL / l.cell_size);
+    const float last = (float)(g->size - 1);
+
+    /* keep the centre of the display over a cell: find the (fractional) row
+       and column under it and pull them back onto the board */
+    const float cx = (width / 2.0f - view->x) / view->zoom;
+    const float cy = (height / 2.0f - view->y) / view->zoom;
+    float i = (cy - l.v_offset) / CELL_Y(0, l.cell_height, 1);
+    i = fminf(fmaxf(i, 0.0f), last);
+    float j = (cx - l.h_offset - l.cell_width / 2.0f * i) / l.cell_width;
+    j = fminf(fmaxf(j, 0.0f), last);
+
+    view->zoom = fminf(fmaxf(view->zoom, min_zoom), max_zoom);
+    view->x = width / 2.0f -
+              CELL_X(l.h_offset, l.cell_width, i, j) * view->zoom;
+    view->y = height / 2.0f - CELL_Y(l.v_offset, l.cell_height, i) * view->zoom;
+}
+
+/* As far out as the board can be drawn, centred. */
+static void view_reset(struct board_view *view,
+                       ALLEGRO_DISPLAY *display,
+                       const hex_grid *g) {
+    const float width = GRID_REGION_WIDTH(display);
+    const float height = GRID_REGION_HEIGHT(display);
+    const float cell_size = board_layout(display, g).cell_size;
+    view->zoom = fmaxf(1.0f, VIEW_MIN_CELL / cell_size);
+    view->x = width / 2.0f * (1.0f - view->zoom);
+    view->y = height / 2.0f * (1.0f - view->zoom);
+}
+
+/* Zooms by `factor`, keeping the board point under (x, y) in place. */
+static void view_zoom(struct board_view *view,
+                      ALLEGRO_DISPLAY *display,
+                      const hex_grid *g,
+                      float factor,
+                      float x,
+                      float y) {
+    const float zoom = view->zoom;
+    view->zoom *= factor;
+    view_clamp(view, display, g);
+    view->x = x - (x - view->x) * view->zoom / zoom;
+    view->y = y - (y - view->y) * view->zoom / zoom;
+    view_clamp(view, display, g);
+}
+
+static void view_pan(struct board_view *view,
+                     ALLEGRO_DISPLAY *display,
+                     const hex_grid *g,
+                     float dx,
+                     float dy) {
+    view->x += dx;
+    view->y += dy;
+    view_clamp(view, display, g);
+}
+
+#define VIEW_ZOOM_STEP 1.25f
+
+/* Arrow keys pan, + and - zoom about the centre, and 0 zooms back out.
+   Returns whether the key was one of those. */
+static bool view_key(struct board_view *view,
+                     ALLEGRO_DISPLAY *display,
+                     const hex_grid *g,
+                     int keycode) {
     const float width = GRID_REGION_WIDTH(display);
     const float height = GRID_REGION_HEIGHT(display);
-    const float h_offset = H_OFFSET(g->size, width);
-    const float v_offset = V_OFFSET(g->size, height);
-    const float cell_width = CELL_WIDTH(g->size, width, h_offset);
-    const float cell_size = CELL_SIZE(cell_width);
-    const float cell_height = CELL_HEIGHT(cell_size);
+    switch (keycode) {
+        case ALLEGRO_KEY_LEFT:
+            view_pan(view, display, g, width / 8.0f, 0.0f);
+            return true;
+        case ALLEGRO_KEY_RIGHT:
+            view_pan(view, display, g, -width / 8.0f, 0.0f);
+            return true;
+        case ALLEGRO_KEY_UP:
+            view_pan(view, display, g, 0.0f, height / 8.0f);
+            return true;
+        case ALLEGRO_KEY_DOWN:
+            view_pan(view, display, g, 0.0f, -height / 8.0f);
+            return true;
+        case ALLEGRO_KEY_EQUALS:
+        case ALLEGRO_KEY_PAD_PLUS:
+            view_zoom(view, display, g, VIEW_ZOOM_STEP, width / 2.0f,
+                      height / 2.0f);
+            return true;
+        case ALLEGRO_KEY_MINUS:
+        case ALLEGRO_KEY_PAD_MINUS:
+            view_zoom(view, display, g, 1.0f / VIEW_ZOOM_STEP, width / 2.0f,
+                      height / 2.0f);
+            return true;
+        case ALLEGRO_KEY_0:
+            view_reset(view, display, g);
+            return true;
+        default:
+            return false;
+    }
+}
+
+/* What a cell looks like on screen, as far as the board cache cares. */
+enum cell_look {
+    LOOK_EMPTY = 0,
+    LOOK_RED,
+    LOOK_BLUE,
+    LOOK_RED_HOVERED,
+    LOOK_BLUE_HOVERED,
+    LOOK_HEAT // the analysis shades for red, then those for blue
+};
+
+/* The visible part of the board is one triangle list: every cell is a black
+   hexagon with a slightly smaller one in the cell colour on top, and the
+   border triangles come after the cells. Only the fill colours change
+   between frames. */
+#define CELL_OUTLINE 1.5f
+#define CELL_VERTICES 12 // outline corners, then fill corners
+#define CELL_INDICES 24  // four triangles for each hexagon
+
+/* The visible cells of board row i_first + r are j_first..j_last, at
+   k, k + 1, ... in the triangle list. */
+struct row_span {
+    size_t j_first, j_last, k;
+};
+
+/* Cells whose look may have changed since the last frame, at most this
+   many; more than that and the whole board is laid out again. */
+#define GRID_VIEW_TOUCHED 64
+
+/* The board is drawn into `cache` once when it is laid out. After that,
+   only the fills of the cells touched since the last frame are drawn over
+   it: a fill lies inside its own cell and is drawn last, so repainting one
+   leaves every other pixel as it was. A move costs O(1), not O(cells). */
+static struct grid_view {
+    ALLEGRO_BITMAP *cache;
+    ALLEGRO_VERTEX *vertices;
+    int *indices;
+    size_t *cells;        // board index of every visible cell
+    unsigned char *drawn; // cell_look of every visible cell in the cache
+    struct row_span *rows;
+    size_t i_first, row_count;
+    size_t visible;
+    int index_count;
+    size_t touched[GRID_VIEW_TOUCHED];
+    size_t touched_len;
+    int repaint[GRID_VIEW_TOUCHED * CELL_INDICES / 2]; // touched fills
+    int width, height; // display size the geometry was built for
+    size_t size;       // board size the geometry was built for
+    bool valid;
+} grid_view;
+
+static void grid_view_invalidate(void) {
+    grid_view.valid = false;
+}
+
+/* Notes that cell i may look different now. */
+static void grid_view_touch(size_t i) {
+    if (i == (size_t)-1 || !grid_view.valid)
+        return;
+    if (grid_view.touched_len == GRID_VIEW_TOUCHED) {
+        grid_view_invalidate();
+        return;
+    }
+    grid_view.touched[grid_view.touched_len++] = i;
+}
+
+/* Where cell i is in the triangle list, or (size_t)-1 if it is off
+   screen. */
+static size_t grid_view_slot(size_t i) {
+    const size_t r = i / grid_view.size - grid_view.i_first;
+    const size_t j = i % grid_view.size;
+    if (r >= grid_view.row_count || j < grid_view.rows[r].j_first ||
+        j > grid_view.rows[r].j_last)
+        return (size_t)-1;
+    return grid_view.rows[r].k + j - grid_view.rows[r].j_first;
+}
+
+/* H shades every empty cell by how often the side to move wins random
+   playouts after playing there. The estimates come from hex-analysis.c
+   worker threads, which start over on every move; a timer polls for what
+   they published about the position on the board, and only the cells whose
+   shade changed are repainted. */
+#define HEXGAME_ANALYSIS_LEVELS 16
+#define HEXGAME_ANALYSIS_POLL (1.0 / 10.0)
+
+static struct analysis_view {
+    struct hex_analysis engine;
+    bool ready;
+    bool enabled;
+    uint32_t epoch;     // of the position on the board, 0 for none
+    cell_color to_move; // whom the shades are for
+    size_t size;
+    float *win;
+    unsigned char *level; // shade of every cell, 0 for none
+} analysis;
+
+static void analysis_clear(void) {
+    for (size_t i = 0; analysis.level && i < analysis.size * analysis.size;
+         i++) {
+        if (analysis.level[i]) {
+            analysis.level[i] = 0;
+            grid_view_touch(i);
+        }
+    }
+}
+
+/* Hands the position on the board to the workers, or idles them if there
+   is nothing to analyse. Called after every change to def_grid or the
+   scene. */
+static void analysis_update(const struct hexgame *game) {
+    if (!analysis.enabled)
+        return;
+    analysis_clear();
+    analysis.epoch = 0;
+    if (game->scene != grid_scene || def_grid.size > HEXGAME_AI_MAX_SIZE) {
+        if (analysis.ready)
+            hex_analysis_stop(&analysis.engine);
+        return;
+    }
+    if (analysis.ready && analysis.size != def_grid.size) {
+        hex_analysis_destroy(&analysis.engine);
+        analysis.ready = false;
+    }
+    if (!analysis.ready) {
+        const size_t cells = def_grid.size * def_grid.size;
+        struct hex_analysis_config config;
+        hex_analysis_default_config(&config);
+        /* a core is left for the event loop */
+        config.threads = (unsigned)al_get_cpu_count();
+        if (config.threads > 1)
+            config.threads--;
+        float *win = realloc(analysis.win, cells * sizeof(float));
+        if (win)
+            analysis.win = win;
+        unsigned char *level = realloc(analysis.level, cells);
+        if (level)
+            analysis.level = level;
+        analysis.size = 0;
+        if (!win || !level ||
+            !hex_analysis_init(&analysis.engine, &config, def_grid.size)) {
+            fprintf(stderr, "chex-game: cannot start the analysis\n");
+            analysis.enabled = false;
+            return;
+        }
+        memset(analysis.level, 0, cells);
+        analysis.size = def_grid.size;
+        analysis.ready = true;
+    }
+    analysis.to_move = game->current_player;
+    analysis.epoch = hex_analysis_set_position(&analysis.engine, &def_grid,
+                                               game->current_player);
+}
+
+/* Takes in the latest estimates. Returns whether any shade changed. */
+static bool analysis_poll(void) {
+    if (!analysis.ready || analysis.epoch == 0 ||
+        hex_analysis_read(&analysis.engine, analysis.win, NULL) !=
+            analysis.epoch)
+        return false;
+    bool changed = false;
+    for (size_t i = 0; i < analysis.size * analysis.size; i++) {
+        const float win = analysis.win[i];
+        unsigned char level = 0;
+        if (win >= 0)
+            level = win >= 1 ? HEXGAME_ANALYSIS_LEVELS
+                             : 1 + (unsigned char)(win *
+                                                   HEXGAME_ANALYSIS_LEVELS);
+        if (level != analysis.level[i]) {
+            analysis.level[i] = level;
+            grid_view_touch(i);
+            changed = true;
+        }
+    }
+    return changed;
+}
+
+static unsigned char cell_look(const struct hexgame *game,
+                               const hex_grid *g,
+                               size_t i) {
+    if (g->cells[i].color == RED)
+        return LOOK_RED;
+    if (g->cells[i].color == BLUE)
+        return LOOK_BLUE;
+    if (g->cells[i].hovered)
+        return game->current_player == RED ? LOOK_RED_HOVERED
+                                           : LOOK_BLUE_HOVERED;
+    if (analysis.enabled && analysis.size == g->size && analysis.level[i])
+        return (unsigned char)(LOOK_HEAT +
+                               (analysis.to_move == BLUE) *
+                                   HEXGAME_ANALYSIS_LEVELS +
+                               analysis.level[i] - 1);
+    return LOOK_EMPTY;
+}
+
+static ALLEGRO_COLOR look_color(unsigned char look) {
+    switch (look) {
+        case LOOK_RED:
+            return AL_RED;
+        case LOOK_BLUE:
+            return AL_BLUE;
+        case LOOK_RED_HOVERED:
+            return AL_RED_HOVERED;
+        case LOOK_BLUE_HOVERED:
+            return AL_BLUE_HOVERED;
+        case LOOK_EMPTY:
+            return AL_WHITE;
+        default: {
+            /* up to 60% of the player's colour over white */
+            const unsigned heat = look - LOOK_HEAT;
+            const float t = 0.6f * (float)(heat % HEXGAME_ANALYSIS_LEVELS + 1) /
+                            HEXGAME_ANALYSIS_LEVELS;
+            return heat < HEXGAME_ANALYSIS_LEVELS
+                       ? al_map_rgb_f(1.0f, 1.0f - t, 1.0f - t)
+                       : al_map_rgb_f(1.0f - t, 1.0f - t, 1.0f);
+        }
+    }
+}
+
+static void hexagon_vertices(ALLEGRO_VERTEX *v,
+                             float x,
+                             float y,
+                             float r,
+                             ALLEGRO_COLOR color) {
+    struct point center = {.x = x, .y = y};
+    for (unsigned i = 0; i < 6; i++) {
+        struct point corner = pointy_hex_corner(&center, r, i);
+        v[i] = (ALLEGRO_VERTEX){.x = corner.x, .y = corner.y, .color = color};
+    }
+}
+
+static void triangle_vertices(ALLEGRO_VERTEX *v,
+                              const struct board_view *view,
+                              float x1,
+                              float y1,
+                              float x2,
+                              float y2,
+                              float x3,
+                              float y3,
+                              ALLEGRO_COLOR color) {
+    v[0] = (ALLEGRO_VERTEX){.x = x1 * view->zoom + view->x,
+                            .y = y1 * view->zoom + view->y,
+                            .color = color};
+    v[1] = (ALLEGRO_VERTEX){.x = x2 * view->zoom + view->x,
+                            .y = y2 * view->zoom + view->y,
+                            .color = color};
+    v[2] = (ALLEGRO_VERTEX){.x = x3 * view->zoom + view->x,
+                            .y = y3 * view->zoom + view->y,
+                            .color = color};
+}
+
+/* The k in [0, n) with lo <= a + b * k <= hi are first..last. Returns false
+   if there are none. */
+static bool index_range(float lo,
+                        float hi,
+                        float a,
+                        float b,
+                        size_t n,
+                        size_t *first,
+                        size_t *last) {
+    const float f = ceilf((lo - a) / b);
+    const float l = floorf((hi - a) / b);
+    if (l < 0.0f || f > (float)(n - 1) || f > l)
+        return false;
+    *first = f < 0.0f ? 0 : (size_t)f;
+    *last = l > (float)(n - 1) ? n - 1 : (size_t)l;
+    return true;
+}
+
+/* Lays out the vertices and indices of every cell on screen, and of the
+   borders. Every cell starts out drawn as LOOK_EMPTY. */
+static void grid_view_build(ALLEGRO_DISPLAY *display,
+                            const struct board_view *view,
+                            const hex_grid *g) {
+    const float width = GRID_REGION_WIDTH(display);
+    const float height = GRID_REGION_HEIGHT(display);
+    const struct board_layout l = board_layout(display, g);
+    const float h_offset = l.h_offset;
+    const float v_offset = l.v_offset;
+    const float cell_width = l.cell_width;
+    const float cell_size = l.cell_size;
+    const float cell_height = l.cell_height;
+    /* moves each edge CELL_OUTLINE / 2 in or out, whatever the zoom */
+    const float inset = CELL_OUTLINE / SQRT_3;
+
+    /* the part of the board on screen, with a cell to spare on each side */
+    const float left = -view->x / view->zoom - cell_width;
+    const float right = (width - view->x) / view->zoom + cell_width;
+    const float top = -view->y / view->zoom - cell_size;
+    const float bottom = (height - view->y) / view->zoom + cell_size;
+    size_t i_first, i_last, j_first, j_last;
+    const bool rows = index_range(top, bottom, v_offset, 0.75f * cell_height,
+                                  g->size, &i_first, &i_last);
+
+    const size_t row_count = rows ? i_last - i_first + 1 : 0;
+    struct row_span *spans =
+        realloc(grid_view.rows, (row_count + 1) * sizeof(struct row_span));
+    if (!spans)
+        abort();
+    grid_view.rows = spans;
+    grid_view.i_first = rows ? i_first : 0;
+    grid_view.row_count = row_count;
+
+    size_t visible = 0;
+    for (size_t r = 0; r < row_count; r++) {
+        const size_t i = i_first + r;
+        spans[r] = (struct row_span){.j_first = 1, .j_last = 0, .k = visible};
+        if (index_range(left, right, h_offset + cell_width / 2.0f * i,
+                        cell_width, g->size, &j_first, &j_last)) {
+            spans[r].j_first = j_first;
+            spans[r].j_last = j_last;
+            visible += j_last - j_first + 1;
+        }
+    }
+
+    const size_t border_vertices = 4 * 3 * (g->size - 1);
+    ALLEGRO_VERTEX *vertices = realloc(
+        grid_view.vertices,
+        (visible * CELL_VERTICES + border_vertices) * sizeof(ALLEGRO_VERTEX));
+    int *indices = realloc(grid_view.indices,
+                           (border_vertices + visible * CELL_INDICES) *
+                               sizeof(int));
+    size_t *cells = realloc(grid_view.cells, visible * sizeof(size_t) + 1);
+    unsigned char *drawn = realloc(grid_view.drawn, visible + 1);
+    if (!vertices || !indices || !cells || !drawn)
+        abort();
+    grid_view.vertices = vertices;
+    grid_view.indices = indices;
+    grid_view.cells = cells;
+    grid_view.drawn = drawn;
+    grid_view.visible = visible;
+
+    /* grid cells */
+    ALLEGRO_VERTEX *v = vertices;
+    size_t k = 0;
+    for (size_t i = i_first; rows && i <= i_last; i++) {
+        if (!index_range(left, right, h_offset + cell_width / 2.0f * i,
+                         cell_width, g->size, &j_first, &j_last))
+            continue;
+        for (size_t j = j_first; j <= j_last; j++, k++, v += CELL_VERTICES) {
+            const float x =
+                CELL_X(h_offset, cell_width, i, j) * view->zoom + view->x;
+            const float y = CELL_Y(v_offset, cell_height, i) * view->zoom +
+                            view->y;
+            const float r = cell_size * view->zoom;
+            hexagon_vertices(v, x, y, r + inset, AL_BLACK);
+            hexagon_vertices(v + 6, x, y, r - inset, AL_WHITE);
+            cells[k] = i * g->size + j;
+            drawn[k] = LOOK_EMPTY;
+        }
+    }
 
     /* grid borders */
-    for (size_t j = 0; j < g->size - 1; j++) {
+    for (size_t j = 0; j < g->size - 1; j++, v += 12) {
         /* red borders */
-        al_draw_filled_triangle(
-            CELL_X(h_offset, cell_width, 0, j),
+        triangle_vertices(
+            v, view, CELL_X(h_offset, cell_width, 0, j),
             CELL_Y(v_offset, cell_height, 0) - cell_size,
             CELL_X(h_offset, cell_width, 0, j + 1),
             CELL_Y(v_offset, cell_height, 0) - cell_size,
             CELL_X(h_offset, cell_width, 0, j) + cell_width / 2.0f,
             CELL_Y(v_offset, cell_height, 0) - cell_size / 2.0f, AL_RED);
 
-        al_draw_filled_triangle(
-            CELL_X(h_offset, cell_width, g->size - 1, j),
+        triangle_vertices(
+            v + 3, view, CELL_X(h_offset, cell_width, g->size - 1, j),
             CELL_Y(v_offset, cell_height, g->size - 1) + cell_size,
             CELL_X(h_offset, cell_width, g->size - 1, j + 1),
             CELL_Y(v_offset, cell_height, g->size - 1) + cell_size,
@@ -195,15 +639,16 @@ static void hex_grid_draw(struct hexgame *game,
             AL_RED);
 
         /* blue borders */
-        al_draw_filled_triangle(
-            CELL_X(h_offset, cell_width, j, 0) - cell_width / 2.0f,
+        triangle_vertices(
+            v + 6, view, CELL_X(h_offset, cell_width, j, 0) - cell_width / 2.0f,
             CELL_Y(v_offset, cell_height, j) + cell_height / 4.0f,
             CELL_X(h_offset, cell_width, j, 0),
             CELL_Y(v_offset, cell_height, j) + cell_height / 2.0f,
             CELL_X(h_offset, cell_width, j, 0),
             CELL_Y(v_offset, cell_height, j + 1) + cell_height / 4.0f, AL_BLUE);
 
-        al_draw_filled_triangle(
+        triangle_vertices(
+            v + 9, view,
             CELL_X(h_offset, cell_width, j, g->size - 1) + cell_width / 2.0f,
             CELL_Y(v_offset, cell_height, j) - cell_height / 4.0f,
             CELL_X(h_offset, cell_width, j, g->size - 1) + cell_width / 2.0f,
@@ -213,112 +658,189 @@ static void hex_grid_draw(struct hexgame *game,
             CELL_Y(v_offset, cell_height, j + 1) - cell_height / 4.0f, AL_BLUE);
     }
 
-    ALLEGRO_COLOR al_red = AL_RED;
-    ALLEGRO_COLOR al_red_hovered = AL_RED_HOVERED;
-    ALLEGRO_COLOR al_blue = AL_BLUE;
-    ALLEGRO_COLOR al_blue_hovered = AL_BLUE_HOVERED;
-    ALLEGRO_COLOR al_white = AL_WHITE;
-    ALLEGRO_COLOR *color;
-
-    /* grid cells */
-    for (size_t i = 0; i < g->size; i++) {
-        for (size_t j = 0; j < g->size; j++) {
-            if (g->cells[i * g->size + j].color == RED) {
-                color = &al_red;
-            } else if (g->cells[i * g->size + j].color == BLUE) {
-                color = &al_blue;
-            } else if (g->cells[i * g->size + j].hovered) {
-                if (game->current_player == RED)
-                    color = &al_red_hovered;
-                else
-                    color = &al_blue_hovered;
-            } else
-                color = &al_white;
-
-            draw_filled_hexagon(CELL_X(h_offset, cell_width, i, j),
-                                CELL_Y(v_offset, cell_height, i), cell_size,
-                                *color);
-
-            draw_hexagon(CELL_X(h_offset, cell_width, i, j),
-                         CELL_Y(v_offset, cell_height, i), cell_size, AL_BLACK);
+    /* borders first, then every outline, then every fill, so that the fills
+       are drawn over the outlines of their neighbours */
+    int *idx = indices;
+    for (size_t b = 0; b < border_vertices; b++)
+        *idx++ = (int)(visible * CELL_VERTICES + b);
+    for (size_t layer = 0; layer < 2; layer++) {
+        for (k = 0; k < visible; k++) {
+            const int base = (int)(k * CELL_VERTICES + layer * 6);
+            for (int c = 1; c < 5; c++) {
+                *idx++ = base;
+                *idx++ = base + c;
+                *idx++ = base + c + 1;
+            }
         }
     }
+    grid_view.index_count = (int)(idx - indices);
 }
 
-static size_t get_cell_index_from_mouse_coordinates(ALLEGRO_DISPLAY *display,
-                                                    const hex_grid *g,
-                                                    int x,
-                                                    int y) {
-    const float width = GRID_REGION_WIDTH(display);
-    const float height = GRID_REGION_HEIGHT(display);
-    const float h_offset = H_OFFSET(g->size, width);
-    const float v_offset = V_OFFSET(g->size, height);
-    const float cell_width = CELL_WIDTH(g->size, width, h_offset);
-    const float cell_size = CELL_SIZE(cell_width);
-    const float cell_height = CELL_HEIGHT(cell_size);
+/* Gives visible cell k the fill colour of `look`. */
+static void grid_view_fill(size_t k, unsigned char look) {
+    ALLEGRO_COLOR color = look_color(look);
+    ALLEGRO_VERTEX *v = grid_view.vertices + k * CELL_VERTICES + 6;
+    for (unsigned c = 0; c < 6; c++)
+        v[c].color = color;
+    grid_view.drawn[k] = look;
+}
 
-    float i_f = ((float)y - v_offset) / CELL_Y(0, cell_height, 1);
+static void hex_grid_draw(struct hexgame *game,
+                          ALLEGRO_DISPLAY *display,
+                          const hex_grid *g) {
+    const int width = al_get_display_width(display);
+    const int height = al_get_display_height(display);
+    bool rebuilt = false;
+    int repaint = 0; // indices in grid_view.repaint
+    HEX_TRACE_BEGIN("hex_grid_draw");
+
+    if (!grid_view.valid || grid_view.width != width ||
+        grid_view.height != height || grid_view.size != g->size) {
+        if (!grid_view.cache || grid_view.width != width ||
+            grid_view.height != height) {
+            if (grid_view.cache)
+                al_destroy_bitmap(grid_view.cache);
+            grid_view.cache = al_create_bitmap(width, height);
+        }
+        grid_view_build(display, &game->view, g);
+        grid_view.width = width;
+        grid_view.height = height;
+        grid_view.size = g->size;
+        grid_view.valid = true;
+        for (size_t k = 0; k < grid_view.visible; k++)
+            grid_view_fill(k, cell_look(game, g, grid_view.cells[k]));
+        rebuilt = true;
+    } else {
+        for (size_t t = 0; t < grid_view.touched_len; t++) {
+            const size_t k = grid_view_slot(grid_view.touched[t]);
+            if (k == (size_t)-1)
+                continue;
+            const unsigned char look = cell_look(game, g, grid_view.cells[k]);
+            if (look == grid_view.drawn[k])
+                continue;
+            grid_view_fill(k, look);
+            /* the fill indices of cell k, as grid_view_build() made them */
+            const int *fill = grid_view.indices + grid_view.index_count -
+                              (int)(grid_view.visible - k) * CELL_INDICES / 2;
+            memcpy(grid_view.repaint + repaint, fill,
+                   CELL_INDICES / 2 * sizeof(int));
+            repaint += CELL_INDICES / 2;
+        }
+    }
+    grid_view.touched_len = 0;
+
+    /* without a cache the board is drawn straight to the backbuffer, every
+       frame */
+    if (!grid_view.cache || rebuilt) {
+        if (grid_view.cache) {
+            al_set_target_bitmap(grid_view.cache);
+            al_clear_to_color(AL_WHITE);
+        }
+        al_draw_indexed_prim(grid_view.vertices, NULL, NULL, grid_view.indices,
+                             grid_view.index_count,
+                             ALLEGRO_PRIM_TRIANGLE_LIST);
+        HEX_TRACE_DRAW_CALL();
+    } else if (repaint > 0) {
+        al_set_target_bitmap(grid_view.cache);
+        al_draw_indexed_prim(grid_view.vertices, NULL, NULL, grid_view.repaint,
+                             repaint, ALLEGRO_PRIM_TRIANGLE_LIST);
+        HEX_TRACE_DRAW_CALL();
+    }
+    if (grid_view.cache) {
+        al_set_target_backbuffer(display);
+        al_draw_bitmap(grid_view.cache, 0, 0, 0);
+        HEX_TRACE_DRAW_CALL();
+    }
+    HEX_TRACE_END();
+}
+
+static size_t get_cell_index_from_mouse_coordinates(
+    ALLEGRO_DISPLAY *display,
+    const struct board_view *view,
+    const hex_grid *g,
+    int x,
+    int y) {
+    const struct board_layout l = board_layout(display, g);
+    const float h_offset = l.h_offset;
+    const float v_offset = l.v_offset;
+    const float cell_width = l.cell_width;
+    const float cell_height = l.cell_height;
+    HEX_TRACE_BEGIN("get_cell_index_from_mouse_coordinates");
+
+    /* back to where the cell is before the view is applied */
+    const float board_x = ((float)x - view->x) / view->zoom;
+    const float board_y = ((float)y - view->y) / view->zoom;
+
+    float i_f = (board_y - v_offset) / CELL_Y(0, cell_height, 1);
     size_t i = (size_t)llroundf(i_f);
-    float j_f = ((float)x - h_offset - (cell_width) / 2.0f * i_f) /
+    float j_f = (board_x - h_offset - (cell_width) / 2.0f * i_f) /
                 CELL_X(0, cell_width, 0, 1);
     size_t j = (size_t)llroundf(j_f);
 
+    HEX_TRACE_END();
     if (i < g->size && j < g->size) {
         return i * g->size + j;
     }
     return (size_t)-1;
 }
 
-static void open_cell(struct hexgame *game, hex_grid *g, size_t i) {
-    assert(i < g->size * g->size);
+/* Games are appended to the archive named by the CHEX_RECORD environment
+   variable, if there is one: when they are won, and when they are abandoned
+   for a new game. */
+static struct hex_record_writer recorder;
+static bool recording;
 
-    if (g->cells[i].color != NEUTRAL) {
+static void record_game(struct hexgame *game) {
+    if (!recording || game->recorded || def_grid.move_count == 0)
         return;
-    }
-
-    size_t x = i % g->size;
-    size_t y = i / g->size;
-    g->cells[i].color = game->current_player;
+    if (!hex_record_write(&recorder, &def_grid, game->winner))
+        fprintf(stderr, "chex-game: cannot record the game\n");
+    HEXGAME_FLAG_ON(*game, recorded);
+}
 
-    size_t neighbors[6];
-    neighbors[0] = i - g->size;
-    neighbors[1] = (x != (g->size - 1) ? (i - g->size + 1) : (size_t)-1);
-    neighbors[2] = (x != (g->size - 1) ? (i + 1) : (size_t)-1);
-    neighbors[3] = i + g->size;
-    neighbors[4] = (x != 0 ? (i + g->size - 1) : (size_t)-1);
-    neighbors[5] = (x != 0 ? (i - 1) : (size_t)-1);
+static void recorder_close(void) {
+    if (recording && !hex_record_writer_close(&recorder))
+        fprintf(stderr, "chex-game: cannot write the game index\n");
+    recording = false;
+}
 
-    for (size_t n = 0; n < 6; n++) {
-        if (neighbors[n] < g->size * g->size &&
-            g->cells[neighbors[n]].color == g->cells[i].color) {
-            w_quickunion_union(&g->disjoint_set, neighbors[n], i);
-        }
+/* Prints a chex-cli command that solves the current position. */
+static void print_position(void) {
+    const size_t size = def_grid.size;
+    if (size > 26 || (def_grid.move_count &&
+                      def_grid.cells[def_grid.moves[0]].color != RED)) {
+        fprintf(stderr, "chex-game: chex-cli cannot read this position\n");
+        return;
     }
-
-    size_t red_idx = RED_VIRTUAL_CELLS_START(g);
-    size_t blue_idx = BLUE_VIRTUAL_CELLS_START(g);
-
-    if (y == 0 && game->current_player == RED) {  // upper
-        w_quickunion_union(&g->disjoint_set, red_idx, i);
-    } else if (y == (g->size - 1) && game->current_player == RED) {  // lower
-        w_quickunion_union(&g->disjoint_set, red_idx + 1, i);
-    } else if (x == 0 && game->current_player == BLUE) {  // left
-        w_quickunion_union(&g->disjoint_set, blue_idx, i);
-    } else if (x == (g->size - 1) && game->current_player == BLUE) {  // right
-        w_quickunion_union(&g->disjoint_set, blue_idx + 1, i);
+    fprintf(stderr, "chex-cli --solve %zu", size);
+    for (size_t k = 0; k < def_grid.move_count; k++) {
+        size_t i = def_grid.moves[k];
+        fprintf(stderr, "%s%c%zu", k ? "," : " --position ",
+                (char)('a' + i % size), i / size + 1);
     }
-
-    game->current_player = 1 + (game->current_player % 2);
+    fputc('\n', stderr);
 }
 
-static cell_color get_winner(hex_grid *g) {
-    size_t red_idx = RED_VIRTUAL_CELLS_START(g);
-    if (w_quickunion_is_connected(&g->disjoint_set, red_idx, red_idx + 1))
-        return RED;
-    size_t blue_idx = BLUE_VIRTUAL_CELLS_START(g);
-    if (w_quickunion_is_connected(&g->disjoint_set, blue_idx, blue_idx + 1))
-        return BLUE;
-    return NEUTRAL;
+static void open_cell(struct hexgame *game, hex_grid *g, size_t i) {
+    HEX_TRACE_BEGIN("open_cell");
+    const bool opened = hex_grid_open_cell(g, i, game->current_player);
+    if (opened) {
+        game->current_player = 1 + (game->current_player % 2);
+        /* the hovered cell takes the colour of the other player */
+        grid_view_touch(i);
+        grid_view_touch(game->hovered_cell);
+        HEXGAME_FLAG_OFF(*game, recorded);
+    }
+    HEX_TRACE_BEGIN("get_winner");
+    game->winner = hex_grid_get_winner(g);
+    HEX_TRACE_END();
+    if (game->winner != NEUTRAL) {
+        game->scene = result_scene;
+        record_game(game);
+    }
+    if (opened)
+        analysis_update(game);
+    HEX_TRACE_END();
 }
 
 static void show_winner(struct hexgame *game,
@@ -328,14 +850,168 @@ static void show_winner(struct hexgame *game,
     static char *msg[3] = {[RED] = "Red Wins!", [BLUE] = "Blue Wins!"};
     if (game->winner != NEUTRAL) {
         al_draw_text(font_big, AL_BLUE, 50,
-                     al_get_display_height(display) - 100, 0,
+                     al_get_display_height(display) - 116, 0,
                      msg[game->winner]);
+        HEX_TRACE_DRAW_CALL();
     } else
         return;
 
     al_draw_multiline_text(
-        font, AL_BLACK, 50, al_get_display_height(display) - 50, 250, 0,
-        ALLEGRO_ALIGN_LEFT, "Press R to play again,\nM to return to main menu");
+        font, AL_BLACK, 50, al_get_display_height(display) - 66, 250, 0,
+        ALLEGRO_ALIGN_LEFT,
+        "Press R to play again,\nU to take back a move,\nM to return to main "
+        "menu");
+    HEX_TRACE_DRAW_CALL();
+}
+
+#define HEXGAME_AI_SECONDS 1.0
+#define HEXGAME_TT_MB 64
+
+static struct hex_mcts ai;
+static struct hex_tt ai_tt;
+static bool ai_ready;
+static bool ai_tt_ready;
+
+/* The search runs on its own thread, so that the board can still be
+   hovered, zoomed and panned while the computer thinks, and posts its move
+   back as a HEXGAME_EVENT_AI_MOVE event. */
+#define HEXGAME_EVENT_AI_MOVE ALLEGRO_GET_EVENT_TYPE('C', 'H', 'X', 'M')
+
+static struct ai_search {
+    ALLEGRO_THREAD *thread; // NULL unless a search is running or unjoined
+    ALLEGRO_EVENT_SOURCE done;
+    intptr_t generation; // bumped by ai_cancel(), to drop stale moves
+    size_t move;
+    struct hex_mcts_stats stats;
+} ai_search;
+
+static void *ai_search_run(ALLEGRO_THREAD *thread, void *arg) {
+    (void)thread;
+    intptr_t generation = (intptr_t)arg;
+    ai_search.move = hex_mcts_search(&ai, &ai_search.stats);
+    ALLEGRO_EVENT event = {.type = HEXGAME_EVENT_AI_MOVE};
+    event.user.data1 = generation;
+    event.user.data2 = (intptr_t)ai_search.move;
+    al_emit_user_event(&ai_search.done, &event, NULL);
+    return NULL;
+}
+
+/* The opening book named by the CHEX_BOOK environment variable, if there
+   is one, answers before any search is started. */
+static struct hex_book book;
+static bool book_ready;
+
+/* Stops a running search and forgets its move. Called before anything
+   that changes def_grid other than the computer's own move. */
+static void ai_cancel(void) {
+    ai_search.generation++;
+    if (!ai_search.thread)
+        return;
+    hex_mcts_stop(&ai);
+    al_join_thread(ai_search.thread, NULL);
+    al_destroy_thread(ai_search.thread);
+    ai_search.thread = NULL;
+}
+
+/* Starts the search for the computer's move from the current def_grid
+   position, unless one is already running. The search runs on every core
+   for HEXGAME_AI_SECONDS, and keeps what it learnt in a transposition table
+   for its next moves. */
+static void ai_start(struct hexgame *game) {
+    if (ai_search.thread)
+        return;
+    /* the computer may have been on when a larger board was picked */
+    if (def_grid.size > HEXGAME_AI_MAX_SIZE) {
+        game->ai_player = NEUTRAL;
+        return;
+    }
+    size_t move;
+    if (book_ready &&
+        hex_book_lookup(&book, &def_grid, game->current_player, &move,
+                        NULL) &&
+        def_grid.cells[move].color == NEUTRAL) {
+        ALLEGRO_EVENT event = {.type = HEXGAME_EVENT_AI_MOVE};
+        event.user.data1 = ai_search.generation;
+        event.user.data2 = (intptr_t)move;
+        al_emit_user_event(&ai_search.done, &event, NULL);
+        return;
+    }
+    if (ai_ready && ai.root_grid.size != def_grid.size) {
+        hex_mcts_destroy(&ai);
+        ai_ready = false;
+    }
+    if (!ai_ready) {
+        struct hex_mcts_config config;
+        hex_mcts_default_config(&config);
+        config.threads = (unsigned)al_get_cpu_count();
+        config.max_seconds = HEXGAME_AI_SECONDS;
+        /* keys only mean something for one board size */
+        if (ai_tt_ready)
+            hex_tt_clear(&ai_tt);
+        else
+            ai_tt_ready = hex_tt_init(&ai_tt, HEXGAME_TT_MB);
+        if (ai_tt_ready)
+            config.tt = &ai_tt;
+        if (!hex_mcts_init(&ai, &config, def_grid.size)) {
+            game->ai_player = NEUTRAL;
+            return;
+        }
+        ai_ready = true;
+    }
+
+    hex_mcts_set_position(&ai, &def_grid, game->current_player);
+    ai_search.thread =
+        al_create_thread(ai_search_run, (void *)ai_search.generation);
+    if (!ai_search.thread) {
+        game->ai_player = NEUTRAL;
+        return;
+    }
+    al_start_thread(ai_search.thread);
+}
+
+/* Plays the move of the search or the book lookup that just posted
+   `event`, if it is still wanted. */
+static void ai_play(struct hexgame *game, const ALLEGRO_EVENT *event) {
+    if (event->user.data1 != ai_search.generation)
+        return;
+    if (ai_search.thread) {
+        al_join_thread(ai_search.thread, NULL);
+        al_destroy_thread(ai_search.thread);
+        ai_search.thread = NULL;
+
+        const struct hex_mcts_stats *stats = &ai_search.stats;
+        fprintf(stderr,
+                "mcts: %zu playouts in %.2fs (%.0f/s), %zu nodes, value "
+                "%.2f\n",
+                stats->playouts, stats->seconds, stats->playouts_per_second,
+                stats->nodes, stats->value);
+    }
+    size_t move = (size_t)event->user.data2;
+    if (move == (size_t)-1 || game->scene != grid_scene ||
+        game->current_player != game->ai_player)
+        return;
+    open_cell(game, &def_grid, move);
+}
+
+/* Takes back the last move, and the computer's reply to it as well if that
+   would hand the move straight back to the computer. */
+static void take_back(struct hexgame *game) {
+    ai_cancel();
+    size_t i = hex_grid_undo(&def_grid);
+    if (i == (size_t)-1)
+        return;
+    grid_view_touch(i);
+    game->current_player = 1 + (game->current_player % 2);
+    if (game->current_player == game->ai_player &&
+        (i = hex_grid_undo(&def_grid)) != (size_t)-1) {
+        grid_view_touch(i);
+        game->current_player = 1 + (game->current_player % 2);
+    }
+    grid_view_touch(game->hovered_cell);
+    game->winner = NEUTRAL;
+    game->scene = grid_scene;
+    HEXGAME_FLAG_OFF(*game, recorded);
+    analysis_update(game);
 }
 
 struct menu_button {
@@ -348,25 +1024,33 @@ static struct menu_button main_menu[MAIN_MENU_BUTTON_NUM] = {
     {.title = "Start", .hovered = false},
     {.title = "Quit", .hovered = false}};
 
-#define BOARD_SIZE_MENU_BUTTON_NUM 4
+#define BOARD_SIZE_MENU_BUTTON_NUM 6
 static struct menu_button board_size_menu[BOARD_SIZE_MENU_BUTTON_NUM] = {
     {.title = "11x11", .hovered = false},
     {.title = "13x13", .hovered = false},
     {.title = "14x14", .hovered = false},
-    {.title = "19x19", .hovered = false}};
-static size_t board_sizes[BOARD_SIZE_MENU_BUTTON_NUM] = {11, 13, 14, 19};
+    {.title = "19x19", .hovered = false},
+    {.title = "100x100", .hovered = false},
+    {.title = "1000x1000", .hovered = false}};
+static size_t board_sizes[BOARD_SIZE_MENU_BUTTON_NUM] = {11,  13,  14,
+                                                         19, 100, 1000};
 
 #define MENU_BUTTON_WIDTH 250
 #define MENU_BUTTON_HEIGHT 50
-#define MENU_BUTTON_MARGIN 50
-#define Y1_OFFSET(height, buttons_num) \
-    ((height) - ((MENU_BUTTON_MARGIN + MENU_BUTTON_HEIGHT) * (buttons_num + 1)))
+#define MENU_BUTTON_SPACING 50
+/* the spacing shrinks when that many buttons would not fit otherwise */
+#define MENU_BUTTON_MARGIN(height, buttons_num)                   \
+    fmaxf(0.0f, fminf(MENU_BUTTON_SPACING,                         \
+                      (float)(height) / ((buttons_num) + 1) -      \
+                          MENU_BUTTON_HEIGHT))
+#define Y1_OFFSET(height, buttons_num, margin) \
+    ((height) - (((margin) + MENU_BUTTON_HEIGHT) * (buttons_num + 1)))
 
 #define MENU_BUTTON_X1(width) ((width) / 2 - MENU_BUTTON_WIDTH / 2)
-#define MENU_BUTTON_Y1(y1_offset) ((y1_offset) + MENU_BUTTON_MARGIN)
+#define MENU_BUTTON_Y1(y1_offset, margin) ((y1_offset) + (margin))
 #define MENU_BUTTON_X2(width) ((width) / 2 + MENU_BUTTON_WIDTH / 2)
-#define MENU_BUTTON_Y2(y1_offset) \
-    (MENU_BUTTON_Y1(y1_offset) + MENU_BUTTON_HEIGHT)
+#define MENU_BUTTON_Y2(y1_offset, margin) \
+    (MENU_BUTTON_Y1(y1_offset, margin) + MENU_BUTTON_HEIGHT)
 
 static void menu_show(ALLEGRO_DISPLAY *display,
                       ALLEGRO_FONT *font,
@@ -374,23 +1058,30 @@ static void menu_show(ALLEGRO_DISPLAY *display,
                       size_t buttons_num) {
     const size_t width = (size_t)al_get_display_width(display);
     const size_t height = (size_t)al_get_display_height(display);
-    float y1_offset = Y1_OFFSET(height, buttons_num);
+    const float margin = MENU_BUTTON_MARGIN(height, buttons_num);
+    float y1_offset = Y1_OFFSET(height, buttons_num, margin);
+    HEX_TRACE_BEGIN("menu_show");
     for (size_t i = 0; i < buttons_num; i++) {
         if (menu[i].hovered) {
-            al_draw_rectangle(MENU_BUTTON_X1(width), MENU_BUTTON_Y1(y1_offset),
-                              MENU_BUTTON_X2(width), MENU_BUTTON_Y2(y1_offset),
-                              AL_BLUE, 1);
+            al_draw_rectangle(
+                MENU_BUTTON_X1(width), MENU_BUTTON_Y1(y1_offset, margin),
+                MENU_BUTTON_X2(width), MENU_BUTTON_Y2(y1_offset, margin),
+                AL_BLUE, 1);
         } else {
-            al_draw_rectangle(MENU_BUTTON_X1(width), MENU_BUTTON_Y1(y1_offset),
-                              MENU_BUTTON_X2(width), MENU_BUTTON_Y2(y1_offset),
-                              AL_BLACK, 1);
+            al_draw_rectangle(
+                MENU_BUTTON_X1(width), MENU_BUTTON_Y1(y1_offset, margin),
+                MENU_BUTTON_X2(width), MENU_BUTTON_Y2(y1_offset, margin),
+                AL_BLACK, 1);
         }
 
         al_draw_text(font, AL_BLACK, width / 2,
-                     MENU_BUTTON_Y1(y1_offset) + 12.5f, ALLEGRO_ALIGN_CENTRE,
-                     menu[i].title);
-        y1_offset = MENU_BUTTON_Y2(y1_offset);
+                     MENU_BUTTON_Y1(y1_offset, margin) + 12.5f,
+                     ALLEGRO_ALIGN_CENTRE, menu[i].title);
+        HEX_TRACE_DRAW_CALL();
+        HEX_TRACE_DRAW_CALL(); // and the rectangle
+        y1_offset = MENU_BUTTON_Y2(y1_offset, margin);
     }
+    HEX_TRACE_END();
 }
 
 static size_t get_menu_button_index_from_mouse_coordinates(
@@ -402,13 +1093,14 @@ static size_t get_menu_button_index_from_mouse_coordinates(
     if ((size_t)x < MENU_BUTTON_X1(width) || (size_t)x > MENU_BUTTON_X2(width))
         return (size_t)-1;
     const size_t height = (size_t)al_get_display_height(display);
-    float y1_offset = Y1_OFFSET(height, buttons_num);
+    const float margin = MENU_BUTTON_MARGIN(height, buttons_num);
+    float y1_offset = Y1_OFFSET(height, buttons_num, margin);
 
     for (size_t i = 0; i < buttons_num; i++) {
-        if ((size_t)y >= MENU_BUTTON_Y1(y1_offset) &&
-            (size_t)y <= MENU_BUTTON_Y2(y1_offset))
+        if ((size_t)y >= MENU_BUTTON_Y1(y1_offset, margin) &&
+            (size_t)y <= MENU_BUTTON_Y2(y1_offset, margin))
             return i;
-        y1_offset = MENU_BUTTON_Y2(y1_offset);
+        y1_offset = MENU_BUTTON_Y2(y1_offset, margin);
     }
     return (size_t)-1;
 }
@@ -445,6 +1137,61 @@ static void menu_button_hovered(struct menu_button *menu,
     }
 }
 
+/* Build with -DHEXGAME_REDRAW_TIMER to redraw on a fixed 30 Hz tick instead
+   of only when something changed. */
+static void request_redraw(struct hexgame *game, double timestamp) {
+    if (game->input_time == 0.0)
+        game->input_time = timestamp;
+#if !defined(HEXGAME_REDRAW_TIMER)
+    HEXGAME_FLAG_ON(*game, redraw);
+#endif
+}
+
+/* Time from an event to the flip that first shows its effect, printed to
+   stderr when toggled on with the L key. */
+static struct latency_stats {
+    bool enabled;
+    size_t count;
+    double total;
+    double max;
+} latency;
+
+static void latency_record(double input_time) {
+    const double seconds = al_get_time() - input_time;
+    latency.count++;
+    latency.total += seconds;
+    if (seconds > latency.max)
+        latency.max = seconds;
+    fprintf(stderr, "latency: %.2f ms (mean %.2f ms, max %.2f ms, n %zu)\n",
+            seconds * 1e3, latency.total / latency.count * 1e3,
+            latency.max * 1e3, latency.count);
+}
+
+#if defined(HEX_TRACE)
+/* Build with -DHEX_TRACE to time the main loop: CHEX_TRACE=trace.json
+   writes the timeline out at exit, and T shows the frame times on screen. */
+static const char *trace_path;
+static bool trace_overlay;
+
+static void trace_write(void) {
+    if (!hex_trace_write(trace_path))
+        fprintf(stderr, "chex-game: cannot write the trace to %s\n",
+                trace_path);
+    else if (hex_trace_dropped())
+        fprintf(stderr, "chex-game: the trace is full, %zu events dropped\n",
+                hex_trace_dropped());
+}
+
+static void trace_overlay_show(ALLEGRO_FONT *font) {
+    struct hex_trace_frame_stats stats;
+    hex_trace_frame_stats(&stats);
+    al_draw_filled_rectangle(0, 0, 420, 20, al_map_rgba(0, 0, 0, 160));
+    al_draw_textf(font, AL_WHITE, 4, 2, 0,
+                  "%.2f ms p50 %.2f p99 %.2f, %zu draws", stats.last_ms,
+                  stats.p50_ms, stats.p99_ms, stats.draw_calls);
+}
+#endif
+
 static void hexgame_init(struct hexgame *game) {
     memset(game, 0, sizeof(struct hexgame));
     HEXGAME_FLAG_ON(*game, redraw);
@@ -453,6 +1200,8 @@ static void hexgame_init(struct hexgame *game) {
     game->user_chosen_board_size = 11;
 }
 
+#define HEXGAME_EVENT_AI_TURN ALLEGRO_GET_EVENT_TYPE('C', 'H', 'E', 'X')
+
 int main(void) {
     al_init();
     al_init_primitives_addon();
@@ -462,8 +1211,10 @@ int main(void) {
     al_init_ttf_addon();
     al_init_image_addon();
 
+    /* nothing is redrawn unless asked to, so uncovering the window has to
+       ask */
+    al_set_new_display_flags(ALLEGRO_GENERATE_EXPOSE_EVENTS);
     ALLEGRO_DISPLAY *display = al_create_display(600, 500);
-    ALLEGRO_TIMER *timer = al_create_timer(1.0 / 30.0);
     ALLEGRO_EVENT_QUEUE *queue = al_create_event_queue();
     ALLEGRO_FONT *font = al_load_ttf_font("VCR_OSD_MONO_1.001.ttf", 16, 0);
     if (!font) {
@@ -478,21 +1229,66 @@ int main(void) {
         al_set_display_icon(display, icon);
     }
 
+    /* the computer's turn is an event too, so that it waits for the
+       opponent's last stone to be on screen */
+    ALLEGRO_EVENT_SOURCE ai_turn;
+    al_init_user_event_source(&ai_turn);
+    al_init_user_event_source(&ai_search.done);
+
     al_register_event_source(queue, al_get_keyboard_event_source());
     al_register_event_source(queue, al_get_display_event_source(display));
-    al_register_event_source(queue, al_get_timer_event_source(timer));
     al_register_event_source(queue, al_get_mouse_event_source());
+    al_register_event_source(queue, &ai_turn);
+    al_register_event_source(queue, &ai_search.done);
+    ALLEGRO_TIMER *analysis_timer = al_create_timer(HEXGAME_ANALYSIS_POLL);
+    al_register_event_source(queue,
+                             al_get_timer_event_source(analysis_timer));
+#if defined(HEXGAME_REDRAW_TIMER)
+    ALLEGRO_TIMER *timer = al_create_timer(1.0 / 30.0);
+    al_register_event_source(queue, al_get_timer_event_source(timer));
+#endif
     ALLEGRO_EVENT event;
 
     struct hexgame game;
     hexgame_init(&game);
 
+    const char *record_path = getenv("CHEX_RECORD");
+    if (record_path) {
+        recording = hex_record_writer_open(&recorder, record_path);
+        if (recording)
+            atexit(recorder_close);
+        else
+            fprintf(stderr, "chex-game: cannot record to %s\n", record_path);
+    }
+
+    const char *book_path = getenv("CHEX_BOOK");
+    if (book_path) {
+        book_ready = hex_book_open(&book, book_path);
+        if (!book_ready)
+            fprintf(stderr, "chex-game: %s is not an opening book\n",
+                    book_path);
+    }
+
+#if defined(HEX_TRACE)
+    trace_path = getenv("CHEX_TRACE");
+    if (trace_path)
+        atexit(trace_write);
+#endif
+
+#if defined(HEXGAME_REDRAW_TIMER)
     al_start_timer(timer);
+#endif
 
     while (1) {
         al_wait_for_event(queue, &event);
-
-        if (event.type == ALLEGRO_EVENT_TIMER) {
+        HEX_TRACE_BEGIN("event");
+
+        if (event.type == ALLEGRO_EVENT_TIMER &&
+            event.timer.source == analysis_timer) {
+            /* new estimates are not input, so this is not latency */
+            if (analysis_poll())
+                HEXGAME_FLAG_ON(game, redraw);
+        } else if (event.type == ALLEGRO_EVENT_TIMER) {
             HEXGAME_FLAG_ON(game, redraw);
         } else if ((event.type == ALLEGRO_EVENT_KEY_DOWN &&
                     event.keyboard.keycode == ALLEGRO_KEY_ESCAPE) ||
@@ -503,50 +1299,153 @@ int main(void) {
             HEXGAME_FLIP_FLAG(game, fullscreen);
             al_set_display_flag(display, ALLEGRO_FULLSCREEN_WINDOW,
                                 game.fullscreen);
+            if (def_grid.cells)
+                view_clamp(&game.view, display, &def_grid);
+            grid_view_invalidate();
+            request_redraw(&game, event.any.timestamp);
+        } else if (event.type == ALLEGRO_EVENT_DISPLAY_RESIZE) {
+            al_acknowledge_resize(display);
+            if (def_grid.cells)
+                view_clamp(&game.view, display, &def_grid);
+            grid_view_invalidate();
+            request_redraw(&game, event.any.timestamp);
+        } else if (event.type == ALLEGRO_EVENT_KEY_DOWN &&
+                   (game.scene == grid_scene || game.scene == result_scene) &&
+                   view_key(&game.view, display, &def_grid,
+                            event.keyboard.keycode)) {
+            grid_view_invalidate();
+            request_redraw(&game, event.any.timestamp);
+        } else if (event.type == ALLEGRO_EVENT_DISPLAY_EXPOSE ||
+                   event.type == ALLEGRO_EVENT_DISPLAY_SWITCH_IN) {
+            request_redraw(&game, event.any.timestamp);
+        } else if (event.type == ALLEGRO_EVENT_KEY_DOWN &&
+                   event.keyboard.keycode == ALLEGRO_KEY_H &&
+                   (game.scene == grid_scene || game.scene == result_scene)) {
+            analysis.enabled = !analysis.enabled;
+            if (analysis.enabled) {
+                analysis_update(&game);
+                al_start_timer(analysis_timer);
+            } else {
+                al_stop_timer(analysis_timer);
+                if (analysis.ready)
+                    hex_analysis_stop(&analysis.engine);
+                analysis_clear();
+            }
+            request_redraw(&game, event.any.timestamp);
+        } else if (event.type == ALLEGRO_EVENT_KEY_DOWN &&
+                   event.keyboard.keycode == ALLEGRO_KEY_L) {
+            latency.enabled = !latency.enabled;
+#if defined(HEX_TRACE)
+        } else if (event.type == ALLEGRO_EVENT_KEY_DOWN &&
+                   event.keyboard.keycode == ALLEGRO_KEY_T) {
+            trace_overlay = !trace_overlay;
+            request_redraw(&game, event.any.timestamp);
+#endif
         } else if (event.type == ALLEGRO_EVENT_KEY_DOWN &&
                    event.keyboard.keycode == ALLEGRO_KEY_R &&
                    (game.scene == grid_scene || game.scene == result_scene)) {
+            ai_cancel();
             HEXGAME_FLAG_ON(game, reset);
             game.scene = grid_scene;
+            request_redraw(&game, event.any.timestamp);
+        } else if (event.type == ALLEGRO_EVENT_KEY_DOWN &&
+                   event.keyboard.keycode == ALLEGRO_KEY_U &&
+                   (game.scene == grid_scene || game.scene == result_scene)) {
+            take_back(&game);
+            request_redraw(&game, event.any.timestamp);
+        } else if (event.type == ALLEGRO_EVENT_KEY_DOWN &&
+                   event.keyboard.keycode == ALLEGRO_KEY_P &&
+                   (game.scene == grid_scene || game.scene == result_scene)) {
+            print_position();
+        } else if (event.type == ALLEGRO_EVENT_KEY_DOWN &&
+                   event.keyboard.keycode == ALLEGRO_KEY_A &&
+                   game.scene == grid_scene) {
+            /* the computer takes over the side to move, or gives it back */
+            if (game.ai_player != NEUTRAL) {
+                ai_cancel();
+                game.ai_player = NEUTRAL;
+            } else if (def_grid.size <= HEXGAME_AI_MAX_SIZE) {
+                game.ai_player = game.current_player;
+            } else {
+                fprintf(stderr,
+                        "chex-game: the computer plays boards of up to "
+                        "%dx%d\n",
+                        HEXGAME_AI_MAX_SIZE, HEXGAME_AI_MAX_SIZE);
+            }
+            request_redraw(&game, event.any.timestamp);
         } else if (event.type == ALLEGRO_EVENT_KEY_DOWN &&
                    event.keyboard.keycode == ALLEGRO_KEY_M) {
+            ai_cancel();
+            record_game(&game);
             game.scene = main_menu_scene;
+            analysis_update(&game);
             menu_reset(main_menu, MAIN_MENU_BUTTON_NUM);
-
+            request_redraw(&game, event.any.timestamp);
+        } else if (event.type == HEXGAME_EVENT_AI_TURN) {
+            if (game.scene == grid_scene &&
+                game.current_player == game.ai_player)
+                ai_start(&game);
+        } else if (event.type == HEXGAME_EVENT_AI_MOVE) {
+            ai_play(&game, &event);
+            /* the thinking time is not latency */
+            request_redraw(&game, al_get_time());
         } else if (event.type == ALLEGRO_EVENT_MOUSE_AXES) {
             if (game.scene == main_menu_scene) {
                 size_t i = get_menu_button_index_from_mouse_coordinates(
                     display, MAIN_MENU_BUTTON_NUM, event.mouse.x,
                     event.mouse.y);
                 if (i != (size_t)-1) {
+                    if (!main_menu[i].hovered)
+                        request_redraw(&game, event.any.timestamp);
                     menu_button_hovered(main_menu, MAIN_MENU_BUTTON_NUM, i);
                     game.hovered_button = i;
-                } else {
+                } else if (main_menu[game.hovered_button].hovered) {
                     main_menu[game.hovered_button].hovered = false;
+                    request_redraw(&game, event.any.timestamp);
                 }
             } else if (game.scene == board_size_menu_scene) {
                 size_t i = get_menu_button_index_from_mouse_coordinates(
                     display, BOARD_SIZE_MENU_BUTTON_NUM, event.mouse.x,
                     event.mouse.y);
                 if (i != (size_t)-1) {
+                    if (!board_size_menu[i].hovered)
+                        request_redraw(&game, event.any.timestamp);
                     menu_button_hovered(board_size_menu,
                                         BOARD_SIZE_MENU_BUTTON_NUM, i);
                     game.hovered_button = i;
-                } else {
+                } else if (board_size_menu[game.hovered_button].hovered) {
                     board_size_menu[game.hovered_button].hovered = false;
+                    request_redraw(&game, event.any.timestamp);
+                }
+            } else if (game.scene == grid_scene ||
+                       game.scene == result_scene) {
+                /* the wheel zooms about the pointer, the right button drags
+                   the board */
+                if (event.mouse.dz != 0 || game.panning) {
+                    if (event.mouse.dz != 0)
+                        view_zoom(&game.view, display, &def_grid,
+                                  powf(VIEW_ZOOM_STEP, (float)event.mouse.dz),
+                                  event.mouse.x, event.mouse.y);
+                    if (game.panning)
+                        view_pan(&game.view, display, &def_grid,
+                                 event.mouse.dx, event.mouse.dy);
+                    grid_view_invalidate();
+                    request_redraw(&game, event.any.timestamp);
                 }
-            } else if (game.scene == grid_scene) {
                 size_t i = get_cell_index_from_mouse_coordinates(
-                    display, &def_grid, event.mouse.x, event.mouse.y);
-                if (i != (size_t)-1) {
+                    display, &game.view, &def_grid, event.mouse.x,
+                    event.mouse.y);
+                if (game.scene == grid_scene && i != game.hovered_cell) {
                     if (game.hovered_cell != (size_t)-1) {
                         def_grid.cells[game.hovered_cell].hovered = false;
                     }
-                    def_grid.cells[i].hovered = true;
+                    if (i != (size_t)-1) {
+                        def_grid.cells[i].hovered = true;
+                    }
+                    grid_view_touch(game.hovered_cell);
+                    grid_view_touch(i);
                     game.hovered_cell = i;
-                } else {
-                    def_grid.cells[game.hovered_cell].hovered = false;
-                    game.hovered_cell = (size_t)-1;
+                    request_redraw(&game, event.any.timestamp);
                 }
             }
         }
@@ -559,6 +1458,7 @@ int main(void) {
                     event.mouse.y);
                 if (i != (size_t)-1) {
                     main_menu_button_clicked(&game, i);
+                    request_redraw(&game, event.any.timestamp);
                 }
             } else if (game.scene == board_size_menu_scene) {
                 size_t i = get_menu_button_index_from_mouse_coordinates(
@@ -566,28 +1466,42 @@ int main(void) {
                     event.mouse.y);
                 if (i != (size_t)-1) {
                     board_size_menu_button_clicked(&game, i);
+                    request_redraw(&game, event.any.timestamp);
                 }
             } else if (game.scene == grid_scene) {
                 size_t i = get_cell_index_from_mouse_coordinates(
-                    display, &def_grid, event.mouse.x, event.mouse.y);
-                if (i != (size_t)-1) {
+                    display, &game.view, &def_grid, event.mouse.x,
+                    event.mouse.y);
+                if (i != (size_t)-1 && game.current_player != game.ai_player) {
                     open_cell(&game, &def_grid, i);
-                    game.winner = get_winner(&def_grid);
-                    if (game.winner != NEUTRAL) {
-                        game.scene = result_scene;
-                    }
+                    request_redraw(&game, event.any.timestamp);
                 }
             }
+        } else if (event.type == ALLEGRO_EVENT_MOUSE_BUTTON_DOWN &&
+                   event.mouse.button == 2 &&
+                   (game.scene == grid_scene || game.scene == result_scene)) {
+            HEXGAME_FLAG_ON(game, panning);
+        } else if (event.type == ALLEGRO_EVENT_MOUSE_BUTTON_UP &&
+                   event.mouse.button == 2) {
+            HEXGAME_FLAG_OFF(game, panning);
         }
+        HEX_TRACE_END();
 
         if (game.redraw && al_is_event_queue_empty(queue)) {
+#if defined(HEX_TRACE)
+            const double frame_start = al_get_time();
+#endif
             if (game.reset) {
-                def_grid.size = game.user_chosen_board_size;
-                hex_def_grid_init();
+                ai_cancel();
+                record_game(&game);
+                hex_def_grid_init(game.user_chosen_board_size);
+                view_reset(&game.view, display, &def_grid);
+                grid_view_invalidate();
                 game.winner = NEUTRAL;
                 game.current_player = HEXGAME_FIRST_PLAYER;
                 HEXGAME_FLAG_OFF(game, reset);
                 game.hovered_cell = (size_t)-1;
+                analysis_update(&game);
             }
 
             al_clear_to_color(AL_WHITE);
@@ -604,10 +1518,36 @@ int main(void) {
                 }
             }
 
+#if defined(HEX_TRACE)
+            if (trace_overlay)
+                trace_overlay_show(font);
+#endif
+            HEX_TRACE_BEGIN("al_flip_display");
             al_flip_display();
+            HEX_TRACE_END();
+            HEX_TRACE_FRAME(al_get_time() - frame_start);
             HEXGAME_FLAG_OFF(game, redraw);
+            if (game.input_time != 0.0) {
+                if (latency.enabled)
+                    latency_record(game.input_time);
+                game.input_time = 0.0;
+            }
+
+            if (game.scene == grid_scene &&
+                game.current_player == game.ai_player) {
+                ALLEGRO_EVENT turn = {.type = HEXGAME_EVENT_AI_TURN};
+                al_emit_user_event(&ai_turn, &turn, NULL);
+            }
         }
     }
 
+    /* Escape leaves in the middle of the event span */
+    HEX_TRACE_END();
+    ai_cancel();
+    if (analysis.ready)
+        hex_analysis_destroy(&analysis.engine);
+    record_game(&game);
+    if (book_ready)
+        hex_book_close(&book);
     return 0;
 }
@@ -0,0 +1,223 @@
+#include <assert.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hex-grid.h"
+
+typedef uint32_t neighbors[6];
+
+static _Atomic(const neighbors *) shared_tables[HEX_GRID_SHARED_TABLES + 1];
+
+static neighbors *build_neighbors(size_t size) {
+    const size_t cells = size * size;
+    const uint32_t top = (uint32_t)cells, bottom = top + 1;
+    const uint32_t left = top + 2, right = top + 3;
+    neighbors *table = malloc(cells * sizeof(neighbors));
+    if (!table)
+        return NULL;
+    for (size_t i = 0; i < cells; i++) {
+        const size_t x = i % size, y = i / size;
+        uint32_t *n = table[i];
+        n[0] = y != 0 ? (uint32_t)(i - size) : top;
+        n[1] = y != 0 ? (x != size - 1 ? (uint32_t)(i - size + 1) : right)
+                      : top;
+        n[2] = x != size - 1 ? (uint32_t)(i + 1) : right;
+        n[3] = y != size - 1 ? (uint32_t)(i + size) : bottom;
+        n[4] = y != size - 1 ? (x != 0 ? (uint32_t)(i + size - 1) : left)
+                             : bottom;
+        n[5] = x != 0 ? (uint32_t)(i - 1) : left;
+    }
+    return table;
+}
+
+/* The shared table of `size`, built by whichever grid needs it first. */
+static const neighbors *neighbor_table(size_t size) {
+    if (size > HEX_GRID_SHARED_TABLES)
+        return build_neighbors(size);
+    const neighbors *table =
+        atomic_load_explicit(&shared_tables[size], memory_order_acquire);
+    if (table)
+        return table;
+    neighbors *fresh = build_neighbors(size);
+    if (fresh &&
+        !atomic_compare_exchange_strong_explicit(
+            &shared_tables[size], &table, (const neighbors *)fresh,
+            memory_order_acq_rel, memory_order_acquire)) {
+        free(fresh); // another thread got there first
+        return table;
+    }
+    return fresh;
+}
+
+const uint32_t (*hex_grid_neighbor_table(size_t size))[6] {
+    return size <= HEX_GRID_SHARED_TABLES ? neighbor_table(size) : NULL;
+}
+
+int hex_grid_init(hex_grid *g, size_t size, enum hex_grid_backend backend) {
+    memset(g, 0, sizeof(*g));
+    /* before the neighbour table, which is size * size rows past the
+       shared ones */
+    if (size < 1 || size > WQU_MAX_NODES / size ||
+        size * size + 4 > WQU_MAX_NODES)
+        return 0;
+    g->size = size;
+    g->backend = backend;
+    g->cells = calloc(size * size + 4, sizeof(struct hexgrid_cell));
+    g->neighbors = neighbor_table(size);
+    g->moves = malloc(size * size * sizeof(size_t));
+    if (backend == HEX_GRID_UNDOABLE_UNION_FIND)
+        g->checkpoints = malloc(size * size * sizeof(size_t));
+    int ok = g->cells && g->neighbors && g->moves &&
+             (g->checkpoints || backend != HEX_GRID_UNDOABLE_UNION_FIND);
+    if (ok && backend == HEX_GRID_BITBOARD)
+        ok = hex_bitboard_init(&g->bitboard, size);
+    else if (ok && backend == HEX_GRID_UNDOABLE_UNION_FIND)
+        ok = w_quickunion_init_undoable(&g->disjoint_set, size * size + 4);
+    else if (ok)
+        ok = w_quickunion_init(&g->disjoint_set, size * size + 4);
+    if (ok) {
+        struct hexgrid_cell *edges = g->cells + size * size;
+        edges[0].color = edges[1].color = RED;
+        edges[2].color = edges[3].color = BLUE;
+    } else {
+        free(g->cells);
+        if (size > HEX_GRID_SHARED_TABLES)
+            free((void *)g->neighbors);
+        free(g->moves);
+        free(g->checkpoints);
+        g->cells = NULL;
+    }
+    return ok;
+}
+
+void hex_grid_destroy(hex_grid *g) {
+    if (g->backend == HEX_GRID_BITBOARD)
+        hex_bitboard_destroy(&g->bitboard);
+    else
+        w_quickunion_destroy(&g->disjoint_set);
+    free(g->cells);
+    if (g->size > HEX_GRID_SHARED_TABLES)
+        free((void *)g->neighbors);
+    free(g->moves);
+    free(g->checkpoints);
+    g->cells = NULL;
+}
+
+void hex_grid_clear(hex_grid *g) {
+    if (g->backend == HEX_GRID_BITBOARD) {
+        hex_bitboard_clear(&g->bitboard);
+    } else {
+        w_quickunion_reset(&g->disjoint_set);
+    }
+    memset(g->cells, 0, sizeof(struct hexgrid_cell) * g->size * g->size);
+    g->move_count = 0;
+    g->hash = 0;
+}
+
+void hex_grid_copy(hex_grid *dst, const hex_grid *src) {
+    assert(dst->size == src->size);
+    const size_t cells = src->size * src->size;
+
+    if (dst->backend != src->backend) {
+        hex_grid_clear(dst);
+        for (size_t i = 0; i < cells; i++) {
+            if (src->cells[i].color != NEUTRAL)
+                hex_grid_open_cell(dst, i, src->cells[i].color);
+        }
+        return;
+    }
+
+    memcpy(dst->cells, src->cells, cells * sizeof(struct hexgrid_cell));
+    memcpy(dst->moves, src->moves, src->move_count * sizeof(size_t));
+    if (src->checkpoints) {
+        memcpy(dst->checkpoints, src->checkpoints,
+               src->move_count * sizeof(size_t));
+    }
+    dst->move_count = src->move_count;
+    dst->hash = src->hash;
+    if (src->backend == HEX_GRID_BITBOARD) {
+        for (size_t p = 0; p < 2; p++) {
+            memcpy(dst->bitboard.planes[p], src->bitboard.planes[p],
+                   src->bitboard.words * sizeof(uint64_t));
+        }
+    } else {
+        w_quickunion_copy(&dst->disjoint_set, &src->disjoint_set);
+    }
+}
+
+/* Joins the stone on i to its neighbours of the same colour, the virtual
+   edge cells included. */
+static void union_neighbors(hex_grid *g, size_t i, cell_color player) {
+    const uint32_t *n = g->neighbors[i];
+    for (unsigned k = 0; k < 6; k++) {
+        if (g->cells[n[k]].color == player)
+            w_quickunion_union(&g->disjoint_set, n[k], i);
+    }
+}
+
+bool hex_grid_open_cell(hex_grid *g, size_t i, cell_color player) {
+    assert(i < g->size * g->size);
+
+    if (g->cells[i].color != NEUTRAL) {
+        return false;
+    }
+    g->cells[i].color = player;
+    if (g->checkpoints) {
+        g->checkpoints[g->move_count] =
+            w_quickunion_checkpoint(&g->disjoint_set);
+    }
+    g->moves[g->move_count++] = i;
+    g->hash ^= hex_grid_zobrist(i, player);
+
+    if (g->backend == HEX_GRID_BITBOARD) {
+        hex_bitboard_set(&g->bitboard,
+                         player == RED ? HEX_BITBOARD_RED : HEX_BITBOARD_BLUE,
+                         i);
+    } else {
+        union_neighbors(g, i, player);
+    }
+    return true;
+}
+
+size_t hex_grid_undo(hex_grid *g) {
+    if (g->move_count == 0)
+        return (size_t)-1;
+
+    size_t i = g->moves[--g->move_count];
+    cell_color player = g->cells[i].color;
+    g->cells[i].color = NEUTRAL;
+    g->hash ^= hex_grid_zobrist(i, player);
+
+    if (g->backend == HEX_GRID_BITBOARD) {
+        hex_bitboard_unset(&g->bitboard,
+                           player == RED ? HEX_BITBOARD_RED : HEX_BITBOARD_BLUE,
+                           i);
+    } else if (g->backend == HEX_GRID_UNDOABLE_UNION_FIND) {
+        w_quickunion_rollback(&g->disjoint_set,
+                              g->checkpoints[g->move_count]);
+    } else {
+        w_quickunion_reset(&g->disjoint_set);
+        for (size_t k = 0; k < g->move_count; k++)
+            union_neighbors(g, g->moves[k], g->cells[g->moves[k]].color);
+    }
+    return i;
+}
+
+cell_color hex_grid_get_winner(hex_grid *g) {
+    if (g->backend == HEX_GRID_BITBOARD) {
+        if (hex_bitboard_is_connected(&g->bitboard, HEX_BITBOARD_RED))
+            return RED;
+        if (hex_bitboard_is_connected(&g->bitboard, HEX_BITBOARD_BLUE))
+            return BLUE;
+        return NEUTRAL;
+    }
+
+    size_t red_idx = RED_VIRTUAL_CELLS_START(g);
+    if (w_quickunion_is_connected(&g->disjoint_set, red_idx, red_idx + 1))
+        return RED;
+    size_t blue_idx = BLUE_VIRTUAL_CELLS_START(g);
+    if (w_quickunion_is_connected(&g->disjoint_set, blue_idx, blue_idx + 1))
+        return BLUE;
+    return NEUTRAL;
+}
@@ -0,0 +1,103 @@
+#if !defined(HEX_GRID_H)
+#define HEX_GRID_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "hex-bitboard.h"
+#include "hex-random.h"
+#include "weighted-quick-union.h"
+
+typedef enum cell_color { NEUTRAL = 0, RED = 1, BLUE = 2 } cell_color;
+
+struct hexgrid_cell {
+    cell_color color;
+    bool hovered;
+};
+
+/* How connections between stones are tracked: incrementally with the
+   union-find (cheap per move), or recomputed from packed bitsets when the
+   winner is asked for (cheap to store and copy). The undoable union-find
+   takes moves back in O(1) each; the compressing one has to replay the
+   game. */
+enum hex_grid_backend {
+    HEX_GRID_UNION_FIND = 0,
+    HEX_GRID_BITBOARD,
+    HEX_GRID_UNDOABLE_UNION_FIND
+};
+
+/* Boards up to this size share one neighbour table per size; larger ones,
+   which only people play on, get their own. */
+#define HEX_GRID_SHARED_TABLES 128
+
+typedef struct hex_grid {
+    struct wqu_uf disjoint_set;
+    struct hex_bitboard bitboard;
+    /* size * size cells, then the four virtual cells, which always hold the
+       colour of their edge */
+    struct hexgrid_cell *cells;
+    /* The six neighbours of each cell, clockwise from the one above, with
+       the virtual cell of the edge wherever the board ends: moves look at
+       all six with no bounds checks. */
+    const uint32_t (*neighbors)[6];
+    size_t *moves;       // cells in the order they were opened
+    size_t *checkpoints; // undoable union-find state before each move
+    size_t move_count;
+    size_t size;
+    uint64_t hash; // XOR of the Zobrist keys of every stone on the board
+    enum hex_grid_backend backend;
+} hex_grid;
+
+/* top and bottom, then left and right */
+#define RED_VIRTUAL_CELLS_START(g) ((g)->size * (g)->size)
+#define BLUE_VIRTUAL_CELLS_START(g) (RED_VIRTUAL_CELLS_START((g)) + 2)
+
+/* Zobrist key of a stone of `player` on cell i. The keys are splitmix64
+   outputs of (i, player), which is a bijection, so they never collide and no
+   key table has to be allocated or shared between threads. */
+static inline uint64_t hex_grid_zobrist(size_t i, cell_color player) {
+    struct hex_rng rng = {(uint64_t)i * 2 + (player == BLUE)};
+    return hex_rng_next(&rng);
+}
+
+/* Hash of the position with `to_move` to play, for transposition tables. */
+static inline uint64_t hex_grid_key(const hex_grid *g, cell_color to_move) {
+    return to_move == BLUE ? ~g->hash : g->hash;
+}
+
+/* Key of the position after `player` opens cell i, without opening it. */
+static inline uint64_t hex_grid_child_key(const hex_grid *g,
+                                          size_t i,
+                                          cell_color player) {
+    uint64_t hash = g->hash ^ hex_grid_zobrist(i, player);
+    return player == RED ? ~hash : hash;
+}
+
+/* The neighbour table hex_grid uses for `size`, for code that keeps boards
+   of its own. NULL above HEX_GRID_SHARED_TABLES or if memory runs out. */
+const uint32_t (*hex_grid_neighbor_table(size_t size))[6];
+
+/* Allocates an empty grid on the heap. Returns 0 on failure. */
+int hex_grid_init(hex_grid *g, size_t size, enum hex_grid_backend backend);
+
+void hex_grid_destroy(hex_grid *g);
+
+void hex_grid_clear(hex_grid *g);
+
+/* Copies the position of src into dst, which must have the same size. Grids
+   with the same backend are copied with a few memcpy()s, so a search can keep
+   one scratch grid per thread and reset it from the root position. */
+void hex_grid_copy(hex_grid *dst, const hex_grid *src);
+
+/* Places a stone of `player` on cell i. Returns false if the cell is already
+   taken. */
+bool hex_grid_open_cell(hex_grid *g, size_t i, cell_color player);
+
+/* Takes back the last move and returns its cell, or (size_t)-1 if there
+   are no moves. */
+size_t hex_grid_undo(hex_grid *g);
+
+cell_color hex_grid_get_winner(hex_grid *g);
+
+#endif /* HEX_GRID_H */
@@ -0,0 +1,325 @@
+#include <ctype.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hex-clock.h"
+#include "hex-htp.h"
+
+#define MAX_ARGS 8
+
+static const char *commands[] = {
+    "protocol_version", "name",      "version",       "known_command",
+    "list_commands",    "quit",      "boardsize",     "clear_board",
+    "play",             "genmove",   "undo",          "showboard",
+    "time_settings",    "time_left", NULL};
+
+static cell_color other(cell_color player) {
+    return 1 + (player % 2);
+}
+
+void hex_htp_default_config(struct hex_htp_config *config) {
+    config->threads = 1;
+    config->move_seconds = 1.0;
+    config->max_playouts = 0;
+    config->tt_megabytes = 64;
+    config->ponder = true;
+}
+
+/* Gives the engine an empty board of the given size. */
+static int set_size(struct hex_htp *h, size_t size) {
+    hex_grid grid;
+    struct hex_mcts mcts;
+    struct hex_mcts_config config;
+    hex_mcts_default_config(&config);
+    config.threads = h->config.threads;
+    config.tt = h->tt_ready ? &h->tt : NULL;
+    if (!hex_grid_init(&grid, size, HEX_GRID_UNDOABLE_UNION_FIND))
+        return 0;
+    if (!hex_mcts_init(&mcts, &config, size)) {
+        hex_grid_destroy(&grid);
+        return 0;
+    }
+    if (h->grid.cells) {
+        hex_mcts_destroy(&h->mcts);
+        hex_grid_destroy(&h->grid);
+    }
+    h->grid = grid;
+    h->mcts = mcts;
+    /* keys only mean something for one board size */
+    if (h->tt_ready)
+        hex_tt_clear(&h->tt);
+    return 1;
+}
+
+int hex_htp_init(struct hex_htp *h, const struct hex_htp_config *config) {
+    memset(h, 0, sizeof(*h));
+    h->config = *config;
+    h->tt_ready = hex_tt_init(&h->tt, config->tt_megabytes);
+    if (!set_size(h, 11)) {
+        if (h->tt_ready)
+            hex_tt_destroy(&h->tt);
+        return 0;
+    }
+    return 1;
+}
+
+static void ponder_stop(struct hex_htp *h) {
+    if (!h->pondering)
+        return;
+    hex_mcts_stop(&h->mcts);
+    pthread_join(h->ponder_thread, NULL);
+    h->pondering = false;
+}
+
+void hex_htp_destroy(struct hex_htp *h) {
+    ponder_stop(h);
+    hex_mcts_destroy(&h->mcts);
+    hex_grid_destroy(&h->grid);
+    if (h->tt_ready)
+        hex_tt_destroy(&h->tt);
+}
+
+static void *ponder_run(void *arg) {
+    struct hex_htp *h = arg;
+    hex_mcts_search(&h->mcts, NULL);
+    return NULL;
+}
+
+/* Searches the position with `to_move` to play until the next command.
+   Whatever it finds goes to the table when it is stopped. */
+static void ponder_start(struct hex_htp *h, cell_color to_move) {
+    if (!h->config.ponder || hex_grid_get_winner(&h->grid) != NEUTRAL)
+        return;
+    h->mcts.config.max_seconds = 0;
+    h->mcts.config.max_playouts = 0;
+    hex_mcts_set_position(&h->mcts, &h->grid, to_move);
+    h->pondering =
+        pthread_create(&h->ponder_thread, NULL, ponder_run, h) == 0;
+}
+
+static bool timed(const struct hex_htp *h) {
+    return h->main_time > 0 || h->byoyomi_time > 0;
+}
+
+/* Seconds for the next move of `player`: what is left of the byo-yomi
+   period over its stones, or of the main time over the moves they could
+   still have to make, less a margin for the manager. */
+static double move_budget(const struct hex_htp *h, cell_color player) {
+    if (!timed(h))
+        return h->config.move_seconds;
+    const size_t cells = h->grid.size * h->grid.size;
+    const size_t empty = cells - h->grid.move_count;
+    double budget = h->stones_left[player]
+                        ? h->time_left[player] / h->stones_left[player]
+                        : h->time_left[player] / (double)(empty / 2 + 1);
+    budget = budget * 0.9 - 0.05;
+    return budget > 0.01 ? budget : 0.01;
+}
+
+/* Keeps the clock of `player` for managers that do not send time_left. */
+static void clock_spend(struct hex_htp *h, cell_color player, double seconds) {
+    if (!timed(h))
+        return;
+    h->time_left[player] -= seconds;
+    if (h->stones_left[player] ? --h->stones_left[player] == 0
+                               : h->time_left[player] <= 0) {
+        h->time_left[player] = h->byoyomi_time;
+        h->stones_left[player] = h->byoyomi_stones;
+    }
+}
+
+static void respond(FILE *out,
+                    const char *id,
+                    bool ok,
+                    const char *format,
+                    ...) {
+    va_list ap;
+    fprintf(out, "%c%s ", ok ? '=' : '?', id);
+    va_start(ap, format);
+    vfprintf(out, format, ap);
+    va_end(ap);
+    fputs("\n\n", out);
+    fflush(out);
+}
+
+static cell_color parse_color(const char *arg) {
+    static const char *names[][3] = {{"b", "black", "red"},
+                                     {"w", "white", "blue"}};
+    for (size_t c = 0; arg && c < 2; c++) {
+        for (size_t k = 0; k < 3; k++) {
+            if (!strcmp(arg, names[c][k]))
+                return c ? BLUE : RED;
+        }
+    }
+    return NEUTRAL;
+}
+
+/* Returns the cell named by `arg` (a1 to the board size), or (size_t)-1. */
+static size_t parse_cell(const struct hex_htp *h, const char *arg) {
+    const size_t size = h->grid.size;
+    if (!arg || !isalpha((unsigned char)arg[0]))
+        return (size_t)-1;
+    const size_t x = (size_t)(tolower((unsigned char)arg[0]) - 'a');
+    char *end;
+    const unsigned long y = strtoul(arg + 1, &end, 10);
+    if (x >= size || end == arg + 1 || *end || y < 1 || y > size)
+        return (size_t)-1;
+    return (y - 1) * size + x;
+}
+
+static void print_cell(FILE *out, size_t size, size_t i) {
+    fprintf(out, "%c%zu", (char)('a' + i % size), i / size + 1);
+}
+
+static void showboard(struct hex_htp *h, FILE *out, const char *id) {
+    static const char stones[] = {[NEUTRAL] = '.', [RED] = 'X', [BLUE] = 'O'};
+    const size_t size = h->grid.size;
+    fprintf(out, "=%s\n   ", id);
+    for (size_t x = 0; x < size; x++)
+        fprintf(out, " %c", (char)('a' + x));
+    for (size_t y = 0; y < size; y++) {
+        fprintf(out, "\n%*s%2zu ", (int)y, "", y + 1);
+        for (size_t x = 0; x < size; x++)
+            fprintf(out, " %c", stones[h->grid.cells[y * size + x].color]);
+    }
+    fputs("\n\n", out);
+    fflush(out);
+}
+
+static void genmove(struct hex_htp *h,
+                    cell_color player,
+                    FILE *out,
+                    const char *id) {
+    cell_color winner = hex_grid_get_winner(&h->grid);
+    if (winner != NEUTRAL) {
+        if (winner == player)
+            respond(out, id, false, "the game is over");
+        else
+            respond(out, id, true, "resign");
+        return;
+    }
+    const double start = hex_clock_now();
+    struct hex_mcts_stats stats;
+    h->mcts.config.max_seconds = move_budget(h, player);
+    h->mcts.config.max_playouts = h->config.max_playouts;
+    hex_mcts_set_position(&h->mcts, &h->grid, player);
+    size_t i = hex_mcts_search(&h->mcts, &stats);
+    if (i == (size_t)-1 || !hex_grid_open_cell(&h->grid, i, player)) {
+        respond(out, id, false, "no move");
+        return;
+    }
+    clock_spend(h, player, hex_clock_now() - start);
+    fprintf(out, "=%s ", id);
+    print_cell(out, h->grid.size, i);
+    fputs("\n\n", out);
+    fflush(out);
+    ponder_start(h, other(player));
+}
+
+bool hex_htp_command(struct hex_htp *h, const char *line, FILE *out) {
+    char buf[1024], *args[MAX_ARGS], *save;
+    char id[24] = "";
+    size_t n = 0;
+
+    snprintf(buf, sizeof(buf), "%s", line);
+    buf[strcspn(buf, "#")] = '\0';
+    for (char *t = strtok_r(buf, " \t\r\n", &save); t && n < MAX_ARGS;
+         t = strtok_r(NULL, " \t\r\n", &save))
+        args[n++] = t;
+    if (n > 0 && isdigit((unsigned char)args[0][0])) {
+        snprintf(id, sizeof(id), "%s", args[0]);
+        memmove(args, args + 1, --n * sizeof(args[0]));
+    }
+    if (n == 0)
+        return true;
+
+    const char *cmd = args[0];
+    /* the search only goes on between commands */
+    ponder_stop(h);
+
+    if (!strcmp(cmd, "protocol_version")) {
+        respond(out, id, true, "2");
+    } else if (!strcmp(cmd, "name")) {
+        respond(out, id, true, "chex");
+    } else if (!strcmp(cmd, "version")) {
+        respond(out, id, true, "1");
+    } else if (!strcmp(cmd, "known_command")) {
+        bool known = false;
+        for (size_t k = 0; commands[k] && n > 1; k++)
+            known = known || !strcmp(commands[k], args[1]);
+        respond(out, id, true, known ? "true" : "false");
+    } else if (!strcmp(cmd, "list_commands")) {
+        fprintf(out, "=%s", id);
+        for (size_t k = 0; commands[k]; k++)
+            fprintf(out, "%s%s", k ? "\n" : " ", commands[k]);
+        fputs("\n\n", out);
+        fflush(out);
+    } else if (!strcmp(cmd, "quit")) {
+        respond(out, id, true, "");
+        h->quit = true;
+        return false;
+    } else if (!strcmp(cmd, "boardsize")) {
+        const unsigned long size = n > 1 ? strtoul(args[1], NULL, 10) : 0;
+        if (size < 1 || size > HEX_HTP_MAX_SIZE ||
+            (n > 2 && strtoul(args[2], NULL, 10) != size))
+            respond(out, id, false, "unacceptable size");
+        else if (!set_size(h, size))
+            respond(out, id, false, "out of memory");
+        else
+            respond(out, id, true, "");
+    } else if (!strcmp(cmd, "clear_board")) {
+        hex_grid_clear(&h->grid);
+        respond(out, id, true, "");
+    } else if (!strcmp(cmd, "play")) {
+        cell_color player = parse_color(n > 1 ? args[1] : NULL);
+        size_t i = parse_cell(h, n > 2 ? args[2] : NULL);
+        if (player == NEUTRAL || i == (size_t)-1)
+            respond(out, id, false, "syntax error");
+        else if (!hex_grid_open_cell(&h->grid, i, player))
+            respond(out, id, false, "cell occupied");
+        else
+            respond(out, id, true, "");
+    } else if (!strcmp(cmd, "genmove")) {
+        cell_color player = parse_color(n > 1 ? args[1] : NULL);
+        if (player == NEUTRAL)
+            respond(out, id, false, "syntax error");
+        else
+            genmove(h, player, out, id);
+    } else if (!strcmp(cmd, "undo")) {
+        if (hex_grid_undo(&h->grid) == (size_t)-1)
+            respond(out, id, false, "cannot undo");
+        else
+            respond(out, id, true, "");
+    } else if (!strcmp(cmd, "showboard")) {
+        showboard(h, out, id);
+    } else if (!strcmp(cmd, "time_settings") && n > 3) {
+        h->main_time = strtod(args[1], NULL);
+        h->byoyomi_time = strtod(args[2], NULL);
+        h->byoyomi_stones = (unsigned)strtoul(args[3], NULL, 10);
+        for (cell_color c = RED; c <= BLUE; c++) {
+            h->time_left[c] = h->main_time;
+            h->stones_left[c] = 0;
+        }
+        respond(out, id, true, "");
+    } else if (!strcmp(cmd, "time_left") && n > 3) {
+        cell_color player = parse_color(args[1]);
+        if (player == NEUTRAL) {
+            respond(out, id, false, "syntax error");
+        } else {
+            h->time_left[player] = strtod(args[2], NULL);
+            h->stones_left[player] = (unsigned)strtoul(args[3], NULL, 10);
+            respond(out, id, true, "");
+        }
+    } else {
+        respond(out, id, false, "unknown command");
+    }
+    return true;
+}
+
+void hex_htp_run(struct hex_htp *h, FILE *in, FILE *out) {
+    char line[1024];
+    while (fgets(line, sizeof(line), in) && hex_htp_command(h, line, out))
+        continue;
+    ponder_stop(h);
+}
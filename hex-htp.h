@@ -0,0 +1,70 @@
+#if !defined(HEX_HTP_H)
+#define HEX_HTP_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+#include "hex-grid.h"
+#include "hex-mcts.h"
+#include "hex-tt.h"
+
+/* Hex Text Protocol engine, the GTP dialect tournament managers such as
+   HexGUI speak: one command per line, answered with "= result" or
+   "? error" and a blank line. Black moves first and joins the top and
+   bottom rows (red here), white joins the sides (blue); cells are a
+   column letter and a row number, a1 in the top left corner.
+
+     protocol_version name version known_command list_commands quit
+     boardsize N [N]  clear_board  play COLOR CELL  genmove COLOR  undo
+     showboard  time_settings MAIN BYOYOMI STONES  time_left COLOR T S
+
+   genmove searches with hex_mcts for a share of the time left, and then
+   keeps searching the position on the opponent's time, until the next
+   command comes in; what it found carries over through the transposition
+   table. Commands are read on the calling thread, which only ever stops
+   the search, so a slow manager never holds the search threads up. */
+
+#define HEX_HTP_MAX_SIZE 26
+
+struct hex_htp_config {
+    unsigned threads;
+    double move_seconds;  // per genmove without a time control
+    size_t max_playouts;  // per genmove, 0 for no limit
+    size_t tt_megabytes;
+    bool ponder;
+};
+
+struct hex_htp {
+    struct hex_htp_config config;
+    hex_grid grid;
+    struct hex_mcts mcts;
+    struct hex_tt tt;
+    bool tt_ready;
+    pthread_t ponder_thread;
+    bool pondering;
+    /* time control, 0 main and byo-yomi time for none */
+    double main_time;
+    double byoyomi_time;
+    unsigned byoyomi_stones;
+    double time_left[3]; // by cell_color
+    unsigned stones_left[3];
+    bool quit;
+};
+
+void hex_htp_default_config(struct hex_htp_config *config);
+
+/* Starts on an empty 11x11 board. Returns 0 on failure. */
+int hex_htp_init(struct hex_htp *h, const struct hex_htp_config *config);
+
+void hex_htp_destroy(struct hex_htp *h);
+
+/* Answers one command line on `out`. Returns false once "quit" has been
+   answered. */
+bool hex_htp_command(struct hex_htp *h, const char *line, FILE *out);
+
+/* Answers the commands of `in` until it ends or says quit. */
+void hex_htp_run(struct hex_htp *h, FILE *in, FILE *out);
+
+#endif /* HEX_HTP_H */
@@ -0,0 +1,391 @@
+#include <math.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hex-clock.h"
+#include "hex-mcts.h"
+#include "hex-playout.h"
+#include "hex-random.h"
+
+enum { NODE_LEAF = 0, NODE_EXPANDING, NODE_EXPANDED, NODE_FINAL };
+
+struct worker {
+    struct hex_mcts *m;
+    hex_grid grid;
+    struct hex_playout playout;
+    struct hex_rng rng;
+    uint32_t *path;
+    double deadline;
+};
+
+static cell_color other(cell_color player) {
+    return 1 + (player % 2);
+}
+
+void hex_mcts_default_config(struct hex_mcts_config *config) {
+    config->threads = 1;
+    config->max_playouts = 0;
+    config->max_seconds = 1.0;
+    config->leaf_playouts = 64;
+    config->expand_threshold = 8;
+    config->exploration = 0.7;
+    config->max_nodes = (size_t)1 << 21;
+    config->seed = 0x6865786d637473;
+    config->tt = NULL;
+}
+
+void hex_mcts_fit_nodes(struct hex_mcts_config *config, size_t size) {
+    if (!config->max_playouts || config->max_seconds)
+        return;
+    size_t leaf = config->leaf_playouts ? config->leaf_playouts : 1;
+    size_t nodes = (config->max_playouts / leaf + 2) * size * size;
+    if (nodes < config->max_nodes)
+        config->max_nodes = nodes;
+}
+
+int hex_mcts_init(struct hex_mcts *m,
+                  const struct hex_mcts_config *config,
+                  size_t size) {
+    memset(m, 0, sizeof(*m));
+    m->config = *config;
+    if (m->config.threads == 0)
+        m->config.threads = 1;
+    if (m->config.leaf_playouts == 0 ||
+        m->config.leaf_playouts > HEX_PLAYOUT_LANES)
+        m->config.leaf_playouts = HEX_PLAYOUT_LANES;
+    if (m->config.max_nodes > UINT32_MAX)
+        m->config.max_nodes = UINT32_MAX;
+
+    hex_rng_seed(&m->rng, m->config.seed);
+
+    m->nodes = malloc(m->config.max_nodes * sizeof(struct hex_mcts_node));
+    if (!m->nodes)
+        return 0;
+    if (!hex_grid_init(&m->root_grid, size, HEX_GRID_BITBOARD)) {
+        free(m->nodes);
+        m->nodes = NULL;
+        return 0;
+    }
+    hex_mcts_set_position(m, &m->root_grid, RED);
+    return 1;
+}
+
+void hex_mcts_destroy(struct hex_mcts *m) {
+    hex_grid_destroy(&m->root_grid);
+    free(m->nodes);
+    m->nodes = NULL;
+}
+
+static void node_init(struct hex_mcts_node *node, uint32_t move) {
+    atomic_init(&node->visits, 0);
+    atomic_init(&node->wins, 0);
+    atomic_init(&node->state, NODE_LEAF);
+    node->move = move;
+    node->first_child = 0;
+    node->child_count = 0;
+}
+
+void hex_mcts_set_position(struct hex_mcts *m,
+                           const hex_grid *g,
+                           cell_color to_move) {
+    if (g != &m->root_grid)
+        hex_grid_copy(&m->root_grid, g);
+    m->to_move = to_move;
+    m->root = 0;
+    atomic_store(&m->stop, false);
+    node_init(&m->nodes[0], UINT32_MAX);
+    atomic_store(&m->node_count, 1);
+}
+
+void hex_mcts_stop(struct hex_mcts *m) {
+    atomic_store(&m->stop, true);
+}
+
+/* Starts a new node from the statistics saved for its position. */
+static void seed_node(struct hex_mcts *m,
+                      struct hex_mcts_node *node,
+                      uint64_t key) {
+    struct hex_tt_data d;
+    if (!hex_tt_probe(m->config.tt, key, &d))
+        return;
+    atomic_init(&node->visits, d.count[0] / 2);
+    atomic_init(&node->wins, d.count[1] / 2);
+}
+
+/* Called by the one thread that moved `node` from leaf to expanding, with
+   `player` to move in g. */
+static void expand(struct hex_mcts *m,
+                   struct hex_mcts_node *node,
+                   const hex_grid *g,
+                   cell_color player) {
+    const size_t cells = g->size * g->size;
+    size_t n = 0;
+    for (size_t i = 0; i < cells; i++)
+        n += g->cells[i].color == NEUTRAL;
+
+    size_t first = atomic_load_explicit(&m->node_count, memory_order_relaxed);
+    if (n == 0 || first + n > m->config.max_nodes) {
+        atomic_store_explicit(&node->state, NODE_FINAL, memory_order_release);
+        return;
+    }
+    first = atomic_fetch_add(&m->node_count, n);
+    if (first + n > m->config.max_nodes) {
+        atomic_store_explicit(&node->state, NODE_FINAL, memory_order_release);
+        return;
+    }
+
+    size_t k = first;
+    for (size_t i = 0; i < cells; i++) {
+        if (g->cells[i].color != NEUTRAL)
+            continue;
+        node_init(&m->nodes[k], (uint32_t)i);
+        if (m->config.tt)
+            seed_node(m, &m->nodes[k], hex_grid_child_key(g, i, player));
+        k++;
+    }
+    node->first_child = (uint32_t)first;
+    node->child_count = (uint32_t)n;
+    atomic_store_explicit(&node->state, NODE_EXPANDED, memory_order_release);
+}
+
+static struct hex_mcts_node *select_child(struct hex_mcts *m,
+                                          struct hex_mcts_node *node) {
+    struct hex_mcts_node *children = &m->nodes[node->first_child];
+    uint64_t parent_visits =
+        atomic_load_explicit(&node->visits, memory_order_relaxed);
+    double log_visits = log((double)(parent_visits + 1));
+    struct hex_mcts_node *best = children;
+    double best_score = -1.0;
+
+    for (uint32_t c = 0; c < node->child_count; c++) {
+        uint64_t visits =
+            atomic_load_explicit(&children[c].visits, memory_order_relaxed);
+        if (visits == 0)
+            return &children[c];
+        uint64_t wins =
+            atomic_load_explicit(&children[c].wins, memory_order_relaxed);
+        double score = (double)wins / (double)visits +
+                       m->config.exploration *
+                           sqrt(log_visits / (double)visits);
+        if (score > best_score) {
+            best_score = score;
+            best = &children[c];
+        }
+    }
+    return best;
+}
+
+static void run_iteration(struct worker *w) {
+    struct hex_mcts *m = w->m;
+    const uint64_t k = m->config.leaf_playouts;
+    struct hex_mcts_node *node = &m->nodes[m->root];
+    cell_color player = m->to_move;
+    size_t depth = 0;
+
+    hex_grid_copy(&w->grid, &m->root_grid);
+    atomic_fetch_add_explicit(&node->visits, k, memory_order_relaxed);
+    w->path[depth++] = (uint32_t)(node - m->nodes);
+
+    for (;;) {
+        uint32_t state =
+            atomic_load_explicit(&node->state, memory_order_acquire);
+        bool visited =
+            depth == 1 ||
+            atomic_load_explicit(&node->visits, memory_order_relaxed) >=
+                k * m->config.expand_threshold;
+        if (state == NODE_LEAF && visited &&
+            atomic_compare_exchange_strong(&node->state, &state,
+                                           NODE_EXPANDING)) {
+            expand(m, node, &w->grid, player);
+            state = atomic_load_explicit(&node->state, memory_order_acquire);
+        }
+        if (state != NODE_EXPANDED)
+            break;
+
+        node = select_child(m, node);
+        atomic_fetch_add_explicit(&node->visits, k, memory_order_relaxed);
+        hex_grid_open_cell(&w->grid, node->move, player);
+        player = other(player);
+        w->path[depth++] = (uint32_t)(node - m->nodes);
+    }
+
+    hex_playout_set_position(&w->playout, &w->grid, player);
+    uint64_t red_wins = hex_playout_run(&w->playout, k, &w->rng);
+
+    for (size_t d = 0; d < depth; d++) {
+        cell_color mover = d % 2 ? m->to_move : other(m->to_move);
+        uint64_t wins = mover == RED ? red_wins : k - red_wins;
+        atomic_fetch_add_explicit(&m->nodes[w->path[d]].wins, wins,
+                                  memory_order_relaxed);
+    }
+}
+
+static void *worker_run(void *arg) {
+    struct worker *w = arg;
+    struct hex_mcts *m = w->m;
+    const size_t k = m->config.leaf_playouts;
+
+    while (!atomic_load_explicit(&m->stop, memory_order_relaxed)) {
+        size_t done = atomic_fetch_add(&m->playouts, k);
+        if ((m->config.max_playouts && done >= m->config.max_playouts) ||
+            (w->deadline > 0 && hex_clock_now() >= w->deadline)) {
+            atomic_fetch_sub(&m->playouts, k);
+            break;
+        }
+        run_iteration(w);
+    }
+    return NULL;
+}
+
+static int worker_init(struct worker *w, struct hex_mcts *m) {
+    const size_t size = m->root_grid.size;
+    memset(w, 0, sizeof(*w));
+    w->m = m;
+    hex_rng_seed(&w->rng, hex_rng_next(&m->rng));
+    w->path = malloc((size * size + 1) * sizeof(uint32_t));
+    if (!w->path)
+        return 0;
+    if (!hex_grid_init(&w->grid, size, HEX_GRID_BITBOARD)) {
+        free(w->path);
+        return 0;
+    }
+    if (!hex_playout_init(&w->playout, size)) {
+        hex_grid_destroy(&w->grid);
+        free(w->path);
+        return 0;
+    }
+    return 1;
+}
+
+static void worker_destroy(struct worker *w) {
+    hex_playout_destroy(&w->playout);
+    hex_grid_destroy(&w->grid);
+    free(w->path);
+}
+
+static uint32_t saturate(uint64_t n) {
+    return n > UINT32_MAX ? UINT32_MAX : (uint32_t)n;
+}
+
+/* Saves the statistics of `node`, with `player` to move in g, and of its
+   subtree. Nodes with fewer than min_visits are not worth a slot. */
+static void save_tree(struct hex_mcts *m,
+                      const struct hex_mcts_node *node,
+                      hex_grid *g,
+                      cell_color player,
+                      uint64_t min_visits) {
+    uint64_t visits = atomic_load_explicit(&node->visits, memory_order_relaxed);
+    if (visits < min_visits)
+        return;
+    struct hex_tt_data d = {.move = HEX_TT_NO_MOVE, .bound = HEX_TT_NONE};
+    d.count[0] = saturate(visits);
+    d.count[1] =
+        saturate(atomic_load_explicit(&node->wins, memory_order_relaxed));
+    for (uint64_t v = visits; v > 1; v >>= 1)
+        d.depth++;
+
+    if (atomic_load_explicit(&node->state, memory_order_acquire) ==
+        NODE_EXPANDED) {
+        uint64_t best_visits = 0;
+        for (uint32_t c = 0; c < node->child_count; c++) {
+            const struct hex_mcts_node *child =
+                &m->nodes[node->first_child + c];
+            uint64_t child_visits =
+                atomic_load_explicit(&child->visits, memory_order_relaxed);
+            if (child_visits > best_visits) {
+                best_visits = child_visits;
+                d.move = child->move;
+            }
+            if (child_visits >= min_visits) {
+                hex_grid_open_cell(g, child->move, player);
+                save_tree(m, child, g, other(player), min_visits);
+                hex_grid_undo(g);
+            }
+        }
+    }
+    hex_tt_store(m->config.tt, hex_grid_key(g, player), &d);
+}
+
+size_t hex_mcts_search(struct hex_mcts *m, struct hex_mcts_stats *stats) {
+    const unsigned n = m->config.threads;
+    struct worker *workers = calloc(n, sizeof(struct worker));
+    pthread_t *threads = calloc(n, sizeof(pthread_t));
+    const double start = hex_clock_now();
+    unsigned started = 0;
+
+    atomic_store(&m->playouts, 0);
+    if (workers && threads) {
+        for (; started < n; started++) {
+            if (!worker_init(&workers[started], m))
+                break;
+            if (m->config.max_seconds > 0)
+                workers[started].deadline = start + m->config.max_seconds;
+        }
+        /* if a thread cannot be had, the search makes do with the workers
+           already running, and at worst with this thread alone */
+        unsigned running = 1;
+        while (running < started &&
+               pthread_create(&threads[running], NULL, worker_run,
+                              &workers[running]) == 0)
+            running++;
+        if (started > 0)
+            worker_run(&workers[0]);
+        for (unsigned t = 1; t < running; t++)
+            pthread_join(threads[t], NULL);
+        for (unsigned t = 0; t < started; t++)
+            worker_destroy(&workers[t]);
+    }
+    free(workers);
+    free(threads);
+    atomic_store(&m->stop, false);
+
+    struct hex_mcts_node *root = &m->nodes[m->root];
+    if (m->config.tt) {
+        save_tree(m, root, &m->root_grid, m->to_move,
+                  m->config.leaf_playouts * m->config.expand_threshold);
+    }
+    size_t best_move = (size_t)-1;
+    uint64_t best_visits = 0;
+    double value = 0.5;
+    if (atomic_load(&root->state) == NODE_EXPANDED) {
+        for (uint32_t c = 0; c < root->child_count; c++) {
+            struct hex_mcts_node *child = &m->nodes[root->first_child + c];
+            uint64_t visits = atomic_load(&child->visits);
+            if (best_move == (size_t)-1 || visits > best_visits) {
+                best_move = child->move;
+                best_visits = visits;
+                value = visits ? (double)atomic_load(&child->wins) /
+                                     (double)visits
+                               : 0.5;
+            }
+        }
+    }
+
+    if (stats) {
+        size_t nodes = atomic_load(&m->node_count);
+        stats->playouts = atomic_load(&m->playouts);
+        stats->nodes = nodes < m->config.max_nodes ? nodes
+                                                   : m->config.max_nodes;
+        stats->seconds = hex_clock_now() - start;
+        stats->playouts_per_second =
+            stats->seconds > 0 ? (double)stats->playouts / stats->seconds : 0;
+        stats->value = value;
+    }
+    return best_move;
+}
+
+uint64_t hex_mcts_root_visits(const struct hex_mcts *m, uint64_t *visits) {
+    const struct hex_mcts_node *root = &m->nodes[m->root];
+    const size_t cells = m->root_grid.size * m->root_grid.size;
+    uint64_t total = 0;
+    memset(visits, 0, cells * sizeof(uint64_t));
+    if (atomic_load(&root->state) != NODE_EXPANDED)
+        return 0;
+    for (uint32_t c = 0; c < root->child_count; c++) {
+        const struct hex_mcts_node *child = &m->nodes[root->first_child + c];
+        visits[child->move] = atomic_load(&child->visits);
+        total += visits[child->move];
+    }
+    return total;
+}
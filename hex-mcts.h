@@ -0,0 +1,96 @@
+#if !defined(HEX_MCTS_H)
+#define HEX_MCTS_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "hex-grid.h"
+#include "hex-random.h"
+#include "hex-tt.h"
+
+/* Monte Carlo tree search over a tree shared by all worker threads. Nodes
+   come from a fixed arena; a leaf is expanded by whichever thread wins a
+   compare-and-swap on its state, and the others keep evaluating it with
+   playouts meanwhile. Visits are added on the way down (a virtual loss, so
+   that concurrent threads spread over different lines) and wins on the way
+   back up.
+
+   With a transposition table, a search ends by saving the statistics of its
+   tree there, and new nodes start from the saved statistics (halved, so
+   that old results fade) of their positions. That carries work over from
+   one move to the next and between engines sharing the table. */
+
+struct hex_mcts_config {
+    unsigned threads;
+    size_t max_playouts;     // 0 for no limit
+    double max_seconds;      // 0 for no limit
+    size_t leaf_playouts;    // playouts per leaf, at most HEX_PLAYOUT_LANES
+    size_t expand_threshold; // leaf evaluations before a node is expanded
+    double exploration;
+    size_t max_nodes;
+    uint64_t seed;
+    struct hex_tt *tt; // optional, may be shared with other engines
+};
+
+struct hex_mcts_stats {
+    size_t playouts;
+    size_t nodes;
+    double seconds;
+    double playouts_per_second;
+    double value; // estimated win rate of the side to move
+};
+
+struct hex_mcts_node {
+    _Atomic uint64_t visits; // playouts through this node, virtual or not
+    _Atomic uint64_t wins;   // for the player who moved into this node
+    _Atomic uint32_t state;  // leaf, expanding or expanded
+    uint32_t move;
+    uint32_t first_child;
+    uint32_t child_count;
+};
+
+struct hex_mcts {
+    struct hex_mcts_config config;
+    struct hex_mcts_node *nodes;
+    _Atomic size_t node_count;
+    _Atomic size_t playouts;
+    atomic_bool stop;
+    hex_grid root_grid;
+    struct hex_rng rng; // seeds the workers of each search
+    cell_color to_move;
+    size_t root;
+};
+
+void hex_mcts_default_config(struct hex_mcts_config *config);
+
+/* Caps max_nodes at room for an expansion per leaf evaluation on a board
+   of `size`, when the search is bounded by max_playouts alone. */
+void hex_mcts_fit_nodes(struct hex_mcts_config *config, size_t size);
+
+int hex_mcts_init(struct hex_mcts *m,
+                  const struct hex_mcts_config *config,
+                  size_t size);
+
+void hex_mcts_destroy(struct hex_mcts *m);
+
+/* Drops the tree and searches g with `to_move` to play from now on. Also
+   clears a hex_mcts_stop() that came too late to stop the last search. */
+void hex_mcts_set_position(struct hex_mcts *m,
+                           const hex_grid *g,
+                           cell_color to_move);
+
+/* Searches until the playout or time budget runs out or hex_mcts_stop() is
+   called, and returns the most visited move ((size_t)-1 if the board is
+   full). `stats` may be NULL. */
+size_t hex_mcts_search(struct hex_mcts *m, struct hex_mcts_stats *stats);
+
+/* Writes the visits of every move from the root of the last search into
+   visits[cell], 0 for the cells it did not try, and returns their sum. */
+uint64_t hex_mcts_root_visits(const struct hex_mcts *m, uint64_t *visits);
+
+/* Makes a running search return as soon as possible. Safe to call from any
+   thread. */
+void hex_mcts_stop(struct hex_mcts *m);
+
+#endif /* HEX_MCTS_H */
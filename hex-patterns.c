@@ -0,0 +1,211 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "hex-patterns.h"
+
+/* Two bits per neighbour, n0 in the lowest: a ring turned r steps
+   clockwise moves each neighbour to the next slot up. */
+#define SLOT(k, color) ((unsigned)(color) << (2 * (k)))
+#define ROTATE(x, r) ((((x) << (2 * (r))) | ((x) >> (12 - 2 * (r)))) & 0xfff)
+#define ROTATIONS(mask, value, fill)                                         \
+    {ROTATE(mask, 0), ROTATE(value, 0), fill},                               \
+        {ROTATE(mask, 1), ROTATE(value, 1), fill},                           \
+        {ROTATE(mask, 2), ROTATE(value, 2), fill},                           \
+        {ROTATE(mask, 3), ROTATE(value, 3), fill},                           \
+        {ROTATE(mask, 4), ROTATE(value, 4), fill},                           \
+        {ROTATE(mask, 5), ROTATE(value, 5), fill}
+
+/* X four in a row; X three in a row and Y opposite the middle one; X two
+   in a row facing Y two in a row. */
+#define DEAD(x, y)                                                           \
+    ROTATIONS(0x0ff, SLOT(0, x) | SLOT(1, x) | SLOT(2, x) | SLOT(3, x), x), \
+        ROTATIONS(0x33f, SLOT(0, x) | SLOT(1, x) | SLOT(2, x) | SLOT(4, y), \
+                  x),                                                        \
+        ROTATIONS(0x3cf, SLOT(0, x) | SLOT(1, x) | SLOT(3, y) | SLOT(4, y), \
+                  x)
+
+static const struct pattern {
+    uint16_t mask;
+    uint16_t value;
+    uint8_t fill;
+} dead_patterns[] = {DEAD(RED, BLUE), DEAD(BLUE, RED)};
+
+#define PATTERNS (sizeof(dead_patterns) / sizeof(dead_patterns[0]))
+
+/* The colour to fill a cell with that has this ring, or NEUTRAL if it is
+   not dead. */
+static cell_color dead(uint16_t ring) {
+    for (size_t k = 0; k < PATTERNS; k++) {
+        if ((ring & dead_patterns[k].mask) == dead_patterns[k].value)
+            return dead_patterns[k].fill;
+    }
+    return NEUTRAL;
+}
+
+static uint16_t with(uint16_t ring, unsigned k, cell_color color) {
+    return (uint16_t)((ring & ~SLOT(k, 3)) | SLOT(k, color));
+}
+
+int hex_patterns_init(struct hex_patterns *p, size_t size) {
+    const size_t cells = size * size;
+    memset(p, 0, sizeof(*p));
+    p->size = size;
+    p->neighbors = hex_grid_neighbor_table(size);
+    p->color = malloc(cells + 4);
+    p->kind = malloc(cells);
+    p->ring = malloc(cells * sizeof(uint16_t));
+    p->corner = malloc(cells * sizeof(bool));
+    p->queue = malloc(cells * sizeof(uint32_t));
+    p->queued = calloc(cells, sizeof(bool));
+    p->dominated = malloc(cells * sizeof(bool));
+    if (!p->neighbors || !p->color || !p->kind || !p->ring || !p->corner ||
+        !p->queue || !p->queued || !p->dominated) {
+        hex_patterns_destroy(p);
+        return 0;
+    }
+    for (size_t i = 0; i < cells; i++) {
+        p->corner[i] = false;
+        for (unsigned k = 0; k < 6; k++) {
+            const uint32_t a = p->neighbors[i][k];
+            const uint32_t b = p->neighbors[i][(k + 1) % 6];
+            if (a >= cells && b >= cells && a != b)
+                p->corner[i] = true;
+        }
+    }
+    return 1;
+}
+
+void hex_patterns_destroy(struct hex_patterns *p) {
+    free(p->color);
+    free(p->kind);
+    free(p->ring);
+    free(p->corner);
+    free(p->queue);
+    free(p->queued);
+    free(p->dominated);
+    memset(p, 0, sizeof(*p));
+}
+
+static void push(struct hex_patterns *p, size_t i) {
+    if (!p->queued[i]) {
+        p->queued[i] = true;
+        p->queue[p->queue_length++] = (uint32_t)i;
+    }
+}
+
+/* Colours cell i, and has its empty neighbours looked at again. */
+static void fill(struct hex_patterns *p,
+                 size_t i,
+                 cell_color color,
+                 enum hex_pattern_kind kind) {
+    const size_t cells = p->size * p->size;
+    p->color[i] = (uint8_t)color;
+    p->kind[i] = (uint8_t)kind;
+    p->filled += kind != HEX_PATTERN_NONE;
+    for (unsigned k = 0; k < 6; k++) {
+        const uint32_t v = p->neighbors[i][k];
+        if (v >= cells)
+            continue;
+        /* i is v's neighbour on the opposite side */
+        p->ring[v] = with(p->ring[v], (k + 3) % 6, color);
+        if (p->color[v] == NEUTRAL)
+            push(p, v);
+    }
+}
+
+/* Fills i in if it is dead, or captured along with a neighbour. */
+static void examine(struct hex_patterns *p, size_t i) {
+    const size_t cells = p->size * p->size;
+    if (p->color[i] != NEUTRAL || p->corner[i])
+        return;
+    const cell_color color = dead(p->ring[i]);
+    if (color != NEUTRAL) {
+        fill(p, i, color, HEX_PATTERN_DEAD);
+        return;
+    }
+    for (unsigned k = 0; k < 6; k++) {
+        const uint32_t v = p->neighbors[i][k];
+        if (v >= cells || p->color[v] != NEUTRAL || p->corner[v])
+            continue;
+        for (cell_color owner = RED; owner <= BLUE; owner++) {
+            if (dead(with(p->ring[i], k, owner)) != NEUTRAL &&
+                dead(with(p->ring[v], (k + 3) % 6, owner)) != NEUTRAL) {
+                fill(p, i, owner, HEX_PATTERN_CAPTURED);
+                fill(p, v, owner, HEX_PATTERN_CAPTURED);
+                return;
+            }
+        }
+    }
+}
+
+static void drain(struct hex_patterns *p) {
+    while (p->queue_length) {
+        const uint32_t i = p->queue[--p->queue_length];
+        p->queued[i] = false;
+        examine(p, i);
+    }
+}
+
+void hex_patterns_reset(struct hex_patterns *p, const hex_grid *g) {
+    const size_t cells = p->size * p->size;
+    for (size_t i = 0; i < cells + 4; i++)
+        p->color[i] = (uint8_t)g->cells[i].color;
+    p->filled = 0;
+    for (size_t i = 0; i < cells; i++) {
+        uint16_t ring = 0;
+        p->kind[i] = HEX_PATTERN_NONE;
+        for (unsigned k = 0; k < 6; k++)
+            ring |= (uint16_t)SLOT(k, p->color[p->neighbors[i][k]]);
+        p->ring[i] = ring;
+    }
+    for (size_t i = cells; i-- > 0;) {
+        if (p->color[i] == NEUTRAL)
+            push(p, i);
+    }
+    drain(p);
+}
+
+void hex_patterns_play(struct hex_patterns *p,
+                       const hex_grid *g,
+                       size_t i,
+                       cell_color player) {
+    if (p->color[i] != NEUTRAL) {
+        hex_patterns_reset(p, g);
+        return;
+    }
+    fill(p, i, player, HEX_PATTERN_NONE);
+    drain(p);
+}
+
+size_t hex_patterns_moves(struct hex_patterns *p,
+                          const hex_grid *g,
+                          cell_color player,
+                          uint32_t *moves) {
+    const size_t cells = p->size * p->size;
+    size_t n = 0;
+
+    /* a cell only points at one not dominated yet, so the chains end in a
+       cell that is listed */
+    memset(p->dominated, 0, cells * sizeof(bool));
+    for (size_t i = 0; i < cells; i++) {
+        if (p->color[i] != NEUTRAL)
+            continue;
+        for (unsigned k = 0; k < 6 && !p->corner[i]; k++) {
+            const uint32_t v = p->neighbors[i][k];
+            if (v < cells && p->color[v] == NEUTRAL && !p->dominated[v] &&
+                dead(with(p->ring[i], k, player)) != NEUTRAL) {
+                p->dominated[i] = true;
+                break;
+            }
+        }
+        if (!p->dominated[i])
+            moves[n++] = (uint32_t)i;
+    }
+    if (n == 0) {
+        for (size_t i = 0; i < cells; i++) {
+            if (g->cells[i].color == NEUTRAL)
+                moves[n++] = (uint32_t)i;
+        }
+    }
+    return n;
+}
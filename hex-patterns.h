@@ -0,0 +1,86 @@
+#if !defined(HEX_PATTERNS_H)
+#define HEX_PATTERNS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "hex-grid.h"
+
+/* Inferior cell analysis from the ring of six neighbours around each
+   cell, with the board edges standing in as stones of their colour.
+
+   A cell is dead when no stone there can ever matter to either player:
+   four neighbours in a row of one colour, three in a row with the
+   opposite one of the other colour, or two in a row facing two of the
+   other colour. Two empty neighbours are captured by a player when
+   either one, taken by the opponent, is dead once the player answers in
+   the other. Both are filled in, the dead cells with the colour of the
+   pattern and the captured ones with their owner's, and later patterns
+   see the filled-in board. A cell is dominated for the player to move
+   when a stone of theirs on an empty neighbour would kill it: that
+   neighbour is at least as good a move.
+
+   The patterns are mask and value pairs over the twelve bits of a ring,
+   expanded to all six rotations by the compiler, and each cell keeps its
+   ring up to date, so a lookup is a few masked compares. Where two edges
+   meet in a ring (the corners) they do not touch, and no pattern is
+   tried there.
+
+   The solver finds the fill-in from scratch at every node with
+   hex_patterns_reset(): it backs up through hex_grid_undo(), which the
+   fill-in cannot follow. hex_patterns_play() is for callers that only
+   play forward, a game or a playout. */
+
+enum hex_pattern_kind {
+    HEX_PATTERN_NONE = 0, // empty, or a stone played
+    HEX_PATTERN_DEAD,
+    HEX_PATTERN_CAPTURED
+};
+
+struct hex_patterns {
+    size_t size;
+    const uint32_t (*neighbors)[6];
+    uint8_t *color;  // per cell and virtual cell, with the fill-in
+    uint8_t *kind;   // per cell, why it is filled in
+    uint16_t *ring;  // per cell, the colours of its neighbours from n0 up,
+                     // two bits each
+    bool *corner;    // per cell, two edges meet in its ring
+    uint32_t *queue; // cells whose ring changed
+    bool *queued;
+    size_t queue_length;
+    bool *dominated; // scratch for hex_patterns_moves()
+    size_t filled;   // cells filled in
+};
+
+/* Boards up to HEX_GRID_SHARED_TABLES on a side. Returns 0 on failure. */
+int hex_patterns_init(struct hex_patterns *p, size_t size);
+
+void hex_patterns_destroy(struct hex_patterns *p);
+
+/* Finds the fill-in of g, of the size given to hex_patterns_init(), from
+   scratch: for a new position, or after hex_grid_undo(). */
+void hex_patterns_reset(struct hex_patterns *p, const hex_grid *g);
+
+/* Brings the fill-in up to date after hex_grid_open_cell(g, i, player),
+   looking only around i. A stone on a cell filled in already starts it
+   over, since the reasons for that may no longer hold. */
+void hex_patterns_play(struct hex_patterns *p,
+                       const hex_grid *g,
+                       size_t i,
+                       cell_color player);
+
+static inline bool hex_patterns_filled(const struct hex_patterns *p,
+                                       size_t i) {
+    return p->kind[i] != HEX_PATTERN_NONE;
+}
+
+/* Lists in `moves` the empty cells of g worth trying for `player`: not
+   filled in, and not dominated by another candidate. When the fill-in
+   leaves nothing, lists every empty cell of g. Returns how many. */
+size_t hex_patterns_moves(struct hex_patterns *p,
+                          const hex_grid *g,
+                          cell_color player,
+                          uint32_t *moves);
+
+#endif /* HEX_PATTERNS_H */
@@ -0,0 +1,176 @@
+#include <math.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hex-clock.h"
+#include "hex-percolation.h"
+#include "hex-random.h"
+#include "weighted-quick-union.h"
+
+struct worker {
+    const struct hex_percolation_config *config;
+    _Atomic size_t *next_trial;
+    struct wqu_uf uf;
+    uint8_t *open;
+    uint32_t *order; // cells in the order they will be opened
+    struct hex_rng rng;
+    /* running mean and sum of squared deviations of this worker's trials */
+    size_t count;
+    double mean;
+    double m2;
+};
+
+void hex_percolation_default_config(struct hex_percolation_config *config) {
+    config->size = 64;
+    config->trials = 1000;
+    config->threads = 1;
+    config->seed = 0x68657870657263;
+}
+
+/* Opens cells in random order until the virtual top and bottom cells
+   connect, and returns the fraction of the grid opened. The order is a
+   Fisher-Yates shuffle drawn one cell at a time, so no cell is picked twice;
+   it starts from whatever permutation the last trial left, which is as good
+   as any.
+   Cells are numbered and joined as in hex_grid, with every open cell red, but
+   only the union-find and an open flag per cell are touched. */
+static double run_trial(struct worker *w, size_t size) {
+    struct wqu_uf *uf = &w->uf;
+    const size_t cells = size * size;
+    const size_t top = cells, bottom = cells + 1;
+
+    w_quickunion_reset(uf);
+    memset(w->open, 0, cells);
+
+    size_t opened = 0;
+    while (!w_quickunion_is_connected(uf, top, bottom)) {
+        size_t r = opened + hex_rng_below(&w->rng, (uint32_t)(cells - opened));
+        const size_t i = w->order[r];
+        w->order[r] = w->order[opened];
+        w->order[opened++] = (uint32_t)i;
+
+        const size_t x = i % size, y = i / size;
+        w->open[i] = 1;
+        if (y > 0) {
+            if (w->open[i - size])
+                w_quickunion_union(uf, i - size, i);
+            if (x < size - 1 && w->open[i - size + 1])
+                w_quickunion_union(uf, i - size + 1, i);
+        } else {
+            w_quickunion_union(uf, top, i);
+        }
+        if (y < size - 1) {
+            if (w->open[i + size])
+                w_quickunion_union(uf, i + size, i);
+            if (x > 0 && w->open[i + size - 1])
+                w_quickunion_union(uf, i + size - 1, i);
+        } else {
+            w_quickunion_union(uf, bottom, i);
+        }
+        if (x > 0 && w->open[i - 1])
+            w_quickunion_union(uf, i - 1, i);
+        if (x < size - 1 && w->open[i + 1])
+            w_quickunion_union(uf, i + 1, i);
+    }
+    return (double)opened / (double)cells;
+}
+
+static void *worker_run(void *arg) {
+    struct worker *w = arg;
+    while (atomic_fetch_add_explicit(w->next_trial, 1, memory_order_relaxed) <
+           w->config->trials) {
+        double x = run_trial(w, w->config->size);
+        /* Welford's update */
+        double delta = x - w->mean;
+        w->mean += delta / (double)++w->count;
+        w->m2 += delta * (x - w->mean);
+    }
+    return NULL;
+}
+
+int hex_percolation_run(const struct hex_percolation_config *config,
+                        struct hex_percolation_stats *stats) {
+    const size_t size = config->size;
+    const unsigned n = config->threads ? config->threads : 1;
+    if (size < 2 || size * size + 2 > WQU_MAX_NODES)
+        return 0;
+
+    struct worker *workers = calloc(n, sizeof(struct worker));
+    pthread_t *threads = calloc(n, sizeof(pthread_t));
+    _Atomic size_t next_trial = 0;
+    struct hex_rng rng;
+    unsigned started = 0;
+    const double start = hex_clock_now();
+
+    hex_rng_seed(&rng, config->seed);
+    for (; workers && threads && started < n; started++) {
+        struct worker *w = &workers[started];
+        w->config = config;
+        w->next_trial = &next_trial;
+        hex_rng_seed(&w->rng, hex_rng_next(&rng));
+        w->order = malloc(size * size * sizeof(uint32_t));
+        w->open = malloc(size * size);
+        if (!w->order || !w->open ||
+            !w_quickunion_init(&w->uf, size * size + 2)) {
+            free(w->order);
+            free(w->open);
+            break;
+        }
+        for (size_t k = 0; k < size * size; k++)
+            w->order[k] = (uint32_t)k;
+    }
+    if (started < n) {
+        for (unsigned t = 0; t < started; t++) {
+            w_quickunion_destroy(&workers[t].uf);
+            free(workers[t].order);
+            free(workers[t].open);
+        }
+        free(workers);
+        free(threads);
+        return 0;
+    }
+
+    /* trials go to whichever worker asks next, so the ones that cannot get
+       a thread are simply left out */
+    unsigned running = 1;
+    while (running < n && pthread_create(&threads[running], NULL, worker_run,
+                                          &workers[running]) == 0)
+        running++;
+    worker_run(&workers[0]);
+    for (unsigned t = 1; t < running; t++)
+        pthread_join(threads[t], NULL);
+
+    /* Chan et al.'s pairwise combination of the per-thread moments */
+    size_t count = 0;
+    double mean = 0.0, m2 = 0.0;
+    for (unsigned t = 0; t < n; t++) {
+        const struct worker *w = &workers[t];
+        if (w->count == 0)
+            continue;
+        double delta = w->mean - mean;
+        size_t total = count + w->count;
+        mean += delta * (double)w->count / (double)total;
+        m2 += w->m2 +
+              delta * delta * (double)count * (double)w->count / (double)total;
+        count = total;
+    }
+    for (unsigned t = 0; t < n; t++) {
+        w_quickunion_destroy(&workers[t].uf);
+        free(workers[t].order);
+        free(workers[t].open);
+    }
+    free(workers);
+    free(threads);
+
+    stats->trials = count;
+    stats->mean = mean;
+    stats->stddev = count > 1 ? sqrt(m2 / (double)(count - 1)) : 0.0;
+    const double half = count ? 1.96 * stats->stddev / sqrt((double)count)
+                              : 0.0;
+    stats->confidence_low = mean - half;
+    stats->confidence_high = mean + half;
+    stats->seconds = hex_clock_now() - start;
+    return 1;
+}
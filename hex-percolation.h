@@ -0,0 +1,34 @@
+#if !defined(HEX_PERCOLATION_H)
+#define HEX_PERCOLATION_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Monte Carlo estimate of the site percolation threshold of the hex lattice:
+   each trial opens random cells of an empty size x size grid until the top
+   and bottom virtual cells are connected, and records the fraction opened.
+   Trials are shared out between threads, each with its own grid and RNG. */
+
+struct hex_percolation_config {
+    size_t size;
+    size_t trials;
+    unsigned threads;
+    uint64_t seed;
+};
+
+struct hex_percolation_stats {
+    size_t trials;
+    double mean;
+    double stddev;
+    double confidence_low; // 95% confidence interval of the mean
+    double confidence_high;
+    double seconds;
+};
+
+void hex_percolation_default_config(struct hex_percolation_config *config);
+
+/* Returns 0 if the size is below 2 or memory runs out. */
+int hex_percolation_run(const struct hex_percolation_config *config,
+                        struct hex_percolation_stats *stats);
+
+#endif /* HEX_PERCOLATION_H */
@@ -0,0 +1,150 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "hex-playout.h"
+
+#define W HEX_PLAYOUT_WORDS
+
+int hex_playout_init(struct hex_playout *p, size_t size) {
+    const size_t cells = size * size;
+    const uint32_t zero = (uint32_t)cells;    // never reached
+    const uint32_t top = (uint32_t)cells + 1; // reached in every lane
+
+    memset(p, 0, sizeof(*p));
+    p->size = size;
+    p->neighbors = malloc(cells * sizeof(*p->neighbors));
+    p->empty = malloc(cells * sizeof(*p->empty));
+    p->red = calloc((cells + 2) * W, sizeof(uint64_t));
+    p->reach = calloc((cells + 2) * W, sizeof(uint64_t));
+    if (!p->neighbors || !p->empty || !p->red || !p->reach) {
+        hex_playout_destroy(p);
+        return 0;
+    }
+
+    for (size_t i = 0; i < cells; i++) {
+        size_t x = i % size;
+        size_t y = i / size;
+        uint32_t *n = p->neighbors[i];
+        n[0] = y != 0 ? (uint32_t)(i - size) : top;
+        n[1] = y != 0 ? (x != size - 1 ? (uint32_t)(i - size + 1) : zero)
+                      : top;
+        n[2] = x != size - 1 ? (uint32_t)(i + 1) : zero;
+        n[3] = y != size - 1 ? (uint32_t)(i + size) : zero;
+        n[4] = y != size - 1 && x != 0 ? (uint32_t)(i + size - 1) : zero;
+        n[5] = x != 0 ? (uint32_t)(i - 1) : zero;
+    }
+    for (size_t w = 0; w < W; w++)
+        p->reach[top * W + w] = ~(uint64_t)0;
+    return 1;
+}
+
+void hex_playout_destroy(struct hex_playout *p) {
+    free(p->neighbors);
+    free(p->empty);
+    free(p->red);
+    free(p->reach);
+    memset(p, 0, sizeof(*p));
+}
+
+void hex_playout_set_position(struct hex_playout *p,
+                              const hex_grid *g,
+                              cell_color to_move) {
+    const size_t cells = p->size * p->size;
+    p->empty_count = 0;
+    for (size_t i = 0; i < cells; i++) {
+        uint64_t fill = 0;
+        if (g->cells[i].color == RED)
+            fill = ~(uint64_t)0;
+        else if (g->cells[i].color == NEUTRAL)
+            p->empty[p->empty_count++] = (uint32_t)i;
+        for (size_t w = 0; w < W; w++)
+            p->red[i * W + w] = fill;
+    }
+    p->red_to_place =
+        to_move == RED ? (p->empty_count + 1) / 2 : p->empty_count / 2;
+}
+
+/* Gives each of the first `games` lanes its own uniformly random choice of
+   red_to_place empty cells, by a partial Fisher-Yates shuffle per lane. */
+static void fill(struct hex_playout *p, size_t games, struct hex_rng *rng) {
+    uint32_t *empty = p->empty;
+    const size_t n = p->empty_count;
+
+    for (size_t e = 0; e < n; e++)
+        memset(&p->red[empty[e] * W], 0, W * sizeof(uint64_t));
+
+    for (size_t lane = 0; lane < games; lane++) {
+        const uint64_t bit = (uint64_t)1 << (lane % 64);
+        const size_t word = lane / 64;
+        for (size_t k = 0; k < p->red_to_place; k++) {
+            size_t j = k + hex_rng_below(rng, (uint32_t)(n - k));
+            uint32_t cell = empty[j];
+            empty[j] = empty[k];
+            empty[k] = cell;
+            p->red[cell * W + word] |= bit;
+        }
+    }
+}
+
+/* One Gauss-Seidel pass over the cells in either direction, so that a chain
+   running the same way as the pass is followed in a single sweep. */
+static bool sweep(struct hex_playout *p, bool backwards) {
+    const size_t cells = p->size * p->size;
+    uint64_t changed = 0;
+
+    for (size_t k = 0; k < cells; k++) {
+        const size_t c = backwards ? cells - 1 - k : k;
+        const uint32_t *n = p->neighbors[c];
+        uint64_t acc[W];
+        for (size_t w = 0; w < W; w++) {
+            acc[w] = p->reach[n[0] * W + w] | p->reach[n[1] * W + w] |
+                     p->reach[n[2] * W + w] | p->reach[n[3] * W + w] |
+                     p->reach[n[4] * W + w] | p->reach[n[5] * W + w];
+        }
+        for (size_t w = 0; w < W; w++) {
+            uint64_t v = acc[w] & p->red[c * W + w];
+            changed |= v ^ p->reach[c * W + w];
+            p->reach[c * W + w] = v;
+        }
+    }
+    return changed != 0;
+}
+
+static size_t run_batch(struct hex_playout *p,
+                        size_t games,
+                        struct hex_rng *rng) {
+    const size_t cells = p->size * p->size;
+
+    fill(p, games, rng);
+    memset(p->reach, 0, cells * W * sizeof(uint64_t));
+    bool backwards = false;
+    while (sweep(p, backwards))
+        backwards = !backwards;
+
+    uint64_t wins[W] = {0};
+    for (size_t i = cells - p->size; i < cells; i++) {
+        for (size_t w = 0; w < W; w++)
+            wins[w] |= p->reach[i * W + w];
+    }
+
+    size_t red_wins = 0;
+    for (size_t w = 0; w < W && games > 0; w++) {
+        uint64_t mask = games >= 64 ? ~(uint64_t)0
+                                    : ((uint64_t)1 << games) - 1;
+        red_wins += (size_t)__builtin_popcountll(wins[w] & mask);
+        games = games >= 64 ? games - 64 : 0;
+    }
+    return red_wins;
+}
+
+size_t hex_playout_run(struct hex_playout *p,
+                       size_t games,
+                       struct hex_rng *rng) {
+    size_t red_wins = 0;
+    while (games > 0) {
+        size_t batch = games < HEX_PLAYOUT_LANES ? games : HEX_PLAYOUT_LANES;
+        red_wins += run_batch(p, batch, rng);
+        games -= batch;
+    }
+    return red_wins;
+}
@@ -0,0 +1,44 @@
+#if !defined(HEX_PLAYOUT_H)
+#define HEX_PLAYOUT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "hex-grid.h"
+#include "hex-random.h"
+
+/* Random playouts run bit-sliced: every cell holds one bit per game, so a
+   batch of HEX_PLAYOUT_LANES games is filled and checked in lockstep with
+   plain word operations (one AVX2 register per cell). Hex has no draws, so a
+   completely filled board is checked once, for red only. */
+
+#define HEX_PLAYOUT_WORDS 4
+#define HEX_PLAYOUT_LANES (64 * HEX_PLAYOUT_WORDS)
+
+struct hex_playout {
+    uint32_t (*neighbors)[6]; // board cells, or the two sentinel cells below
+    uint32_t *empty;          // empty cells of the position
+    uint64_t *red;            // (cells + 2) * HEX_PLAYOUT_WORDS lane bits
+    uint64_t *reach;          // red cells connected to the top edge
+    size_t size;
+    size_t empty_count;
+    size_t red_to_place; // red stones in every fill
+};
+
+int hex_playout_init(struct hex_playout *p, size_t size);
+
+void hex_playout_destroy(struct hex_playout *p);
+
+/* Takes the position of g, with `to_move` placing the next stone. g may use
+   either backend and is not modified. */
+void hex_playout_set_position(struct hex_playout *p,
+                              const hex_grid *g,
+                              cell_color to_move);
+
+/* Plays `games` random fills of the empty cells and returns how many of them
+   red won. */
+size_t hex_playout_run(struct hex_playout *p,
+                       size_t games,
+                       struct hex_rng *rng);
+
+#endif /* HEX_PLAYOUT_H */
@@ -0,0 +1,31 @@
+#if !defined(HEX_RANDOM_H)
+#define HEX_RANDOM_H
+
+#include <stdint.h>
+
+/* splitmix64: one word of state, so every thread or lane can own one. */
+struct hex_rng {
+    uint64_t state;
+};
+
+static inline void hex_rng_seed(struct hex_rng *rng, uint64_t seed) {
+    rng->state = seed;
+}
+
+static inline uint64_t hex_rng_next(struct hex_rng *rng) {
+    uint64_t z = (rng->state += 0x9e3779b97f4a7c15);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+    return z ^ (z >> 31);
+}
+
+/* Uniform in [0, n) by multiply-shift, no division. */
+static inline uint32_t hex_rng_below(struct hex_rng *rng, uint32_t n) {
+    return (uint32_t)(((hex_rng_next(rng) >> 32) * n) >> 32);
+}
+
+static inline double hex_rng_double(struct hex_rng *rng) {
+    return (double)(hex_rng_next(rng) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+#endif /* HEX_RANDOM_H */
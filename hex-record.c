@@ -0,0 +1,348 @@
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "hex-clock.h"
+#include "hex-record.h"
+
+#define FILE_HEADER 16
+#define GAME_HEADER 8
+#define TRAILER 16
+#define REPLAY_CHUNK 1024
+
+static const char file_magic[8] = "CHEXREC";
+static const char index_magic[8] = "CHEXIDX";
+
+static void put_le(uint8_t *p, uint64_t v, unsigned bytes) {
+    for (unsigned b = 0; b < bytes; b++)
+        p[b] = (uint8_t)(v >> (8 * b));
+}
+
+static uint64_t get_le(const uint8_t *p, unsigned bytes) {
+    uint64_t v = 0;
+    for (unsigned b = 0; b < bytes; b++)
+        v |= (uint64_t)p[b] << (8 * b);
+    return v;
+}
+
+static unsigned move_bytes(size_t size) {
+    return size <= 16 ? 1 : size <= 256 ? 2 : 4;
+}
+
+static int push_offset(uint64_t **offsets,
+                       size_t *count,
+                       size_t *capacity,
+                       uint64_t offset) {
+    if (*count == *capacity) {
+        size_t capacity2 = *capacity ? *capacity * 2 : 1024;
+        uint64_t *offsets2 = realloc(*offsets, capacity2 * sizeof(uint64_t));
+        if (!offsets2)
+            return 0;
+        *offsets = offsets2;
+        *capacity = capacity2;
+    }
+    (*offsets)[(*count)++] = offset;
+    return 1;
+}
+
+static uint64_t game_offset(const struct hex_record_archive *a, size_t k) {
+    return a->index ? get_le(a->index + 8 * k, 8) : a->offsets[k];
+}
+
+/* Indexes an archive whose writer never got to write the index, up to the
+   last complete game. A game of a size no board has is stepped over all
+   the same, for hex_record_get() to turn down. */
+static int walk_games(struct hex_record_archive *a) {
+    size_t capacity = 0;
+    uint64_t p = FILE_HEADER;
+    while (p + GAME_HEADER <= a->length && a->data[p] == 'g') {
+        const size_t size = (size_t)get_le(a->data + p + 2, 2);
+        const uint64_t moves = get_le(a->data + p + 4, 4);
+        const uint64_t end = p + GAME_HEADER + moves * move_bytes(size);
+        if (end > a->length)
+            break;
+        if (!push_offset(&a->offsets, &a->count, &capacity, p))
+            return 0;
+        p = end;
+    }
+    a->games_end = (size_t)p;
+    return 1;
+}
+
+int hex_record_open(struct hex_record_archive *a, const char *path) {
+    memset(a, 0, sizeof(*a));
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return 0;
+    struct stat st;
+    if (fstat(fd, &st) < 0 || (uint64_t)st.st_size < FILE_HEADER) {
+        close(fd);
+        return 0;
+    }
+    a->length = (size_t)st.st_size;
+    void *data = mmap(NULL, a->length, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+        return 0;
+    a->data = data;
+    if (memcmp(a->data, file_magic, 8) != 0 ||
+        get_le(a->data + 8, 4) != HEX_RECORD_VERSION) {
+        hex_record_close(a);
+        return 0;
+    }
+
+    const uint8_t *trailer = a->data + a->length - TRAILER;
+    if (a->length >= FILE_HEADER + TRAILER &&
+        memcmp(trailer + 8, index_magic, 8) == 0) {
+        const uint64_t count = get_le(trailer, 8);
+        if (count <= (a->length - FILE_HEADER - TRAILER) / 8) {
+            a->count = (size_t)count;
+            a->index = trailer - 8 * count;
+            a->games_end = (size_t)(a->index - a->data);
+            return 1;
+        }
+    }
+    if (!walk_games(a)) {
+        hex_record_close(a);
+        return 0;
+    }
+    return 1;
+}
+
+void hex_record_close(struct hex_record_archive *a) {
+    if (a->data)
+        munmap((void *)a->data, a->length);
+    free(a->offsets);
+    memset(a, 0, sizeof(*a));
+}
+
+int hex_record_get(const struct hex_record_archive *a,
+                   size_t k,
+                   struct hex_record_game *game) {
+    if (k >= a->count)
+        return 0;
+    const uint64_t p = game_offset(a, k);
+    if (p < FILE_HEADER || p + GAME_HEADER > a->games_end || a->data[p] != 'g')
+        return 0;
+    game->result = (cell_color)a->data[p + 1];
+    game->size = (size_t)get_le(a->data + p + 2, 2);
+    game->move_count = (size_t)get_le(a->data + p + 4, 4);
+    game->move_bytes = move_bytes(game->size);
+    game->moves = a->data + p + GAME_HEADER;
+    if (game->size == 0 || game->size > HEX_RECORD_MAX_SIZE)
+        return 0;
+    return p + GAME_HEADER + (uint64_t)game->move_count * game->move_bytes <=
+           a->games_end;
+}
+
+int hex_record_writer_open(struct hex_record_writer *w, const char *path) {
+    memset(w, 0, sizeof(*w));
+    w->file = fopen(path, "r+b");
+    if (!w->file)
+        w->file = fopen(path, "w+b");
+    if (!w->file || fseeko(w->file, 0, SEEK_END) != 0)
+        goto fail;
+
+    if (ftello(w->file) == 0) {
+        uint8_t header[FILE_HEADER] = {0};
+        memcpy(header, file_magic, 8);
+        put_le(header + 8, HEX_RECORD_VERSION, 4);
+        if (fwrite(header, sizeof(header), 1, w->file) != 1)
+            goto fail;
+        w->end = FILE_HEADER;
+    } else {
+        /* take over the games, and drop the index so the next game can go
+           where it was */
+        struct hex_record_archive a;
+        if (!hex_record_open(&a, path))
+            goto fail;
+        for (size_t k = 0; k < a.count; k++) {
+            if (!push_offset(&w->offsets, &w->count, &w->capacity,
+                             game_offset(&a, k))) {
+                hex_record_close(&a);
+                goto fail;
+            }
+        }
+        w->end = a.games_end;
+        hex_record_close(&a);
+        if (fflush(w->file) != 0 ||
+            ftruncate(fileno(w->file), (off_t)w->end) != 0)
+            goto fail;
+    }
+    if (fseeko(w->file, (off_t)w->end, SEEK_SET) != 0)
+        goto fail;
+    return 1;
+
+fail:
+    if (w->file)
+        fclose(w->file);
+    free(w->offsets);
+    memset(w, 0, sizeof(*w));
+    return 0;
+}
+
+int hex_record_write(struct hex_record_writer *w,
+                     const hex_grid *g,
+                     cell_color result) {
+    const unsigned bytes = move_bytes(g->size);
+    uint8_t buf[4096];
+    size_t len = GAME_HEADER;
+
+    if (g->size > HEX_RECORD_MAX_SIZE)
+        return 0;
+    buf[0] = 'g';
+    buf[1] = (uint8_t)result;
+    put_le(buf + 2, g->size, 2);
+    put_le(buf + 4, g->move_count, 4);
+    for (size_t m = 0; m < g->move_count; m++) {
+        if (len + bytes > sizeof(buf)) {
+            if (fwrite(buf, len, 1, w->file) != 1)
+                return 0;
+            len = 0;
+        }
+        put_le(buf + len, g->moves[m], bytes);
+        len += bytes;
+    }
+    if (fwrite(buf, len, 1, w->file) != 1)
+        return 0;
+    if (!push_offset(&w->offsets, &w->count, &w->capacity, w->end))
+        return 0;
+    w->end += GAME_HEADER + (uint64_t)g->move_count * bytes;
+    return 1;
+}
+
+int hex_record_writer_close(struct hex_record_writer *w) {
+    int ok = 1;
+    uint8_t buf[8];
+    for (size_t k = 0; k < w->count && ok; k++) {
+        put_le(buf, w->offsets[k], 8);
+        ok = fwrite(buf, 8, 1, w->file) == 1;
+    }
+    put_le(buf, w->count, 8);
+    ok = ok && fwrite(buf, 8, 1, w->file) == 1 &&
+         fwrite(index_magic, 8, 1, w->file) == 1;
+    ok = fclose(w->file) == 0 && ok;
+    free(w->offsets);
+    memset(w, 0, sizeof(*w));
+    return ok;
+}
+
+struct replay_worker {
+    const struct hex_record_archive *a;
+    _Atomic size_t *next_game;
+    hex_grid grid;
+    struct hex_replay_stats stats;
+};
+
+static void replay_game(struct replay_worker *w,
+                        const struct hex_record_game *game) {
+    hex_grid *g = &w->grid;
+    w->stats.moves += game->move_count;
+    if (game->move_count > w->stats.longest)
+        w->stats.longest = game->move_count;
+
+    if (!g->cells || g->size != game->size) {
+        if (g->cells)
+            hex_grid_destroy(g);
+        if (!hex_grid_init(g, game->size, HEX_GRID_UNION_FIND)) {
+            w->stats.invalid++;
+            return;
+        }
+    }
+    hex_grid_clear(g);
+
+    const size_t cells = game->size * game->size;
+    cell_color winner = NEUTRAL;
+    for (size_t m = 0; m < game->move_count; m++) {
+        const size_t i = hex_record_move(game, m);
+        if (winner != NEUTRAL || i >= cells ||
+            !hex_grid_open_cell(g, i, m % 2 ? BLUE : RED)) {
+            w->stats.invalid++;
+            return;
+        }
+        winner = hex_grid_get_winner(g);
+    }
+    if (winner == RED)
+        w->stats.red_wins++;
+    else if (winner == BLUE)
+        w->stats.blue_wins++;
+    else
+        w->stats.unfinished++;
+    if (winner != game->result)
+        w->stats.mismatches++;
+}
+
+static void *replay_run(void *arg) {
+    struct replay_worker *w = arg;
+    const size_t count = w->a->count;
+    for (;;) {
+        size_t k = atomic_fetch_add_explicit(w->next_game, REPLAY_CHUNK,
+                                             memory_order_relaxed);
+        if (k >= count)
+            break;
+        const size_t end = k + REPLAY_CHUNK < count ? k + REPLAY_CHUNK : count;
+        for (; k < end; k++) {
+            struct hex_record_game game;
+            w->stats.games++;
+            if (hex_record_get(w->a, k, &game))
+                replay_game(w, &game);
+            else
+                w->stats.invalid++;
+        }
+    }
+    return NULL;
+}
+
+int hex_record_replay(const struct hex_record_archive *a,
+                      unsigned threads,
+                      struct hex_replay_stats *stats) {
+    const unsigned n = threads ? threads : 1;
+    struct replay_worker *workers = calloc(n, sizeof(struct replay_worker));
+    pthread_t *tids = calloc(n, sizeof(pthread_t));
+    _Atomic size_t next_game = 0;
+    const double start = hex_clock_now();
+
+    if (!workers || !tids) {
+        free(workers);
+        free(tids);
+        return 0;
+    }
+    for (unsigned t = 0; t < n; t++) {
+        workers[t].a = a;
+        workers[t].next_game = &next_game;
+    }
+    /* games are handed out in chunks on demand, so the workers that cannot
+       get a thread just get none */
+    unsigned running = 1;
+    while (running < n && pthread_create(&tids[running], NULL, replay_run,
+                                          &workers[running]) == 0)
+        running++;
+    replay_run(&workers[0]);
+    for (unsigned t = 1; t < running; t++)
+        pthread_join(tids[t], NULL);
+
+    memset(stats, 0, sizeof(*stats));
+    for (unsigned t = 0; t < n; t++) {
+        const struct hex_replay_stats *s = &workers[t].stats;
+        stats->games += s->games;
+        stats->moves += s->moves;
+        stats->red_wins += s->red_wins;
+        stats->blue_wins += s->blue_wins;
+        stats->unfinished += s->unfinished;
+        stats->mismatches += s->mismatches;
+        stats->invalid += s->invalid;
+        if (s->longest > stats->longest)
+            stats->longest = s->longest;
+        if (workers[t].grid.cells)
+            hex_grid_destroy(&workers[t].grid);
+    }
+    free(workers);
+    free(tids);
+    stats->seconds = hex_clock_now() - start;
+    return 1;
+}
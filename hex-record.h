@@ -0,0 +1,104 @@
+#if !defined(HEX_RECORD_H)
+#define HEX_RECORD_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "hex-grid.h"
+
+/* Game archives. All numbers are little-endian.
+
+     file header  "CHEXREC" 0, u32 version, u32 reserved
+     game         u8 'g', u8 result (a cell_color), u16 board size,
+                  u32 move count, then the cells played, red first, one byte
+                  each on boards of up to 16x16, two up to 256x256, four
+                  beyond
+     ...
+     index        u64 file offset of every game, u64 game count,
+                  "CHEXIDX" 0
+
+   Games are only ever appended. The index is rewritten after the last game
+   when the writer is closed; an archive without one (a writer that never
+   closed) is indexed by walking the games instead. */
+
+#define HEX_RECORD_VERSION 1
+#define HEX_RECORD_MAX_SIZE 1000 // the largest board the game offers
+
+struct hex_record_writer {
+    FILE *file;
+    uint64_t *offsets;
+    size_t count;
+    size_t capacity;
+    uint64_t end; // where the next game goes
+};
+
+/* Opens an archive for appending, creating it if needed. Returns 0 on
+   failure. */
+int hex_record_writer_open(struct hex_record_writer *w, const char *path);
+
+/* Appends the moves of `g` as one game. Returns 0 on failure, or if the
+   board is larger than HEX_RECORD_MAX_SIZE. */
+int hex_record_write(struct hex_record_writer *w,
+                     const hex_grid *g,
+                     cell_color result);
+
+/* Writes the index and closes the file. Returns 0 on failure. */
+int hex_record_writer_close(struct hex_record_writer *w);
+
+struct hex_record_archive {
+    const uint8_t *data; // the whole file, memory-mapped
+    size_t length;
+    const uint8_t *index; // in the mapping, or NULL if `offsets` is used
+    uint64_t *offsets;    // built by walking an archive without an index
+    size_t count;
+    size_t games_end; // where the games stop and the index starts
+};
+
+struct hex_record_game {
+    size_t size;
+    cell_color result;
+    size_t move_count;
+    const uint8_t *moves;
+    unsigned move_bytes;
+};
+
+int hex_record_open(struct hex_record_archive *a, const char *path);
+
+void hex_record_close(struct hex_record_archive *a);
+
+/* Decodes game k. Returns 0 if it runs past the end of the games or its
+   board size is 0 or above HEX_RECORD_MAX_SIZE. */
+int hex_record_get(const struct hex_record_archive *a,
+                   size_t k,
+                   struct hex_record_game *game);
+
+static inline size_t hex_record_move(const struct hex_record_game *game,
+                                     size_t m) {
+    const uint8_t *p = game->moves + m * game->move_bytes;
+    size_t cell = p[0];
+    for (unsigned b = 1; b < game->move_bytes; b++)
+        cell |= (size_t)p[b] << (8 * b);
+    return cell;
+}
+
+struct hex_replay_stats {
+    size_t games;
+    size_t moves;
+    size_t red_wins; // as replayed
+    size_t blue_wins;
+    size_t unfinished;
+    size_t mismatches; // the recorded result differs from the replayed one
+    size_t invalid;    // bad or taken cells, or play after the game was won
+    size_t longest;
+    double seconds;
+};
+
+/* Plays every game of the archive through hex_grid_open_cell and
+   hex_grid_get_winner on `threads` threads, each with its own grids. */
+int hex_record_replay(const struct hex_record_archive *a,
+                      unsigned threads,
+                      struct hex_replay_stats *stats);
+
+#endif /* HEX_RECORD_H */
@@ -0,0 +1,382 @@
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__AVX__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#include "hex-resistance.h"
+
+/* labels of the cells that are not unknowns */
+#define NONE UINT32_MAX
+#define SOURCE (UINT32_MAX - 1)
+#define SINK (UINT32_MAX - 2)
+#define UNSEEN (UINT32_MAX - 3)
+
+static size_t padded(size_t n) {
+    return (n + 3) & ~(size_t)3;
+}
+
+/* The vector kernels. Lengths are padded to 4 and the padding is zero. */
+
+static double dot(const double *a, const double *b, size_t n) {
+    size_t i = 0;
+    double sum = 0;
+#if defined(__AVX__)
+    __m256d acc = _mm256_setzero_pd();
+    for (; i < n; i += 4)
+        acc = _mm256_add_pd(acc, _mm256_mul_pd(_mm256_loadu_pd(a + i),
+                                               _mm256_loadu_pd(b + i)));
+    __m128d half = _mm_add_pd(_mm256_castpd256_pd128(acc),
+                              _mm256_extractf128_pd(acc, 1));
+    sum = _mm_cvtsd_f64(_mm_add_sd(half, _mm_unpackhi_pd(half, half)));
+#elif defined(__SSE2__)
+    __m128d acc = _mm_setzero_pd();
+    for (; i < n; i += 2)
+        acc = _mm_add_pd(acc,
+                         _mm_mul_pd(_mm_loadu_pd(a + i), _mm_loadu_pd(b + i)));
+    sum = _mm_cvtsd_f64(_mm_add_sd(acc, _mm_unpackhi_pd(acc, acc)));
+#endif
+    for (; i < n; i++)
+        sum += a[i] * b[i];
+    return sum;
+}
+
+/* y += alpha * x */
+static void axpy(double *y, double alpha, const double *x, size_t n) {
+    size_t i = 0;
+#if defined(__AVX__)
+    const __m256d a = _mm256_set1_pd(alpha);
+    for (; i < n; i += 4) {
+        const __m256d ax = _mm256_mul_pd(a, _mm256_loadu_pd(x + i));
+        _mm256_storeu_pd(y + i, _mm256_add_pd(_mm256_loadu_pd(y + i), ax));
+    }
+#elif defined(__SSE2__)
+    const __m128d a = _mm_set1_pd(alpha);
+    for (; i < n; i += 2)
+        _mm_storeu_pd(y + i, _mm_add_pd(_mm_loadu_pd(y + i),
+                                        _mm_mul_pd(a, _mm_loadu_pd(x + i))));
+#endif
+    for (; i < n; i++)
+        y[i] += alpha * x[i];
+}
+
+/* y = x + beta * y */
+static void xpby(double *y, double beta, const double *x, size_t n) {
+    size_t i = 0;
+#if defined(__AVX__)
+    const __m256d b = _mm256_set1_pd(beta);
+    for (; i < n; i += 4) {
+        const __m256d by = _mm256_mul_pd(b, _mm256_loadu_pd(y + i));
+        _mm256_storeu_pd(y + i, _mm256_add_pd(_mm256_loadu_pd(x + i), by));
+    }
+#elif defined(__SSE2__)
+    const __m128d b = _mm_set1_pd(beta);
+    for (; i < n; i += 2)
+        _mm_storeu_pd(y + i, _mm_add_pd(_mm_loadu_pd(x + i),
+                                        _mm_mul_pd(b, _mm_loadu_pd(y + i))));
+#endif
+    for (; i < n; i++)
+        y[i] = x[i] + beta * y[i];
+}
+
+/* z = d * r, elementwise: the Jacobi preconditioner */
+static void scale(double *z, const double *d, const double *r, size_t n) {
+    size_t i = 0;
+#if defined(__AVX__)
+    for (; i < n; i += 4)
+        _mm256_storeu_pd(z + i, _mm256_mul_pd(_mm256_loadu_pd(d + i),
+                                              _mm256_loadu_pd(r + i)));
+#elif defined(__SSE2__)
+    for (; i < n; i += 2)
+        _mm_storeu_pd(z + i,
+                      _mm_mul_pd(_mm_loadu_pd(d + i), _mm_loadu_pd(r + i)));
+#endif
+    for (; i < n; i++)
+        z[i] = d[i] * r[i];
+}
+
+/* Starts from potentials falling evenly from each player's source edge
+   (top for red, left for blue) to the other. */
+void hex_resistance_forget(struct hex_resistance *r) {
+    const size_t size = r->size;
+    for (size_t i = 0; i < size * size; i++) {
+        r->potential[0][i] = 1.0 - ((double)(i / size) + 0.5) / (double)size;
+        r->potential[1][i] = 1.0 - ((double)(i % size) + 0.5) / (double)size;
+    }
+}
+
+int hex_resistance_init(struct hex_resistance *r, size_t size) {
+    const size_t cells = size * size;
+    memset(r, 0, sizeof(*r));
+    r->size = size;
+    r->tolerance = 1e-6;
+    r->max_iterations = 4 * cells + 16;
+    r->potential[0] = malloc(cells * sizeof(double));
+    r->potential[1] = malloc(cells * sizeof(double));
+    r->node = malloc((cells + 4) * sizeof(uint32_t));
+    r->queue = malloc(cells * sizeof(uint32_t));
+    r->member_start = malloc((cells + 1) * sizeof(uint32_t));
+    r->row_start = malloc((cells + 1) * sizeof(uint32_t));
+    r->column = malloc(6 * cells * sizeof(uint32_t));
+    r->value = malloc(6 * cells * sizeof(double));
+    r->diagonal = calloc(padded(cells), sizeof(double));
+    r->inverse = calloc(padded(cells), sizeof(double));
+    r->to_source = calloc(padded(cells), sizeof(double));
+    r->vectors = calloc(6 * padded(cells), sizeof(double));
+    r->slot = malloc(cells * sizeof(uint32_t));
+    if (!r->potential[0] || !r->potential[1] || !r->node || !r->queue ||
+        !r->member_start || !r->row_start || !r->column || !r->value ||
+        !r->diagonal || !r->inverse || !r->to_source || !r->vectors ||
+        !r->slot) {
+        hex_resistance_destroy(r);
+        return 0;
+    }
+    for (size_t i = 0; i < cells; i++)
+        r->slot[i] = NONE;
+    hex_resistance_forget(r);
+    return 1;
+}
+
+void hex_resistance_destroy(struct hex_resistance *r) {
+    free(r->potential[0]);
+    free(r->potential[1]);
+    free(r->node);
+    free(r->queue);
+    free(r->member_start);
+    free(r->row_start);
+    free(r->column);
+    free(r->value);
+    free(r->diagonal);
+    free(r->inverse);
+    free(r->to_source);
+    free(r->vectors);
+    free(r->slot);
+    memset(r, 0, sizeof(*r));
+}
+
+/* Labels cell i and the stones of its group `label`, appending them to the
+   queue from `tail`. Returns the new tail. */
+static size_t flood(struct hex_resistance *r,
+                    const hex_grid *g,
+                    size_t i,
+                    uint32_t label,
+                    size_t tail) {
+    const size_t cells = r->size * r->size;
+    const size_t start = tail;
+    r->node[i] = label;
+    r->queue[tail++] = (uint32_t)i;
+    if (g->cells[i].color == NEUTRAL)
+        return tail;
+    for (size_t s = start; s < tail; s++) {
+        for (unsigned k = 0; k < 6; k++) {
+            const uint32_t v = g->neighbors[r->queue[s]][k];
+            if (v < cells && r->node[v] == UNSEEN &&
+                g->cells[v].color == g->cells[i].color) {
+                r->node[v] = label;
+                r->queue[tail++] = v;
+            }
+        }
+    }
+    return tail;
+}
+
+static bool touches(const hex_grid *g, size_t i, uint32_t edge) {
+    for (unsigned k = 0; k < 6; k++) {
+        if (g->neighbors[i][k] == edge)
+            return true;
+    }
+    return false;
+}
+
+/* Numbers the empty cells and groups the source reaches, and queues their
+   cells node by node. Returns 0 if the source groups touch the sink, and
+   HUGE_VAL if the sink cannot be reached; 1 otherwise. */
+static double number_nodes(struct hex_resistance *r,
+                           const hex_grid *g,
+                           cell_color player) {
+    const size_t cells = r->size * r->size;
+    const uint32_t source = (uint32_t)(player == RED ? cells : cells + 2);
+    const uint32_t sink = source + 1;
+    size_t tail = 0, nodes = 0;
+    bool reached = false;
+
+    for (size_t i = 0; i < cells; i++)
+        r->node[i] = g->cells[i].color == 3 - player ? NONE : UNSEEN;
+    /* the sink's groups only need their labels */
+    for (size_t i = 0; i < cells; i++) {
+        if (r->node[i] == UNSEEN && g->cells[i].color == player &&
+            touches(g, i, sink))
+            flood(r, g, i, SINK, 0);
+    }
+    for (size_t i = 0; i < cells; i++) {
+        if (g->cells[i].color != player || !touches(g, i, source))
+            continue;
+        if (r->node[i] == SINK)
+            return 0;
+        if (r->node[i] == UNSEEN)
+            tail = flood(r, g, i, SOURCE, tail);
+    }
+    /* then breadth first from the source edge and its groups */
+    for (size_t i = 0; i < cells; i++) {
+        if (r->node[i] == UNSEEN && touches(g, i, source)) {
+            r->member_start[nodes] = (uint32_t)tail;
+            tail = flood(r, g, i, (uint32_t)nodes++, tail);
+        }
+    }
+    for (size_t s = 0; s < tail; s++) {
+        for (unsigned k = 0; k < 6; k++) {
+            const uint32_t v = g->neighbors[r->queue[s]][k];
+            if (v == sink || (v < cells && r->node[v] == SINK)) {
+                reached = true;
+            } else if (v < cells && r->node[v] == UNSEEN) {
+                r->member_start[nodes] = (uint32_t)tail;
+                tail = flood(r, g, v, (uint32_t)nodes++, tail);
+            }
+        }
+    }
+    r->member_start[nodes] = (uint32_t)tail;
+    r->nodes = nodes;
+    return reached ? 1 : HUGE_VAL;
+}
+
+/* The rows of the Laplacian over the unknowns, and the right side. */
+static void assemble(struct hex_resistance *r,
+                     const hex_grid *g,
+                     cell_color player) {
+    const size_t cells = r->size * r->size;
+    const uint32_t source = (uint32_t)(player == RED ? cells : cells + 2);
+    const uint32_t sink = source + 1;
+    double *b = r->vectors;
+    uint32_t nnz = 0;
+
+    for (uint32_t id = 0; id < r->nodes; id++) {
+        double diagonal = 0, to_source = 0;
+        r->row_start[id] = nnz;
+        for (uint32_t m = r->member_start[id]; m < r->member_start[id + 1];
+             m++) {
+            const uint32_t u = r->queue[m];
+            const double ru = g->cells[u].color == player ? 0 : 1;
+            for (unsigned k = 0; k < 6; k++) {
+                const uint32_t v = g->neighbors[u][k];
+                /* the edges are listed once for each side they touch */
+                if (k > 0 && v == g->neighbors[u][k - 1])
+                    continue;
+                if (v >= cells) {
+                    /* only empty cells touch the edges here */
+                    if (v == source)
+                        to_source += 1;
+                    if (v == source || v == sink)
+                        diagonal += 1;
+                    continue;
+                }
+                const uint32_t lv = r->node[v];
+                if (lv == NONE || lv == UNSEEN || lv == id)
+                    continue;
+                const double c =
+                    1 / (ru + (g->cells[v].color == player ? 0 : 1));
+                diagonal += c;
+                if (lv == SOURCE) {
+                    to_source += c;
+                } else if (lv != SINK && r->slot[lv] == NONE) {
+                    r->slot[lv] = nnz;
+                    r->column[nnz] = lv;
+                    r->value[nnz++] = -c;
+                } else if (lv != SINK) {
+                    r->value[r->slot[lv]] -= c;
+                }
+            }
+        }
+        for (uint32_t e = r->row_start[id]; e < nnz; e++)
+            r->slot[r->column[e]] = NONE;
+        r->diagonal[id] = diagonal;
+        r->inverse[id] = 1 / diagonal;
+        r->to_source[id] = to_source;
+        b[id] = to_source; // the source is at potential 1
+    }
+    r->row_start[r->nodes] = nnz;
+    for (size_t id = r->nodes; id < padded(r->nodes); id++)
+        r->inverse[id] = b[id] = 0;
+}
+
+static void multiply(const struct hex_resistance *r,
+                     const double *p,
+                     double *q) {
+    for (size_t i = 0; i < r->nodes; i++) {
+        double sum = r->diagonal[i] * p[i];
+        for (uint32_t e = r->row_start[i]; e < r->row_start[i + 1]; e++)
+            sum += r->value[e] * p[r->column[e]];
+        q[i] = sum;
+    }
+}
+
+/* Preconditioned conjugate gradients from the x already in place. */
+static void conjugate_gradients(struct hex_resistance *r) {
+    const size_t cap = padded(r->size * r->size), n = padded(r->nodes);
+    double *b = r->vectors, *x = b + cap, *res = x + cap, *z = res + cap;
+    double *p = z + cap, *q = p + cap;
+    size_t k = 0;
+
+    memset(q, 0, n * sizeof(double));
+    multiply(r, x, q);
+    for (size_t i = 0; i < n; i++)
+        res[i] = b[i] - q[i];
+    const double limit = r->tolerance * r->tolerance * dot(b, b, n);
+    if (dot(res, res, n) > limit) {
+        scale(z, r->inverse, res, n);
+        memcpy(p, z, n * sizeof(double));
+        double rz = dot(res, z, n);
+        while (k < r->max_iterations) {
+            multiply(r, p, q);
+            const double alpha = rz / dot(p, q, n);
+            axpy(x, alpha, p, n);
+            axpy(res, -alpha, q, n);
+            k++;
+            if (dot(res, res, n) <= limit)
+                break;
+            scale(z, r->inverse, res, n);
+            const double next = dot(res, z, n);
+            xpby(p, next / rz, z, n);
+            rz = next;
+        }
+    }
+    r->iterations = k;
+}
+
+double hex_resistance_solve(struct hex_resistance *r,
+                            const hex_grid *g,
+                            cell_color player) {
+    const size_t cap = padded(r->size * r->size);
+    double *potential = r->potential[player == BLUE];
+    double *x = r->vectors + cap;
+
+    r->iterations = 0;
+    const double found = number_nodes(r, g, player);
+    if (found != 1)
+        return found;
+    assemble(r, g, player);
+    for (size_t id = 0; id < padded(r->nodes); id++)
+        x[id] = id < r->nodes ? potential[r->queue[r->member_start[id]]] : 0;
+    conjugate_gradients(r);
+
+    double current = 0;
+    for (uint32_t id = 0; id < r->nodes; id++) {
+        current += r->to_source[id] * (1 - x[id]);
+        for (uint32_t m = r->member_start[id]; m < r->member_start[id + 1];
+             m++)
+            potential[r->queue[m]] = x[id];
+    }
+    return current > 0 ? 1 / current : HUGE_VAL;
+}
+
+double hex_resistance_evaluate(struct hex_resistance *r, const hex_grid *g) {
+    const double red = hex_resistance_solve(r, g, RED);
+    const double blue = hex_resistance_solve(r, g, BLUE);
+    if (red == 0 || blue == HUGE_VAL)
+        return HEX_RESISTANCE_CLAMP;
+    if (blue == 0 || red == HUGE_VAL)
+        return -HEX_RESISTANCE_CLAMP;
+    const double v = log(blue / red);
+    return fmax(-HEX_RESISTANCE_CLAMP, fmin(HEX_RESISTANCE_CLAMP, v));
+}
@@ -0,0 +1,63 @@
+#if !defined(HEX_RESISTANCE_H)
+#define HEX_RESISTANCE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "hex-grid.h"
+
+/* Shannon's and Anshelevich's circuit model of a position: for each player
+   the board is a resistor network between the player's two edges, where an
+   empty cell has resistance 1, the player's own stones 0 and the
+   opponent's stones infinity. A player closer to connecting has a smaller
+   resistance, and log(R_blue / R_red) makes a classic evaluation.
+
+   Own stones are merged with their groups (and the edges they touch) into
+   single nodes, which keeps the Laplacian positive definite. It is kept in
+   compressed sparse rows and solved by conjugate gradients with a Jacobi
+   preconditioner, with the vector kernels in AVX or SSE2 where the build
+   has them. Each solve starts from the potentials of the last one for the
+   same player, so re-solving after a move takes a few iterations. */
+
+#define HEX_RESISTANCE_CLAMP 10.0 // evaluations lie in [-CLAMP, CLAMP]
+
+struct hex_resistance {
+    size_t size;
+    double tolerance;       // on the residual, relative to the right side
+    size_t max_iterations;
+    size_t iterations;      // of the last solve
+    double *potential[2];   // per cell, for red and blue: the warm start
+    /* the system of the current solve */
+    uint32_t *node;         // of each cell and virtual cell
+    uint32_t *queue;        // cells grouped by node, after the source's
+    uint32_t *member_start; // nodes + 1 offsets into queue
+    uint32_t *row_start;    // nodes + 1 offsets into column and value
+    uint32_t *column;
+    double *value;          // off-diagonal conductances, negated
+    double *diagonal;
+    double *inverse;        // of the diagonal, zero in the padding
+    double *to_source;      // conductance of each node to the source edge
+    double *vectors;        // b, x, r, z, p and q, padded to 4
+    uint32_t *slot;         // scratch for merging parallel conductances
+    size_t nodes;           // unknowns of the current solve
+};
+
+/* Returns 0 on failure. */
+int hex_resistance_init(struct hex_resistance *r, size_t size);
+
+void hex_resistance_destroy(struct hex_resistance *r);
+
+/* Drops the warm start, for a position unrelated to the last one. */
+void hex_resistance_forget(struct hex_resistance *r);
+
+/* The resistance between the edges of `player` in g: 0 if they are
+   connected already, HUGE_VAL if they cannot be any more. g must be of
+   the size given to hex_resistance_init(). */
+double hex_resistance_solve(struct hex_resistance *r,
+                            const hex_grid *g,
+                            cell_color player);
+
+/* log(R_blue / R_red), clamped: positive when red stands better. */
+double hex_resistance_evaluate(struct hex_resistance *r, const hex_grid *g);
+
+#endif /* HEX_RESISTANCE_H */
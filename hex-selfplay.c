@@ -0,0 +1,556 @@
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "hex-clock.h"
+#include "hex-random.h"
+#include "hex-selfplay.h"
+
+#define HEADER 24
+#define BUFFERS 4 // shards being filled, waiting or being written
+#define BOUND(n) ((n) + (n) / 128 + 1)
+#define NO_SHARD BUFFERS
+
+static const char shard_magic[8] = "CHEXSHD";
+
+static cell_color other(cell_color player) {
+    return 1 + (player % 2);
+}
+
+static void put_le(uint8_t *p, uint64_t v, unsigned bytes) {
+    for (unsigned b = 0; b < bytes; b++)
+        p[b] = (uint8_t)(v >> (8 * b));
+}
+
+static uint64_t get_le(const uint8_t *p, unsigned bytes) {
+    uint64_t v = 0;
+    for (unsigned b = 0; b < bytes; b++)
+        v |= (uint64_t)p[b] << (8 * b);
+    return v;
+}
+
+static size_t sample_bytes(size_t size) {
+    return 2 + (size * size + 3) / 4 + 2 * size * size;
+}
+
+/* A byte t below 128 is followed by t + 1 bytes as they are, and one from
+   128 up stands for t - 126 zeros. A single zero is cheaper left among the
+   bytes around it. */
+static size_t compress(const uint8_t *in, size_t n, uint8_t *out) {
+    size_t i = 0, o = 0;
+    while (i < n) {
+        size_t run = 0;
+        while (i + run < n && in[i + run] == 0 && run < 129)
+            run++;
+        if (run >= 2) {
+            out[o++] = (uint8_t)(126 + run);
+            i += run;
+            continue;
+        }
+        const size_t start = i;
+        while (i < n && i - start < 128 &&
+               !(in[i] == 0 && i + 1 < n && in[i + 1] == 0))
+            i++;
+        out[o++] = (uint8_t)(i - start - 1);
+        memcpy(out + o, in + start, i - start);
+        o += i - start;
+    }
+    return o;
+}
+
+/* Returns 0 unless `in` comes to exactly n bytes. */
+static int decompress(const uint8_t *in,
+                      size_t length,
+                      uint8_t *out,
+                      size_t n) {
+    size_t i = 0, o = 0;
+    while (i < length) {
+        const unsigned t = in[i++];
+        const size_t count = t < 128 ? t + 1 : t - 126;
+        if (count > n - o || (t < 128 && count > length - i))
+            return 0;
+        if (t < 128) {
+            memcpy(out + o, in + i, count);
+            i += count;
+        } else {
+            memset(out + o, 0, count);
+        }
+        o += count;
+    }
+    return o == n;
+}
+
+void hex_selfplay_default_config(struct hex_selfplay_config *config) {
+    memset(config, 0, sizeof(*config));
+    config->size = 11;
+    config->games = 1000;
+    config->threads = 1;
+    config->seed = 0x68657873656c66;
+    config->opening = 2;
+    config->shard_samples = 65536;
+    config->compress = true;
+    config->prefix = "selfplay";
+    hex_mcts_default_config(&config->engine);
+    config->engine.max_seconds = 0;
+    config->engine.max_playouts = 1000;
+}
+
+struct shard {
+    uint8_t *samples;
+    size_t count;
+};
+
+/* The shards between the searches and the writer thread. One is being
+   filled, the full ones queue up in order, and the rest are free. */
+struct pipeline {
+    const struct hex_selfplay_config *config;
+    size_t sample_bytes;
+    pthread_mutex_t lock;
+    pthread_cond_t full; // the writer waits for a shard to write
+    pthread_cond_t free; // the searches wait for a shard to fill
+    struct shard shards[BUFFERS];
+    size_t filling; // NO_SHARD while all of them are full
+    size_t queue[BUFFERS];
+    size_t queue_head;
+    size_t queue_length;
+    size_t spare[BUFFERS];
+    size_t spare_count;
+    bool done;
+    int ok; // no write failed
+    /* the writer's */
+    uint8_t *packed;
+    char *path;
+    size_t written;
+    uint64_t bytes;
+};
+
+static int write_shard(struct pipeline *p, const struct shard *shard) {
+    const struct hex_selfplay_config *config = p->config;
+    const size_t bytes = p->sample_bytes;
+    sprintf(p->path, "%s-%05zu.shard", config->prefix, p->written);
+    FILE *f = fopen(p->path, "wb");
+    if (!f)
+        return 0;
+    uint8_t header[HEADER];
+    memcpy(header, shard_magic, 8);
+    put_le(header + 8, HEX_SELFPLAY_VERSION, 4);
+    put_le(header + 12, config->size, 2);
+    header[14] = config->compress ? HEX_SELFPLAY_COMPRESSED : 0;
+    header[15] = 0;
+    put_le(header + 16, shard->count, 4);
+    put_le(header + 20, HEX_SELFPLAY_BLOCK_SAMPLES, 4);
+    int ok = fwrite(header, HEADER, 1, f) == 1;
+    uint64_t total = HEADER;
+
+    if (!config->compress) {
+        ok = ok && fwrite(shard->samples, bytes, shard->count, f) ==
+                       shard->count;
+        total += (uint64_t)shard->count * bytes;
+    }
+    for (size_t k = 0; config->compress && ok && k < shard->count;
+         k += HEX_SELFPLAY_BLOCK_SAMPLES) {
+        size_t n = shard->count - k;
+        if (n > HEX_SELFPLAY_BLOCK_SAMPLES)
+            n = HEX_SELFPLAY_BLOCK_SAMPLES;
+        const size_t length =
+            compress(shard->samples + k * bytes, n * bytes, p->packed + 4);
+        put_le(p->packed, length, 4);
+        ok = fwrite(p->packed, length + 4, 1, f) == 1;
+        total += length + 4;
+    }
+    ok = fclose(f) == 0 && ok;
+    p->written++;
+    p->bytes += total;
+    return ok;
+}
+
+static void *writer_run(void *arg) {
+    struct pipeline *p = arg;
+    pthread_mutex_lock(&p->lock);
+    for (;;) {
+        while (!p->queue_length && !p->done)
+            pthread_cond_wait(&p->full, &p->lock);
+        if (!p->queue_length)
+            break;
+        const size_t k = p->queue[p->queue_head];
+        p->queue_head = (p->queue_head + 1) % BUFFERS;
+        p->queue_length--;
+        const bool write = p->ok;
+        pthread_mutex_unlock(&p->lock);
+        const int ok = !write || write_shard(p, &p->shards[k]);
+        pthread_mutex_lock(&p->lock);
+        p->ok = p->ok && ok;
+        p->shards[k].count = 0;
+        p->spare[p->spare_count++] = k;
+        pthread_cond_broadcast(&p->free);
+    }
+    pthread_mutex_unlock(&p->lock);
+    return NULL;
+}
+
+/* Queues the shard being filled for the writer, and starts on a free one
+   if there is one. Called with the lock. */
+static void hand_over(struct pipeline *p) {
+    p->queue[(p->queue_head + p->queue_length) % BUFFERS] = p->filling;
+    p->queue_length++;
+    pthread_cond_signal(&p->full);
+    p->filling = p->spare_count ? p->spare[--p->spare_count] : NO_SHARD;
+}
+
+/* Adds n samples to the shards. Returns 0 once a write has failed. */
+static int append(struct pipeline *p,
+                  const uint8_t *samples,
+                  size_t n,
+                  double *wait) {
+    const size_t bytes = p->sample_bytes;
+    pthread_mutex_lock(&p->lock);
+    while (n && p->ok) {
+        if (p->filling == NO_SHARD) {
+            const double start = hex_clock_now();
+            while (p->filling == NO_SHARD && !p->spare_count)
+                pthread_cond_wait(&p->free, &p->lock);
+            *wait += hex_clock_now() - start;
+            if (p->filling == NO_SHARD)
+                p->filling = p->spare[--p->spare_count];
+            continue;
+        }
+        struct shard *shard = &p->shards[p->filling];
+        size_t room = p->config->shard_samples - shard->count;
+        if (room > n)
+            room = n;
+        memcpy(shard->samples + shard->count * bytes, samples, room * bytes);
+        shard->count += room;
+        samples += room * bytes;
+        n -= room;
+        if (shard->count == p->config->shard_samples)
+            hand_over(p);
+    }
+    const int ok = p->ok;
+    pthread_mutex_unlock(&p->lock);
+    return ok;
+}
+
+struct selfplay_worker {
+    const struct hex_selfplay_config *config;
+    struct pipeline *pipeline;
+    _Atomic size_t *next_game;
+    hex_grid grid;
+    struct hex_mcts engine;
+    bool ready;
+    uint64_t *visits;
+    uint8_t *game; // the samples of the game being played
+    size_t games;
+    size_t samples;
+    double wait;
+    int ok;
+};
+
+static void release(struct selfplay_worker *w) {
+    if (w->ready) {
+        hex_mcts_destroy(&w->engine);
+        hex_grid_destroy(&w->grid);
+    }
+    free(w->visits);
+    free(w->game);
+    w->ready = false;
+    w->visits = NULL;
+    w->game = NULL;
+}
+
+static int setup(struct selfplay_worker *w) {
+    const size_t size = w->config->size, cells = size * size;
+    struct hex_mcts_config config = w->config->engine;
+    config.threads = 1;
+    config.tt = NULL;
+    hex_mcts_fit_nodes(&config, size);
+    w->visits = malloc(cells * sizeof(uint64_t));
+    w->game = malloc(cells * w->pipeline->sample_bytes);
+    if (!w->visits || !w->game ||
+        !hex_grid_init(&w->grid, size, HEX_GRID_UNION_FIND))
+        return 0;
+    if (!hex_mcts_init(&w->engine, &config, size)) {
+        hex_grid_destroy(&w->grid);
+        return 0;
+    }
+    w->ready = true;
+    return 1;
+}
+
+/* The position just searched, with the winner left for later. */
+static void pack(struct selfplay_worker *w, uint8_t *out, cell_color player) {
+    const size_t cells = w->grid.size * w->grid.size;
+    const uint64_t total = hex_mcts_root_visits(&w->engine, w->visits);
+    uint8_t *visits = out + 2 + (cells + 3) / 4;
+    out[0] = (uint8_t)player;
+    out[1] = NEUTRAL;
+    memset(out + 2, 0, (cells + 3) / 4);
+    for (size_t i = 0; i < cells; i++) {
+        out[2 + i / 4] |= (uint8_t)(w->grid.cells[i].color << (2 * (i % 4)));
+        /* rounded down, so the shares never add up past 1 */
+        const uint64_t share = total ? w->visits[i] * 65535 / total : 0;
+        put_le(visits + 2 * i, share, 2);
+    }
+}
+
+static int play_game(struct selfplay_worker *w, size_t g) {
+    const struct hex_selfplay_config *config = w->config;
+    const size_t cells = config->size * config->size;
+    const size_t bytes = w->pipeline->sample_bytes;
+    hex_grid *grid = &w->grid;
+    struct hex_rng rng;
+    cell_color player = RED, winner;
+    size_t n = 0;
+
+    hex_rng_seed(&rng, config->seed ^ (g + 1) * 0x9e3779b97f4a7c15);
+    hex_grid_clear(grid);
+    for (unsigned k = 0; k < config->opening && k < cells &&
+                         hex_grid_get_winner(grid) == NEUTRAL;
+         k++) {
+        size_t i;
+        do
+            i = hex_rng_below(&rng, (uint32_t)cells);
+        while (grid->cells[i].color != NEUTRAL);
+        hex_grid_open_cell(grid, i, player);
+        player = other(player);
+    }
+    hex_rng_seed(&w->engine.rng, hex_rng_next(&rng));
+
+    while ((winner = hex_grid_get_winner(grid)) == NEUTRAL) {
+        hex_mcts_set_position(&w->engine, grid, player);
+        const size_t i = hex_mcts_search(&w->engine, NULL);
+        if (i == (size_t)-1)
+            return 0;
+        pack(w, w->game + n++ * bytes, player);
+        hex_grid_open_cell(grid, i, player);
+        player = other(player);
+    }
+    for (size_t k = 0; k < n; k++)
+        w->game[k * bytes + 1] = (uint8_t)winner;
+    w->games++;
+    w->samples += n;
+    return append(w->pipeline, w->game, n, &w->wait);
+}
+
+static void *selfplay_run(void *arg) {
+    struct selfplay_worker *w = arg;
+    while (w->ok) {
+        size_t g = atomic_fetch_add_explicit(w->next_game, 1,
+                                             memory_order_relaxed);
+        if (g >= w->config->games)
+            break;
+        w->ok = play_game(w, g);
+    }
+    return NULL;
+}
+
+static void pipeline_destroy(struct pipeline *p) {
+    for (size_t k = 0; k < BUFFERS; k++)
+        free(p->shards[k].samples);
+    free(p->packed);
+    free(p->path);
+    pthread_cond_destroy(&p->free);
+    pthread_cond_destroy(&p->full);
+    pthread_mutex_destroy(&p->lock);
+}
+
+static int pipeline_init(struct pipeline *p,
+                         const struct hex_selfplay_config *config) {
+    const size_t bytes = sample_bytes(config->size);
+    memset(p, 0, sizeof(*p));
+    p->config = config;
+    p->sample_bytes = bytes;
+    p->ok = 1;
+    if (pthread_mutex_init(&p->lock, NULL) != 0)
+        return 0;
+    if (pthread_cond_init(&p->full, NULL) != 0) {
+        pthread_mutex_destroy(&p->lock);
+        return 0;
+    }
+    if (pthread_cond_init(&p->free, NULL) != 0) {
+        pthread_cond_destroy(&p->full);
+        pthread_mutex_destroy(&p->lock);
+        return 0;
+    }
+    int ok = 1;
+    for (size_t k = 0; k < BUFFERS; k++) {
+        p->shards[k].samples = malloc(config->shard_samples * bytes);
+        ok = ok && p->shards[k].samples;
+        if (k)
+            p->spare[p->spare_count++] = k;
+    }
+    p->packed = malloc(4 + BOUND(HEX_SELFPLAY_BLOCK_SAMPLES * bytes));
+    p->path = malloc(strlen(config->prefix) + 32);
+    if (!ok || !p->packed || !p->path) {
+        pipeline_destroy(p);
+        return 0;
+    }
+    return 1;
+}
+
+int hex_selfplay_run(const struct hex_selfplay_config *config,
+                     struct hex_selfplay_stats *stats) {
+    const unsigned n = config->threads ? config->threads : 1;
+    const double start = hex_clock_now();
+    struct pipeline pipeline;
+    pthread_t writer;
+    _Atomic size_t next_game = 0;
+
+    memset(stats, 0, sizeof(*stats));
+    if (config->size < 2 || config->size * config->size > UINT16_MAX ||
+        config->shard_samples < 1 || config->shard_samples > UINT32_MAX ||
+        !config->prefix)
+        return 0;
+    if (!pipeline_init(&pipeline, config))
+        return 0;
+    struct selfplay_worker *workers =
+        calloc(n, sizeof(struct selfplay_worker));
+    pthread_t *threads = calloc(n, sizeof(pthread_t));
+    int ok = workers && threads;
+    for (unsigned t = 0; ok && t < n; t++) {
+        workers[t].config = config;
+        workers[t].pipeline = &pipeline;
+        workers[t].next_game = &next_game;
+        workers[t].ok = 1;
+        ok = setup(&workers[t]);
+    }
+    ok = ok && pthread_create(&writer, NULL, writer_run, &pipeline) == 0;
+
+    if (ok) {
+        /* games go to whichever worker asks next, as in the arena */
+        unsigned running = 1;
+        while (running < n && pthread_create(&threads[running], NULL,
+                                              selfplay_run,
+                                              &workers[running]) == 0)
+            running++;
+        selfplay_run(&workers[0]);
+        for (unsigned t = 1; t < running; t++)
+            pthread_join(threads[t], NULL);
+
+        pthread_mutex_lock(&pipeline.lock);
+        if (pipeline.filling != NO_SHARD &&
+            pipeline.shards[pipeline.filling].count)
+            hand_over(&pipeline);
+        pipeline.done = true;
+        pthread_cond_signal(&pipeline.full);
+        pthread_mutex_unlock(&pipeline.lock);
+        pthread_join(writer, NULL);
+
+        ok = pipeline.ok;
+        for (unsigned t = 0; t < running; t++) {
+            ok = ok && workers[t].ok;
+            stats->games += workers[t].games;
+            stats->samples += workers[t].samples;
+            stats->writer_wait += workers[t].wait;
+        }
+        stats->shards = pipeline.written;
+        stats->bytes = pipeline.bytes;
+    }
+
+    for (unsigned t = 0; workers && t < n; t++)
+        release(&workers[t]);
+    free(workers);
+    free(threads);
+    pipeline_destroy(&pipeline);
+    stats->seconds = hex_clock_now() - start;
+    stats->samples_per_second =
+        stats->seconds > 0 ? (double)stats->samples / stats->seconds : 0;
+    return ok;
+}
+
+int hex_selfplay_shard_open(struct hex_selfplay_shard *s,
+                            const char *path,
+                            bool symmetry) {
+    memset(s, 0, sizeof(*s));
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return 0;
+    struct stat st;
+    if (fstat(fd, &st) < 0 || (uint64_t)st.st_size < HEADER) {
+        close(fd);
+        return 0;
+    }
+    s->length = (size_t)st.st_size;
+    void *data = mmap(NULL, s->length, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+        return 0;
+    s->data = data;
+    s->size = (size_t)get_le(s->data + 12, 2);
+    s->compressed = s->data[14] & HEX_SELFPLAY_COMPRESSED;
+    s->count = (size_t)get_le(s->data + 16, 4);
+    s->block_samples = (size_t)get_le(s->data + 20, 4);
+    s->sample_bytes = sample_bytes(s->size);
+    s->symmetry = symmetry;
+    s->offset = HEADER;
+    if (memcmp(s->data, shard_magic, 8) != 0 ||
+        get_le(s->data + 8, 4) != HEX_SELFPLAY_VERSION || s->size < 1 ||
+        s->block_samples < 1 || s->block_samples > UINT16_MAX ||
+        (!s->compressed &&
+         s->length != HEADER + (uint64_t)s->count * s->sample_bytes)) {
+        hex_selfplay_shard_close(s);
+        return 0;
+    }
+    if (s->compressed) {
+        s->block = malloc(s->block_samples * s->sample_bytes);
+        if (!s->block) {
+            hex_selfplay_shard_close(s);
+            return 0;
+        }
+    }
+    return 1;
+}
+
+void hex_selfplay_shard_close(struct hex_selfplay_shard *s) {
+    if (s->data)
+        munmap((void *)s->data, s->length);
+    free(s->block);
+    memset(s, 0, sizeof(*s));
+}
+
+/* Uncompresses the block that starts at sample s->next. */
+static int read_block(struct hex_selfplay_shard *s) {
+    size_t n = s->count - s->next;
+    if (n > s->block_samples)
+        n = s->block_samples;
+    if (s->length - s->offset < 4)
+        return 0;
+    const size_t length = (size_t)get_le(s->data + s->offset, 4);
+    if (s->length - s->offset - 4 < length ||
+        !decompress(s->data + s->offset + 4, length, s->block,
+                    n * s->sample_bytes))
+        return 0;
+    s->offset += 4 + length;
+    return 1;
+}
+
+int hex_selfplay_shard_next(struct hex_selfplay_shard *s,
+                            struct hex_selfplay_sample *sample) {
+    sample->size = s->size;
+    if (s->rotated) {
+        s->rotated = false;
+        sample->data = s->current;
+        sample->rotated = true;
+        return 1;
+    }
+    if (s->next == s->count)
+        return 0;
+    if (!s->compressed) {
+        s->current = s->data + HEADER + s->next * s->sample_bytes;
+    } else {
+        const size_t k = s->next % s->block_samples;
+        if (k == 0 && !read_block(s))
+            return 0;
+        s->current = s->block + k * s->sample_bytes;
+    }
+    s->next++;
+    s->rotated = s->symmetry;
+    sample->data = s->current;
+    sample->rotated = false;
+    return 1;
+}
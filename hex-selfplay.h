@@ -0,0 +1,137 @@
+#if !defined(HEX_SELFPLAY_H)
+#define HEX_SELFPLAY_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "hex-grid.h"
+#include "hex-mcts.h"
+
+/* Training data from self-play. Games are shared out between threads as in
+   the arena, each with its own board and single-threaded search, and every
+   searched position becomes a sample: the board, the side to move, the
+   share of the search's visits each move got and who won in the end. A
+   finished game's samples go into the shard being filled, and full shards
+   are handed to a writer thread, so the searches never wait on the disk
+   unless it falls behind by more than a few shards.
+
+   Shards hold up to `shard_samples` samples of one board size each, and
+   all numbers are little-endian:
+
+     header  "CHEXSHD" 0, u32 version, u16 board size, u8 flags
+             (HEX_SELFPLAY_COMPRESSED), u8 reserved, u32 sample count,
+             u32 samples per block
+     sample  u8 side to move, u8 winner (both cell_colors), the cells two
+             bits each, four to a byte from a1 up in the low bits first,
+             then a u16 per cell, its share of the visits in 65535ths
+
+   Samples follow the header back to back, or when compressed in blocks,
+   each a u32 length and then the block's samples with every run of zero
+   bytes (most of the visits, and the empty cells early on) cut down to a
+   byte. An uncompressed shard is read where it lies in the mapping. */
+
+#define HEX_SELFPLAY_VERSION 1
+#define HEX_SELFPLAY_COMPRESSED 1
+#define HEX_SELFPLAY_BLOCK_SAMPLES 256
+
+struct hex_selfplay_config {
+    size_t size;
+    size_t games;
+    unsigned threads;
+    uint64_t seed;
+    unsigned opening;     // random stones before the search takes over
+    size_t shard_samples; // per shard, the last one may hold fewer
+    bool compress;
+    const char *prefix; // shards are written to PREFIX-00000.shard and up
+    /* threads and tt are ignored: each game searches on one thread */
+    struct hex_mcts_config engine;
+};
+
+struct hex_selfplay_stats {
+    size_t games;
+    size_t samples;
+    size_t shards;
+    uint64_t bytes; // written
+    double seconds;
+    double samples_per_second;
+    double writer_wait; // seconds the searches spent waiting for a shard
+};
+
+/* 1000 games of 1000-playout searches on 11x11, two random stones each,
+   64k samples a shard, compressed. */
+void hex_selfplay_default_config(struct hex_selfplay_config *config);
+
+/* Returns 0 on a bad configuration, or if memory runs out or a shard
+   cannot be written. Each game only depends on the seed, but the order of
+   the games in the shards depends on the threads. */
+int hex_selfplay_run(const struct hex_selfplay_config *config,
+                     struct hex_selfplay_stats *stats);
+
+struct hex_selfplay_shard {
+    const uint8_t *data; // the whole file, memory-mapped
+    size_t length;
+    size_t size;
+    size_t count;
+    size_t sample_bytes;
+    size_t block_samples;
+    bool compressed;
+    bool symmetry;  // each sample is also read turned by 180 degrees
+    uint8_t *block; // the block being read, uncompressed
+    size_t offset;  // of the next block in the mapping
+    size_t next;    // sample to read
+    const uint8_t *current;
+    bool rotated; // the next read is `current` turned around
+};
+
+/* A sample in the mapping, or in the shard's block buffer until the next
+   call to hex_selfplay_shard_next(). */
+struct hex_selfplay_sample {
+    const uint8_t *data;
+    size_t size;
+    bool rotated; // turned by 180 degrees: cell i is read from cells - 1 - i
+};
+
+/* Maps a shard. With `symmetry`, every sample is read twice, the second
+   time turned around, which leaves the game and the side to move alone.
+   Returns 0 if it cannot be read or is not a shard. */
+int hex_selfplay_shard_open(struct hex_selfplay_shard *s,
+                            const char *path,
+                            bool symmetry);
+
+void hex_selfplay_shard_close(struct hex_selfplay_shard *s);
+
+/* The next sample. Returns 0 after the last one, or on a broken block. */
+int hex_selfplay_shard_next(struct hex_selfplay_shard *s,
+                            struct hex_selfplay_sample *sample);
+
+static inline cell_color hex_selfplay_to_move(
+    const struct hex_selfplay_sample *s) {
+    return (cell_color)s->data[0];
+}
+
+static inline cell_color hex_selfplay_winner(
+    const struct hex_selfplay_sample *s) {
+    return (cell_color)s->data[1];
+}
+
+static inline cell_color hex_selfplay_cell(
+    const struct hex_selfplay_sample *s,
+    size_t i) {
+    if (s->rotated)
+        i = s->size * s->size - 1 - i;
+    return (cell_color)(s->data[2 + i / 4] >> (2 * (i % 4)) & 3);
+}
+
+/* The share of the visits of the move to cell i. */
+static inline double hex_selfplay_policy(
+    const struct hex_selfplay_sample *s,
+    size_t i) {
+    const size_t cells = s->size * s->size;
+    if (s->rotated)
+        i = cells - 1 - i;
+    const uint8_t *p = s->data + 2 + (cells + 3) / 4 + 2 * i;
+    return (double)(p[0] | p[1] << 8) / 65535.0;
+}
+
+#endif /* HEX_SELFPLAY_H */
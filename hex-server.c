@@ -0,0 +1,789 @@
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "hex-clock.h"
+#include "hex-grid.h"
+#include "hex-random.h"
+#include "hex-server.h"
+
+#define LISTENER UINT32_MAX
+#define STOPPER (UINT32_MAX - 1)
+#define SLOT_BITS 24
+#define MAX_PENDING ((size_t)1 << 16) // unread output before a client is cut
+#define LATENCY_BUCKETS 48
+
+static const char *color_names[] = {"none", "red", "blue"};
+
+void hex_server_default_config(struct hex_server_config *config) {
+    config->address = "unix:/tmp/chex.sock";
+    config->max_games = 16384;
+    config->max_size = 19;
+    config->max_connections = 1024;
+}
+
+static size_t align8(size_t n) {
+    return (n + 7) & ~(size_t)7;
+}
+
+/* A slot: the cells, two bits each, then the union-find parents and ranks,
+   all for the largest board and its four virtual cells. */
+static size_t cells_bytes(const struct hex_server *s) {
+    const size_t nodes = s->config.max_size * s->config.max_size + 4;
+    return align8((nodes + 3) / 4);
+}
+
+static uint8_t *slot_cells(const struct hex_server *s, size_t k) {
+    return s->arena + k * s->slot_bytes;
+}
+
+static struct wqu_uf slot_uf(const struct hex_server *s,
+                             size_t k,
+                             size_t nodes) {
+    const size_t max_nodes = s->config.max_size * s->config.max_size + 4;
+    uint8_t *base = slot_cells(s, k) + cells_bytes(s);
+    struct wqu_uf uf = {
+        .parent = (wqu_id *)base,
+        .rank = base + align8(max_nodes * sizeof(wqu_id)),
+        .size = nodes,
+        .mode = WQU_PATH_COMPRESSION,
+    };
+    return uf;
+}
+
+static unsigned cell_get(const uint8_t *cells, size_t i) {
+    return cells[i >> 2] >> (2 * (i & 3)) & 3;
+}
+
+static void cell_set(uint8_t *cells, size_t i, unsigned color) {
+    cells[i >> 2] |= (uint8_t)(color << (2 * (i & 3)));
+}
+
+/* "unix:PATH", or a port on 127.0.0.1. */
+static int parse_address(const char *address,
+                         struct sockaddr_storage *sa,
+                         socklen_t *length) {
+    memset(sa, 0, sizeof(*sa));
+    if (!strncmp(address, "unix:", 5)) {
+        struct sockaddr_un *un = (struct sockaddr_un *)sa;
+        if (strlen(address + 5) >= sizeof(un->sun_path))
+            return 0;
+        un->sun_family = AF_UNIX;
+        strcpy(un->sun_path, address + 5);
+        *length = sizeof(*un);
+        return 1;
+    }
+    char *end;
+    unsigned long port = strtoul(address, &end, 10);
+    if (end == address || *end || port > 65535)
+        return 0;
+    struct sockaddr_in *in = (struct sockaddr_in *)sa;
+    in->sin_family = AF_INET;
+    in->sin_port = htons((uint16_t)port);
+    in->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    *length = sizeof(*in);
+    return 1;
+}
+
+static int set_nonblocking(int fd) {
+    const int flags = fcntl(fd, F_GETFL);
+    return flags >= 0 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0;
+}
+
+static int watch_fd(struct hex_server *s,
+                    int fd,
+                    uint32_t events,
+                    uint32_t id) {
+    struct epoll_event ev = {.events = events, .data.u32 = id};
+    return epoll_ctl(s->epoll_fd, EPOLL_CTL_ADD, fd, &ev) == 0;
+}
+
+int hex_server_init(struct hex_server *s,
+                    const struct hex_server_config *config) {
+    struct sockaddr_storage sa;
+    socklen_t length;
+    memset(s, 0, sizeof(*s));
+    s->config = *config;
+    s->epoll_fd = s->listen_fd = -1;
+    s->stop_pipe[0] = s->stop_pipe[1] = -1;
+    if (config->max_size < 1 || config->max_size > HEX_GRID_SHARED_TABLES ||
+        config->max_games < 1 || config->max_games > (1u << SLOT_BITS) ||
+        config->max_connections < 1 || config->max_connections >= STOPPER ||
+        !parse_address(config->address, &sa, &length))
+        return 0;
+
+    const size_t max_nodes = config->max_size * config->max_size + 4;
+    s->slot_bytes = cells_bytes(s) + align8(max_nodes * sizeof(wqu_id)) +
+                    align8(max_nodes);
+    s->arena = malloc(config->max_games * s->slot_bytes);
+    s->games = calloc(config->max_games, sizeof(struct hex_server_game));
+    s->free_slots = malloc(config->max_games * sizeof(uint32_t));
+    s->connections = calloc(config->max_connections,
+                            sizeof(struct hex_server_connection));
+    if (!s->arena || !s->games || !s->free_slots || !s->connections) {
+        hex_server_destroy(s);
+        return 0;
+    }
+    /* lowest slots first */
+    for (size_t k = 0; k < config->max_games; k++)
+        s->free_slots[k] = (uint32_t)(config->max_games - 1 - k);
+    s->free_count = config->max_games;
+    for (size_t c = 0; c < config->max_connections; c++)
+        s->connections[c].fd = -1;
+
+    if (sa.ss_family == AF_UNIX)
+        unlink(((struct sockaddr_un *)&sa)->sun_path);
+    const int one = 1;
+    s->listen_fd = socket(sa.ss_family, SOCK_STREAM, 0);
+    s->epoll_fd = epoll_create1(0);
+    if (s->listen_fd < 0 || s->epoll_fd < 0 ||
+        !set_nonblocking(s->listen_fd) ||
+        setsockopt(s->listen_fd, SOL_SOCKET, SO_REUSEADDR, &one,
+                   sizeof(one)) < 0 ||
+        bind(s->listen_fd, (struct sockaddr *)&sa, length) < 0 ||
+        listen(s->listen_fd, SOMAXCONN) < 0 ||
+        pipe(s->stop_pipe) < 0 || !set_nonblocking(s->stop_pipe[0]) ||
+        !set_nonblocking(s->stop_pipe[1]) ||
+        !watch_fd(s, s->listen_fd, EPOLLIN, LISTENER) ||
+        !watch_fd(s, s->stop_pipe[0], EPOLLIN, STOPPER)) {
+        hex_server_destroy(s);
+        return 0;
+    }
+    return 1;
+}
+
+void hex_server_destroy(struct hex_server *s) {
+    for (size_t c = 0; s->connections && c < s->config.max_connections; c++) {
+        if (s->connections[c].fd >= 0)
+            close(s->connections[c].fd);
+        free(s->connections[c].out);
+    }
+    if (s->listen_fd >= 0) {
+        close(s->listen_fd);
+        if (!strncmp(s->config.address, "unix:", 5))
+            unlink(s->config.address + 5);
+    }
+    for (unsigned p = 0; p < 2; p++) {
+        if (s->stop_pipe[p] >= 0)
+            close(s->stop_pipe[p]);
+    }
+    if (s->epoll_fd >= 0)
+        close(s->epoll_fd);
+    free(s->arena);
+    free(s->games);
+    free(s->free_slots);
+    free(s->connections);
+    memset(s, 0, sizeof(*s));
+    s->epoll_fd = s->listen_fd = -1;
+    s->stop_pipe[0] = s->stop_pipe[1] = -1;
+}
+
+void hex_server_stop(struct hex_server *s) {
+    const char byte = 0;
+    if (write(s->stop_pipe[1], &byte, 1) < 0)
+        return; // the pipe is full, so a stop is on its way already
+}
+
+static void drop(struct hex_server *s, uint32_t c) {
+    struct hex_server_connection *conn = &s->connections[c];
+    close(conn->fd); // which takes it out of the epoll set
+    free(conn->out);
+    conn->fd = -1;
+    conn->out = NULL;
+    conn->in_len = conn->out_len = conn->out_sent = conn->out_capacity = 0;
+    conn->writing = false;
+    conn->generation++;
+    s->connection_count--;
+}
+
+/* Queues a line for connection c. Returns 0 once the client has left too
+   much unread, and it is to be dropped. */
+static int reply(struct hex_server *s, uint32_t c, const char *format, ...) {
+    struct hex_server_connection *conn = &s->connections[c];
+    va_list ap;
+    va_start(ap, format);
+    int n = vsnprintf(NULL, 0, format, ap);
+    va_end(ap);
+    if (n < 0 || conn->out_len - conn->out_sent + (size_t)n > MAX_PENDING)
+        return 0;
+    if (conn->out_len + (size_t)n + 2 > conn->out_capacity) {
+        /* what was sent goes first */
+        memmove(conn->out, conn->out + conn->out_sent,
+                conn->out_len - conn->out_sent);
+        conn->out_len -= conn->out_sent;
+        conn->out_sent = 0;
+        size_t capacity = conn->out_capacity ? conn->out_capacity : 1024;
+        while (conn->out_len + (size_t)n + 2 > capacity)
+            capacity *= 2;
+        char *out = realloc(conn->out, capacity);
+        if (!out)
+            return 0;
+        conn->out = out;
+        conn->out_capacity = capacity;
+    }
+    va_start(ap, format);
+    vsnprintf(conn->out + conn->out_len, (size_t)n + 1, format, ap);
+    va_end(ap);
+    conn->out_len += (size_t)n;
+    conn->out[conn->out_len++] = '\n';
+    return 1;
+}
+
+/* Writes what the socket takes, and waits for EPOLLOUT for the rest.
+   Returns 0 if the connection is gone. */
+static int flush(struct hex_server *s, uint32_t c) {
+    struct hex_server_connection *conn = &s->connections[c];
+    while (conn->out_sent < conn->out_len) {
+        /* a client that hung up is an error here, not a SIGPIPE */
+        ssize_t n = send(conn->fd, conn->out + conn->out_sent,
+                         conn->out_len - conn->out_sent, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0 && errno != EAGAIN)
+            return 0;
+        if (n < 0)
+            break;
+        conn->out_sent += (size_t)n;
+    }
+    bool pending = conn->out_sent < conn->out_len;
+    if (!pending)
+        conn->out_len = conn->out_sent = 0;
+    if (pending != conn->writing) {
+        struct epoll_event ev = {.events = EPOLLIN | (pending ? EPOLLOUT : 0),
+                                 .data.u32 = c};
+        if (epoll_ctl(s->epoll_fd, EPOLL_CTL_MOD, conn->fd, &ev) < 0)
+            return 0;
+        conn->writing = pending;
+    }
+    return 1;
+}
+
+static struct hex_server_game *find_game(struct hex_server *s,
+                                         const char *arg,
+                                         uint32_t *slot) {
+    char *end;
+    if (!arg)
+        return NULL;
+    unsigned long id = strtoul(arg, &end, 10);
+    *slot = (uint32_t)(id & ((1u << SLOT_BITS) - 1));
+    if (end == arg || *end || id > UINT32_MAX ||
+        *slot >= s->config.max_games)
+        return NULL;
+    struct hex_server_game *game = &s->games[*slot];
+    if (!game->live || game->generation != (id >> SLOT_BITS))
+        return NULL;
+    return game;
+}
+
+static uint32_t game_id(const struct hex_server *s, uint32_t slot) {
+    return s->games[slot].generation << SLOT_BITS | slot;
+}
+
+static size_t parse_cell(const char *arg, size_t size) {
+    if (!arg || arg[0] < 'a' || arg[0] > 'z')
+        return (size_t)-1;
+    char *end;
+    const size_t x = (size_t)(arg[0] - 'a');
+    const unsigned long y = strtoul(arg + 1, &end, 10);
+    if (x >= size || end == arg + 1 || *end || y < 1 || y > size)
+        return (size_t)-1;
+    return (y - 1) * size + x;
+}
+
+static int new_game(struct hex_server *s, uint32_t c, const char *arg) {
+    const unsigned long size = arg ? strtoul(arg, NULL, 10) : 0;
+    if (size < 1 || size > s->config.max_size)
+        return reply(s, c, "err board sizes go from 1 to %zu",
+                     s->config.max_size);
+    if (s->free_count == 0)
+        return reply(s, c, "err no free games");
+    const uint32_t slot = s->free_slots[--s->free_count];
+    struct hex_server_game *game = &s->games[slot];
+    const size_t cells = size * size;
+    uint8_t *board = slot_cells(s, slot);
+    struct wqu_uf uf = slot_uf(s, slot, cells + 4);
+    memset(board, 0, (cells + 4 + 3) / 4);
+    cell_set(board, cells, RED);
+    cell_set(board, cells + 1, RED);
+    cell_set(board, cells + 2, BLUE);
+    cell_set(board, cells + 3, BLUE);
+    w_quickunion_init_in(&uf, uf.parent, uf.rank, cells + 4);
+    game->size = (uint16_t)size;
+    game->move_count = 0;
+    game->to_move = RED;
+    game->winner = NEUTRAL;
+    game->live = true;
+    memset(game->watchers, 0, sizeof(game->watchers));
+    return reply(s, c, "ok %u", game_id(s, slot));
+}
+
+static int play(struct hex_server *s, uint32_t c, char **args, size_t n) {
+    uint32_t slot;
+    struct hex_server_game *game = find_game(s, n > 1 ? args[1] : NULL, &slot);
+    if (!game)
+        return reply(s, c, "err no such game");
+    const size_t size = game->size, cells = size * size;
+    const size_t i = parse_cell(n > 2 ? args[2] : NULL, size);
+    uint8_t *board = slot_cells(s, slot);
+    if (i == (size_t)-1)
+        return reply(s, c, "err bad cell");
+    if (game->winner != NEUTRAL)
+        return reply(s, c, "err the game is over");
+    if (cell_get(board, i) != NEUTRAL)
+        return reply(s, c, "err cell occupied");
+
+    const unsigned player = game->to_move;
+    const uint32_t(*neighbors)[6] = hex_grid_neighbor_table(size);
+    struct wqu_uf uf = slot_uf(s, slot, cells + 4);
+    cell_set(board, i, player);
+    for (unsigned k = 0; k < 6; k++) {
+        if (cell_get(board, neighbors[i][k]) == player)
+            w_quickunion_union(&uf, neighbors[i][k], i);
+    }
+    const size_t edge = player == RED ? cells : cells + 2;
+    if (w_quickunion_is_connected(&uf, edge, edge + 1))
+        game->winner = (uint8_t)player;
+    game->to_move = (uint8_t)(3 - player);
+    game->move_count++;
+
+    const char *wins = game->winner != NEUTRAL ? " wins" : "";
+    const uint32_t id = game_id(s, slot);
+    for (unsigned w = 0; w < HEX_SERVER_WATCHERS; w++) {
+        struct hex_server_watcher *watcher = &game->watchers[w];
+        struct hex_server_connection *other =
+            &s->connections[watcher->connection];
+        if (!watcher->generation)
+            continue;
+        /* the watcher has gone since */
+        if (other->fd < 0 || other->generation != watcher->generation - 1) {
+            watcher->generation = 0;
+            continue;
+        }
+        if (watcher->connection != c &&
+            !reply(s, watcher->connection, "move %u %s %s%s", id, args[2],
+                   color_names[player], wins))
+            watcher->generation = 0;
+    }
+    return reply(s, c, "ok %u %s %s%s", id, args[2], color_names[player],
+                 wins);
+}
+
+static int state(struct hex_server *s, uint32_t c, const char *arg) {
+    static const char stones[] = ".xo";
+    char text[HEX_GRID_SHARED_TABLES * HEX_GRID_SHARED_TABLES + 1];
+    uint32_t slot;
+    struct hex_server_game *game = find_game(s, arg, &slot);
+    if (!game)
+        return reply(s, c, "err no such game");
+    const size_t cells = (size_t)game->size * game->size;
+    const uint8_t *board = slot_cells(s, slot);
+    for (size_t i = 0; i < cells; i++)
+        text[i] = stones[cell_get(board, i)];
+    text[cells] = '\0';
+    return reply(s, c, "ok %u %u %s %s", game_id(s, slot), game->size,
+                 game->winner != NEUTRAL ? "over"
+                                         : color_names[game->to_move],
+                 text);
+}
+
+static int watch(struct hex_server *s, uint32_t c, const char *arg) {
+    uint32_t slot;
+    struct hex_server_game *game = find_game(s, arg, &slot);
+    if (!game)
+        return reply(s, c, "err no such game");
+    for (unsigned w = 0; w < HEX_SERVER_WATCHERS; w++) {
+        struct hex_server_watcher *watcher = &game->watchers[w];
+        struct hex_server_connection *other =
+            &s->connections[watcher->connection];
+        /* free, or held by a connection that has gone */
+        if (!watcher->generation || other->fd < 0 ||
+            other->generation != watcher->generation - 1) {
+            /* generation + 1, so that 0 stays free */
+            watcher->connection = c;
+            watcher->generation = s->connections[c].generation + 1;
+            return reply(s, c, "ok %u", game_id(s, slot));
+        }
+    }
+    return reply(s, c, "err too many watchers");
+}
+
+static int close_game(struct hex_server *s, uint32_t c, const char *arg) {
+    uint32_t slot;
+    struct hex_server_game *game = find_game(s, arg, &slot);
+    if (!game)
+        return reply(s, c, "err no such game");
+    const uint32_t id = game_id(s, slot);
+    game->live = false;
+    game->generation = (game->generation + 1) & 0xff;
+    s->free_slots[s->free_count++] = slot;
+    return reply(s, c, "ok %u", id);
+}
+
+/* The upper bound of the bucket holding the given share of the times. */
+static double percentile_us(const uint64_t *buckets, double share) {
+    uint64_t total = 0, seen = 0;
+    for (unsigned b = 0; b < LATENCY_BUCKETS; b++)
+        total += buckets[b];
+    for (unsigned b = 0; b < LATENCY_BUCKETS && total; b++) {
+        seen += buckets[b];
+        if ((double)seen >= share * (double)total)
+            return (double)((uint64_t)1 << (b + 1)) / 1e3;
+    }
+    return 0;
+}
+
+static void record_latency(uint64_t *buckets, double seconds) {
+    uint64_t ns = (uint64_t)(seconds * 1e9);
+    unsigned b = 0;
+    while (ns > 1 && b + 1 < LATENCY_BUCKETS) {
+        ns >>= 1;
+        b++;
+    }
+    buckets[b]++;
+}
+
+static int command(struct hex_server *s, uint32_t c, char *line) {
+    char *args[4], *save;
+    size_t n = 0;
+    for (char *t = strtok_r(line, " \t\r", &save); t && n < 4;
+         t = strtok_r(NULL, " \t\r", &save))
+        args[n++] = t;
+    if (n == 0)
+        return 1;
+    s->commands++;
+    if (!strcmp(args[0], "play"))
+        return play(s, c, args, n);
+    if (!strcmp(args[0], "new"))
+        return new_game(s, c, n > 1 ? args[1] : NULL);
+    if (!strcmp(args[0], "state"))
+        return state(s, c, n > 1 ? args[1] : NULL);
+    if (!strcmp(args[0], "watch"))
+        return watch(s, c, n > 1 ? args[1] : NULL);
+    if (!strcmp(args[0], "close"))
+        return close_game(s, c, n > 1 ? args[1] : NULL);
+    if (!strcmp(args[0], "stats")) {
+        return reply(s, c, "ok %zu %zu %llu %.1f %.1f",
+                     s->config.max_games - s->free_count,
+                     s->connection_count, (unsigned long long)s->commands,
+                     percentile_us(s->latency, 0.5),
+                     percentile_us(s->latency, 0.99));
+    }
+    return reply(s, c, "err unknown command");
+}
+
+/* Answers the complete lines that came in on connection c. Returns 0 if
+   the connection is to be dropped. */
+static int serve(struct hex_server *s, uint32_t c) {
+    struct hex_server_connection *conn = &s->connections[c];
+    for (;;) {
+        ssize_t n = read(conn->fd, conn->in + conn->in_len,
+                         sizeof(conn->in) - conn->in_len);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0 && errno == EAGAIN)
+            return 1;
+        if (n <= 0)
+            return 0;
+        conn->in_len += (size_t)n;
+        char *line = conn->in, *newline;
+        while ((newline = memchr(line, '\n', conn->in_len -
+                                                 (size_t)(line - conn->in)))) {
+            *newline = '\0';
+            const double start = hex_clock_now();
+            int ok = command(s, c, line);
+            record_latency(s->latency, hex_clock_now() - start);
+            if (!ok)
+                return 0;
+            line = newline + 1;
+        }
+        conn->in_len -= (size_t)(line - conn->in);
+        memmove(conn->in, line, conn->in_len);
+        /* no command is that long */
+        if (conn->in_len == sizeof(conn->in))
+            return 0;
+    }
+}
+
+static void accept_all(struct hex_server *s) {
+    for (;;) {
+        int fd = accept(s->listen_fd, NULL, NULL);
+        if (fd < 0)
+            return;
+        uint32_t c = 0;
+        while (c < s->config.max_connections && s->connections[c].fd >= 0)
+            c++;
+        if (c == s->config.max_connections || !set_nonblocking(fd) ||
+            !watch_fd(s, fd, EPOLLIN, c)) {
+            close(fd);
+            continue;
+        }
+        s->connections[c].fd = fd;
+        s->connection_count++;
+    }
+}
+
+int hex_server_run(struct hex_server *s) {
+    struct epoll_event events[64];
+    for (;;) {
+        int n = epoll_wait(s->epoll_fd, events, 64, -1);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0)
+            return 0;
+        for (int e = 0; e < n; e++) {
+            const uint32_t c = events[e].data.u32;
+            if (c == STOPPER) {
+                char byte;
+                while (read(s->stop_pipe[0], &byte, 1) > 0)
+                    continue;
+                return 1;
+            }
+            if (c == LISTENER) {
+                accept_all(s);
+                continue;
+            }
+            if (s->connections[c].fd < 0)
+                continue;
+            int ok = 1;
+            if (events[e].events & (EPOLLIN | EPOLLHUP | EPOLLERR))
+                ok = serve(s, c);
+            if (ok)
+                ok = flush(s, c);
+            if (!ok)
+                drop(s, c);
+        }
+        /* watchers may have been sent moves by other connections */
+        for (uint32_t c = 0; c < s->config.max_connections; c++) {
+            struct hex_server_connection *conn = &s->connections[c];
+            if (conn->fd >= 0 && !conn->writing &&
+                conn->out_sent < conn->out_len && !flush(s, c))
+                drop(s, c);
+        }
+    }
+}
+
+/* The load generator. */
+
+struct load_game {
+    uint32_t id;
+    uint16_t next; // into the game's order of cells
+    bool done;
+};
+
+struct load_worker {
+    const struct hex_server_load_config *config;
+    size_t games;
+    uint64_t seed;
+    struct load_game *game;
+    uint16_t *order; // a random order of the cells per game
+    int fd;
+    char buf[1 << 16];
+    size_t start, end;
+    uint64_t latency[LATENCY_BUCKETS];
+    size_t finished, moves, errors;
+    int ok;
+};
+
+static int send_all(int fd, const char *data, size_t length) {
+    while (length) {
+        ssize_t n = send(fd, data, length, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return 0;
+        data += n;
+        length -= (size_t)n;
+    }
+    return 1;
+}
+
+static char *read_line(struct load_worker *w) {
+    for (;;) {
+        char *newline = memchr(w->buf + w->start, '\n', w->end - w->start);
+        if (newline) {
+            char *line = w->buf + w->start;
+            *newline = '\0';
+            w->start = (size_t)(newline + 1 - w->buf);
+            return line;
+        }
+        memmove(w->buf, w->buf + w->start, w->end - w->start);
+        w->end -= w->start;
+        w->start = 0;
+        if (w->end == sizeof(w->buf))
+            return NULL;
+        ssize_t n = read(w->fd, w->buf + w->end, sizeof(w->buf) - w->end);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return NULL;
+        w->end += (size_t)n;
+    }
+}
+
+#define LOAD_BATCH 256
+
+/* Sends one line per game of games[0..count) and reads the answers. */
+static int load_batch(struct load_worker *w,
+                      struct load_game **batch,
+                      size_t count,
+                      bool closing) {
+    const size_t size = w->config->size, cells = size * size;
+    char lines[LOAD_BATCH * 32];
+    size_t length = 0;
+    for (size_t k = 0; k < count; k++) {
+        struct load_game *game = batch[k];
+        if (closing) {
+            length += (size_t)sprintf(lines + length, "close %u\n", game->id);
+            continue;
+        }
+        const size_t i = w->order[(size_t)(game - w->game) * cells +
+                                  game->next++];
+        length += (size_t)sprintf(lines + length, "play %u %c%zu\n", game->id,
+                                  (char)('a' + i % size), i / size + 1);
+    }
+    const double start = hex_clock_now();
+    if (!send_all(w->fd, lines, length))
+        return 0;
+    for (size_t k = 0; k < count; k++) {
+        char *line = read_line(w);
+        if (!line)
+            return 0;
+        record_latency(w->latency, hex_clock_now() - start);
+        if (strncmp(line, "ok ", 3) != 0) {
+            w->errors++;
+            batch[k]->done = true;
+        } else if (!closing) {
+            w->moves++;
+            if (strstr(line, " wins") || batch[k]->next == cells) {
+                batch[k]->done = true;
+                w->finished++;
+            }
+        }
+    }
+    return 1;
+}
+
+static void *load_run(void *arg) {
+    struct load_worker *w = arg;
+    const size_t size = w->config->size, cells = size * size;
+    struct sockaddr_storage sa;
+    socklen_t length;
+    struct hex_rng rng;
+    struct load_game *batch[LOAD_BATCH];
+
+    hex_rng_seed(&rng, w->seed);
+    w->fd = -1;
+    if (!parse_address(w->config->address, &sa, &length) ||
+        (w->fd = socket(sa.ss_family, SOCK_STREAM, 0)) < 0 ||
+        connect(w->fd, (struct sockaddr *)&sa, length) < 0)
+        return NULL;
+
+    /* every game gets its own random order of moves */
+    for (size_t g = 0; g < w->games; g++) {
+        uint16_t *order = w->order + g * cells;
+        for (size_t i = 0; i < cells; i++)
+            order[i] = (uint16_t)i;
+        for (size_t i = cells - 1; i > 0; i--) {
+            size_t j = hex_rng_below(&rng, (uint32_t)(i + 1));
+            uint16_t t = order[i];
+            order[i] = order[j];
+            order[j] = t;
+        }
+        char line[32];
+        int n = snprintf(line, sizeof(line), "new %zu\n", size);
+        char *answer;
+        if (!send_all(w->fd, line, (size_t)n) || !(answer = read_line(w)) ||
+            sscanf(answer, "ok %u", &w->game[g].id) != 1)
+            return NULL;
+    }
+
+    /* a move in every game that is still on, a batch at a time */
+    for (bool playing = true; playing;) {
+        size_t count = 0;
+        playing = false;
+        for (size_t g = 0; g < w->games; g++) {
+            if (w->game[g].done)
+                continue;
+            playing = true;
+            batch[count++] = &w->game[g];
+            if (count == LOAD_BATCH) {
+                if (!load_batch(w, batch, count, false))
+                    return NULL;
+                count = 0;
+            }
+        }
+        if (count && !load_batch(w, batch, count, false))
+            return NULL;
+    }
+    for (size_t g = 0; g < w->games; g += LOAD_BATCH) {
+        size_t count = 0;
+        for (size_t k = g; k < w->games && count < LOAD_BATCH; k++)
+            batch[count++] = &w->game[k];
+        if (!load_batch(w, batch, count, true))
+            return NULL;
+    }
+    w->ok = 1;
+    return NULL;
+}
+
+int hex_server_load(const struct hex_server_load_config *config,
+                    struct hex_server_load_stats *stats) {
+    const unsigned n = config->connections ? config->connections : 1;
+    const size_t cells = config->size * config->size;
+    const double start = hex_clock_now();
+    uint64_t latency[LATENCY_BUCKETS] = {0};
+    int ok = config->size >= 1 && cells <= UINT16_MAX;
+
+    memset(stats, 0, sizeof(*stats));
+    struct load_worker *workers = ok ? calloc(n, sizeof(*workers)) : NULL;
+    pthread_t *threads = calloc(n, sizeof(pthread_t));
+    ok = workers && threads;
+    for (unsigned t = 0; ok && t < n; t++) {
+        struct load_worker *w = &workers[t];
+        w->config = config;
+        w->games = config->games / n + (t < config->games % n);
+        w->seed = config->seed + t;
+        w->game = calloc(w->games + 1, sizeof(struct load_game));
+        w->order = malloc((w->games + 1) * cells * sizeof(uint16_t));
+        ok = w->game && w->order;
+    }
+    unsigned running = 0;
+    while (ok && running < n && pthread_create(&threads[running], NULL,
+                                                load_run,
+                                                &workers[running]) == 0)
+        running++;
+    for (unsigned t = 0; t < running; t++)
+        pthread_join(threads[t], NULL);
+    ok = ok && running == n;
+    for (unsigned t = 0; workers && t < n; t++) {
+        struct load_worker *w = &workers[t];
+        ok = ok && w->ok;
+        stats->games += w->finished;
+        stats->moves += w->moves;
+        stats->errors += w->errors;
+        for (unsigned b = 0; b < LATENCY_BUCKETS; b++)
+            latency[b] += w->latency[b];
+        if (w->fd >= 0)
+            close(w->fd);
+        free(w->game);
+        free(w->order);
+    }
+    free(workers);
+    free(threads);
+    stats->seconds = hex_clock_now() - start;
+    stats->moves_per_second =
+        stats->seconds > 0 ? (double)stats->moves / stats->seconds : 0;
+    stats->p50_us = percentile_us(latency, 0.5);
+    stats->p99_us = percentile_us(latency, 0.99);
+    return ok;
+}
@@ -0,0 +1,120 @@
+#if !defined(HEX_SERVER_H)
+#define HEX_SERVER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "weighted-quick-union.h"
+
+/* Referee for many games at once, in one thread: an epoll loop serving a
+   line protocol on a local TCP port ("PORT", bound to 127.0.0.1) or a Unix
+   socket ("unix:PATH"). Any connection may address any game.
+
+     new SIZE        ok ID
+     play ID CELL    ok ID CELL red|blue [wins]  (the side to move plays)
+     state ID        ok ID SIZE red|blue|over BOARD  (one of .xo per cell)
+     watch ID        ok ID, then "move ID CELL red|blue [wins]" lines for
+                     the moves other connections make
+     close ID        ok ID
+     stats           ok GAMES CONNECTIONS COMMANDS P50_US P99_US
+
+   and "err ..." for anything that fails. Cells are named as in HTP, a1 in
+   the top left corner.
+
+   Games live in fixed slots of one arena allocated up front, each with
+   two-bit cells and union-find arrays sized for the largest board, so the
+   memory used is bounded by max_games whatever the clients do. Ids carry a
+   generation, so an id outlives neither its game nor its slot. */
+
+#define HEX_SERVER_WATCHERS 4
+
+struct hex_server_config {
+    const char *address;
+    size_t max_games;
+    size_t max_size; // largest board, at most HEX_GRID_SHARED_TABLES
+    size_t max_connections;
+};
+
+struct hex_server_watcher {
+    uint32_t connection; // index, and the generation it was watched at
+    uint32_t generation;
+};
+
+struct hex_server_game {
+    uint32_t generation;
+    uint16_t size;
+    uint16_t move_count;
+    uint8_t to_move;
+    uint8_t winner;
+    bool live;
+    struct hex_server_watcher watchers[HEX_SERVER_WATCHERS];
+};
+
+struct hex_server_connection {
+    int fd; // -1 when free
+    uint32_t generation;
+    char in[256];
+    size_t in_len;
+    char *out;
+    size_t out_len;
+    size_t out_sent;
+    size_t out_capacity;
+    bool writing; // waiting for EPOLLOUT
+};
+
+struct hex_server {
+    struct hex_server_config config;
+    int epoll_fd;
+    int listen_fd;
+    int stop_pipe[2];
+    struct hex_server_game *games;
+    uint8_t *arena; // max_games slots of slot_bytes
+    size_t slot_bytes;
+    uint32_t *free_slots;
+    size_t free_count;
+    struct hex_server_connection *connections;
+    size_t connection_count;
+    uint64_t commands;
+    uint64_t latency[48]; // handling times, by power of two nanoseconds
+};
+
+void hex_server_default_config(struct hex_server_config *config);
+
+/* Allocates every slot and starts listening. Returns 0 on failure. */
+int hex_server_init(struct hex_server *s,
+                    const struct hex_server_config *config);
+
+/* Serves until hex_server_stop(). Returns 0 if epoll fails. */
+int hex_server_run(struct hex_server *s);
+
+/* Makes hex_server_run() return. Safe to call from any thread. */
+void hex_server_stop(struct hex_server *s);
+
+void hex_server_destroy(struct hex_server *s);
+
+/* A load generator: `connections` threads, each creating its share of
+   `games` games of `size` and playing them all at once with random moves,
+   one pipelined batch of moves per round, until every game is won. */
+struct hex_server_load_config {
+    const char *address;
+    size_t games;
+    unsigned connections;
+    size_t size;
+    uint64_t seed;
+};
+
+struct hex_server_load_stats {
+    size_t games;     // finished
+    size_t moves;
+    size_t errors;    // "err" answers
+    double seconds;
+    double moves_per_second;
+    double p50_us;    // from sending a batch to each answer
+    double p99_us;
+};
+
+int hex_server_load(const struct hex_server_load_config *config,
+                    struct hex_server_load_stats *stats);
+
+#endif /* HEX_SERVER_H */
@@ -0,0 +1,526 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "hex-clock.h"
+#include "hex-solve.h"
+
+#define INF UINT32_MAX
+#define EPSILON 0.25
+#define PROVEN_DEPTH 255
+
+static cell_color other(cell_color player) {
+    return 1 + (player % 2);
+}
+
+void hex_solve_default_config(struct hex_solve_config *config) {
+    config->tt_megabytes = 256;
+    config->max_nodes = 0;
+    config->max_seconds = 0;
+    config->patterns = true;
+}
+
+int hex_solver_init(struct hex_solver *s,
+                    const struct hex_solve_config *config,
+                    size_t size) {
+    const size_t cells = size * size;
+    memset(s, 0, sizeof(*s));
+    s->config = *config;
+    if (cells == 0 || cells >= INF)
+        return 0;
+    s->children = malloc((cells + 1) * cells * sizeof(*s->children));
+    s->dist = malloc(4 * cells * sizeof(uint32_t));
+    s->queue = malloc((2 * cells + 1) * sizeof(uint32_t));
+    s->moves = malloc(cells * sizeof(uint32_t));
+    if (!s->children || !s->dist || !s->queue || !s->moves) {
+        hex_solver_destroy(s);
+        return 0;
+    }
+    if (!hex_grid_init(&s->grid, size, HEX_GRID_UNDOABLE_UNION_FIND) ||
+        !hex_tt_init(&s->tt, config->tt_megabytes)) {
+        hex_solver_destroy(s);
+        return 0;
+    }
+    /* larger boards go without the connections */
+    if (cells <= HEX_VC_MAX_CELLS && !hex_vc_init(&s->vc, &s->grid)) {
+        hex_solver_destroy(s);
+        return 0;
+    }
+    if (cells <= HEX_VC_MAX_CELLS && config->patterns &&
+        !hex_patterns_init(&s->patterns, size)) {
+        hex_solver_destroy(s);
+        return 0;
+    }
+    return 1;
+}
+
+void hex_solver_destroy(struct hex_solver *s) {
+    if (s->vc.grid)
+        hex_vc_destroy(&s->vc);
+    if (s->patterns.neighbors)
+        hex_patterns_destroy(&s->patterns);
+    hex_tt_destroy(&s->tt);
+    if (s->grid.cells)
+        hex_grid_destroy(&s->grid);
+    free(s->children);
+    free(s->dist);
+    free(s->queue);
+    free(s->moves);
+    s->children = NULL;
+    s->dist = NULL;
+    s->queue = NULL;
+    s->moves = NULL;
+}
+
+static bool out_of_budget(struct hex_solver *s) {
+    if (s->config.max_nodes && s->nodes >= s->config.max_nodes)
+        s->aborted = true;
+    else if (s->deadline > 0 && s->nodes >= s->next_check) {
+        s->next_check = s->nodes + 1024;
+        s->aborted = hex_clock_now() >= s->deadline;
+    }
+    return s->aborted;
+}
+
+/* Fills dist with the fewest empty cells `player` has to fill to reach each
+   cell from one of their edges (the far one with `far`), counting the cell
+   itself: a 0-1 breadth-first search where own stones cost nothing and the
+   opponent's block. */
+static void distances(struct hex_solver *s,
+                      cell_color player,
+                      bool far,
+                      uint32_t *dist) {
+    const hex_grid *g = &s->grid;
+    const size_t size = g->size, cells = size * size;
+    const size_t capacity = 2 * cells + 1;
+    uint32_t *queue = s->queue;
+    size_t head = 0, tail = 0;
+
+    for (size_t i = 0; i < cells; i++)
+        dist[i] = INF;
+    for (size_t j = 0; j < size; j++) {
+        size_t edge = far ? size - 1 : 0;
+        size_t i = player == RED ? edge * size + j : j * size + edge;
+        if (g->cells[i].color == NEUTRAL) {
+            dist[i] = 1;
+            queue[tail++] = (uint32_t)i;
+        } else if (g->cells[i].color == player) {
+            dist[i] = 0;
+            head = head ? head - 1 : capacity - 1;
+            queue[head] = (uint32_t)i;
+        }
+    }
+    while (head != tail) {
+        size_t i = queue[head];
+        head = head + 1 == capacity ? 0 : head + 1;
+        for (size_t k = 0; k < 6; k++) {
+            const uint32_t n = g->neighbors[i][k];
+            if (n >= cells || g->cells[n].color == other(player))
+                continue;
+            uint32_t cost = g->cells[n].color == NEUTRAL;
+            if (dist[i] + cost >= dist[n])
+                continue;
+            dist[n] = dist[i] + cost;
+            if (cost) {
+                queue[tail] = (uint32_t)n;
+                tail = tail + 1 == capacity ? 0 : tail + 1;
+            } else {
+                head = head ? head - 1 : capacity - 1;
+                queue[head] = (uint32_t)n;
+            }
+        }
+    }
+}
+
+/* Empty cells `player` would still have to fill to connect after putting a
+   stone on the empty cell i, given their distances from both edges (which
+   both count i). */
+static uint32_t through(const uint32_t *near, const uint32_t *far, size_t i) {
+    if (near[i] == INF || far[i] == INF)
+        return INF;
+    return near[i] + far[i] - 2;
+}
+
+/* Looks the position of s->grid up in the connections of both sides.
+   Returns to_move if they win, with the move in *move: the key of a
+   semi-connection between their edges, or a cell of a full one. Returns
+   the opponent if they have a full connection. Otherwise returns NEUTRAL
+   and leaves in must_play the cells that meet every semi-connection of the
+   opponent: a move anywhere else leaves one of them to be played. */
+static cell_color connections(struct hex_solver *s,
+                              cell_color to_move,
+                              uint32_t *move,
+                              uint64_t *must_play) {
+    struct hex_vc_engine *e = &s->vc;
+    const hex_grid *g = &s->grid;
+    const size_t cells = g->size * g->size;
+
+    hex_vc_rebuild(e);
+    cell_color winner = hex_vc_winner(e, to_move);
+    if (winner == to_move) {
+        size_t edge = to_move == RED ? RED_VIRTUAL_CELLS_START(g)
+                                     : BLUE_VIRTUAL_CELLS_START(g);
+        const struct hex_vc_list *l =
+            hex_vc_between(e, to_move, edge, edge + 1);
+        *move = UINT32_MAX;
+        if (l && l->vcs[0].key != HEX_VC_FULL)
+            *move = l->vcs[0].key;
+        /* any stone keeps a full one, and one in the carrier does no harm */
+        for (size_t i = 0; i < cells && *move == UINT32_MAX; i++) {
+            if (g->cells[i].color == NEUTRAL &&
+                (!l || l->vcs[0].carrier[i / 64] >> (i % 64) & 1))
+                *move = (uint32_t)i;
+        }
+        return *move == UINT32_MAX ? NEUTRAL : winner;
+    }
+    if (winner != NEUTRAL)
+        return winner;
+
+    const size_t edge = to_move == RED ? BLUE_VIRTUAL_CELLS_START(g)
+                                       : RED_VIRTUAL_CELLS_START(g);
+    const struct hex_vc_list *l =
+        hex_vc_between(e, other(to_move), edge, edge + 1);
+    memset(must_play, 0xff, HEX_VC_WORDS * sizeof(uint64_t));
+    for (size_t k = l ? l->fulls : 0; l && k < l->count; k++) {
+        for (size_t w = 0; w < HEX_VC_WORDS; w++)
+            must_play[w] &= l->vcs[k].carrier[w];
+    }
+    return NEUTRAL;
+}
+
+/* Narrows must_play to the cells hex_patterns_moves() leaves to_move,
+   unless it has none of them. A cell filled in or dominated is never the
+   only way to win, and one dominated from outside must_play loses. */
+static void prune(struct hex_solver *s,
+                  cell_color to_move,
+                  uint64_t *must_play) {
+    uint64_t kept[HEX_VC_WORDS] = {0}, any = 0;
+    hex_patterns_reset(&s->patterns, &s->grid);
+    const size_t n =
+        hex_patterns_moves(&s->patterns, &s->grid, to_move, s->moves);
+    for (size_t k = 0; k < n; k++)
+        kept[s->moves[k] / 64] |= (uint64_t)1 << (s->moves[k] % 64);
+    for (size_t w = 0; w < HEX_VC_WORDS; w++)
+        any |= kept[w] & must_play[w];
+    for (size_t w = 0; w < HEX_VC_WORDS && any; w++)
+        must_play[w] &= kept[w];
+}
+
+/* Fills in the children of the position of s->grid, with initial proof
+   numbers from the edge distances of both sides (df-pn+): a child starts
+   easy to prove for whoever is close to connecting there. An immediate win
+   is all there is to know, so it is then the only child. Otherwise, a cell
+   where the opponent would win next is the only move worth trying, and two
+   such cells cannot both be blocked, which leaves no child: a loss. */
+static void generate(struct hex_solver *s,
+                     cell_color to_move,
+                     struct hex_solve_child *children,
+                     size_t *count) {
+    hex_grid *g = &s->grid;
+    const size_t size = g->size, cells = size * size;
+    uint32_t *mine = s->dist, *mine_far = mine + cells;
+    uint32_t *theirs = mine_far + cells, *theirs_far = theirs + cells;
+    size_t threats = 0, threat = 0;
+    uint32_t their_distance = INF;
+    uint64_t must_play[HEX_VC_WORDS];
+    size_t n = 0;
+
+    memset(must_play, 0xff, sizeof(must_play));
+    if (s->vc.grid) {
+        uint32_t move = 0;
+        cell_color winner = connections(s, to_move, &move, must_play);
+        if (winner == to_move) {
+            children[0] = (struct hex_solve_child){move, INF, 0};
+            *count = 1;
+            return;
+        }
+        if (winner != NEUTRAL) {
+            *count = 0;
+            return;
+        }
+    }
+
+    distances(s, to_move, false, mine);
+    distances(s, to_move, true, mine_far);
+    distances(s, other(to_move), false, theirs);
+    distances(s, other(to_move), true, theirs_far);
+
+    for (size_t i = 0; i < cells; i++) {
+        if (g->cells[i].color != NEUTRAL)
+            continue;
+        if (through(mine, mine_far, i) == 0) {
+            children[0] = (struct hex_solve_child){(uint32_t)i, INF, 0};
+            *count = 1;
+            return;
+        }
+        uint32_t d = through(theirs, theirs_far, i);
+        if (d == 0 && threats++ == 0)
+            threat = i;
+        if (d < their_distance)
+            their_distance = d;
+    }
+    /* a threat outside must_play is a second one */
+    if (threats >= 2 ||
+        (threats && !(must_play[threat / 64] >> (threat % 64) & 1))) {
+        *count = 0;
+        return;
+    }
+    if (s->patterns.neighbors && !threats)
+        prune(s, to_move, must_play);
+
+    for (size_t i = threats ? threat : 0; i < cells; i++) {
+        if (g->cells[i].color != NEUTRAL ||
+            !(must_play[i / 64] >> (i % 64) & 1))
+            continue;
+        struct hex_solve_child *c = &children[n++];
+        struct hex_tt_data d;
+        c->move = (uint32_t)i;
+        if (hex_tt_probe(&s->tt, hex_grid_child_key(g, i, to_move), &d)) {
+            c->phi = d.count[0];
+            c->delta = d.count[1];
+        } else {
+            /* a stone on one of their shortest paths probably lengthens
+               it; distances are capped at the board, which no real one
+               exceeds */
+            uint32_t mine_here = through(mine, mine_far, i);
+            uint64_t theirs_now = (uint64_t)their_distance + 1;
+            if (through(theirs, theirs_far, i) == their_distance)
+                theirs_now++;
+            c->phi = theirs_now < cells ? theirs_now : (uint32_t)cells;
+            c->delta = mine_here < cells ? mine_here : (uint32_t)cells;
+        }
+        if (threats)
+            break;
+    }
+    *count = n;
+}
+
+/* Searches the position of s->grid with `to_move` to play until its proof
+   number phi reaches thphi or its disproof number delta reaches thdelta,
+   which it returns along with the move that looked best. A win needs one
+   child lost for the opponent and a loss needs all of them won, so phi is
+   the least delta of the children and delta the sum of their phi. */
+static void mid(struct hex_solver *s,
+                cell_color to_move,
+                size_t depth,
+                uint32_t thphi,
+                uint32_t thdelta,
+                uint32_t *phi,
+                uint32_t *delta,
+                uint32_t *move) {
+    hex_grid *g = &s->grid;
+    const size_t cells = g->size * g->size;
+    struct hex_solve_child *children = &s->children[depth * cells];
+    const uint64_t start = s->nodes;
+    size_t n, best = 0;
+
+    s->nodes++;
+    generate(s, to_move, children, &n);
+    for (;;) {
+        uint32_t second = INF;
+        uint64_t sum = 0;
+        bool infinite = false;
+        *phi = INF;
+        for (size_t k = 0; k < n; k++) {
+            if (children[k].delta < *phi) {
+                second = *phi;
+                *phi = children[k].delta;
+                best = k;
+            } else if (children[k].delta < second) {
+                second = children[k].delta;
+            }
+            if (children[k].phi == INF)
+                infinite = true;
+            sum += children[k].phi;
+        }
+        /* only a proof is infinite, a large sum saturates below it */
+        *delta = infinite ? INF : sum >= INF ? INF - 1 : (uint32_t)sum;
+        if (*phi >= thphi || *delta >= thdelta || out_of_budget(s))
+            break;
+
+        struct hex_solve_child *c = &children[best];
+        /* thdelta > *delta >= c->phi here, so this cannot underflow */
+        uint32_t child_thphi = thdelta - *delta + c->phi;
+        uint64_t child_thdelta = thphi;
+        if (second < INF) {
+            uint64_t widened = (uint64_t)((double)second * (1 + EPSILON));
+            if (widened < (uint64_t)second + 1)
+                widened = (uint64_t)second + 1;
+            if (widened < child_thdelta)
+                child_thdelta = widened;
+        }
+        uint32_t child_move;
+        hex_grid_open_cell(g, c->move, to_move);
+        mid(s, other(to_move), depth + 1, child_thphi, (uint32_t)child_thdelta,
+            &c->phi, &c->delta, &child_move);
+        hex_grid_undo(g);
+    }
+
+    *move = children[best].move;
+    if (s->aborted)
+        return;
+    struct hex_tt_data d = {.move = *move, .bound = HEX_TT_NONE};
+    if (*phi == 0 || *delta == 0) {
+        d.bound = HEX_TT_EXACT;
+        d.value = *phi == 0 ? 1 : -1;
+        d.depth = PROVEN_DEPTH;
+    } else {
+        for (uint64_t work = s->nodes - start; work > 1; work >>= 1)
+            d.depth++;
+        if (d.depth >= PROVEN_DEPTH)
+            d.depth = PROVEN_DEPTH - 1;
+    }
+    d.count[0] = *phi;
+    d.count[1] = *delta;
+    hex_tt_store(&s->tt, hex_grid_key(g, to_move), &d);
+}
+
+/* Returns whether the position of s->grid is a win for to_move, and the
+   winning move in *move if so. Positions the table lost are proved again,
+   which can run out of budget and set s->aborted. */
+static bool prove(struct hex_solver *s,
+                  cell_color to_move,
+                  size_t depth,
+                  uint32_t *move) {
+    struct hex_tt_data d;
+    if (hex_tt_probe(&s->tt, hex_grid_key(&s->grid, to_move), &d) &&
+        d.bound == HEX_TT_EXACT) {
+        *move = d.move;
+        return d.value > 0;
+    }
+    uint32_t phi, delta;
+    mid(s, to_move, depth, INF, INF, &phi, &delta, move);
+    return phi == 0;
+}
+
+/* Positions already counted by the proof walk. Key 0 marks free slots, so
+   the position with key 0 is tracked on its own. */
+struct key_set {
+    uint64_t *keys;
+    size_t mask;
+    size_t count;
+    bool zero;
+};
+
+static bool key_set_insert(struct key_set *set, uint64_t key) {
+    if (key == 0) {
+        bool fresh = !set->zero;
+        set->zero = true;
+        return fresh;
+    }
+    if (2 * (set->count + 1) > set->mask + 1) {
+        size_t capacity = (set->mask + 1) * 2;
+        uint64_t *keys = calloc(capacity, sizeof(uint64_t));
+        if (!keys)
+            return false;
+        for (size_t k = 0; k <= set->mask; k++) {
+            if (!set->keys[k])
+                continue;
+            size_t h = set->keys[k] & (capacity - 1);
+            while (keys[h])
+                h = (h + 1) & (capacity - 1);
+            keys[h] = set->keys[k];
+        }
+        free(set->keys);
+        set->keys = keys;
+        set->mask = capacity - 1;
+    }
+    size_t h = key & set->mask;
+    while (set->keys[h]) {
+        if (set->keys[h] == key)
+            return false;
+        h = (h + 1) & set->mask;
+    }
+    set->keys[h] = key;
+    set->count++;
+    return true;
+}
+
+/* Counts the positions of the proof tree below the position of s->grid that
+   have not been counted yet: one winning move where the winner is to move,
+   every move where the loser is. */
+static size_t proof_walk(struct hex_solver *s,
+                         struct key_set *set,
+                         cell_color to_move,
+                         size_t depth) {
+    hex_grid *g = &s->grid;
+    if (s->aborted || !key_set_insert(set, hex_grid_key(g, to_move)))
+        return 0;
+    if (hex_grid_get_winner(g) != NEUTRAL)
+        return 1;
+
+    /* what the connections settle is a leaf, and they and the patterns
+       leave the loser only the moves in must_play */
+    uint32_t move;
+    uint64_t must_play[HEX_VC_WORDS];
+    memset(must_play, 0xff, sizeof(must_play));
+    if (s->vc.grid && connections(s, to_move, &move, must_play) != NEUTRAL)
+        return 1;
+    if (s->patterns.neighbors)
+        prune(s, to_move, must_play);
+
+    size_t size = 1;
+    if (prove(s, to_move, depth, &move)) {
+        hex_grid_open_cell(g, move, to_move);
+        size += proof_walk(s, set, other(to_move), depth + 1);
+        hex_grid_undo(g);
+        return size;
+    }
+    const size_t cells = g->size * g->size;
+    for (size_t i = 0; i < cells && !s->aborted; i++) {
+        if (g->cells[i].color != NEUTRAL ||
+            !(must_play[i / 64] >> (i % 64) & 1))
+            continue;
+        hex_grid_open_cell(g, i, to_move);
+        size += proof_walk(s, set, other(to_move), depth + 1);
+        hex_grid_undo(g);
+    }
+    return size;
+}
+
+cell_color hex_solve(struct hex_solver *s,
+                     const hex_grid *g,
+                     cell_color to_move,
+                     bool proof,
+                     struct hex_solve_stats *stats) {
+    const double start = hex_clock_now();
+    const size_t cells = s->grid.size * s->grid.size;
+    struct key_set set = {0};
+    cell_color winner;
+
+    s->nodes = 0;
+    s->next_check = 0;
+    s->aborted = false;
+    s->deadline = s->config.max_seconds > 0 ? start + s->config.max_seconds : 0;
+    hex_grid_copy(&s->grid, g);
+
+    winner = hex_grid_get_winner(&s->grid);
+    if (winner == NEUTRAL) {
+        uint32_t move;
+        bool won = prove(s, to_move, 0, &move);
+        winner = s->aborted ? NEUTRAL : won ? to_move : other(to_move);
+    }
+
+    size_t proof_size = 0;
+    if (proof && winner != NEUTRAL) {
+        set.keys = calloc(1024, sizeof(uint64_t));
+        set.mask = set.keys ? 1023 : 0;
+        if (set.keys)
+            proof_size = proof_walk(s, &set, to_move, 0);
+        if (s->aborted)
+            proof_size = 0;
+    }
+
+    if (stats) {
+        stats->nodes = s->nodes;
+        stats->proof_size = proof_size;
+        stats->memory = (s->tt.mask + 1) * 2 * sizeof(struct hex_tt_slot) +
+                        (cells + 1) * cells * sizeof(*s->children) +
+                        (6 * cells + 1) * sizeof(uint32_t) +
+                        (set.keys ? (set.mask + 1) * sizeof(uint64_t) : 0);
+        stats->seconds = hex_clock_now() - start;
+        stats->nodes_per_second =
+            stats->seconds > 0 ? (double)s->nodes / stats->seconds : 0;
+    }
+    free(set.keys);
+    return winner;
+}
@@ -0,0 +1,84 @@
+#if !defined(HEX_SOLVE_H)
+#define HEX_SOLVE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "hex-grid.h"
+#include "hex-patterns.h"
+#include "hex-tt.h"
+#include "hex-vc.h"
+
+/* Exact solver: depth-first proof-number search (df-pn) in negamax form,
+   with the 1 + epsilon threshold trick and a transposition table holding
+   the proof and disproof numbers. Moves are made and taken back on one grid
+   with the undoable union-find, so a node costs a few O(log n) finds.
+   Hex positions never repeat, so there are no cycles to worry about.
+
+   At each node the virtual connections of both sides are rebuilt
+   (hex-vc.h): one between the edges of the side to move, or a full one of
+   the opponent, settles the node, and the opponent's semi-connections
+   leave only the moves in all of their carriers. That costs most of the
+   time of a node, and saves far more nodes from 5x5 up. The dead, captured
+   and dominated cells of hex-patterns.h, found from scratch at each node,
+   then drop out of what is left, unless that would leave nothing.
+
+   The table outlives a solve: positions solved by one call (a child of the
+   root, say) are free for the next. */
+
+struct hex_solve_config {
+    size_t tt_megabytes;
+    size_t max_nodes;   // 0 for no limit
+    double max_seconds; // 0 for no limit
+    bool patterns;      // prune inferior cells
+};
+
+struct hex_solve_stats {
+    uint64_t nodes;    // positions expanded
+    size_t proof_size; // distinct positions in the proof tree, if asked for
+    size_t memory;     // bytes held by the solver
+    double seconds;
+    double nodes_per_second;
+};
+
+struct hex_solve_child {
+    uint32_t move;
+    uint32_t phi; // proof and disproof numbers for the side to move there
+    uint32_t delta;
+};
+
+struct hex_solver {
+    struct hex_solve_config config;
+    struct hex_tt tt;
+    hex_grid grid;
+    struct hex_solve_child *children; // size * size per depth of the search
+    uint32_t *dist; // edge distances of both sides, for the heuristic
+    uint32_t *queue;
+    struct hex_vc_engine vc; // not set up (grid NULL) past HEX_VC_MAX_CELLS
+    struct hex_patterns patterns; // likewise (neighbors NULL), or if off
+    uint32_t *moves;              // what the patterns leave
+    uint64_t nodes;
+    uint64_t next_check; // node count at which to look at the clock again
+    double deadline;
+    bool aborted;
+};
+
+void hex_solve_default_config(struct hex_solve_config *config);
+
+int hex_solver_init(struct hex_solver *s,
+                    const struct hex_solve_config *config,
+                    size_t size);
+
+void hex_solver_destroy(struct hex_solver *s);
+
+/* Proves who wins g with `to_move` to play. Returns NEUTRAL if the node or
+   time budget ran out first. With `proof`, the proof tree is walked
+   afterwards to measure it. `stats` may be NULL. */
+cell_color hex_solve(struct hex_solver *s,
+                     const hex_grid *g,
+                     cell_color to_move,
+                     bool proof,
+                     struct hex_solve_stats *stats);
+
+#endif /* HEX_SOLVE_H */
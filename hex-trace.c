@@ -0,0 +1,153 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hex-clock.h"
+#include "hex-trace.h"
+
+#define MAX_DEPTH 64
+
+struct event {
+    const char *name;
+    double time;
+    double value; // counters only
+    char phase;   // 'B', 'E' or 'C'
+};
+
+_Atomic uint64_t hex_trace_uf_finds;
+_Atomic uint64_t hex_trace_uf_steps;
+
+static struct trace {
+    struct event *events; // allocated by the first event
+    size_t count;
+    size_t dropped;
+    double origin;
+    /* whether each open span made it into the buffer */
+    bool open[MAX_DEPTH];
+    unsigned depth;
+    size_t draw_calls;
+    size_t last_draw_calls;
+    uint64_t last_finds;
+    uint64_t last_steps;
+    double frames[HEX_TRACE_FRAMES];
+    size_t frame_count;
+} trace;
+
+/* Records an event if there is room for it and for closing every open
+   span, so the trace always stays balanced. */
+static bool push(const char *name, char phase, double value) {
+    if (!trace.events) {
+        trace.events = malloc(HEX_TRACE_MAX_EVENTS * sizeof(struct event));
+        trace.origin = hex_clock_now();
+    }
+    if (!trace.events ||
+        (phase != 'E' &&
+         trace.count + trace.depth + 2 > HEX_TRACE_MAX_EVENTS)) {
+        trace.dropped++;
+        return false;
+    }
+    trace.events[trace.count++] =
+        (struct event){name, hex_clock_now(), value, phase};
+    return true;
+}
+
+void hex_trace_begin(const char *name) {
+    if (trace.depth < MAX_DEPTH)
+        trace.open[trace.depth] = push(name, 'B', 0);
+    else
+        trace.dropped++;
+    trace.depth++;
+}
+
+void hex_trace_end(void) {
+    if (trace.depth == 0)
+        return;
+    trace.depth--;
+    if (trace.depth < MAX_DEPTH && trace.open[trace.depth])
+        push(NULL, 'E', 0);
+}
+
+void hex_trace_counter(const char *name, double value) {
+    push(name, 'C', value);
+}
+
+void hex_trace_draw_call(void) {
+    trace.draw_calls++;
+}
+
+void hex_trace_frame(double seconds) {
+    const uint64_t finds =
+        atomic_load_explicit(&hex_trace_uf_finds, memory_order_relaxed);
+    const uint64_t steps =
+        atomic_load_explicit(&hex_trace_uf_steps, memory_order_relaxed);
+    trace.frames[trace.frame_count++ % HEX_TRACE_FRAMES] = seconds;
+    trace.last_draw_calls = trace.draw_calls;
+    hex_trace_counter("frame ms", seconds * 1e3);
+    hex_trace_counter("draw calls", (double)trace.draw_calls);
+    if (finds != trace.last_finds) {
+        hex_trace_counter("uf steps per find",
+                          (double)(steps - trace.last_steps) /
+                              (double)(finds - trace.last_finds));
+    }
+    trace.draw_calls = 0;
+    trace.last_finds = finds;
+    trace.last_steps = steps;
+}
+
+static int compare_doubles(const void *a, const void *b) {
+    const double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+void hex_trace_frame_stats(struct hex_trace_frame_stats *stats) {
+    double sorted[HEX_TRACE_FRAMES];
+    const size_t n = trace.frame_count < HEX_TRACE_FRAMES ? trace.frame_count
+                                                          : HEX_TRACE_FRAMES;
+    memset(stats, 0, sizeof(*stats));
+    stats->frames = n;
+    stats->draw_calls = trace.last_draw_calls;
+    if (n == 0)
+        return;
+    stats->last_ms =
+        trace.frames[(trace.frame_count - 1) % HEX_TRACE_FRAMES] * 1e3;
+    memcpy(sorted, trace.frames, n * sizeof(double));
+    qsort(sorted, n, sizeof(double), compare_doubles);
+    stats->p50_ms = sorted[(n - 1) / 2] * 1e3;
+    stats->p99_ms = sorted[(n - 1) * 99 / 100] * 1e3;
+}
+
+size_t hex_trace_event_count(void) {
+    return trace.count;
+}
+
+size_t hex_trace_dropped(void) {
+    return trace.dropped;
+}
+
+int hex_trace_write(const char *path) {
+    FILE *f = fopen(path, "w");
+    if (!f)
+        return 0;
+    fputs("{\"traceEvents\":[", f);
+    for (size_t k = 0; k < trace.count; k++) {
+        const struct event *e = &trace.events[k];
+        const double ts = (e->time - trace.origin) * 1e6;
+        fprintf(f, "%s\n{\"ph\":\"%c\",\"ts\":%.3f,\"pid\":1,\"tid\":1",
+                k ? "," : "", e->phase, ts);
+        if (e->name)
+            fprintf(f, ",\"name\":\"%s\"", e->name);
+        if (e->phase == 'C')
+            fprintf(f, ",\"args\":{\"value\":%.6g}", e->value);
+        fputc('}', f);
+    }
+    fputs("\n],\"displayTimeUnit\":\"ms\"}\n", f);
+    return fclose(f) == 0;
+}
+
+void hex_trace_reset(void) {
+    free(trace.events);
+    memset(&trace, 0, sizeof(trace));
+    atomic_store(&hex_trace_uf_finds, 0);
+    atomic_store(&hex_trace_uf_steps, 0);
+}
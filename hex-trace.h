@@ -0,0 +1,81 @@
+#if !defined(HEX_TRACE_H)
+#define HEX_TRACE_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Timeline of what the game's main thread spends its frames on, written
+   out in the Chrome trace format (chrome://tracing, ui.perfetto.dev).
+
+   The HEX_TRACE_ macros are what the code is instrumented with. Unless
+   built with -DHEX_TRACE they expand to nothing, arguments included, so a
+   normal build does not even evaluate them. The functions behind them are
+   always there, for the tests and for tools that want them anyway.
+
+   Spans and counters are recorded from one thread only; the union-find
+   statistics are atomic, as the search threads find roots too. Names must
+   be string literals without quotes or backslashes: only the pointers are
+   kept, and they are written out as they are. */
+
+#define HEX_TRACE_MAX_EVENTS ((size_t)1 << 20)
+#define HEX_TRACE_FRAMES 256 // kept for the frame time percentiles
+
+struct hex_trace_frame_stats {
+    size_t frames; // recorded, up to HEX_TRACE_FRAMES
+    double last_ms;
+    double p50_ms;
+    double p99_ms;
+    size_t draw_calls; // of the last frame
+};
+
+/* Roots found by the union-find, and the parent links walked to them. */
+extern _Atomic uint64_t hex_trace_uf_finds;
+extern _Atomic uint64_t hex_trace_uf_steps;
+
+/* Opens a span, closed by the next hex_trace_end(). Spans nest. */
+void hex_trace_begin(const char *name);
+void hex_trace_end(void);
+
+/* A value plotted over time. */
+void hex_trace_counter(const char *name, double value);
+
+void hex_trace_draw_call(void);
+
+/* Ends a frame that took `seconds`: records its time, and the draw calls
+   and union-find walks since the last one as counters. */
+void hex_trace_frame(double seconds);
+
+void hex_trace_frame_stats(struct hex_trace_frame_stats *stats);
+
+/* Events recorded, and dropped once HEX_TRACE_MAX_EVENTS were. */
+size_t hex_trace_event_count(void);
+size_t hex_trace_dropped(void);
+
+/* Writes the events so far as trace JSON. Returns 0 on failure. */
+int hex_trace_write(const char *path);
+
+/* Forgets every event and frame. */
+void hex_trace_reset(void);
+
+#if defined(HEX_TRACE)
+#define HEX_TRACE_BEGIN(name) hex_trace_begin(name)
+#define HEX_TRACE_END() hex_trace_end()
+#define HEX_TRACE_DRAW_CALL() hex_trace_draw_call()
+#define HEX_TRACE_FRAME(seconds) hex_trace_frame(seconds)
+#define HEX_TRACE_UF_FIND(steps)                                        \
+    do {                                                                \
+        atomic_fetch_add_explicit(&hex_trace_uf_finds, 1,               \
+                                  memory_order_relaxed);                \
+        atomic_fetch_add_explicit(&hex_trace_uf_steps, (steps),         \
+                                  memory_order_relaxed);                \
+    } while (0)
+#else
+#define HEX_TRACE_BEGIN(name) ((void)0)
+#define HEX_TRACE_END() ((void)0)
+#define HEX_TRACE_DRAW_CALL() ((void)0)
+#define HEX_TRACE_FRAME(seconds) ((void)0)
+#define HEX_TRACE_UF_FIND(steps) ((void)0)
+#endif
+
+#endif /* HEX_TRACE_H */
@@ -0,0 +1,88 @@
+#include <stdlib.h>
+
+#include "hex-tt.h"
+
+/* set in the stored bound byte so that a zeroed slot never matches key 0 */
+#define USED 0x80
+
+static uint64_t pack(const struct hex_tt_data *d) {
+    return (uint64_t)d->move | (uint64_t)(uint16_t)d->value << 32 |
+           (uint64_t)d->depth << 48 | (uint64_t)(d->bound | USED) << 56;
+}
+
+static void unpack(uint64_t w0, uint64_t w1, struct hex_tt_data *d) {
+    d->move = (uint32_t)w0;
+    d->value = (int16_t)(uint16_t)(w0 >> 32);
+    d->depth = (uint8_t)(w0 >> 48);
+    d->bound = (uint8_t)(w0 >> 56) & ~USED;
+    d->count[0] = (uint32_t)w1;
+    d->count[1] = (uint32_t)(w1 >> 32);
+}
+
+int hex_tt_init(struct hex_tt *tt, size_t megabytes) {
+    size_t bytes = megabytes << 20;
+    size_t pairs = 1;
+    while (pairs * 2 * 2 * sizeof(struct hex_tt_slot) <= bytes)
+        pairs *= 2;
+    tt->slots = malloc(pairs * 2 * sizeof(struct hex_tt_slot));
+    if (!tt->slots)
+        return 0;
+    tt->mask = pairs - 1;
+    hex_tt_clear(tt);
+    return 1;
+}
+
+void hex_tt_destroy(struct hex_tt *tt) {
+    free(tt->slots);
+    tt->slots = NULL;
+    tt->mask = 0;
+}
+
+void hex_tt_clear(struct hex_tt *tt) {
+    for (size_t s = 0; s < (tt->mask + 1) * 2; s++) {
+        atomic_init(&tt->slots[s].check, 0);
+        atomic_init(&tt->slots[s].data[0], 0);
+        atomic_init(&tt->slots[s].data[1], 0);
+    }
+}
+
+/* Loads a slot and returns whether it holds key. */
+static bool load(struct hex_tt_slot *slot,
+                 uint64_t key,
+                 uint64_t *w0,
+                 uint64_t *w1) {
+    uint64_t check = atomic_load_explicit(&slot->check, memory_order_relaxed);
+    *w0 = atomic_load_explicit(&slot->data[0], memory_order_relaxed);
+    *w1 = atomic_load_explicit(&slot->data[1], memory_order_relaxed);
+    return (check ^ *w0 ^ *w1) == key && (*w0 >> 56 & USED);
+}
+
+bool hex_tt_probe(const struct hex_tt *tt,
+                  uint64_t key,
+                  struct hex_tt_data *out) {
+    struct hex_tt_slot *pair = &tt->slots[(key & tt->mask) * 2];
+    uint64_t w0, w1;
+    for (size_t s = 0; s < 2; s++) {
+        if (load(&pair[s], key, &w0, &w1)) {
+            unpack(w0, w1, out);
+            return true;
+        }
+    }
+    return false;
+}
+
+void hex_tt_store(struct hex_tt *tt,
+                  uint64_t key,
+                  const struct hex_tt_data *data) {
+    struct hex_tt_slot *pair = &tt->slots[(key & tt->mask) * 2];
+    uint64_t w0, w1;
+    struct hex_tt_slot *slot = &pair[1];
+    if (load(&pair[0], key, &w0, &w1) || (uint8_t)(w0 >> 48) <= data->depth)
+        slot = &pair[0];
+
+    w0 = pack(data);
+    w1 = (uint64_t)data->count[0] | (uint64_t)data->count[1] << 32;
+    atomic_store_explicit(&slot->check, key ^ w0 ^ w1, memory_order_relaxed);
+    atomic_store_explicit(&slot->data[0], w0, memory_order_relaxed);
+    atomic_store_explicit(&slot->data[1], w1, memory_order_relaxed);
+}
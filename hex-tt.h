@@ -0,0 +1,67 @@
+#if !defined(HEX_TT_H)
+#define HEX_TT_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* A fixed-size transposition table keyed by hex_grid_key(), shared by any
+   number of threads without locks. Each slot is three words written with
+   plain relaxed stores: the two data words and the key XORed with both. A
+   reader accepts a slot only if the XOR of the three gives back its key, so
+   a slot torn by two concurrent writers reads as a miss instead of as the
+   data of another position.
+
+   Slots come in pairs: the first keeps the deeper entry and the second
+   takes whatever the first refused, so recent results are never lost to
+   old deep ones. */
+
+#define HEX_TT_NO_MOVE UINT32_MAX
+
+enum hex_tt_bound {
+    HEX_TT_NONE = 0, // visit data only
+    HEX_TT_LOWER,
+    HEX_TT_UPPER,
+    HEX_TT_EXACT
+};
+
+struct hex_tt_data {
+    uint32_t move; // best move, HEX_TT_NO_MOVE if unknown
+    int16_t value;
+    uint8_t depth; // search effort, deeper entries are kept longer
+    uint8_t bound;
+    /* Visit data, its meaning is up to the search: visits and wins for
+       MCTS, proof and disproof numbers for proof-number search. */
+    uint32_t count[2];
+};
+
+struct hex_tt_slot {
+    _Atomic uint64_t check; // key ^ data[0] ^ data[1]
+    _Atomic uint64_t data[2];
+};
+
+struct hex_tt {
+    struct hex_tt_slot *slots;
+    size_t mask; // slot pairs - 1, a power of two minus one
+};
+
+/* Allocates the largest power of two of slot pairs that fits in `megabytes`
+   (at least one pair). Returns 0 on failure. */
+int hex_tt_init(struct hex_tt *tt, size_t megabytes);
+
+void hex_tt_destroy(struct hex_tt *tt);
+
+/* Empties the table. Must not run concurrently with probes or stores. */
+void hex_tt_clear(struct hex_tt *tt);
+
+/* Looks key up and copies its entry to `out`. Returns false on a miss. */
+bool hex_tt_probe(const struct hex_tt *tt,
+                  uint64_t key,
+                  struct hex_tt_data *out);
+
+void hex_tt_store(struct hex_tt *tt,
+                  uint64_t key,
+                  const struct hex_tt_data *data);
+
+#endif /* HEX_TT_H */
@@ -0,0 +1,315 @@
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hex-twodistance.h"
+
+#define PLANES 4
+#define NONE UINT32_MAX
+
+static uint64_t *plane(struct hex_twodistance *t, size_t k) {
+    return t->storage + k * (t->words + 2 * t->pad) + t->pad;
+}
+
+static bool test_bit(const uint64_t *x, size_t bit) {
+    return x[bit / 64] >> (bit % 64) & 1;
+}
+
+static void set_bit(uint64_t *x, size_t bit) {
+    x[bit / 64] |= (uint64_t)1 << (bit % 64);
+}
+
+int hex_twodistance_init(struct hex_twodistance *t, size_t size) {
+    const size_t cells = size * size;
+    memset(t, 0, sizeof(*t));
+    if (size < 1 || size > HEX_GRID_SHARED_TABLES)
+        return 0;
+    t->size = size;
+    t->stride = size + 1;
+    t->words = (size * t->stride + 63) / 64;
+    t->pad = t->stride / 64 + 2;
+    t->storage = calloc(PLANES * (t->words + 2 * t->pad), sizeof(uint64_t));
+    t->distance[0] = malloc(cells * sizeof(uint16_t));
+    t->distance[1] = malloc(cells * sizeof(uint16_t));
+    t->label = malloc(cells * sizeof(uint32_t));
+    t->order = malloc(cells * sizeof(uint32_t));
+    t->group_start = malloc((cells + 1) * sizeof(uint32_t));
+    t->around = malloc(6 * cells * sizeof(uint32_t));
+    t->around_start = malloc((cells + 1) * sizeof(uint32_t));
+    t->edges = malloc(cells);
+    t->mark = calloc(size * t->stride, sizeof(uint32_t));
+    t->via = malloc(size * t->stride * sizeof(uint32_t));
+    t->active = malloc(cells * sizeof(uint32_t));
+    if (!t->storage || !t->distance[0] || !t->distance[1] || !t->label ||
+        !t->order || !t->group_start || !t->around || !t->around_start ||
+        !t->edges || !t->mark || !t->via || !t->active) {
+        hex_twodistance_destroy(t);
+        return 0;
+    }
+    t->empty = plane(t, 0);
+    t->reached = plane(t, 1);
+    t->one = plane(t, 2);
+    t->two = plane(t, 3);
+    return 1;
+}
+
+void hex_twodistance_destroy(struct hex_twodistance *t) {
+    free(t->storage);
+    free(t->distance[0]);
+    free(t->distance[1]);
+    free(t->label);
+    free(t->order);
+    free(t->group_start);
+    free(t->around);
+    free(t->around_start);
+    free(t->edges);
+    free(t->mark);
+    free(t->via);
+    free(t->active);
+    memset(t, 0, sizeof(*t));
+}
+
+static uint32_t next_stamp(struct hex_twodistance *t) {
+    if (++t->stamp == 0) {
+        memset(t->mark, 0, t->size * t->stride * sizeof(uint32_t));
+        t->stamp = 1;
+    }
+    return t->stamp;
+}
+
+static uint32_t bit_of(const struct hex_twodistance *t, size_t i) {
+    return (uint32_t)(i / t->size * t->stride + i % t->size);
+}
+
+/* Floods the player's groups and lists the empty cells around each, once
+   per group. The union-find would join every group on an edge through the
+   virtual cell, which is one node too many for the other edge. */
+static void find_groups(struct hex_twodistance *t,
+                        const hex_grid *g,
+                        cell_color player) {
+    const size_t cells = t->size * t->size;
+    const uint32_t edge = (uint32_t)(player == RED
+                                         ? RED_VIRTUAL_CELLS_START(g)
+                                         : BLUE_VIRTUAL_CELLS_START(g));
+    uint32_t tail = 0, n = 0;
+    size_t groups = 0;
+
+    for (size_t i = 0; i < cells; i++)
+        t->label[i] = NONE;
+    for (size_t i = 0; i < cells; i++) {
+        if (g->cells[i].color != player || t->label[i] != NONE)
+            continue;
+        const uint32_t stamp = next_stamp(t);
+        uint8_t edges = 0;
+        t->group_start[groups] = tail;
+        t->around_start[groups] = n;
+        t->label[i] = (uint32_t)groups;
+        t->order[tail++] = (uint32_t)i;
+        for (uint32_t m = t->group_start[groups]; m < tail; m++) {
+            const uint32_t *neighbors = g->neighbors[t->order[m]];
+            for (unsigned k = 0; k < 6; k++) {
+                const uint32_t v = neighbors[k];
+                if (v >= cells) {
+                    edges |= (v == edge) | (v == edge + 1) << 1;
+                } else if (g->cells[v].color == player) {
+                    if (t->label[v] == NONE) {
+                        t->label[v] = (uint32_t)groups;
+                        t->order[tail++] = v;
+                    }
+                } else if (g->cells[v].color == NEUTRAL) {
+                    const uint32_t b = bit_of(t, v);
+                    if (t->mark[b] != stamp) {
+                        t->mark[b] = stamp;
+                        t->around[n++] = b;
+                    }
+                }
+            }
+        }
+        t->edges[groups++] = edges;
+    }
+    t->group_start[groups] = tail;
+    t->around_start[groups] = n;
+    t->groups = groups;
+}
+
+static bool adjacent(const struct hex_twodistance *t, uint32_t a, uint32_t b) {
+    const size_t d = a > b ? a - b : b - a;
+    return d == 1 || d == t->stride - 1 || d == t->stride;
+}
+
+/* Adds to `two` the cells that the groups give two reached neighbours,
+   given those `one` has from next door. A group around which a single
+   cell is reached brings in that cell, which only counts if the cell has
+   another way in. Once two are reached everything around the group is on
+   the next level, and the group drops out. */
+static void through_groups(struct hex_twodistance *t) {
+    const uint32_t stamp = next_stamp(t);
+    for (size_t a = 0; a < t->active_count; a++) {
+        const uint32_t l = t->active[a];
+        const uint32_t *begin = t->around + t->around_start[l];
+        const uint32_t *end = t->around + t->around_start[l + 1];
+        uint32_t first = NONE;
+        unsigned count = 0;
+        for (const uint32_t *p = begin; p < end && count < 2; p++) {
+            if (test_bit(t->reached, *p)) {
+                if (!count++)
+                    first = *p;
+            }
+        }
+        if (!count)
+            continue;
+        if (count == 2)
+            t->active[a--] = t->active[--t->active_count];
+        for (const uint32_t *p = begin; p < end; p++) {
+            const uint32_t c = *p;
+            if (test_bit(t->reached, c)) {
+                continue;
+            } else if (count == 2 ||
+                       (t->mark[c] == stamp && t->via[c] != first) ||
+                       (test_bit(t->one, c) && !adjacent(t, c, first))) {
+                set_bit(t->two, c);
+            } else {
+                t->mark[c] = stamp;
+                t->via[c] = first;
+            }
+        }
+    }
+}
+
+/* The distances of the empty cells from edge e (0 or 1) of the player
+   find_groups() was last run for, level by level: `one` holds each new
+   level in turn. */
+static void spread(struct hex_twodistance *t,
+                   cell_color player,
+                   unsigned e,
+                   uint16_t *distance) {
+    const size_t size = t->size, words = t->words;
+    const size_t shifts[3] = {1, t->stride - 1, t->stride};
+    size_t q[3];
+    unsigned r[3];
+    for (unsigned s = 0; s < 3; s++) {
+        q[s] = shifts[s] / 64;
+        r[s] = shifts[s] % 64;
+    }
+
+    for (size_t i = 0; i < size * size; i++)
+        distance[i] = HEX_TWODISTANCE_FAR;
+    memset(t->reached, 0, words * sizeof(uint64_t));
+    memset(t->one, 0, words * sizeof(uint64_t));
+    for (size_t j = 0; j < size; j++) {
+        const size_t far = e ? size - 1 : 0;
+        set_bit(t->one, player == RED ? far * t->stride + j
+                                      : j * t->stride + far);
+    }
+    for (size_t w = 0; w < words; w++)
+        t->one[w] &= t->empty[w];
+    t->active_count = 0;
+    for (size_t l = 0; l < t->groups; l++) {
+        if (!(t->edges[l] >> e & 1)) {
+            t->active[t->active_count++] = (uint32_t)l;
+            continue;
+        }
+        for (uint32_t m = t->around_start[l]; m < t->around_start[l + 1]; m++)
+            set_bit(t->one, t->around[m]);
+    }
+
+    for (uint16_t level = 1;; level++) {
+        uint64_t any = 0;
+        for (size_t w = 0; w < words; w++) {
+            uint64_t bits = t->one[w];
+            any |= bits;
+            t->reached[w] |= bits;
+            while (bits) {
+                const size_t b = w * 64 + (size_t)__builtin_ctzll(bits);
+                bits &= bits - 1;
+                distance[b / t->stride * size + b % t->stride] = level;
+            }
+        }
+        if (!any)
+            break;
+
+        /* a two-bit count of the reached neighbours of the other cells,
+           from the reached set shifted each way by each neighbour offset;
+           the zero pads supply what is shifted in */
+        for (size_t w = 0; w < words; w++) {
+            const uint64_t open = t->empty[w] & ~t->reached[w];
+            uint64_t one = 0, two = 0;
+            for (unsigned s = 0; s < 3; s++) {
+                const uint64_t *lo = t->reached - q[s] + w;
+                const uint64_t *hi = t->reached + q[s] + w;
+                uint64_t v = lo[0] << r[s];
+                uint64_t u = hi[0] >> r[s];
+                if (r[s]) {
+                    v |= lo[-1] >> (64 - r[s]);
+                    u |= hi[1] << (64 - r[s]);
+                }
+                v &= open;
+                two |= one & v;
+                one |= v;
+                u &= open;
+                two |= one & u;
+                one |= u;
+            }
+            t->one[w] = one;
+            t->two[w] = two;
+        }
+        through_groups(t);
+        memcpy(t->one, t->two, words * sizeof(uint64_t));
+    }
+}
+
+unsigned hex_twodistance_potential(struct hex_twodistance *t,
+                                   const hex_grid *g,
+                                   cell_color player,
+                                   size_t *ties) {
+    assert(g->size == t->size);
+    const size_t cells = t->size * t->size;
+    unsigned best = HEX_TWODISTANCE_FAR;
+    size_t n = 0;
+
+    find_groups(t, g, player);
+    memset(t->empty, 0, t->words * sizeof(uint64_t));
+    for (size_t i = 0; i < cells; i++) {
+        if (g->cells[i].color == NEUTRAL)
+            set_bit(t->empty, bit_of(t, i));
+    }
+    spread(t, player, 0, t->distance[0]);
+    spread(t, player, 1, t->distance[1]);
+
+    bool connected = false;
+    for (size_t l = 0; l < t->groups; l++)
+        connected |= t->edges[l] == 3;
+    if (connected) {
+        best = 0;
+    } else {
+        for (size_t i = 0; i < cells; i++) {
+            const unsigned a = t->distance[0][i], b = t->distance[1][i];
+            if (a == HEX_TWODISTANCE_FAR || b == HEX_TWODISTANCE_FAR)
+                continue;
+            if (a + b < best) {
+                best = a + b;
+                n = 0;
+            }
+            n += a + b == best;
+        }
+    }
+    if (ties)
+        *ties = n;
+    return best;
+}
+
+int hex_twodistance_evaluate(struct hex_twodistance *t, const hex_grid *g) {
+    const int cells = (int)(t->size * t->size);
+    size_t red_ties, blue_ties;
+    const unsigned red = hex_twodistance_potential(t, g, RED, &red_ties);
+    if (red == 0)
+        return HEX_TWODISTANCE_WIN;
+    const unsigned blue = hex_twodistance_potential(t, g, BLUE, &blue_ties);
+    if (blue == 0)
+        return -HEX_TWODISTANCE_WIN;
+    /* no potential ranks below any, and a step of potential outweighs any
+       difference in ties */
+    const int r = red == HEX_TWODISTANCE_FAR ? 2 * cells + 1 : (int)red;
+    const int b = blue == HEX_TWODISTANCE_FAR ? 2 * cells + 1 : (int)blue;
+    return (cells + 1) * (b - r) + (int)red_ties - (int)blue_ties;
+}
@@ -0,0 +1,74 @@
+#if !defined(HEX_TWODISTANCE_H)
+#define HEX_TWODISTANCE_H
+
+#include <limits.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "hex-grid.h"
+
+/* Queenbee's two-distance evaluation. An empty cell next to one of a
+   player's edges is at distance 1 from it, and any other is one further
+   than the second nearest of its neighbours, since the opponent can always
+   block the nearest. Each of the player's groups is a single node: all the
+   empty cells around it neighbour each other, and a group on the edge puts
+   them at distance 1. A player's potential is the least sum of the two
+   distances over the empty cells, the fewer the better, and the number of
+   cells that reach it breaks ties.
+
+   The distances grow one level at a time over bitsets laid out as in
+   hex-bitboard: the six neighbour shifts of the cells reached so far go
+   through a two-bit counter 64 cells at a time, so a level costs a few
+   word operations plus a pass over the cells around the groups still in
+   play. */
+
+#define HEX_TWODISTANCE_FAR UINT16_MAX // never two ways in from the edge
+#define HEX_TWODISTANCE_WIN INT_MAX
+
+struct hex_twodistance {
+    size_t size;
+    size_t stride; // bits per row, size + 1 guard bit
+    size_t words;  // per plane
+    size_t pad;    // zero words before and after every plane
+    uint64_t *storage;
+    uint64_t *empty;   // cells the player can still take
+    uint64_t *reached; // cells with a distance so far
+    uint64_t *one;     // one neighbour reached, then the next level
+    uint64_t *two;     // two or more
+    uint16_t *distance[2]; // per cell, from the player's first and second
+                           // edge (top or left first) at the last call
+    /* the player's groups */
+    uint32_t *label;       // group of each stone
+    uint32_t *order;       // stones grouped by group
+    uint32_t *group_start; // groups + 1 offsets into order
+    uint32_t *around;      // bits of the empty cells around each group
+    uint32_t *around_start; // groups + 1 offsets into around
+    uint8_t *edges;        // per group, 1 and 2 for the edges it touches
+    uint32_t *mark;        // per bit: scratch stamps
+    uint32_t *via;         // per bit: the one cell a group brings in
+    uint32_t *active;      // groups that can still bring cells in
+    size_t active_count;
+    uint32_t stamp;
+    size_t groups;
+};
+
+/* Boards up to HEX_GRID_SHARED_TABLES on a side. Returns 0 on failure. */
+int hex_twodistance_init(struct hex_twodistance *t, size_t size);
+
+void hex_twodistance_destroy(struct hex_twodistance *t);
+
+/* Fills t->distance for `player` and returns the potential, with the
+   number of cells that reach it in *ties (which may be NULL): 0 if the
+   player has connected, HEX_TWODISTANCE_FAR if no empty cell has a
+   distance to both edges. g must be of the size given to
+   hex_twodistance_init(). */
+unsigned hex_twodistance_potential(struct hex_twodistance *t,
+                                   const hex_grid *g,
+                                   cell_color player,
+                                   size_t *ties);
+
+/* Compares both potentials, then the ties: positive when red stands
+   better, +-HEX_TWODISTANCE_WIN once a player has connected. */
+int hex_twodistance_evaluate(struct hex_twodistance *t, const hex_grid *g);
+
+#endif /* HEX_TWODISTANCE_H */
@@ -0,0 +1,541 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "hex-vc.h"
+
+/* Connections kept per pair: the ones with the smallest carriers win. */
+#define MAX_FULLS 4
+#define MAX_SEMIS 8
+#define NO_NODE UINT32_MAX
+
+static struct hex_vc_side *side_of(struct hex_vc_engine *e,
+                                   cell_color player) {
+    return &e->sides[player == BLUE];
+}
+
+static size_t edge_start(const struct hex_vc_engine *e, cell_color player) {
+    return player == RED ? RED_VIRTUAL_CELLS_START(e->grid)
+                         : BLUE_VIRTUAL_CELLS_START(e->grid);
+}
+
+static struct hex_vc_list *pair(struct hex_vc_engine *e,
+                                struct hex_vc_side *s,
+                                size_t x,
+                                size_t y) {
+    return x < y ? &s->pairs[x * e->nodes + y] : &s->pairs[y * e->nodes + x];
+}
+
+static bool has(const uint64_t *c, size_t i) {
+    return c[i / 64] >> (i % 64) & 1;
+}
+
+static bool disjoint(const uint64_t *a, const uint64_t *b) {
+    for (size_t w = 0; w < HEX_VC_WORDS; w++) {
+        if (a[w] & b[w])
+            return false;
+    }
+    return true;
+}
+
+static bool subset(const uint64_t *a, const uint64_t *b) {
+    for (size_t w = 0; w < HEX_VC_WORDS; w++) {
+        if (a[w] & ~b[w])
+            return false;
+    }
+    return true;
+}
+
+static size_t weight(const uint64_t *c) {
+    size_t n = 0;
+    for (size_t w = 0; w < HEX_VC_WORDS; w++)
+        n += (size_t)__builtin_popcountll(c[w]);
+    return n;
+}
+
+/* The node of `player` holding cell or edge i, NO_NODE if the opponent
+   holds it. */
+static uint32_t node_of(struct hex_vc_engine *e, cell_color player, size_t i) {
+    hex_grid *g = e->grid;
+    size_t cells = g->size * g->size;
+    if (i >= cells) {
+        size_t start = edge_start(e, player);
+        if (i != start && i != start + 1)
+            return NO_NODE;
+    } else if (g->cells[i].color == NEUTRAL) {
+        return (uint32_t)i;
+    } else if (g->cells[i].color != player) {
+        return NO_NODE;
+    }
+    return (uint32_t)w_quickunion_find(&g->disjoint_set, i);
+}
+
+/* Cells next to cell i, and the edges of `player` it touches. */
+static size_t neighbors(const struct hex_vc_engine *e,
+                        size_t i,
+                        cell_color player,
+                        size_t out[8]) {
+    const size_t cells = e->grid->size * e->grid->size;
+    const size_t start = edge_start(e, player);
+    const uint32_t *around = e->grid->neighbors[i];
+    bool near = false, far = false;
+    size_t n = 0;
+    for (unsigned k = 0; k < 6; k++) {
+        if (around[k] < cells)
+            out[n++] = around[k];
+        near |= around[k] == start;
+        far |= around[k] == start + 1;
+    }
+    if (near)
+        out[n++] = start;
+    if (far)
+        out[n++] = start + 1;
+    return n;
+}
+
+/* Groups touching an edge are never midpoints: everything along the edge
+   would be connected to everything else through them. */
+static bool is_midpoint(struct hex_vc_engine *e, cell_color player, size_t z) {
+    if (z < e->grid->size * e->grid->size &&
+        e->grid->cells[z].color == NEUTRAL)
+        return true;
+    size_t start = edge_start(e, player);
+    return z != node_of(e, player, start) &&
+           z != node_of(e, player, start + 1);
+}
+
+static void enqueue(struct hex_vc_side *s, size_t x) {
+    if (!s->queued[x]) {
+        s->queued[x] = 1;
+        s->queue[s->queue_len++] = (uint32_t)x;
+    }
+}
+
+static void deactivate(struct hex_vc_side *s, struct hex_vc_list *l) {
+    l->fulls = l->count = 0;
+    if (l->active == NO_NODE)
+        return;
+    uint32_t last = s->active[--s->active_len];
+    s->active[l->active] = last;
+    s->pairs[last].active = l->active;
+    l->active = NO_NODE;
+}
+
+static void remove_at(struct hex_vc_list *l, size_t k) {
+    if (k < l->fulls) {
+        l->vcs[k] = l->vcs[--l->fulls];
+        l->vcs[l->fulls] = l->vcs[--l->count];
+    } else {
+        l->vcs[k] = l->vcs[--l->count];
+    }
+}
+
+/* The one of vcs[from, to) with the largest carrier. */
+static size_t largest(const struct hex_vc_list *l, size_t from, size_t to) {
+    size_t best = from;
+    for (size_t k = from + 1; k < to; k++) {
+        if (l->vcs[k].weight > l->vcs[best].weight)
+            best = k;
+    }
+    return best;
+}
+
+/* Adds vc to the connections of (x, y) unless one of them is at least as
+   good. Returns whether it was added. */
+static bool add(struct hex_vc_engine *e,
+                struct hex_vc_side *s,
+                size_t x,
+                size_t y,
+                const struct hex_vc *vc) {
+    struct hex_vc_list *l = pair(e, s, x, y);
+    bool full = vc->key == HEX_VC_FULL;
+    for (size_t k = 0; k < l->count; k++) {
+        if ((k < l->fulls || !full) && subset(l->vcs[k].carrier, vc->carrier))
+            return false;
+    }
+    for (size_t k = l->count; k-- > 0;) {
+        if ((full || k >= l->fulls) && subset(vc->carrier, l->vcs[k].carrier))
+            remove_at(l, k);
+    }
+
+    size_t from = full ? 0 : l->fulls;
+    size_t to = full ? l->fulls : l->count;
+    if (to - from == (full ? MAX_FULLS : MAX_SEMIS)) {
+        size_t k = largest(l, from, to);
+        if (vc->weight >= l->vcs[k].weight)
+            return false;
+        l->vcs[k] = *vc;
+        l->vcs[k].born = ++e->clock;
+        return true;
+    }
+
+    if (l->count == l->capacity) {
+        size_t capacity = l->capacity ? l->capacity * 2 : 2;
+        if (capacity > MAX_FULLS + MAX_SEMIS)
+            capacity = MAX_FULLS + MAX_SEMIS;
+        struct hex_vc *vcs = realloc(l->vcs, capacity * sizeof(*vcs));
+        if (!vcs)
+            return false;
+        l->vcs = vcs;
+        l->capacity = (uint8_t)capacity;
+    }
+    size_t k = l->count++;
+    if (full) {
+        l->vcs[k] = l->vcs[l->fulls];
+        k = l->fulls++;
+        s->linked[x * HEX_VC_NODE_WORDS + y / 64] |= (uint64_t)1 << (y % 64);
+        s->linked[y * HEX_VC_NODE_WORDS + x / 64] |= (uint64_t)1 << (x % 64);
+    }
+    l->vcs[k] = *vc;
+    l->vcs[k].born = ++e->clock;
+    if (l->active == NO_NODE) {
+        l->active = (uint32_t)s->active_len;
+        s->active[s->active_len++] = (uint32_t)(l - s->pairs);
+    }
+    return true;
+}
+
+static void derive(struct hex_vc_engine *e,
+                   struct hex_vc_side *s,
+                   size_t x,
+                   size_t y,
+                   const struct hex_vc *vc);
+
+/* OR rule, greedily: semis of (x, y) are taken while they shrink the
+   intersection of the carriers, starting from `seed`. If it runs empty,
+   no single move stops all of them. */
+static void or_rule(struct hex_vc_engine *e,
+                    struct hex_vc_side *s,
+                    size_t x,
+                    size_t y,
+                    const struct hex_vc *seed) {
+    struct hex_vc_list *l = pair(e, s, x, y);
+    uint64_t meet[HEX_VC_WORDS];
+    struct hex_vc vc = *seed;
+    vc.key = HEX_VC_FULL;
+    memcpy(meet, seed->carrier, sizeof(meet));
+    for (size_t k = l->fulls; k < l->count; k++) {
+        const uint64_t *c = l->vcs[k].carrier;
+        if (subset(meet, c))
+            continue;
+        bool empty = true;
+        for (size_t w = 0; w < HEX_VC_WORDS; w++) {
+            meet[w] &= c[w];
+            vc.carrier[w] |= c[w];
+            empty = empty && !meet[w];
+        }
+        if (empty) {
+            vc.weight = (uint16_t)weight(vc.carrier);
+            derive(e, s, x, y, &vc);
+            return;
+        }
+    }
+}
+
+static void derive(struct hex_vc_engine *e,
+                   struct hex_vc_side *s,
+                   size_t x,
+                   size_t y,
+                   const struct hex_vc *vc) {
+    if (!add(e, s, x, y, vc))
+        return;
+    enqueue(s, x);
+    enqueue(s, y);
+    if (vc->key != HEX_VC_FULL)
+        or_rule(e, s, x, y, vc);
+}
+
+/* AND rule through z: every two fulls from z with disjoint carriers, at
+   least one of them new since z was last a midpoint. */
+static void process(struct hex_vc_engine *e, cell_color player, size_t z) {
+    struct hex_vc_side *s = side_of(e, player);
+    if (node_of(e, player, z) != z || !is_midpoint(e, player, z))
+        return;
+    bool empty = z < e->grid->size * e->grid->size &&
+                 e->grid->cells[z].color == NEUTRAL;
+    uint32_t seen = s->seen[z];
+    s->seen[z] = e->clock;
+
+    size_t n = 0;
+    uint64_t *linked = &s->linked[z * HEX_VC_NODE_WORDS];
+    for (size_t w = 0; w < HEX_VC_NODE_WORDS; w++) {
+        for (uint64_t bits = linked[w]; bits; bits &= bits - 1) {
+            size_t y = w * 64 + (size_t)__builtin_ctzll(bits);
+            if (pair(e, s, z, y)->fulls)
+                e->scratch[n++] = (uint32_t)y;
+            else
+                linked[w] &= ~((uint64_t)1 << (y % 64));
+        }
+    }
+    for (size_t a = 0; a < n; a++) {
+        size_t x = e->scratch[a];
+        const struct hex_vc_list *lx = pair(e, s, z, x);
+        for (size_t i = 0; i < lx->fulls; i++) {
+            const struct hex_vc *v1 = &lx->vcs[i];
+            if (v1->born <= seen)
+                continue;
+            for (size_t b = 0; b < n; b++) {
+                size_t y = e->scratch[b];
+                const struct hex_vc_list *ly = pair(e, s, z, y);
+                if (b == a || (y < e->nodes - 4 && has(v1->carrier, y)))
+                    continue;
+                for (size_t j = 0; j < ly->fulls; j++) {
+                    const struct hex_vc *v2 = &ly->vcs[j];
+                    /* two new ones are tried from the first */
+                    if ((b < a && v2->born > seen) ||
+                        (x < e->nodes - 4 && has(v2->carrier, x)) ||
+                        !disjoint(v1->carrier, v2->carrier))
+                        continue;
+                    struct hex_vc vc = {
+                        .key = HEX_VC_FULL,
+                        .weight = (uint16_t)(v1->weight + v2->weight)};
+                    for (size_t w = 0; w < HEX_VC_WORDS; w++)
+                        vc.carrier[w] = v1->carrier[w] | v2->carrier[w];
+                    if (empty) {
+                        vc.key = (uint16_t)z;
+                        vc.weight++;
+                        vc.carrier[z / 64] |= (uint64_t)1 << (z % 64);
+                    }
+                    derive(e, s, x, y, &vc);
+                }
+            }
+        }
+    }
+}
+
+static void closure(struct hex_vc_engine *e, cell_color player) {
+    struct hex_vc_side *s = side_of(e, player);
+    while (s->queue_len) {
+        size_t z = s->queue[--s->queue_len];
+        s->queued[z] = 0;
+        process(e, player, z);
+    }
+}
+
+static void build(struct hex_vc_engine *e, cell_color player) {
+    struct hex_vc_side *s = side_of(e, player);
+    while (s->active_len)
+        deactivate(s, &s->pairs[s->active[0]]);
+    memset(s->seen, 0, e->nodes * sizeof(uint32_t));
+    memset(s->linked, 0, e->nodes * HEX_VC_NODE_WORDS * sizeof(uint64_t));
+
+    const struct hex_vc adjacent = {.key = HEX_VC_FULL};
+    size_t cells = e->grid->size * e->grid->size;
+    for (size_t i = 0; i < cells; i++) {
+        uint32_t x = node_of(e, player, i);
+        if (x == NO_NODE)
+            continue;
+        size_t near[8];
+        size_t n = neighbors(e, i, player, near);
+        for (size_t k = 0; k < n; k++) {
+            uint32_t y = node_of(e, player, near[k]);
+            if (y != NO_NODE && y != x)
+                derive(e, s, x, y, &adjacent);
+        }
+    }
+    closure(e, player);
+}
+
+int hex_vc_init(struct hex_vc_engine *e, hex_grid *g) {
+    memset(e, 0, sizeof(*e));
+    if (g->size * g->size > HEX_VC_MAX_CELLS || g->backend == HEX_GRID_BITBOARD)
+        return 0;
+    e->grid = g;
+    e->nodes = g->size * g->size + 4;
+    size_t pairs = e->nodes * e->nodes;
+    int ok = (e->scratch = malloc(e->nodes * sizeof(uint32_t))) != NULL;
+    for (size_t p = 0; p < 2; p++) {
+        struct hex_vc_side *s = &e->sides[p];
+        s->pairs = malloc(pairs * sizeof(struct hex_vc_list));
+        s->active = malloc(pairs * sizeof(uint32_t));
+        s->queued = calloc(e->nodes, 1);
+        s->queue = malloc(e->nodes * sizeof(uint32_t));
+        s->seen = malloc(e->nodes * sizeof(uint32_t));
+        s->linked = malloc(e->nodes * HEX_VC_NODE_WORDS * sizeof(uint64_t));
+        ok = ok && s->pairs && s->active && s->queued && s->queue &&
+             s->seen && s->linked;
+        for (size_t i = 0; s->pairs && i < pairs; i++)
+            s->pairs[i] = (struct hex_vc_list){NULL, 0, 0, 0, NO_NODE};
+    }
+    if (!ok) {
+        hex_vc_destroy(e);
+        return 0;
+    }
+    hex_vc_rebuild(e);
+    return 1;
+}
+
+void hex_vc_destroy(struct hex_vc_engine *e) {
+    for (size_t p = 0; p < 2; p++) {
+        struct hex_vc_side *s = &e->sides[p];
+        for (size_t i = 0; s->pairs && i < e->nodes * e->nodes; i++)
+            free(s->pairs[i].vcs);
+        free(s->pairs);
+        free(s->active);
+        free(s->queued);
+        free(s->queue);
+        free(s->seen);
+        free(s->linked);
+        *s = (struct hex_vc_side){0};
+    }
+    free(e->scratch);
+    e->scratch = NULL;
+}
+
+void hex_vc_rebuild(struct hex_vc_engine *e) {
+    e->clock = 0;
+    build(e, RED);
+    build(e, BLUE);
+}
+
+/* The mover's connections lose c from their carriers, and semis played at
+   c become full. */
+static void take_cell(struct hex_vc_engine *e, cell_color player, size_t c) {
+    struct hex_vc_side *s = side_of(e, player);
+    struct hex_vc played[MAX_SEMIS];
+    uint64_t bit = (uint64_t)1 << (c % 64);
+    for (size_t a = 0; a < s->active_len; a++) {
+        struct hex_vc_list *l = &s->pairs[s->active[a]];
+        size_t x = s->active[a] / e->nodes;
+        size_t y = s->active[a] % e->nodes;
+        bool changed = false;
+        size_t n = 0;
+        for (size_t k = l->count; k-- > 0;) {
+            struct hex_vc *v = &l->vcs[k];
+            if (!(v->carrier[c / 64] & bit))
+                continue;
+            changed = true;
+            v->carrier[c / 64] &= ~bit;
+            v->weight--;
+            if (v->key == c) {
+                played[n] = *v;
+                played[n++].key = HEX_VC_FULL;
+                remove_at(l, k);
+            }
+        }
+        if (!changed)
+            continue;
+        for (size_t k = 0; k < n; k++)
+            derive(e, s, x, y, &played[k]);
+        for (size_t k = l->fulls; k < l->count; k++) {
+            struct hex_vc seed = l->vcs[k];
+            or_rule(e, s, x, y, &seed);
+        }
+    }
+}
+
+/* The opponent's connections through c are gone. What is left of their
+   pairs may still make fulls by the OR rule; connections the lost ones
+   had kept out as worse are not looked for again, as that would mean
+   trying every midpoint of the pair. */
+static void lose_cell(struct hex_vc_engine *e, cell_color player, size_t c) {
+    struct hex_vc_side *s = side_of(e, player);
+    for (size_t a = 0; a < s->active_len;) {
+        struct hex_vc_list *l = &s->pairs[s->active[a]];
+        size_t x = s->active[a] / e->nodes;
+        size_t y = s->active[a] % e->nodes;
+        size_t count = l->count;
+        if (x == c || y == c) {
+            deactivate(s, l);
+        } else {
+            for (size_t k = l->count; k-- > 0;) {
+                if (has(l->vcs[k].carrier, c))
+                    remove_at(l, k);
+            }
+        }
+        if (l->count == count) {
+            a++;
+            continue;
+        }
+        if (l->count == 0) {
+            deactivate(s, l);
+            continue;
+        }
+        for (size_t k = l->fulls; k < l->count; k++) {
+            struct hex_vc seed = l->vcs[k];
+            or_rule(e, s, x, y, &seed);
+        }
+        a++;
+    }
+}
+
+bool hex_vc_play(struct hex_vc_engine *e, size_t c, cell_color player) {
+    hex_grid *g = e->grid;
+    if (g->cells[c].color != NEUTRAL)
+        return false;
+
+    /* the nodes that become one group with the new stone */
+    size_t merged[9];
+    size_t m = 0;
+    merged[m++] = c;
+    size_t near[8];
+    size_t n = neighbors(e, c, player, near);
+    for (size_t k = 0; k < n; k++) {
+        if (near[k] < g->size * g->size && g->cells[near[k]].color != player)
+            continue;
+        size_t r = node_of(e, player, near[k]);
+        size_t j = 0;
+        while (j < m && merged[j] != r)
+            j++;
+        if (j == m)
+            merged[m++] = r;
+    }
+
+    hex_grid_open_cell(g, c, player);
+    struct hex_vc_side *s = side_of(e, player);
+    take_cell(e, player, c);
+
+    size_t root = node_of(e, player, c);
+    for (size_t k = 0; k < m; k++) {
+        for (size_t y = 0; y < e->nodes; y++) {
+            struct hex_vc_list *l = pair(e, s, merged[k], y);
+            if (l->count == 0 || y == merged[k])
+                continue;
+            size_t j = 0;
+            while (j < m && merged[j] != y)
+                j++;
+            if (j == m && merged[k] != root) {
+                for (size_t v = 0; v < l->count; v++)
+                    derive(e, s, root, y, &l->vcs[v]);
+                deactivate(s, l);
+            } else if (j < m) {
+                deactivate(s, l);
+            }
+        }
+    }
+    enqueue(s, root);
+    closure(e, player);
+
+    cell_color other = player == RED ? BLUE : RED;
+    lose_cell(e, other, c);
+    closure(e, other);
+    return true;
+}
+
+const struct hex_vc_list *hex_vc_between(struct hex_vc_engine *e,
+                                         cell_color player,
+                                         size_t a,
+                                         size_t b) {
+    uint32_t x = node_of(e, player, a);
+    uint32_t y = node_of(e, player, b);
+    if (x == NO_NODE || y == NO_NODE || x == y)
+        return NULL;
+    const struct hex_vc_list *l = pair(e, side_of(e, player), x, y);
+    return l->count ? l : NULL;
+}
+
+cell_color hex_vc_winner(struct hex_vc_engine *e, cell_color to_move) {
+    cell_color order[2] = {to_move, to_move == RED ? BLUE : RED};
+    for (size_t k = 0; k < 2; k++) {
+        size_t start = edge_start(e, order[k]);
+        if (node_of(e, order[k], start) == node_of(e, order[k], start + 1))
+            return order[k];
+    }
+    for (size_t k = 0; k < 2; k++) {
+        size_t start = edge_start(e, order[k]);
+        const struct hex_vc_list *l =
+            hex_vc_between(e, order[k], start, start + 1);
+        if (l && (l->fulls || k == 0))
+            return order[k];
+    }
+    return NEUTRAL;
+}
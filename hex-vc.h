@@ -0,0 +1,107 @@
+#if !defined(HEX_VC_H)
+#define HEX_VC_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "hex-grid.h"
+
+/* Virtual connections by H-search. For each colour, the nodes are its
+   groups (union-find roots of hex_grid, including the colour's two virtual
+   edge nodes) and the empty cells. A full connection between two nodes
+   holds even if the opponent moves first; a semi-connection holds if its
+   owner moves first, at its key cell. Either one needs the empty cells of
+   its carrier:
+
+     adjacent nodes           full, empty carrier
+     full(x,z) and full(z,y)  with disjoint carriers: full(x,y) if z is a
+                              group, semi(x,y) with key z if z is empty
+     semis(x,y)               whose carriers have no common cell: full(x,y)
+                              over the union of the carriers
+
+   which gives bridges, the edge templates of rows 2 and 3 and chains of
+   them. After a move only the connections it touches are redone: the
+   opponent loses every connection through the cell, the mover's groups
+   around it are merged, and the rules run again from just the nodes that
+   changed. Boards of up to HEX_VC_MAX_CELLS cells are supported.
+
+   The update is not a rebuild. Each pair keeps only its few smallest
+   connections; when the opponent's stone breaks them, the larger ones
+   they had pushed out are not derived again, since that would mean
+   running every midpoint of the pair once more. So the update may call a
+   won game a few moves after a rebuild would: two or three calls in a
+   hundred, on random games up to 7x7. It also keeps some connections a rebuild
+   would not find, as the order of derivation differs. Both are sound:
+   whatever either calls is the winner. */
+
+#define HEX_VC_WORDS 6
+#define HEX_VC_MAX_CELLS (64 * HEX_VC_WORDS)
+#define HEX_VC_NODE_WORDS ((HEX_VC_MAX_CELLS + 4 + 63) / 64)
+#define HEX_VC_FULL UINT16_MAX
+
+struct hex_vc {
+    uint16_t key;    // HEX_VC_FULL, or the cell a semi-connection plays
+    uint16_t weight; // cells in the carrier
+    uint32_t born;   // hex_vc_engine.clock when it was added
+    uint64_t carrier[HEX_VC_WORDS];
+};
+
+/* The connections of one pair of nodes, fulls first. */
+struct hex_vc_list {
+    struct hex_vc *vcs;
+    uint8_t fulls;
+    uint8_t count;
+    uint8_t capacity;
+    uint32_t active; // index in hex_vc_side.active, UINT32_MAX if not there
+};
+
+struct hex_vc_side {
+    struct hex_vc_list *pairs; // nodes * nodes, used for x < y only
+    uint32_t *active;          // pairs with connections, for the scans
+    size_t active_len;
+    uint8_t *queued;
+    uint32_t *queue; // nodes to use as midpoints again
+    size_t queue_len;
+    uint32_t *seen; // clock when each node was last used as a midpoint
+    /* per node, HEX_VC_NODE_WORDS of bits for the nodes it has had fulls
+       with since, so that midpoints find theirs without a scan */
+    uint64_t *linked;
+};
+
+struct hex_vc_engine {
+    hex_grid *grid; // with a union-find backend
+    size_t nodes;   // cells and the four virtual edge nodes
+    struct hex_vc_side sides[2]; // red, blue
+    uint32_t *scratch;           // nodes, for the rules
+    uint32_t clock;              // counts additions
+};
+
+/* Computes the connections of g from scratch. g must use a union-find
+   backend and may only change through hex_vc_play() from now on (or be
+   followed by hex_vc_rebuild()). Returns 0 on failure. */
+int hex_vc_init(struct hex_vc_engine *e, hex_grid *g);
+
+void hex_vc_destroy(struct hex_vc_engine *e);
+
+/* Recomputes everything, after the grid changed behind the engine's back
+   (an undo, say). */
+void hex_vc_rebuild(struct hex_vc_engine *e);
+
+/* Opens cell i for `player` on the grid and updates the connections.
+   Returns false if the cell is taken. */
+bool hex_vc_play(struct hex_vc_engine *e, size_t i, cell_color player);
+
+/* The connections of `player` between the nodes holding a and b (cells or
+   virtual edge nodes), or NULL if there are none. */
+const struct hex_vc_list *hex_vc_between(struct hex_vc_engine *e,
+                                         cell_color player,
+                                         size_t a,
+                                         size_t b);
+
+/* Who has already won with `to_move` to play: a colour with a full
+   connection between its edges, or the side to move with a semi one.
+   NEUTRAL if neither. */
+cell_color hex_vc_winner(struct hex_vc_engine *e, cell_color to_move);
+
+#endif /* HEX_VC_H */
@@ -0,0 +1,70 @@
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "hex-analysis.h"
+#include "hex-grid.h"
+#include "test.h"
+
+/* Reads until the results are for `epoch` and behind at least `playouts`
+   playouts a cell, for up to ten seconds. */
+static size_t wait_for(struct hex_analysis *a,
+                       uint32_t epoch,
+                       size_t playouts,
+                       float *win) {
+    size_t n = 0;
+    for (unsigned k = 0; k < 10000; k++) {
+        if (hex_analysis_read(a, win, &n) == epoch && n >= playouts)
+            return n;
+        usleep(1000);
+    }
+    return n;
+}
+
+int main(void) {
+    struct hex_analysis_config config;
+    struct hex_analysis a;
+    hex_grid g;
+    float win[9];
+
+    hex_analysis_default_config(&config);
+    config.max_playouts = 4096;
+    if (!hex_grid_init(&g, 3, HEX_GRID_UNION_FIND) ||
+        !hex_analysis_init(&a, &config, 3))
+        return 1;
+    CHECK(hex_analysis_read(&a, win, NULL) == 0);
+
+    /* the centre is the best first move, and the workers rest once every
+       cell has had its playouts */
+    uint32_t epoch = hex_analysis_set_position(&a, &g, RED);
+    CHECK(wait_for(&a, epoch, 4096, win) == 4096);
+    for (unsigned i = 0; i < 9; i++)
+        CHECK(win[i] >= 0 && win[i] <= 1);
+    CHECK(win[4] > win[0] && win[4] > win[8]);
+    usleep(20000);
+    size_t playouts;
+    CHECK(hex_analysis_read(&a, win, &playouts) == epoch && playouts == 4096);
+
+    /* a new position replaces the old one, stones get no estimate */
+    hex_grid_open_cell(&g, 4, RED);
+    uint32_t next = hex_analysis_set_position(&a, &g, BLUE);
+    CHECK(next != epoch);
+    CHECK(wait_for(&a, next, 256, win) >= 256);
+    CHECK(win[4] == -1);
+    for (unsigned i = 0; i < 9; i++)
+        CHECK(i == 4 || (win[i] >= 0 && win[i] <= 1));
+
+    /* stopped in the middle, then a won position: nothing to estimate */
+    hex_analysis_stop(&a);
+    hex_grid_clear(&g);
+    hex_grid_open_cell(&g, 0, RED);
+    hex_grid_open_cell(&g, 3, RED);
+    hex_grid_open_cell(&g, 6, RED);
+    epoch = hex_analysis_set_position(&a, &g, BLUE);
+    CHECK(wait_for(&a, epoch, 0, win) == 0);
+    for (unsigned i = 0; i < 9; i++)
+        CHECK(win[i] == -1);
+
+    hex_analysis_destroy(&a);
+    hex_grid_destroy(&g);
+    return test_exit("test-analysis");
+}
@@ -0,0 +1,59 @@
+#include "hex-arena.h"
+#include "test.h"
+
+static void check_stats(const struct hex_arena_config *config,
+                        const struct hex_arena_stats *stats) {
+    size_t games = 0;
+    for (size_t k = 0; k < config->size_count; k++) {
+        CHECK(stats->size_games[k] == (config->games + 1) / 2 * 2);
+        CHECK(stats->size_wins[k] <= stats->size_games[k]);
+        games += stats->size_games[k];
+    }
+    CHECK(stats->games == games);
+    CHECK(stats->wins[0] + stats->wins[1] == games);
+    CHECK(stats->red_wins <= games);
+    /* at least one move a game besides the opening */
+    CHECK(stats->moves >= games);
+    CHECK(stats->elo_low <= stats->elo && stats->elo <= stats->elo_high);
+    for (unsigned e = 0; e < 2; e++) {
+        CHECK(stats->move_ms[e][0] >= 0);
+        CHECK(stats->move_ms[e][0] <= stats->move_ms[e][1]);
+        CHECK(stats->move_ms[e][1] <= stats->move_ms[e][2]);
+    }
+}
+
+int main(void) {
+    struct hex_arena_config config;
+    struct hex_arena_stats stats, again;
+    hex_arena_default_config(&config);
+    config.sizes[0] = 4;
+    config.sizes[1] = 5;
+    config.games = 39; // played as 40
+    config.threads = 3;
+    /* a search against a single leaf evaluation */
+    config.engines[0].max_playouts = 64 * 40;
+    config.engines[1].max_playouts = 64;
+    CHECK(hex_arena_run(&config, &stats));
+    check_stats(&config, &stats);
+    CHECK(stats.wins[0] > 2 * stats.wins[1]);
+    CHECK(stats.elo_low > 0);
+    CHECK(stats.move_ms[0][0] > stats.move_ms[1][0]);
+
+    /* every game only depends on its seed */
+    config.threads = 1;
+    CHECK(hex_arena_run(&config, &again));
+    CHECK(again.wins[0] == stats.wins[0] && again.moves == stats.moves);
+    CHECK(again.red_wins == stats.red_wins);
+
+    /* the same engine on both sides */
+    config.engines[1] = config.engines[0];
+    config.size_count = 1;
+    config.threads = 2;
+    CHECK(hex_arena_run(&config, &stats));
+    check_stats(&config, &stats);
+    CHECK(stats.elo_low < stats.elo_high);
+
+    config.sizes[0] = 1;
+    CHECK(!hex_arena_run(&config, &stats));
+    return test_exit("test-arena");
+}
@@ -0,0 +1,135 @@
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "hex-book.h"
+#include "hex-grid.h"
+#include "test.h"
+
+static cell_color other(cell_color player) {
+    return 1 + (player % 2);
+}
+
+/* Looks g up, and checks that the book move is an empty cell. */
+static bool in_book(const struct hex_book *b,
+                    const hex_grid *g,
+                    cell_color to_move,
+                    size_t *move) {
+    double value;
+    if (!hex_book_lookup(b, g, to_move, move, &value))
+        return false;
+    CHECK(*move < g->size * g->size && g->cells[*move].color == NEUTRAL);
+    CHECK(value >= 0 && value <= 1);
+    return true;
+}
+
+/* Every line of a two-move book is there: the empty board, every first
+   move, and every reply to the book's answer to either. Nothing deeper
+   is. Returns the number of lines, transpositions counted each time. */
+static size_t check_lines(const struct hex_book *b, size_t size) {
+    const size_t cells = size * size;
+    size_t found = 0, move, reply;
+    hex_grid g;
+    if (!hex_grid_init(&g, size, HEX_GRID_UNDOABLE_UNION_FIND))
+        exit(1);
+
+    /* the line the book plays red in, then the ones it plays blue in */
+    for (size_t first = 0; first <= cells; first++) {
+        hex_grid_clear(&g);
+        cell_color player = RED;
+        if (first < cells) {
+            hex_grid_open_cell(&g, first, RED);
+            player = BLUE;
+        }
+        CHECK(in_book(b, &g, player, &move));
+        found++;
+        if (move >= cells || !hex_grid_open_cell(&g, move, player))
+            continue;
+        for (size_t i = 0; i < cells; i++) {
+            if (!hex_grid_open_cell(&g, i, other(player)))
+                continue;
+            if (hex_grid_get_winner(&g) == NEUTRAL) {
+                CHECK(in_book(b, &g, player, &reply));
+                found++;
+                /* one more pair of moves is out of the book */
+                if (hex_grid_open_cell(&g, reply, player)) {
+                    for (size_t j = 0; j < cells; j++) {
+                        if (!hex_grid_open_cell(&g, j, other(player)))
+                            continue;
+                        CHECK(!hex_book_lookup(b, &g, player, &reply, NULL));
+                        hex_grid_undo(&g);
+                        break;
+                    }
+                    hex_grid_undo(&g);
+                }
+            }
+            hex_grid_undo(&g);
+        }
+    }
+    hex_grid_destroy(&g);
+    return found;
+}
+
+/* The entries are in the order the lookup relies on. */
+static void check_sorted(const char *path, size_t count) {
+    struct hex_book b;
+    CHECK(hex_book_open(&b, path));
+    CHECK(b.count == count);
+    for (size_t k = 1; k < b.count; k++) {
+        const uint8_t *e = b.data + 16 + 16 * k, *p = e - 16;
+        uint64_t key = 0, prev = 0;
+        for (unsigned i = 0; i < 8; i++) {
+            key |= (uint64_t)e[i] << (8 * i);
+            prev |= (uint64_t)p[i] << (8 * i);
+        }
+        unsigned size = e[8] | e[9] << 8, prev_size = p[8] | p[9] << 8;
+        CHECK(prev < key || (prev == key && prev_size < size));
+    }
+    hex_book_close(&b);
+}
+
+int main(void) {
+    char path[] = "/tmp/chex-test-XXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0)
+        return 1;
+    close(fd);
+
+    struct hex_book_config config;
+    struct hex_book_stats stats;
+    hex_book_default_config(&config);
+    config.sizes[0] = 3;
+    config.sizes[1] = 4;
+    config.size_count = 2;
+    config.depth = 2;
+    config.playouts = 4096;
+    config.threads = 3;
+    CHECK(hex_book_build(&config, path, &stats));
+    CHECK(stats.entries <= stats.positions);
+    check_sorted(path, stats.entries);
+
+    struct hex_book b;
+    CHECK(hex_book_open(&b, path));
+    /* the empty 3x3 and 4x4 boards share their key */
+    CHECK(check_lines(&b, 3) + check_lines(&b, 4) >= b.count);
+    hex_grid g;
+    size_t move;
+    if (!hex_grid_init(&g, 3, HEX_GRID_UNION_FIND))
+        return 1;
+    CHECK(in_book(&b, &g, RED, &move));
+    CHECK(move >= 2 && move <= 6); // a winning first move
+    hex_grid_destroy(&g);
+    if (!hex_grid_init(&g, 5, HEX_GRID_UNION_FIND))
+        return 1;
+    CHECK(!hex_book_lookup(&b, &g, RED, &move, NULL));
+    hex_grid_destroy(&g);
+    hex_book_close(&b);
+
+    /* a book cut short is refused */
+    struct stat st;
+    CHECK(stat(path, &st) == 0);
+    CHECK(truncate(path, st.st_size - 1) == 0);
+    CHECK(!hex_book_open(&b, path));
+    unlink(path);
+    return test_exit("test-book");
+}
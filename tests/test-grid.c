@@ -0,0 +1,185 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "hex-grid.h"
+#include "hex-random.h"
+#include "test.h"
+
+/* Random fills, red and blue in random order and not necessarily
+   alternating, checked after every stone against the winner the union-find
+   backends compute. The sizes cross the 64-bit word boundary of a bitboard
+   row. */
+static void random_fills(size_t size, unsigned games, struct hex_rng *rng) {
+    hex_grid uf, undoable, bits;
+    CHECK(hex_grid_init(&uf, size, HEX_GRID_UNION_FIND));
+    CHECK(hex_grid_init(&undoable, size, HEX_GRID_UNDOABLE_UNION_FIND));
+    CHECK(hex_grid_init(&bits, size, HEX_GRID_BITBOARD));
+    if (!uf.cells || !undoable.cells || !bits.cells)
+        exit(1);
+
+    const size_t cells = size * size;
+    size_t *order = malloc(cells * sizeof(size_t));
+    if (!order)
+        exit(1);
+    for (unsigned n = 0; n < games; n++) {
+        hex_grid_clear(&uf);
+        hex_grid_clear(&undoable);
+        hex_grid_clear(&bits);
+        for (size_t k = 0; k < cells; k++)
+            order[k] = k;
+        for (size_t k = 0; k < cells; k++) {
+            size_t r = k + hex_rng_below(rng, (uint32_t)(cells - k));
+            size_t i = order[r];
+            order[r] = order[k];
+            order[k] = i;
+            cell_color player = hex_rng_next(rng) & 1 ? RED : BLUE;
+            CHECK(hex_grid_open_cell(&uf, i, player));
+            CHECK(hex_grid_open_cell(&undoable, i, player));
+            CHECK(hex_grid_open_cell(&bits, i, player));
+            cell_color winner = hex_grid_get_winner(&uf);
+            CHECK(hex_grid_get_winner(&undoable) == winner);
+            CHECK(hex_grid_get_winner(&bits) == winner);
+            CHECK(uf.hash == bits.hash);
+        }
+        /* a full board always has a winner */
+        CHECK(hex_grid_get_winner(&bits) != NEUTRAL);
+    }
+    free(order);
+    hex_grid_destroy(&uf);
+    hex_grid_destroy(&undoable);
+    hex_grid_destroy(&bits);
+}
+
+/* The smallest node in the component of every node, which is the same for
+   two union-finds exactly when they hold the same components. */
+static void components(struct wqu_uf *uf, size_t *least) {
+    for (size_t p = 0; p < uf->size; p++)
+        least[p] = (size_t)-1;
+    for (size_t p = 0; p < uf->size; p++) {
+        size_t r = w_quickunion_find(uf, p);
+        if (p < least[r])
+            least[r] = p;
+    }
+    for (size_t p = 0; p < uf->size; p++)
+        least[p] = least[w_quickunion_find(uf, p)];
+}
+
+/* Plays random games with random takebacks on the way, and checks after
+   every undo that the grid is the one a fresh replay of the moves left
+   gives: same stones, hash, winner and, for the union-finds, components. */
+static void undo_replay(size_t size,
+                        enum hex_grid_backend backend,
+                        struct hex_rng *rng) {
+    hex_grid g, fresh;
+    if (!hex_grid_init(&g, size, backend) ||
+        !hex_grid_init(&fresh, size, backend))
+        exit(1);
+    const size_t cells = size * size;
+    size_t *least = malloc((cells + 4) * sizeof(size_t));
+    size_t *fresh_least = malloc((cells + 4) * sizeof(size_t));
+    if (!least || !fresh_least)
+        exit(1);
+
+    for (unsigned n = 0; n < 20; n++) {
+        hex_grid_clear(&g);
+        cell_color player = RED;
+        while (g.move_count < cells) {
+            if (g.move_count && hex_rng_below(rng, 3) == 0) {
+                const size_t i = g.moves[g.move_count - 1];
+                CHECK(hex_grid_undo(&g) == i);
+                CHECK(g.cells[i].color == NEUTRAL);
+                player = 1 + (player % 2);
+            } else {
+                /* the k-th empty cell, so that the game gets to the end */
+                size_t k = hex_rng_below(rng, (uint32_t)(cells - g.move_count));
+                size_t i = 0;
+                while (g.cells[i].color != NEUTRAL || k--)
+                    i++;
+                CHECK(hex_grid_open_cell(&g, i, player));
+                player = 1 + (player % 2);
+                continue;
+            }
+
+            hex_grid_clear(&fresh);
+            for (size_t k = 0; k < g.move_count; k++)
+                hex_grid_open_cell(&fresh, g.moves[k], k % 2 ? BLUE : RED);
+            for (size_t i = 0; i < cells; i++)
+                CHECK(g.cells[i].color == fresh.cells[i].color);
+            CHECK(g.hash == fresh.hash);
+            CHECK(hex_grid_get_winner(&g) == hex_grid_get_winner(&fresh));
+            if (backend != HEX_GRID_BITBOARD) {
+                components(&g.disjoint_set, least);
+                components(&fresh.disjoint_set, fresh_least);
+                CHECK(!memcmp(least, fresh_least,
+                              (cells + 4) * sizeof(size_t)));
+            }
+        }
+        /* and back to the empty board */
+        while (hex_grid_undo(&g) != (size_t)-1)
+            ;
+        CHECK(g.hash == 0 && hex_grid_get_winner(&g) == NEUTRAL);
+    }
+    free(least);
+    free(fresh_least);
+    hex_grid_destroy(&g);
+    hex_grid_destroy(&fresh);
+}
+
+/* The neighbour table against the hex directions: a step off the board
+   has to land on the virtual cell of an edge it crosses. */
+static void neighbor_table(size_t size) {
+    static const int steps[6][2] = {{0, -1}, {1, -1}, {1, 0},
+                                    {0, 1},  {-1, 1}, {-1, 0}};
+    hex_grid g, other;
+    CHECK(hex_grid_init(&g, size, HEX_GRID_UNION_FIND));
+    CHECK(hex_grid_init(&other, size, HEX_GRID_BITBOARD));
+    const size_t cells = size * size;
+    const int n = (int)size;
+    /* one table per size, up to the shared ones */
+    CHECK((g.neighbors == other.neighbors) ==
+          (size <= HEX_GRID_SHARED_TABLES));
+    CHECK(g.cells[cells].color == RED && g.cells[cells + 1].color == RED);
+    CHECK(g.cells[cells + 2].color == BLUE &&
+          g.cells[cells + 3].color == BLUE);
+    for (size_t i = 0; i < cells; i++) {
+        const int x = (int)(i % size), y = (int)(i / size);
+        for (unsigned k = 0; k < 6; k++) {
+            const int nx = x + steps[k][0], ny = y + steps[k][1];
+            const uint32_t m = g.neighbors[i][k];
+            if (nx >= 0 && nx < n && ny >= 0 && ny < n) {
+                CHECK(m == (uint32_t)(ny * n + nx));
+                continue;
+            }
+            CHECK((m == cells && ny < 0) || (m == cells + 1 && ny >= n) ||
+                  (m == cells + 2 && nx < 0) || (m == cells + 3 && nx >= n));
+        }
+    }
+    hex_grid_destroy(&g);
+    hex_grid_destroy(&other);
+}
+
+int main(void) {
+    static const size_t sizes[] = {1,  2,  3,  5,  8,  11,
+                                   13, 19, 63, 64, 70, 130};
+    struct hex_rng rng;
+    hex_rng_seed(&rng, 1);
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        const size_t size = sizes[s];
+        random_fills(size, size > 100 ? 1 : size > 20 ? 4 : 50, &rng);
+    }
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++)
+        neighbor_table(sizes[s]);
+    for (size_t size = 1; size <= 11; size += 2) {
+        undo_replay(size, HEX_GRID_UNION_FIND, &rng);
+        undo_replay(size, HEX_GRID_UNDOABLE_UNION_FIND, &rng);
+        undo_replay(size, HEX_GRID_BITBOARD, &rng);
+    }
+
+    /* sizes the union-find cannot hold are turned down before anything is
+       built for them */
+    hex_grid g;
+    CHECK(!hex_grid_init(&g, 0, HEX_GRID_UNION_FIND));
+    CHECK(!hex_grid_init(&g, 46341, HEX_GRID_UNION_FIND) && !g.cells);
+    CHECK(!hex_grid_init(&g, (size_t)1 << 33, HEX_GRID_BITBOARD));
+    return test_exit("test-grid");
+}
@@ -0,0 +1,132 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "hex-htp.h"
+#include "test.h"
+
+/* Sends one command line and returns the whole response. */
+static const char *ask(struct hex_htp *h, const char *line) {
+    static char *answer;
+    size_t length;
+    free(answer);
+    answer = NULL;
+    FILE *out = open_memstream(&answer, &length);
+    if (!out)
+        exit(1);
+    hex_htp_command(h, line, out);
+    fclose(out);
+    return answer;
+}
+
+static bool starts(const char *s, const char *prefix) {
+    return !strncmp(s, prefix, strlen(prefix));
+}
+
+/* The move of a "= c4" answer, or (size_t)-1. */
+static size_t answer_cell(const char *answer, size_t size) {
+    char col;
+    unsigned row;
+    if (sscanf(answer, "= %c%u", &col, &row) != 2 || col < 'a' ||
+        (size_t)(col - 'a') >= size || row < 1 || row > size)
+        return (size_t)-1;
+    return (row - 1) * size + (size_t)(col - 'a');
+}
+
+static void commands(struct hex_htp *h) {
+    CHECK(!strcmp(ask(h, "protocol_version"), "= 2\n\n"));
+    CHECK(!strcmp(ask(h, "7 name # a comment"), "=7 chex\n\n"));
+    CHECK(!strcmp(ask(h, "known_command genmove"), "= true\n\n"));
+    CHECK(!strcmp(ask(h, "known_command fly"), "= false\n\n"));
+    CHECK(starts(ask(h, "3 fly"), "?3 "));
+    CHECK(!strcmp(ask(h, "  # nothing but a comment"), ""));
+    CHECK(starts(ask(h, "list_commands"), "= protocol_version\nname\n"));
+
+    CHECK(starts(ask(h, "boardsize 27"), "? "));
+    CHECK(starts(ask(h, "boardsize 5 6"), "? "));
+    CHECK(starts(ask(h, "boardsize 5"), "= "));
+    CHECK(h->grid.size == 5);
+    CHECK(starts(ask(h, "play black c3"), "= "));
+    CHECK(h->grid.cells[12].color == RED);
+    CHECK(starts(ask(h, "play w c3"), "? "));
+    CHECK(starts(ask(h, "play w f1"), "? "));
+    CHECK(starts(ask(h, "play w c0"), "? "));
+    CHECK(starts(ask(h, "play green a1"), "? "));
+
+    /* a legal move, and the engine keeps thinking about the answer */
+    size_t i = answer_cell(ask(h, "genmove white"), 5);
+    CHECK(i < 25 && i != 12 && h->grid.cells[i].color == BLUE);
+    CHECK(h->pondering == h->config.ponder);
+    const char *board = ask(h, "showboard");
+    CHECK(!h->pondering);
+    CHECK(starts(board, "=\n") && strchr(board, 'X') && strchr(board, 'O'));
+
+    CHECK(starts(ask(h, "undo"), "= "));
+    CHECK(h->grid.cells[i].color == NEUTRAL);
+    CHECK(starts(ask(h, "undo"), "= "));
+    CHECK(starts(ask(h, "undo"), "? "));
+
+    /* a finished game */
+    CHECK(starts(ask(h, "boardsize 3"), "= "));
+    ask(h, "play b a1");
+    ask(h, "play b a2");
+    ask(h, "play b a3");
+    CHECK(!strcmp(ask(h, "genmove w"), "= resign\n\n"));
+    CHECK(starts(ask(h, "genmove b"), "? "));
+    CHECK(starts(ask(h, "clear_board"), "= "));
+    CHECK(h->grid.move_count == 0);
+}
+
+/* With two seconds for the whole game, genmove keeps to its share. */
+static void time_control(struct hex_htp *h) {
+    CHECK(starts(ask(h, "boardsize 7"), "= "));
+    CHECK(starts(ask(h, "time_settings 2 0 0"), "= "));
+    h->config.max_playouts = 0;
+    size_t i = answer_cell(ask(h, "genmove b"), 7);
+    CHECK(i < 49);
+    CHECK(h->time_left[RED] < 2 && h->time_left[RED] > 1.7);
+    CHECK(h->time_left[BLUE] == 2);
+
+    /* the manager's clock wins over ours */
+    CHECK(starts(ask(h, "time_left white 0.5 3"), "= "));
+    CHECK(h->time_left[BLUE] == 0.5 && h->stones_left[BLUE] == 3);
+    i = answer_cell(ask(h, "genmove w"), 7);
+    CHECK(i < 49);
+    CHECK(h->stones_left[BLUE] == 2 && h->time_left[BLUE] > 0.3);
+    CHECK(starts(ask(h, "time_settings 0 0 0"), "= "));
+}
+
+/* The loop answers until quit and leaves the rest unread. */
+static void run(struct hex_htp *h) {
+    static char script[] = "boardsize 3\n1 genmove b\nquit\nshowboard\n";
+    char *answer = NULL;
+    size_t length, answers = 0;
+    FILE *in = fmemopen(script, strlen(script), "r");
+    FILE *out = open_memstream(&answer, &length);
+    if (!in || !out)
+        exit(1);
+    hex_htp_run(h, in, out);
+    fclose(in);
+    fclose(out);
+    for (const char *s = answer; (s = strstr(s, "\n\n")); s += 2)
+        answers++;
+    CHECK(answers == 3 && h->quit && !h->pondering);
+    CHECK(strstr(answer, "\n\n=1 ") != NULL);
+    free(answer);
+}
+
+int main(void) {
+    struct hex_htp_config config;
+    struct hex_htp h;
+    hex_htp_default_config(&config);
+    config.threads = 2;
+    config.max_playouts = 64 * 100;
+    config.tt_megabytes = 4;
+    if (!hex_htp_init(&h, &config))
+        return 1;
+    CHECK(h.grid.size == 11);
+    commands(&h);
+    time_control(&h);
+    run(&h);
+    hex_htp_destroy(&h);
+    return test_exit("test-htp");
+}
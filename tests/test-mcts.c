@@ -0,0 +1,100 @@
+#include <stdlib.h>
+
+#include "hex-grid.h"
+#include "hex-mcts.h"
+#include "hex-random.h"
+#include "hex-tt.h"
+#include "test.h"
+
+static cell_color other(cell_color player) {
+    return 1 + (player % 2);
+}
+
+/* Whether `player`, to move, wins g, by trying everything. */
+static bool wins(hex_grid *g, cell_color player) {
+    for (size_t i = 0; i < g->size * g->size; i++) {
+        if (!hex_grid_open_cell(g, i, player))
+            continue;
+        bool won = hex_grid_get_winner(g) == player ||
+                   !wins(g, other(player));
+        hex_grid_undo(g);
+        if (won)
+            return true;
+    }
+    return false;
+}
+
+/* Random 3x3 positions that the side to move wins: the search has to
+   answer with a move that keeps the win. */
+static void winning_moves(unsigned threads, struct hex_tt *tt) {
+    struct hex_mcts_config config;
+    struct hex_mcts m;
+    struct hex_rng rng;
+    hex_grid g;
+    hex_mcts_default_config(&config);
+    config.threads = threads;
+    config.max_seconds = 0;
+    config.max_playouts = 64 * 2000;
+    config.tt = tt;
+    if (!hex_mcts_init(&m, &config, 3) ||
+        !hex_grid_init(&g, 3, HEX_GRID_UNDOABLE_UNION_FIND))
+        exit(1);
+    hex_rng_seed(&rng, threads);
+
+    for (unsigned tried = 0, positions = 0; positions < 20; tried++) {
+        CHECK(tried < 1000);
+        hex_grid_clear(&g);
+        cell_color player = RED;
+        const unsigned stones = 2 + hex_rng_below(&rng, 3);
+        while (g.move_count < stones) {
+            if (hex_grid_open_cell(&g, hex_rng_below(&rng, 9), player))
+                player = other(player);
+        }
+        if (hex_grid_get_winner(&g) != NEUTRAL || !wins(&g, player))
+            continue;
+        positions++;
+
+        struct hex_mcts_stats stats;
+        hex_mcts_set_position(&m, &g, player);
+        size_t i = hex_mcts_search(&m, &stats);
+        CHECK(i < 9 && g.cells[i].color == NEUTRAL);
+        CHECK(stats.playouts >= config.max_playouts);
+        CHECK(stats.value > 0.5);
+        if (i >= 9 || !hex_grid_open_cell(&g, i, player))
+            continue;
+        CHECK(hex_grid_get_winner(&g) == player || !wins(&g, other(player)));
+    }
+    hex_grid_destroy(&g);
+    hex_mcts_destroy(&m);
+}
+
+/* A stop that comes after the search has finished does not cut the next
+   one short. */
+static void late_stop(void) {
+    struct hex_mcts_config config;
+    struct hex_mcts m;
+    hex_mcts_default_config(&config);
+    config.max_seconds = 0;
+    config.max_playouts = 64 * 10;
+    if (!hex_mcts_init(&m, &config, 5))
+        exit(1);
+    struct hex_mcts_stats stats;
+    hex_mcts_search(&m, &stats);
+    hex_mcts_stop(&m);
+    hex_mcts_set_position(&m, &m.root_grid, RED);
+    CHECK(hex_mcts_search(&m, &stats) < 25);
+    CHECK(stats.playouts >= config.max_playouts);
+    hex_mcts_destroy(&m);
+}
+
+int main(void) {
+    struct hex_tt tt;
+    if (!hex_tt_init(&tt, 1))
+        return 1;
+    winning_moves(1, NULL);
+    winning_moves(2, NULL);
+    winning_moves(4, &tt);
+    late_stop();
+    hex_tt_destroy(&tt);
+    return test_exit("test-mcts");
+}
@@ -0,0 +1,155 @@
+#include <stdlib.h>
+
+#include "hex-grid.h"
+#include "hex-patterns.h"
+#include "hex-random.h"
+#include "test.h"
+
+static cell_color other(cell_color player) {
+    return 1 + (player % 2);
+}
+
+/* Whether `player`, to move, wins g, by trying everything. */
+static bool wins(hex_grid *g, cell_color player) {
+    cell_color winner = hex_grid_get_winner(g);
+    if (winner != NEUTRAL)
+        return winner == player;
+    for (size_t i = 0; i < g->size * g->size; i++) {
+        if (!hex_grid_open_cell(g, i, player))
+            continue;
+        bool won = !wins(g, other(player));
+        hex_grid_undo(g);
+        if (won)
+            return true;
+    }
+    return false;
+}
+
+/* Clears g and plays the red stones, then the blue ones, keeping the
+   fill-in up to date. */
+static void play(struct hex_patterns *p,
+                 hex_grid *g,
+                 const int *red,
+                 const int *blue) {
+    hex_grid_clear(g);
+    hex_patterns_reset(p, g);
+    for (; *red >= 0; red++) {
+        hex_grid_open_cell(g, (size_t)*red, RED);
+        hex_patterns_play(p, g, (size_t)*red, RED);
+    }
+    for (; *blue >= 0; blue++) {
+        hex_grid_open_cell(g, (size_t)*blue, BLUE);
+        hex_patterns_play(p, g, (size_t)*blue, BLUE);
+    }
+}
+
+/* Around c3 (12) on 5x5, clockwise from above: c2 (7), d2 (8), d3 (13),
+   c4 (17), b4 (16) and b3 (11). */
+static void rings(void) {
+    struct hex_patterns p;
+    hex_grid g;
+    uint32_t moves[25];
+    if (!hex_grid_init(&g, 5, HEX_GRID_UNDOABLE_UNION_FIND) ||
+        !hex_patterns_init(&p, 5))
+        exit(1);
+
+    play(&p, &g, (const int[]){7, 8, 13, 17, -1}, (const int[]){-1});
+    CHECK(p.kind[12] == HEX_PATTERN_DEAD);
+    play(&p, &g, (const int[]){7, 8, 13, -1}, (const int[]){16, -1});
+    CHECK(p.kind[12] == HEX_PATTERN_DEAD);
+    play(&p, &g, (const int[]){7, 8, -1}, (const int[]){17, 16, -1});
+    CHECK(p.kind[12] == HEX_PATTERN_DEAD);
+    play(&p, &g, (const int[]){7, 13, 16, -1}, (const int[]){-1});
+    CHECK(!hex_patterns_filled(&p, 12));
+    hex_patterns_reset(&p, &g);
+    CHECK(!hex_patterns_filled(&p, 12));
+
+    /* a stone a row from the edge captures the two cells between */
+    play(&p, &g, (const int[]){7, -1}, (const int[]){-1});
+    CHECK(p.kind[2] == HEX_PATTERN_CAPTURED && p.color[2] == RED);
+    CHECK(p.kind[3] == HEX_PATTERN_CAPTURED && p.color[3] == RED);
+    CHECK(p.filled == 2);
+
+    /* three red in a row: red on c4 or b3 would kill c3, and so would
+       blue opposite the middle one, on b4, so neither side is to play it */
+    play(&p, &g, (const int[]){7, 8, 13, -1}, (const int[]){-1});
+    CHECK(!hex_patterns_filled(&p, 12));
+    for (cell_color player = RED; player <= BLUE; player++) {
+        const size_t n = hex_patterns_moves(&p, &g, player, moves);
+        bool c3 = false, b4 = false;
+        for (size_t k = 0; k < n; k++) {
+            c3 |= moves[k] == 12;
+            b4 |= moves[k] == 16;
+        }
+        CHECK(!c3 && (player == RED || b4));
+    }
+
+    hex_patterns_destroy(&p);
+    hex_grid_destroy(&g);
+}
+
+/* Along random games, filling in neither changes who wins nor drops every
+   winning move, with the fill-in kept up move by move and found afresh. */
+static void against_brute_force(size_t size, unsigned games) {
+    const size_t cells = size * size;
+    struct hex_patterns incremental, fresh;
+    struct hex_rng rng;
+    hex_grid g, filled;
+    uint32_t moves[16];
+    if (!hex_grid_init(&g, size, HEX_GRID_UNDOABLE_UNION_FIND) ||
+        !hex_grid_init(&filled, size, HEX_GRID_UNDOABLE_UNION_FIND) ||
+        !hex_patterns_init(&incremental, size) ||
+        !hex_patterns_init(&fresh, size))
+        exit(1);
+    hex_rng_seed(&rng, size);
+
+    for (unsigned game = 0; game < games; game++) {
+        hex_grid_clear(&g);
+        hex_patterns_reset(&incremental, &g);
+        cell_color player = RED;
+        while (hex_grid_get_winner(&g) == NEUTRAL) {
+            size_t i;
+            do
+                i = hex_rng_below(&rng, (uint32_t)cells);
+            while (g.cells[i].color != NEUTRAL);
+            hex_grid_open_cell(&g, i, player);
+            hex_patterns_play(&incremental, &g, i, player);
+            player = other(player);
+            if (cells - g.move_count > 10 || hex_grid_get_winner(&g))
+                continue;
+
+            hex_patterns_reset(&fresh, &g);
+            const bool won = wins(&g, player);
+            for (unsigned k = 0; k < 2; k++) {
+                struct hex_patterns *p = k ? &fresh : &incremental;
+                hex_grid_copy(&filled, &g);
+                for (size_t c = 0; c < cells; c++) {
+                    if (hex_patterns_filled(p, c))
+                        hex_grid_open_cell(&filled, c, p->color[c]);
+                }
+                CHECK(wins(&filled, player) == won);
+
+                const size_t n = hex_patterns_moves(p, &g, player, moves);
+                bool found = false;
+                for (size_t m = 0; m < n && !found; m++) {
+                    CHECK(g.cells[moves[m]].color == NEUTRAL);
+                    hex_grid_open_cell(&g, moves[m], player);
+                    found = !wins(&g, other(player));
+                    hex_grid_undo(&g);
+                }
+                CHECK(found == won);
+            }
+        }
+    }
+    hex_patterns_destroy(&fresh);
+    hex_patterns_destroy(&incremental);
+    hex_grid_destroy(&filled);
+    hex_grid_destroy(&g);
+}
+
+int main(void) {
+    rings();
+    against_brute_force(3, 200);
+    against_brute_force(4, 100);
+    return test_exit("test-patterns");
+}
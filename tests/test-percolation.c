@@ -0,0 +1,30 @@
+#include <math.h>
+
+#include "hex-percolation.h"
+#include "test.h"
+
+int main(void) {
+    struct hex_percolation_config config;
+    struct hex_percolation_stats one, again, many;
+    hex_percolation_default_config(&config);
+    config.size = 48;
+    config.trials = 400;
+
+    CHECK(hex_percolation_run(&config, &one));
+    CHECK(hex_percolation_run(&config, &again));
+    /* one thread with one seed is repeatable */
+    CHECK(one.trials == 400 && again.trials == 400);
+    CHECK(one.mean == again.mean && one.stddev == again.stddev);
+    /* the site threshold of the triangular lattice is 1/2 */
+    CHECK(one.confidence_low < one.mean && one.mean < one.confidence_high);
+    CHECK(fabs(one.mean - 0.5) < 0.02);
+
+    config.threads = 5;
+    CHECK(hex_percolation_run(&config, &many));
+    CHECK(many.trials == 400);
+    CHECK(fabs(many.mean - one.mean) < 6 * one.stddev / sqrt(400.0));
+
+    config.size = 1;
+    CHECK(!hex_percolation_run(&config, &many));
+    return test_exit("test-percolation");
+}
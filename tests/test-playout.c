@@ -0,0 +1,82 @@
+#include <math.h>
+#include <stdlib.h>
+
+#include "hex-grid.h"
+#include "hex-playout.h"
+#include "hex-random.h"
+#include "test.h"
+
+/* The exact chance that red wins a random fill of g: every way of giving
+   red its share of the empty cells, filled in and checked on a grid. */
+static double exact_red(const hex_grid *g, cell_color to_move) {
+    const size_t cells = g->size * g->size;
+    size_t empty[16], n = 0;
+    for (size_t i = 0; i < cells; i++) {
+        if (g->cells[i].color == NEUTRAL)
+            empty[n++] = i;
+    }
+    const unsigned reds = to_move == RED ? (n + 1) / 2 : n / 2;
+    hex_grid fill;
+    if (n > 16 || !hex_grid_init(&fill, g->size, HEX_GRID_UNION_FIND))
+        exit(1);
+    size_t fills = 0, wins = 0;
+    for (uint32_t mask = 0; mask < (uint32_t)1 << n; mask++) {
+        if ((unsigned)__builtin_popcount(mask) != reds)
+            continue;
+        hex_grid_copy(&fill, g);
+        for (size_t e = 0; e < n; e++)
+            hex_grid_open_cell(&fill, empty[e], mask >> e & 1 ? RED : BLUE);
+        wins += hex_grid_get_winner(&fill) == RED;
+        fills++;
+    }
+    hex_grid_destroy(&fill);
+    return (double)wins / (double)fills;
+}
+
+/* Plays MOVES, cells alternating from red, and checks the playout win rate
+   against the exact one to within five standard errors. */
+static void check_position(size_t size, const size_t *moves, size_t count) {
+    hex_grid g;
+    struct hex_playout p;
+    struct hex_rng rng;
+    if (!hex_grid_init(&g, size, HEX_GRID_BITBOARD) ||
+        !hex_playout_init(&p, size))
+        exit(1);
+    for (size_t m = 0; m < count; m++)
+        CHECK(hex_grid_open_cell(&g, moves[m], m % 2 ? BLUE : RED));
+    const cell_color to_move = count % 2 ? BLUE : RED;
+
+    const size_t games = HEX_PLAYOUT_LANES * 200;
+    size_t red = 0;
+    hex_rng_seed(&rng, size * 1000 + count);
+    hex_playout_set_position(&p, &g, to_move);
+    for (size_t done = 0; done < games; done += HEX_PLAYOUT_LANES)
+        red += hex_playout_run(&p, HEX_PLAYOUT_LANES, &rng);
+    /* a batch smaller than the lanes counts only its own games */
+    CHECK(hex_playout_run(&p, 3, &rng) <= 3);
+
+    const double expected = exact_red(&g, to_move);
+    const double rate = (double)red / (double)games;
+    const double error = sqrt(expected * (1 - expected) / (double)games);
+    CHECK(fabs(rate - expected) <= 5 * error + 1e-12);
+    hex_playout_destroy(&p);
+    hex_grid_destroy(&g);
+}
+
+int main(void) {
+    static const size_t none[1];
+    static const size_t red_column[] = {1, 0, 4, 3, 7}; // b1 b2 b3 on 3x3
+    static const size_t blue_row[] = {0, 3, 1, 4, 8, 5}; // a2 b2 c2
+    static const size_t opening[] = {5, 6, 9};
+    static const size_t middle[] = {5, 10, 6, 9, 0};
+
+    check_position(1, none, 0);
+    check_position(2, none, 0);
+    check_position(3, none, 0);
+    check_position(3, red_column, 5);
+    check_position(3, blue_row, 6);
+    check_position(4, none, 0);
+    check_position(4, opening, 3);
+    check_position(4, middle, 5);
+    return test_exit("test-playout");
+}
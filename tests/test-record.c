@@ -0,0 +1,143 @@
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "hex-grid.h"
+#include "hex-random.h"
+#include "hex-record.h"
+#include "test.h"
+
+#define GAMES 60
+
+/* The games written, to compare with what is read back. */
+static hex_grid played[GAMES];
+static cell_color results[GAMES];
+
+/* A random game on a random size, played to the end, or cut short (and
+   so unfinished) now and then. Sizes go past 16 and 256, where moves take
+   two and then four bytes. */
+static void random_game(size_t k, struct hex_rng *rng) {
+    static const size_t sizes[] = {1, 2, 7, 11, 16, 17, 19, 40, 257};
+    const size_t size = sizes[hex_rng_below(rng, 9)];
+    hex_grid *g = &played[k];
+    if (!hex_grid_init(g, size, HEX_GRID_UNION_FIND))
+        exit(1);
+    const size_t cells = size * size;
+    const size_t stop = hex_rng_below(rng, 4) ? cells : cells / 3;
+    cell_color player = RED;
+    while (g->move_count < stop && hex_grid_get_winner(g) == NEUTRAL) {
+        if (hex_grid_open_cell(g, hex_rng_below(rng, (uint32_t)cells),
+                               player))
+            player = player == RED ? BLUE : RED;
+    }
+    results[k] = hex_grid_get_winner(g);
+}
+
+static int write_games(const char *path, size_t first, size_t last) {
+    struct hex_record_writer w;
+    if (!hex_record_writer_open(&w, path))
+        return 0;
+    for (size_t k = first; k < last; k++)
+        CHECK(hex_record_write(&w, &played[k], results[k]));
+    return hex_record_writer_close(&w);
+}
+
+/* Reads the archive back, and replays it on `threads` threads. */
+static void check_archive(const char *path, size_t count, unsigned threads) {
+    struct hex_record_archive a;
+    CHECK(hex_record_open(&a, path));
+    CHECK(a.count == count);
+    size_t red = 0, blue = 0, moves = 0;
+    for (size_t k = 0; k < a.count && k < count; k++) {
+        struct hex_record_game game;
+        CHECK(hex_record_get(&a, k, &game));
+        CHECK(game.size == played[k].size);
+        CHECK(game.result == results[k]);
+        CHECK(game.move_count == played[k].move_count);
+        for (size_t m = 0; m < game.move_count; m++)
+            CHECK(hex_record_move(&game, m) == played[k].moves[m]);
+        red += results[k] == RED;
+        blue += results[k] == BLUE;
+        moves += game.move_count;
+    }
+    struct hex_record_game past;
+    CHECK(!hex_record_get(&a, count, &past));
+
+    struct hex_replay_stats stats;
+    CHECK(hex_record_replay(&a, threads, &stats));
+    CHECK(stats.games == count && stats.moves == moves);
+    CHECK(stats.red_wins == red && stats.blue_wins == blue);
+    CHECK(stats.unfinished == count - red - blue);
+    CHECK(stats.mismatches == 0 && stats.invalid == 0);
+    hex_record_close(&a);
+}
+
+/* A game on a board larger than any is counted as invalid, not played,
+   and is not written in the first place. */
+static void huge_size(const char *path) {
+    static const uint8_t huge[24] = {'C', 'H', 'E', 'X', 'R', 'E', 'C', 0,
+                                     1,   0,   0,   0,   0,   0,   0,   0,
+                                     'g', 0,   0x10, 0x27, 0, 0,  0,   0};
+    struct hex_record_archive a;
+    struct hex_record_game game;
+    struct hex_replay_stats stats;
+    FILE *f = fopen(path, "wb");
+    CHECK(f && fwrite(huge, sizeof(huge), 1, f) == 1);
+    if (f)
+        fclose(f);
+    CHECK(hex_record_open(&a, path) && a.count == 1);
+    CHECK(!hex_record_get(&a, 0, &game));
+    CHECK(hex_record_replay(&a, 2, &stats));
+    CHECK(stats.games == 1 && stats.invalid == 1);
+    hex_record_close(&a);
+    unlink(path);
+
+    struct hex_record_writer w;
+    hex_grid g;
+    if (!hex_grid_init(&g, HEX_RECORD_MAX_SIZE + 1, HEX_GRID_UNION_FIND))
+        exit(1);
+    CHECK(hex_record_writer_open(&w, path));
+    CHECK(!hex_record_write(&w, &g, NEUTRAL));
+    CHECK(hex_record_writer_close(&w));
+    CHECK(hex_record_open(&a, path) && a.count == 0);
+    hex_record_close(&a);
+    hex_grid_destroy(&g);
+    unlink(path);
+}
+
+int main(void) {
+    char path[] = "/tmp/chex-test-XXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0)
+        return 1;
+    close(fd);
+    unlink(path);
+
+    struct hex_rng rng;
+    hex_rng_seed(&rng, 11);
+    for (size_t k = 0; k < GAMES; k++)
+        random_game(k, &rng);
+
+    /* written in one go, then appended to */
+    CHECK(write_games(path, 0, GAMES / 2));
+    check_archive(path, GAMES / 2, 1);
+    CHECK(write_games(path, GAMES / 2, GAMES));
+    check_archive(path, GAMES, 1);
+    check_archive(path, GAMES, 3);
+
+    /* without its index, as a writer that never closed leaves it, the
+       archive is walked instead */
+    struct stat st;
+    CHECK(stat(path, &st) == 0);
+    CHECK(truncate(path, st.st_size - 8 * GAMES - 16) == 0);
+    check_archive(path, GAMES, 2);
+    /* and a game cut off halfway is not read */
+    CHECK(truncate(path, st.st_size - 8 * GAMES - 17) == 0);
+    check_archive(path, GAMES - 1, 2);
+
+    unlink(path);
+    huge_size(path);
+    for (size_t k = 0; k < GAMES; k++)
+        hex_grid_destroy(&played[k]);
+    return test_exit("test-record");
+}
@@ -0,0 +1,130 @@
+#include <math.h>
+#include <stdlib.h>
+
+#include "hex-grid.h"
+#include "hex-random.h"
+#include "hex-resistance.h"
+#include "test.h"
+
+/* The solver stops at a relative residual of 1e-6. */
+static bool close_to(double a, double b) {
+    return fabs(a - b) <= 1e-4 * fabs(b);
+}
+
+/* 1x1 is two unit conductors in series; 2x2 was solved by hand. */
+static void small_boards(void) {
+    struct hex_resistance r;
+    hex_grid g;
+    if (!hex_grid_init(&g, 1, HEX_GRID_UNION_FIND) ||
+        !hex_resistance_init(&r, 1))
+        exit(1);
+    CHECK(close_to(hex_resistance_solve(&r, &g, RED), 2));
+    CHECK(close_to(hex_resistance_solve(&r, &g, BLUE), 2));
+    hex_grid_open_cell(&g, 0, RED);
+    CHECK(hex_resistance_solve(&r, &g, RED) == 0);
+    CHECK(hex_resistance_solve(&r, &g, BLUE) == HUGE_VAL);
+    CHECK(hex_resistance_evaluate(&r, &g) == HEX_RESISTANCE_CLAMP);
+    hex_resistance_destroy(&r);
+    hex_grid_destroy(&g);
+
+    if (!hex_grid_init(&g, 2, HEX_GRID_UNION_FIND) ||
+        !hex_resistance_init(&r, 2))
+        exit(1);
+    CHECK(close_to(hex_resistance_solve(&r, &g, RED), 12.0 / 7.0));
+    CHECK(close_to(hex_resistance_solve(&r, &g, BLUE), 12.0 / 7.0));
+    /* a red stone on b1 joins the top edge: b1 is a short to the source */
+    hex_grid_open_cell(&g, 1, RED);
+    CHECK(hex_resistance_solve(&r, &g, RED) < 12.0 / 7.0);
+    hex_resistance_destroy(&r);
+    hex_grid_destroy(&g);
+}
+
+static void empty_board(void) {
+    struct hex_resistance r;
+    hex_grid g;
+    if (!hex_grid_init(&g, 7, HEX_GRID_UNION_FIND) ||
+        !hex_resistance_init(&r, 7))
+        exit(1);
+    /* red's and blue's boards are mirror images */
+    const double red = hex_resistance_solve(&r, &g, RED);
+    CHECK(close_to(hex_resistance_solve(&r, &g, BLUE), red));
+    CHECK(fabs(hex_resistance_evaluate(&r, &g)) < 1e-4);
+
+    /* a blue wall across the board cuts red off */
+    for (size_t x = 0; x < 7; x++)
+        hex_grid_open_cell(&g, 3 * 7 + x, BLUE);
+    CHECK(hex_resistance_solve(&r, &g, RED) == HUGE_VAL);
+    CHECK(hex_resistance_solve(&r, &g, BLUE) == 0);
+    CHECK(hex_resistance_evaluate(&r, &g) == -HEX_RESISTANCE_CLAMP);
+    hex_resistance_destroy(&r);
+    hex_grid_destroy(&g);
+}
+
+/* A stone can only lower its owner's resistance and raise the opponent's,
+   and a warm start from the position before the move takes fewer
+   iterations than starting over. */
+static void random_games(void) {
+    const size_t size = 9, cells = size * size;
+    struct hex_resistance warm, cold;
+    struct hex_rng rng;
+    hex_grid g;
+    size_t warm_iterations = 0, cold_iterations = 0;
+    if (!hex_grid_init(&g, size, HEX_GRID_UNION_FIND) ||
+        !hex_resistance_init(&warm, size) || !hex_resistance_init(&cold, size))
+        exit(1);
+    hex_rng_seed(&rng, 5);
+    for (unsigned game = 0; game < 20; game++) {
+        hex_grid_clear(&g);
+        hex_resistance_forget(&warm);
+        double red = hex_resistance_solve(&warm, &g, RED);
+        double blue = hex_resistance_solve(&warm, &g, BLUE);
+        cell_color player = RED;
+        while (hex_grid_get_winner(&g) == NEUTRAL) {
+            size_t i;
+            do
+                i = hex_rng_below(&rng, (uint32_t)cells);
+            while (g.cells[i].color != NEUTRAL);
+            hex_grid_open_cell(&g, i, player);
+
+            const double r2 = hex_resistance_solve(&warm, &g, RED);
+            warm_iterations += warm.iterations;
+            const double b2 = hex_resistance_solve(&warm, &g, BLUE);
+            warm_iterations += warm.iterations;
+            hex_resistance_forget(&cold);
+            CHECK(r2 == HUGE_VAL ||
+                  close_to(hex_resistance_solve(&cold, &g, RED), r2));
+            cold_iterations += cold.iterations;
+            CHECK(b2 == HUGE_VAL ||
+                  close_to(hex_resistance_solve(&cold, &g, BLUE), b2));
+            cold_iterations += cold.iterations;
+
+            if (player == RED)
+                CHECK(r2 <= red * (1 + 1e-4) && b2 >= blue * (1 - 1e-4));
+            else
+                CHECK(b2 <= blue * (1 + 1e-4) && r2 >= red * (1 - 1e-4));
+            red = r2;
+            blue = b2;
+            player = 3 - player;
+        }
+    }
+    CHECK(warm_iterations < cold_iterations);
+
+    /* solving the same position again needs no iterations at all */
+    hex_grid_clear(&g);
+    hex_grid_open_cell(&g, 40, RED);
+    hex_grid_open_cell(&g, 30, BLUE);
+    hex_resistance_solve(&warm, &g, RED);
+    CHECK(warm.iterations > 0);
+    hex_resistance_solve(&warm, &g, RED);
+    CHECK(warm.iterations == 0);
+    hex_resistance_destroy(&warm);
+    hex_resistance_destroy(&cold);
+    hex_grid_destroy(&g);
+}
+
+int main(void) {
+    small_boards();
+    empty_board();
+    random_games();
+    return test_exit("test-resistance");
+}
@@ -0,0 +1,151 @@
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "hex-selfplay.h"
+#include "test.h"
+
+#define SIZE 5
+#define CELLS (SIZE * SIZE)
+#define MAX_SAMPLES 1024
+
+static char dir[] = "/tmp/chex-test-XXXXXX";
+
+struct run {
+    struct hex_selfplay_stats stats;
+    uint8_t samples[MAX_SAMPLES][2 + CELLS + 2 * CELLS];
+    size_t count;
+};
+
+static const char *names[3] = {"raw", "packed", "threads"};
+static struct run runs[3];
+
+static int play(struct run *r,
+                const char *name,
+                unsigned threads,
+                bool compress) {
+    static char prefix[64];
+    struct hex_selfplay_config config;
+    hex_selfplay_default_config(&config);
+    snprintf(prefix, sizeof(prefix), "%s/%s", dir, name);
+    config.size = SIZE;
+    config.games = 12;
+    config.threads = threads;
+    config.shard_samples = 16;
+    config.compress = compress;
+    config.prefix = prefix;
+    config.engine.max_playouts = 300;
+    return hex_selfplay_run(&config, &r->stats);
+}
+
+/* Reads every shard of a run in order, checking each sample on the way. */
+static void read_back(struct run *r, const char *name) {
+    const size_t bytes = 2 + (CELLS + 3) / 4 + 2 * CELLS;
+    struct hex_selfplay_shard s;
+    struct hex_selfplay_sample sample;
+    char path[128];
+    r->count = 0;
+    for (size_t k = 0; k < r->stats.shards; k++) {
+        snprintf(path, sizeof(path), "%s/%s-%05zu.shard", dir, name, k);
+        CHECK(hex_selfplay_shard_open(&s, path, false));
+        CHECK(s.size == SIZE && s.count <= 16);
+        while (hex_selfplay_shard_next(&s, &sample)) {
+            size_t stones[3] = {0};
+            double sum = 0;
+            for (size_t i = 0; i < CELLS; i++) {
+                const cell_color c = hex_selfplay_cell(&sample, i);
+                const double p = hex_selfplay_policy(&sample, i);
+                stones[c]++;
+                sum += p;
+                CHECK(c == NEUTRAL || p == 0);
+            }
+            CHECK(hex_selfplay_to_move(&sample) ==
+                  (stones[RED] == stones[BLUE] ? RED : BLUE));
+            CHECK(hex_selfplay_winner(&sample) == RED ||
+                  hex_selfplay_winner(&sample) == BLUE);
+            CHECK(sum <= 1 && sum > 1 - CELLS / 65535.0);
+            if (r->count < MAX_SAMPLES)
+                memcpy(r->samples[r->count], sample.data, bytes);
+            r->count++;
+        }
+        CHECK(s.next == s.count);
+        hex_selfplay_shard_close(&s);
+    }
+    CHECK(r->count == r->stats.samples && r->count <= MAX_SAMPLES);
+}
+
+/* Each sample is followed by itself turned around. */
+static void symmetry(const char *name) {
+    struct hex_selfplay_shard s;
+    struct hex_selfplay_sample a, b;
+    char path[128];
+    snprintf(path, sizeof(path), "%s/%s-00000.shard", dir, name);
+    CHECK(hex_selfplay_shard_open(&s, path, true));
+    size_t count = 0;
+    while (hex_selfplay_shard_next(&s, &a)) {
+        CHECK(hex_selfplay_shard_next(&s, &b));
+        CHECK(!a.rotated && b.rotated);
+        CHECK(hex_selfplay_to_move(&a) == hex_selfplay_to_move(&b));
+        for (size_t i = 0; i < CELLS; i++) {
+            CHECK(hex_selfplay_cell(&a, i) ==
+                  hex_selfplay_cell(&b, CELLS - 1 - i));
+            CHECK(hex_selfplay_policy(&a, i) ==
+                  hex_selfplay_policy(&b, CELLS - 1 - i));
+        }
+        count++;
+    }
+    CHECK(count == s.count);
+    hex_selfplay_shard_close(&s);
+}
+
+/* A shard cut short stops at the block it breaks. */
+static void truncated(const char *name) {
+    struct hex_selfplay_shard s;
+    struct hex_selfplay_sample sample;
+    char path[128];
+    snprintf(path, sizeof(path), "%s/%s-00000.shard", dir, name);
+    CHECK(hex_selfplay_shard_open(&s, path, false));
+    const size_t length = s.length;
+    hex_selfplay_shard_close(&s);
+    CHECK(truncate(path, (off_t)length - 1) == 0);
+    CHECK(hex_selfplay_shard_open(&s, path, false));
+    while (hex_selfplay_shard_next(&s, &sample))
+        ;
+    CHECK(s.next < s.count);
+    hex_selfplay_shard_close(&s);
+}
+
+int main(void) {
+    if (!mkdtemp(dir))
+        return 1;
+
+    /* one thread keeps the games in order, so the runs match sample for
+       sample whether compressed or not */
+    CHECK(play(&runs[0], names[0], 1, false));
+    CHECK(play(&runs[1], names[1], 1, true));
+    CHECK(play(&runs[2], names[2], 3, true));
+    CHECK(runs[0].stats.games == 12 && runs[0].stats.samples > 0);
+    CHECK(runs[0].stats.shards == (runs[0].stats.samples + 15) / 16);
+    CHECK(runs[1].stats.bytes < runs[0].stats.bytes);
+    CHECK(runs[2].stats.samples == runs[0].stats.samples);
+
+    for (unsigned r = 0; r < 3; r++)
+        read_back(&runs[r], names[r]);
+    CHECK(runs[0].count == runs[1].count);
+    CHECK(!memcmp(runs[0].samples, runs[1].samples,
+                  sizeof(runs[0].samples)));
+    symmetry("raw");
+    symmetry("packed");
+    truncated("packed");
+
+    for (unsigned r = 0; r < 3; r++) {
+        for (size_t k = 0; k < runs[r].stats.shards; k++) {
+            char path[128];
+            snprintf(path, sizeof(path), "%s/%s-%05zu.shard", dir, names[r],
+                     k);
+            unlink(path);
+        }
+    }
+    rmdir(dir);
+    return test_exit("test-selfplay");
+}
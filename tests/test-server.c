@@ -0,0 +1,127 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "hex-server.h"
+#include "test.h"
+
+static char address[64];
+
+static void *serve(void *arg) {
+    hex_server_run(arg);
+    return NULL;
+}
+
+static int dial(void) {
+    struct sockaddr_un un = {.sun_family = AF_UNIX};
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    strcpy(un.sun_path, address + 5);
+    if (fd < 0 || connect(fd, (struct sockaddr *)&un, sizeof(un)) < 0)
+        exit(1);
+    return fd;
+}
+
+/* Sends a command and reads one line back, one byte at a time. */
+static const char *ask(int fd, const char *line) {
+    static char answer[256];
+    size_t n = 0;
+    if (line && write(fd, line, strlen(line)) < 0)
+        return "";
+    while (n + 1 < sizeof(answer) && read(fd, answer + n, 1) == 1 &&
+           answer[n] != '\n')
+        n++;
+    answer[n] = '\0';
+    return answer;
+}
+
+static void protocol(void) {
+    char line[64], expected[64];
+    unsigned id, other;
+    int fd = dial(), watcher = dial();
+
+    CHECK(!strncmp(ask(fd, "new 99\n"), "err", 3));
+    CHECK(sscanf(ask(fd, "new 2\n"), "ok %u", &id) == 1);
+    CHECK(sscanf(ask(fd, "new 2\n"), "ok %u", &other) == 1 && other != id);
+    snprintf(line, sizeof(line), "watch %u\n", id);
+    CHECK(!strncmp(ask(watcher, line), "ok", 2));
+
+    snprintf(line, sizeof(line), "play %u a1\n", id);
+    snprintf(expected, sizeof(expected), "ok %u a1 red", id);
+    CHECK(!strcmp(ask(fd, line), expected));
+    snprintf(expected, sizeof(expected), "move %u a1 red", id);
+    CHECK(!strcmp(ask(watcher, NULL), expected));
+    CHECK(!strcmp(ask(fd, line), "err cell occupied"));
+    snprintf(line, sizeof(line), "play %u c1\n", id);
+    CHECK(!strcmp(ask(fd, line), "err bad cell"));
+
+    /* blue at b1, then red joins top and bottom through a2 */
+    snprintf(line, sizeof(line), "play %u b1\n", id);
+    snprintf(expected, sizeof(expected), "ok %u b1 blue", id);
+    CHECK(!strcmp(ask(fd, line), expected));
+    snprintf(line, sizeof(line), "state %u\n", id);
+    snprintf(expected, sizeof(expected), "ok %u 2 red xo..", id);
+    CHECK(!strcmp(ask(fd, line), expected));
+    snprintf(line, sizeof(line), "play %u a2\n", id);
+    snprintf(expected, sizeof(expected), "ok %u a2 red wins", id);
+    CHECK(!strcmp(ask(fd, line), expected));
+    snprintf(line, sizeof(line), "play %u b2\n", id);
+    CHECK(!strcmp(ask(fd, line), "err the game is over"));
+    snprintf(line, sizeof(line), "state %u\n", id);
+    snprintf(expected, sizeof(expected), "ok %u 2 over xox.", id);
+    CHECK(!strcmp(ask(fd, line), expected));
+
+    /* a closed game's id does not name the game that gets its slot */
+    snprintf(line, sizeof(line), "close %u\n", id);
+    CHECK(!strncmp(ask(fd, line), "ok", 2));
+    CHECK(!strcmp(ask(fd, line), "err no such game"));
+    CHECK(sscanf(ask(fd, "new 3\n"), "ok %u", &other) == 1 && other != id);
+    snprintf(line, sizeof(line), "state %u\n", id);
+    CHECK(!strcmp(ask(fd, line), "err no such game"));
+
+    CHECK(!strcmp(ask(fd, "hello\n"), "err unknown command"));
+    CHECK(!strncmp(ask(fd, "stats\n"), "ok 2 2 ", 7));
+    close(watcher);
+    close(fd);
+}
+
+static void load(void) {
+    struct hex_server_load_config config = {address, 300, 3, 7, 1};
+    struct hex_server_load_stats stats;
+    CHECK(hex_server_load(&config, &stats));
+    CHECK(stats.games == 300 && stats.errors == 0);
+    CHECK(stats.moves >= 300 * 7 && stats.moves <= 300 * 49);
+    CHECK(stats.p50_us > 0 && stats.p50_us <= stats.p99_us);
+
+    /* more games than slots: the rest are refused, nothing else breaks */
+    config.games = 2000;
+    CHECK(!hex_server_load(&config, &stats));
+}
+
+int main(void) {
+    struct hex_server_config config;
+    struct hex_server s;
+    pthread_t thread;
+
+    snprintf(address, sizeof(address), "unix:/tmp/chex-test-%d.sock",
+             (int)getpid());
+    hex_server_default_config(&config);
+    config.address = address;
+    config.max_games = 1000;
+    config.max_size = 11;
+    CHECK(hex_server_init(&s, &config));
+    CHECK(pthread_create(&thread, NULL, serve, &s) == 0);
+
+    protocol();
+    load();
+
+    hex_server_stop(&s);
+    pthread_join(thread, NULL);
+    CHECK(s.commands > 300 * 8);
+    hex_server_destroy(&s);
+    CHECK(access(address + 5, F_OK) != 0);
+    return test_exit("test-server");
+}
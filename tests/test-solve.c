@@ -0,0 +1,133 @@
+#include <stdlib.h>
+
+#include "hex-grid.h"
+#include "hex-random.h"
+#include "hex-solve.h"
+#include "test.h"
+
+static cell_color other(cell_color player) {
+    return 1 + (player % 2);
+}
+
+/* Whether `player`, to move, wins g, by trying everything. */
+static bool wins(hex_grid *g, cell_color player) {
+    for (size_t i = 0; i < g->size * g->size; i++) {
+        if (!hex_grid_open_cell(g, i, player))
+            continue;
+        bool won = hex_grid_get_winner(g) == player ||
+                   !wins(g, other(player));
+        hex_grid_undo(g);
+        if (won)
+            return true;
+    }
+    return false;
+}
+
+/* Random positions with `min` to `max` stones, solved and then taken one
+   move further, against the brute force. One solver does them all, so the
+   table carries over from one position to the next as in chex-cli. */
+static void against_brute_force(size_t size,
+                                unsigned positions,
+                                unsigned min,
+                                unsigned max) {
+    const size_t cells = size * size;
+    struct hex_solve_config config;
+    struct hex_solver s;
+    struct hex_rng rng;
+    hex_grid g;
+    hex_solve_default_config(&config);
+    config.tt_megabytes = 1;
+    if (!hex_solver_init(&s, &config, size) ||
+        !hex_grid_init(&g, size, HEX_GRID_UNDOABLE_UNION_FIND))
+        exit(1);
+    hex_rng_seed(&rng, size);
+
+    for (unsigned k = 0; k < positions;) {
+        hex_grid_clear(&g);
+        cell_color player = RED;
+        const unsigned stones = min + hex_rng_below(&rng, max - min + 1);
+        while (g.move_count < stones) {
+            if (hex_grid_open_cell(&g, hex_rng_below(&rng, (uint32_t)cells),
+                                   player))
+                player = other(player);
+        }
+        if (hex_grid_get_winner(&g) != NEUTRAL)
+            continue;
+        k++;
+
+        struct hex_solve_stats stats;
+        cell_color winner = hex_solve(&s, &g, player, true, &stats);
+        CHECK(winner == (wins(&g, player) ? player : other(player)));
+        CHECK(stats.proof_size >= 1);
+        for (size_t i = 0; i < cells; i++) {
+            if (!hex_grid_open_cell(&g, i, player))
+                continue;
+            cell_color expected = hex_grid_get_winner(&g) == player ||
+                                          !wins(&g, other(player))
+                                      ? player
+                                      : other(player);
+            CHECK(hex_solve(&s, &g, other(player), false, NULL) == expected);
+            hex_grid_undo(&g);
+        }
+    }
+    hex_grid_destroy(&g);
+    hex_solver_destroy(&s);
+}
+
+/* The winning first moves of the empty boards: the short diagonal, and on
+   3x3 the middle row as well. */
+static void first_moves(size_t size, const char *winning) {
+    struct hex_solve_config config;
+    struct hex_solver s;
+    hex_grid g;
+    hex_solve_default_config(&config);
+    config.tt_megabytes = 1;
+    if (!hex_solver_init(&s, &config, size) ||
+        !hex_grid_init(&g, size, HEX_GRID_UNDOABLE_UNION_FIND))
+        exit(1);
+    CHECK(hex_solve(&s, &g, RED, false, NULL) == RED);
+    for (size_t i = 0; i < size * size; i++) {
+        hex_grid_open_cell(&g, i, RED);
+        bool won = hex_solve(&s, &g, BLUE, false, NULL) == RED;
+        CHECK(won == (winning[i] == 'x'));
+        hex_grid_undo(&g);
+    }
+    hex_grid_destroy(&g);
+    hex_solver_destroy(&s);
+}
+
+/* A node budget too small for the position gives up with NEUTRAL, close
+   to the budget, and the next solve starts from a clean count. */
+static void budget(void) {
+    struct hex_solve_config config;
+    struct hex_solver s;
+    struct hex_solve_stats stats;
+    hex_grid g;
+    hex_solve_default_config(&config);
+    config.tt_megabytes = 1;
+    config.max_nodes = 50;
+    if (!hex_solver_init(&s, &config, 7) ||
+        !hex_grid_init(&g, 7, HEX_GRID_UNDOABLE_UNION_FIND))
+        exit(1);
+    CHECK(hex_solve(&s, &g, RED, true, &stats) == NEUTRAL);
+    CHECK(stats.nodes >= 50 && stats.nodes < 60);
+    CHECK(stats.proof_size == 0);
+    CHECK(hex_solve(&s, &g, RED, false, &stats) == NEUTRAL);
+    CHECK(stats.nodes < 60);
+    hex_grid_destroy(&g);
+    hex_solver_destroy(&s);
+}
+
+int main(void) {
+    first_moves(3, "..x"
+                   "xxx"
+                   "x..");
+    first_moves(4, "...x"
+                   "..x."
+                   ".x.."
+                   "x...");
+    against_brute_force(3, 40, 0, 6);
+    against_brute_force(4, 20, 4, 9);
+    budget();
+    return test_exit("test-solve");
+}
@@ -0,0 +1,113 @@
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "hex-trace.h"
+#include "test.h"
+
+/* The whole file, NUL-terminated. */
+static char *slurp(const char *path) {
+    FILE *f = fopen(path, "r");
+    char *text = NULL;
+    size_t length = 0;
+    if (!f)
+        return NULL;
+    text = malloc(1 << 16);
+    if (text)
+        length = fread(text, 1, (1 << 16) - 1, f);
+    fclose(f);
+    if (text)
+        text[length] = '\0';
+    return text;
+}
+
+static size_t occurrences(const char *text, const char *needle) {
+    size_t n = 0;
+    for (const char *s = text; (s = strstr(s, needle)); s += strlen(needle))
+        n++;
+    return n;
+}
+
+static void spans(void) {
+    char path[] = "/tmp/chex-test-XXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0)
+        exit(1);
+    close(fd);
+
+    hex_trace_reset();
+    hex_trace_end(); // nothing open: ignored
+    hex_trace_begin("outer");
+    hex_trace_begin("inner");
+    hex_trace_counter("count", 3);
+    hex_trace_end();
+    hex_trace_end();
+    CHECK(hex_trace_event_count() == 5 && hex_trace_dropped() == 0);
+    CHECK(hex_trace_write(path));
+
+    char *text = slurp(path);
+    CHECK(text != NULL);
+    if (text) {
+        CHECK(!strncmp(text, "{\"traceEvents\":[", 16));
+        CHECK(strstr(text, "\"displayTimeUnit\":\"ms\"}") != NULL);
+        CHECK(occurrences(text, "\"ph\":\"B\"") == 2);
+        CHECK(occurrences(text, "\"ph\":\"E\"") == 2);
+        CHECK(strstr(text, "\"name\":\"outer\"") <
+              strstr(text, "\"name\":\"inner\""));
+        CHECK(strstr(text, "\"args\":{\"value\":3}") != NULL);
+    }
+    free(text);
+    unlink(path);
+}
+
+static void frames(void) {
+    struct hex_trace_frame_stats stats;
+    hex_trace_reset();
+    hex_trace_frame_stats(&stats);
+    CHECK(stats.frames == 0 && stats.p99_ms == 0);
+
+    for (unsigned k = 100; k >= 1; k--) {
+        hex_trace_draw_call();
+        hex_trace_frame(k * 1e-3);
+    }
+    hex_trace_frame_stats(&stats);
+    CHECK(stats.frames == 100 && stats.draw_calls == 1);
+    CHECK(stats.last_ms > 0.99 && stats.last_ms < 1.01);
+    CHECK(stats.p50_ms > 49.99 && stats.p50_ms < 50.01);
+    CHECK(stats.p99_ms > 98.99 && stats.p99_ms < 99.01);
+
+    /* only the latest frames count */
+    for (unsigned k = 0; k < HEX_TRACE_FRAMES; k++)
+        hex_trace_frame(2e-3);
+    hex_trace_frame_stats(&stats);
+    CHECK(stats.frames == HEX_TRACE_FRAMES && stats.draw_calls == 0);
+    CHECK(stats.p99_ms > 1.99 && stats.p99_ms < 2.01);
+}
+
+/* A full buffer drops events, but never the end of a recorded span. */
+static void full(void) {
+    hex_trace_reset();
+    while (hex_trace_dropped() == 0) {
+        hex_trace_begin("a");
+        hex_trace_begin("b");
+        hex_trace_end();
+        hex_trace_end();
+    }
+    CHECK(hex_trace_event_count() <= HEX_TRACE_MAX_EVENTS);
+    CHECK(hex_trace_event_count() % 2 == 0);
+    hex_trace_reset();
+}
+
+int main(void) {
+    /* without -DHEX_TRACE the macros do not even look at their arguments */
+    HEX_TRACE_BEGIN(no_such_name);
+    HEX_TRACE_UF_FIND(no_such_count);
+    HEX_TRACE_FRAME(no_such_time);
+    HEX_TRACE_END();
+    HEX_TRACE_DRAW_CALL();
+
+    spans();
+    frames();
+    full();
+    return test_exit("test-trace");
+}
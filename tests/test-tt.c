@@ -0,0 +1,156 @@
+#include <pthread.h>
+#include <stdlib.h>
+
+#include "hex-grid.h"
+#include "hex-random.h"
+#include "hex-tt.h"
+#include "test.h"
+
+static void round_trip(void) {
+    struct hex_tt tt;
+    CHECK(hex_tt_init(&tt, 1));
+    struct hex_tt_data in = {.move = 123456,
+                             .value = -300,
+                             .depth = 17,
+                             .bound = HEX_TT_LOWER,
+                             .count = {7, UINT32_MAX}};
+    struct hex_tt_data out;
+    CHECK(!hex_tt_probe(&tt, 0, &out)); // a zeroed slot is not key 0
+    hex_tt_store(&tt, 0x1234, &in);
+    CHECK(hex_tt_probe(&tt, 0x1234, &out));
+    CHECK(out.move == in.move && out.value == in.value);
+    CHECK(out.depth == in.depth && out.bound == in.bound);
+    CHECK(out.count[0] == in.count[0] && out.count[1] == in.count[1]);
+    CHECK(!hex_tt_probe(&tt, 0x1235, &out));
+    hex_tt_clear(&tt);
+    CHECK(!hex_tt_probe(&tt, 0x1234, &out));
+    hex_tt_destroy(&tt);
+}
+
+/* A table of one pair of slots, which every key shares. */
+static void replacement(void) {
+    struct hex_tt tt;
+    struct hex_tt_data d = {.move = HEX_TT_NO_MOVE}, out;
+    CHECK(hex_tt_init(&tt, 0));
+    CHECK(tt.mask == 0);
+    d.depth = 5;
+    hex_tt_store(&tt, 1, &d);
+    d.depth = 1;
+    hex_tt_store(&tt, 2, &d);
+    CHECK(hex_tt_probe(&tt, 1, &out) && out.depth == 5);
+    CHECK(hex_tt_probe(&tt, 2, &out) && out.depth == 1);
+    /* the deep entry stays, the recent one takes the other slot */
+    d.depth = 2;
+    hex_tt_store(&tt, 3, &d);
+    CHECK(hex_tt_probe(&tt, 1, &out) && out.depth == 5);
+    CHECK(!hex_tt_probe(&tt, 2, &out));
+    CHECK(hex_tt_probe(&tt, 3, &out) && out.depth == 2);
+    /* a key updates its own entry even when that makes it shallower */
+    d.depth = 0;
+    d.value = 9;
+    hex_tt_store(&tt, 1, &d);
+    CHECK(hex_tt_probe(&tt, 1, &out) && out.value == 9);
+    hex_tt_destroy(&tt);
+}
+
+/* Threads hammering one pair with entries whose data is a function of
+   their key: a slot torn between two writers must read as a miss, never
+   as a hit with another key's data. */
+struct hammer {
+    struct hex_tt *tt;
+    uint64_t seed;
+    unsigned bad;
+};
+
+static void entry_for(uint64_t key, struct hex_tt_data *d) {
+    struct hex_rng rng = {key};
+    uint64_t r = hex_rng_next(&rng);
+    *d = (struct hex_tt_data){.move = (uint32_t)r,
+                              .value = (int16_t)(r >> 32),
+                              .depth = (uint8_t)(r >> 48) & 0x3f,
+                              .bound = (uint8_t)(r >> 56) & 3,
+                              .count = {(uint32_t)(r >> 8),
+                                        (uint32_t)(r >> 24)}};
+}
+
+static void *hammer_run(void *arg) {
+    struct hammer *h = arg;
+    struct hex_rng rng = {h->seed};
+    for (unsigned n = 0; n < 500000; n++) {
+        uint64_t key = hex_rng_below(&rng, 16) * 0x9e3779b97f4a7c15;
+        struct hex_tt_data d, expected;
+        entry_for(key, &expected);
+        if (n % 2) {
+            hex_tt_store(h->tt, key, &expected);
+        } else if (hex_tt_probe(h->tt, key, &d)) {
+            h->bad += d.move != expected.move || d.value != expected.value ||
+                      d.depth != expected.depth ||
+                      d.bound != expected.bound ||
+                      d.count[0] != expected.count[0] ||
+                      d.count[1] != expected.count[1];
+        }
+    }
+    return NULL;
+}
+
+static void torn_slots(void) {
+    struct hex_tt tt;
+    struct hammer h[4];
+    pthread_t threads[4];
+    unsigned running = 0;
+    CHECK(hex_tt_init(&tt, 0));
+    for (unsigned t = 0; t < 4; t++) {
+        h[t] = (struct hammer){.tt = &tt, .seed = t};
+        if (pthread_create(&threads[t], NULL, hammer_run, &h[t]) == 0)
+            running = t + 1;
+        else
+            break;
+    }
+    CHECK(running > 0);
+    for (unsigned t = 0; t < running; t++) {
+        pthread_join(threads[t], NULL);
+        CHECK(h[t].bad == 0);
+    }
+    hex_tt_destroy(&tt);
+}
+
+/* The incremental Zobrist hash of random games against one computed from
+   the stones, and child keys against the keys of the children. */
+static void zobrist(void) {
+    hex_grid g;
+    struct hex_rng rng;
+    if (!hex_grid_init(&g, 7, HEX_GRID_UNDOABLE_UNION_FIND))
+        exit(1);
+    hex_rng_seed(&rng, 12);
+    for (unsigned n = 0; n < 50; n++) {
+        hex_grid_clear(&g);
+        cell_color player = RED;
+        while (g.move_count < 49) {
+            size_t i = hex_rng_below(&rng, 49);
+            if (g.cells[i].color != NEUTRAL)
+                continue;
+            uint64_t child = hex_grid_child_key(&g, i, player);
+            CHECK(child != hex_grid_key(&g, player));
+            hex_grid_open_cell(&g, i, player);
+            player = player == RED ? BLUE : RED;
+            CHECK(hex_grid_key(&g, player) == child);
+            CHECK(hex_grid_key(&g, RED) != hex_grid_key(&g, BLUE));
+
+            uint64_t hash = 0;
+            for (size_t c = 0; c < 49; c++) {
+                if (g.cells[c].color != NEUTRAL)
+                    hash ^= hex_grid_zobrist(c, g.cells[c].color);
+            }
+            CHECK(g.hash == hash);
+        }
+    }
+    hex_grid_destroy(&g);
+}
+
+int main(void) {
+    round_trip();
+    replacement();
+    torn_slots();
+    zobrist();
+    return test_exit("test-tt");
+}
@@ -0,0 +1,207 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "hex-grid.h"
+#include "hex-random.h"
+#include "hex-twodistance.h"
+#include "test.h"
+
+#define MAX_CELLS 121
+
+/* The definition, one cell at a time: the neighbours of an empty cell are
+   the empty cells next to it or around a group next to it, and a cell
+   joins the next level once two of them are reached. */
+static void reference(const hex_grid *g,
+                      cell_color player,
+                      unsigned e,
+                      uint16_t *distance) {
+    const size_t cells = g->size * g->size;
+    const uint32_t edge =
+        (uint32_t)(cells + (player == BLUE ? 2 : 0) + e);
+    static bool near[MAX_CELLS][MAX_CELLS];
+    static size_t group[MAX_CELLS];
+    static bool on_edge[MAX_CELLS];
+    size_t stack[MAX_CELLS];
+
+    /* label the groups by flooding */
+    for (size_t i = 0; i < cells; i++)
+        group[i] = (size_t)-1;
+    for (size_t i = 0; i < cells; i++) {
+        if (g->cells[i].color != player || group[i] != (size_t)-1)
+            continue;
+        size_t top = 0;
+        on_edge[i] = false;
+        group[i] = i;
+        stack[top++] = i;
+        while (top) {
+            const size_t s = stack[--top];
+            for (unsigned k = 0; k < 6; k++) {
+                const uint32_t v = g->neighbors[s][k];
+                if (v == edge)
+                    on_edge[i] = true;
+                if (v < cells && g->cells[v].color == player &&
+                    group[v] == (size_t)-1) {
+                    group[v] = i;
+                    stack[top++] = v;
+                }
+            }
+        }
+    }
+
+    memset(near, 0, sizeof(near));
+    for (size_t c = 0; c < cells; c++) {
+        distance[c] = HEX_TWODISTANCE_FAR;
+        if (g->cells[c].color != NEUTRAL)
+            continue;
+        for (unsigned k = 0; k < 6; k++) {
+            const uint32_t v = g->neighbors[c][k];
+            if (v == edge)
+                distance[c] = 1;
+            if (v >= cells || g->cells[v].color == 3 - player)
+                continue;
+            if (g->cells[v].color == NEUTRAL) {
+                near[c][v] = true;
+                continue;
+            }
+            if (on_edge[group[v]])
+                distance[c] = 1;
+            for (size_t s = 0; s < cells; s++) {
+                if (group[s] != group[v])
+                    continue;
+                for (unsigned j = 0; j < 6; j++) {
+                    const uint32_t u = g->neighbors[s][j];
+                    if (u < cells && u != c && g->cells[u].color == NEUTRAL)
+                        near[c][u] = true;
+                }
+            }
+        }
+    }
+
+    uint16_t next[MAX_CELLS];
+    for (uint16_t level = 1;; level++) {
+        bool grew = false;
+        memcpy(next, distance, cells * sizeof(uint16_t));
+        for (size_t c = 0; c < cells; c++) {
+            if (g->cells[c].color != NEUTRAL ||
+                distance[c] != HEX_TWODISTANCE_FAR)
+                continue;
+            unsigned reached = 0;
+            for (size_t u = 0; u < cells; u++)
+                reached += near[c][u] && distance[u] <= level;
+            if (reached >= 2) {
+                next[c] = level + 1;
+                grew = true;
+            }
+        }
+        memcpy(distance, next, cells * sizeof(uint16_t));
+        if (!grew)
+            break;
+    }
+}
+
+static void small_boards(void) {
+    struct hex_twodistance t;
+    hex_grid g;
+    size_t ties;
+
+    /* 1x1: the only cell touches all four edges */
+    if (!hex_grid_init(&g, 1, HEX_GRID_UNION_FIND) ||
+        !hex_twodistance_init(&t, 1))
+        exit(1);
+    CHECK(hex_twodistance_potential(&t, &g, RED, &ties) == 2 && ties == 1);
+    CHECK(hex_twodistance_evaluate(&t, &g) == 0);
+    hex_grid_open_cell(&g, 0, BLUE);
+    CHECK(hex_twodistance_potential(&t, &g, BLUE, &ties) == 0);
+    CHECK(hex_twodistance_evaluate(&t, &g) == -HEX_TWODISTANCE_WIN);
+    hex_twodistance_destroy(&t);
+    hex_grid_destroy(&g);
+
+    /* 2x2: a2 and b1 sum to 2 + 1, a1 and b2 to 3 + 1 */
+    if (!hex_grid_init(&g, 2, HEX_GRID_UNION_FIND) ||
+        !hex_twodistance_init(&t, 2))
+        exit(1);
+    CHECK(hex_twodistance_potential(&t, &g, RED, &ties) == 3 && ties == 2);
+    CHECK(t.distance[0][3] == 3 && t.distance[1][0] == 3);
+    hex_twodistance_destroy(&t);
+    hex_grid_destroy(&g);
+
+    /* 3x3 with red in the centre: the cells around it neighbour each other,
+       so c2 is two from the top instead of three */
+    if (!hex_grid_init(&g, 3, HEX_GRID_UNION_FIND) ||
+        !hex_twodistance_init(&t, 3))
+        exit(1);
+    hex_grid_open_cell(&g, 4, RED);
+    CHECK(hex_twodistance_potential(&t, &g, RED, &ties) == 3 && ties == 4);
+    CHECK(t.distance[0][5] == 2 && t.distance[0][8] == 3);
+    CHECK(hex_twodistance_evaluate(&t, &g) > 0);
+    hex_twodistance_destroy(&t);
+    hex_grid_destroy(&g);
+}
+
+static void empty_board(void) {
+    struct hex_twodistance t;
+    hex_grid g;
+    size_t red_ties, blue_ties;
+    if (!hex_grid_init(&g, 7, HEX_GRID_UNION_FIND) ||
+        !hex_twodistance_init(&t, 7))
+        exit(1);
+    /* red's and blue's boards are mirror images */
+    CHECK(hex_twodistance_potential(&t, &g, RED, &red_ties) ==
+          hex_twodistance_potential(&t, &g, BLUE, &blue_ties));
+    CHECK(red_ties == blue_ties);
+    CHECK(hex_twodistance_evaluate(&t, &g) == 0);
+
+    /* a blue wall leaves red no cell with a way to both edges */
+    for (size_t x = 0; x < 7; x++)
+        hex_grid_open_cell(&g, 3 * 7 + x, BLUE);
+    CHECK(hex_twodistance_potential(&t, &g, RED, NULL) ==
+          HEX_TWODISTANCE_FAR);
+    CHECK(hex_twodistance_evaluate(&t, &g) == -HEX_TWODISTANCE_WIN);
+    hex_twodistance_destroy(&t);
+    hex_grid_destroy(&g);
+}
+
+/* The bitsets agree with the definition on every position of random
+   games, for both players and both edges. */
+static void random_games(size_t size, enum hex_grid_backend backend) {
+    const size_t cells = size * size;
+    struct hex_twodistance t;
+    struct hex_rng rng;
+    hex_grid g;
+    uint16_t expected[MAX_CELLS];
+    if (!hex_grid_init(&g, size, backend) || !hex_twodistance_init(&t, size))
+        exit(1);
+    hex_rng_seed(&rng, size);
+    for (unsigned game = 0; game < 10; game++) {
+        hex_grid_clear(&g);
+        cell_color player = RED;
+        while (hex_grid_get_winner(&g) == NEUTRAL) {
+            size_t i;
+            do
+                i = hex_rng_below(&rng, (uint32_t)cells);
+            while (g.cells[i].color != NEUTRAL);
+            hex_grid_open_cell(&g, i, player);
+            player = 3 - player;
+
+            for (cell_color p = RED; p <= BLUE; p++) {
+                hex_twodistance_potential(&t, &g, p, NULL);
+                for (unsigned e = 0; e < 2; e++) {
+                    reference(&g, p, e, expected);
+                    CHECK(!memcmp(t.distance[e], expected,
+                                  cells * sizeof(uint16_t)));
+                }
+            }
+        }
+    }
+    hex_twodistance_destroy(&t);
+    hex_grid_destroy(&g);
+}
+
+int main(void) {
+    small_boards();
+    empty_board();
+    random_games(5, HEX_GRID_BITBOARD);
+    random_games(9, HEX_GRID_UNDOABLE_UNION_FIND);
+    random_games(11, HEX_GRID_UNION_FIND);
+    return test_exit("test-twodistance");
+}
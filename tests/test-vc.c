@@ -0,0 +1,123 @@
+#include <stdlib.h>
+
+#include "hex-grid.h"
+#include "hex-random.h"
+#include "hex-solve.h"
+#include "hex-vc.h"
+#include "test.h"
+
+static cell_color other(cell_color player) {
+    return 1 + (player % 2);
+}
+
+/* Whether `player`, to move, wins g, by trying everything. */
+static bool wins(hex_grid *g, cell_color player) {
+    for (size_t i = 0; i < g->size * g->size; i++) {
+        if (!hex_grid_open_cell(g, i, player))
+            continue;
+        bool won = hex_grid_get_winner(g) == player ||
+                   !wins(g, other(player));
+        hex_grid_undo(g);
+        if (won)
+            return true;
+    }
+    return false;
+}
+
+/* Who wins g with `to_move` to play: by brute force once few cells are
+   left, by the solver before that. */
+static cell_color winner_of(struct hex_solver *s,
+                            hex_grid *g,
+                            cell_color to_move) {
+    if (g->size * g->size - g->move_count <= 10)
+        return wins(g, to_move) ? to_move : other(to_move);
+    return hex_solve(s, g, to_move, false, NULL);
+}
+
+/* Every connection holds empty cells only, and never one of its ends. */
+static void check_carriers(struct hex_vc_engine *e, cell_color player) {
+    const hex_grid *g = e->grid;
+    const size_t cells = g->size * g->size;
+    for (size_t a = 0; a < cells + 4; a++) {
+        for (size_t b = a + 1; b < cells + 4; b++) {
+            const struct hex_vc_list *l = hex_vc_between(e, player, a, b);
+            for (size_t k = 0; l && k < l->count; k++) {
+                const uint64_t *c = l->vcs[k].carrier;
+                for (size_t i = 0; i < cells; i++) {
+                    if (c[i / 64] >> (i % 64) & 1)
+                        CHECK(g->cells[i].color == NEUTRAL && i != a &&
+                              i != b);
+                }
+            }
+        }
+    }
+}
+
+/* Random games played through the update and through a rebuild after each
+   move. Whatever either one calls has to be the real winner; the solver
+   cuts off at what a rebuild calls, so that is only checked where the
+   brute force can. The update drops connections that a rebuild finds
+   again (see hex-vc.h), so it may call a game later, but it must not miss
+   more than one call in `slack` of the rebuild's. */
+static void against_rebuild(size_t size, unsigned games, unsigned slack) {
+    struct hex_vc_engine live, full;
+    struct hex_solve_config config;
+    struct hex_solver s;
+    struct hex_rng rng;
+    hex_grid g, copy;
+    unsigned called = 0, missed = 0;
+    hex_solve_default_config(&config);
+    config.tt_megabytes = 16;
+    if (!hex_solver_init(&s, &config, size) ||
+        !hex_grid_init(&g, size, HEX_GRID_UNION_FIND) ||
+        !hex_grid_init(&copy, size, HEX_GRID_UNDOABLE_UNION_FIND) ||
+        !hex_vc_init(&live, &g) || !hex_vc_init(&full, &copy))
+        exit(1);
+    hex_rng_seed(&rng, size);
+
+    for (unsigned game = 0; game < games; game++) {
+        hex_grid_clear(&g);
+        hex_vc_rebuild(&live);
+        cell_color player = RED;
+        while (hex_grid_get_winner(&g) == NEUTRAL) {
+            size_t i = hex_rng_below(&rng, (uint32_t)(size * size));
+            if (!hex_vc_play(&live, i, player))
+                continue;
+            player = other(player);
+            hex_grid_copy(&copy, &g);
+            hex_vc_rebuild(&full);
+            check_carriers(&live, RED);
+            check_carriers(&live, BLUE);
+
+            cell_color updated = hex_vc_winner(&live, player);
+            cell_color rebuilt = hex_vc_winner(&full, player);
+            if (hex_grid_get_winner(&g) != NEUTRAL) {
+                CHECK(updated == hex_grid_get_winner(&g));
+                CHECK(rebuilt == updated);
+                break;
+            }
+            const size_t empty = size * size - g.move_count;
+            if (updated != rebuilt || (rebuilt != NEUTRAL && empty <= 10)) {
+                cell_color winner = winner_of(&s, &copy, player);
+                CHECK(updated == NEUTRAL || updated == winner);
+                CHECK(rebuilt == NEUTRAL || rebuilt == winner);
+            }
+            called += rebuilt != NEUTRAL;
+            missed += rebuilt != NEUTRAL && updated == NEUTRAL;
+        }
+    }
+    CHECK(called > games);
+    CHECK(missed * slack <= called);
+    hex_vc_destroy(&live);
+    hex_vc_destroy(&full);
+    hex_grid_destroy(&copy);
+    hex_grid_destroy(&g);
+    hex_solver_destroy(&s);
+}
+
+int main(void) {
+    against_rebuild(4, 200, 20);
+    against_rebuild(5, 60, 20);
+    against_rebuild(6, 40, 20);
+    return test_exit("test-vc");
+}
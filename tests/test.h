@@ -0,0 +1,30 @@
+#if !defined(TEST_H)
+#define TEST_H
+
+#include <stdio.h>
+
+/* Just enough of a harness for the tests: CHECK() reports a failed
+   condition and carries on, and test_exit() turns the count of failures
+   into the exit status make test looks at. */
+
+static unsigned test_failures;
+
+#define CHECK(cond)                                                        \
+    do {                                                                   \
+        if (!(cond)) {                                                     \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__,         \
+                    __LINE__, #cond);                                      \
+            test_failures++;                                               \
+        }                                                                  \
+    } while (0)
+
+static inline int test_exit(const char *name) {
+    if (test_failures) {
+        fprintf(stderr, "%s: %u failures\n", name, test_failures);
+        return 1;
+    }
+    printf("%s: ok\n", name);
+    return 0;
+}
+
+#endif /* TEST_H */
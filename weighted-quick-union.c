@@ -1,68 +1,158 @@
 #include <stdlib.h>
+#include <string.h>
 
+#include "hex-trace.h"
 #include "weighted-quick-union.h"
 
+/* set in an undo log entry when the union raised the new root's rank */
+#define RANK_RAISED ((wqu_id)1 << (sizeof(wqu_id) * 8 - 1))
+
 int w_quickunion_init(struct wqu_uf *uf, size_t size) {
-    uf->nodes = malloc(size * sizeof(struct wqu_node));
-    if (!uf->nodes)
+    if (size > WQU_MAX_NODES)
         return 0;
-    for (size_t i = 0; i < size; i++) {
-        uf->nodes[i].id = i;
-        uf->nodes[i].size = 1;
-    }
+    /* one block: the parent array, then the rank bytes */
+    uf->parent = malloc(size * (sizeof(wqu_id) + sizeof(uint8_t)));
+    if (!uf->parent)
+        return 0;
+    uf->rank = (uint8_t *)(uf->parent + size);
     uf->size = size;
-    uf->count = size;
+    uf->mode = WQU_PATH_COMPRESSION;
+    uf->undo_log = NULL;
+    w_quickunion_reset(uf);
     return 1;
 }
 
+int w_quickunion_init_undoable(struct wqu_uf *uf, size_t size) {
+    if (!w_quickunion_init(uf, size))
+        return 0;
+    /* every union merges two components, so at most size - 1 are logged */
+    uf->undo_log = malloc(size * sizeof(wqu_id));
+    if (!uf->undo_log) {
+        w_quickunion_destroy(uf);
+        return 0;
+    }
+    uf->mode = WQU_UNDOABLE;
+    return 1;
+}
+
+void w_quickunion_init_in(struct wqu_uf *uf,
+                          wqu_id *parent,
+                          uint8_t *rank,
+                          size_t size) {
+    uf->parent = parent;
+    uf->rank = rank;
+    uf->size = size;
+    uf->mode = WQU_PATH_COMPRESSION;
+    uf->undo_log = NULL;
+    w_quickunion_reset(uf);
+}
+
+void w_quickunion_reset(struct wqu_uf *uf) {
+    for (size_t i = 0; i < uf->size; i++)
+        uf->parent[i] = (wqu_id)i;
+    memset(uf->rank, 0, uf->size);
+    uf->count = uf->size;
+    uf->undo_len = 0;
+}
+
+void w_quickunion_copy(struct wqu_uf *dst, const struct wqu_uf *src) {
+    size_t size = src->size < dst->size ? src->size : dst->size;
+    memcpy(dst->parent, src->parent, size * sizeof(wqu_id));
+    memcpy(dst->rank, src->rank, size);
+    dst->count = src->count;
+    if (src->mode == WQU_UNDOABLE) {
+        memcpy(dst->undo_log, src->undo_log, src->undo_len * sizeof(wqu_id));
+        dst->undo_len = src->undo_len;
+    }
+}
+
 void w_quickunion_destroy(struct wqu_uf *uf) {
-    free(uf->nodes);
-    uf->nodes = NULL;
+    free(uf->parent);
+    free(uf->undo_log);
+    uf->parent = NULL;
+    uf->rank = NULL;
+    uf->undo_log = NULL;
     uf->size = 0;
     uf->count = 0;
+    uf->undo_len = 0;
 }
 
-/* static size_t root_id(struct wqu_uf *uf, size_t p) {
+/* static wqu_id root_id(struct wqu_uf *uf, wqu_id p) {
 
-        struct wqu_node *node = &uf->nodes[p];
-        while(node->id != uf->nodes[node->id].id) {
-
-                uf->nodes[node->id].id = uf->nodes[uf->nodes[node->id].id].id;
-// path halving node = &uf->nodes[node->id];
+        while (p != uf->parent[p]) {
+                uf->parent[p] = uf->parent[uf->parent[p]]; // path halving
+                p = uf->parent[p];
         }
-        return node->id;
+        return p;
 } */
 
-static size_t root_id(struct wqu_uf *uf, size_t p) {
-    size_t root_i = uf->nodes[p].id;
-    while (root_i != uf->nodes[root_i].id)
-        root_i = uf->nodes[root_i].id;
+static wqu_id root_id(struct wqu_uf *uf, wqu_id p) {
+    wqu_id *parent = uf->parent;
+#if defined(HEX_TRACE)
+    size_t steps = 0;
+    for (wqu_id q = p; q != parent[q]; q = parent[q])
+        steps++;
+    HEX_TRACE_UF_FIND(steps);
+#endif
+    if (uf->mode == WQU_UNDOABLE) {
+        while (p != parent[p])
+            p = parent[p];
+        return p;
+    }
+
+    wqu_id root_i = parent[p];
+    while (root_i != parent[root_i])
+        root_i = parent[root_i];
     while (p != root_i) {
-        size_t newp = uf->nodes[p].id;
-        uf->nodes[p].id = root_i;
+        wqu_id newp = parent[p];
+        parent[p] = root_i;
         p = newp;
     }
     return root_i;
 }
 
 bool w_quickunion_is_connected(struct wqu_uf *uf, size_t p, size_t q) {
-    return root_id(uf, p) == root_id(uf, q);
+    return root_id(uf, (wqu_id)p) == root_id(uf, (wqu_id)q);
+}
+
+size_t w_quickunion_find(struct wqu_uf *uf, size_t p) {
+    return root_id(uf, (wqu_id)p);
 }
 
 void w_quickunion_union(struct wqu_uf *uf, size_t p, size_t q) {
-    size_t p_root_id = root_id(uf, p);
-    size_t q_root_id = root_id(uf, q);
+    wqu_id p_root_id = root_id(uf, (wqu_id)p);
+    wqu_id q_root_id = root_id(uf, (wqu_id)q);
     if (p_root_id == q_root_id)
         return;
-    struct wqu_node *p_node = &uf->nodes[p];
-    struct wqu_node *q_node = &uf->nodes[q];
-
-    if (p_node->size <= q_node->size) {
-        uf->nodes[p_root_id].id = uf->nodes[q_root_id].id;
-        q_node->size += p_node->size;
-    } else {
-        uf->nodes[q_root_id].id = uf->nodes[p_root_id].id;
-        p_node->size += q_node->size;
+
+    /* the lower ranked root goes under the other one */
+    if (uf->rank[p_root_id] > uf->rank[q_root_id]) {
+        wqu_id tmp = p_root_id;
+        p_root_id = q_root_id;
+        q_root_id = tmp;
+    }
+    uf->parent[p_root_id] = q_root_id;
+    wqu_id logged = p_root_id;
+    if (uf->rank[p_root_id] == uf->rank[q_root_id]) {
+        uf->rank[q_root_id]++;
+        logged |= RANK_RAISED;
     }
+    if (uf->mode == WQU_UNDOABLE)
+        uf->undo_log[uf->undo_len++] = logged;
     uf->count--;
 }
+
+size_t w_quickunion_checkpoint(const struct wqu_uf *uf) {
+    return uf->undo_len;
+}
+
+void w_quickunion_rollback(struct wqu_uf *uf, size_t checkpoint) {
+    while (uf->undo_len > checkpoint) {
+        wqu_id logged = uf->undo_log[--uf->undo_len];
+        wqu_id child = logged & ~RANK_RAISED;
+        if (logged & RANK_RAISED)
+            uf->rank[uf->parent[child]]--;
+        uf->parent[child] = child;
+        uf->count++;
+    }
+}
@@ -3,25 +3,68 @@
 
 #include <stddef.h>
 #include <stdbool.h>
+#include <stdint.h>
 
+/* Node ids are 32 bits unless built with -DWQU_WIDE_IDS, which lifts the
+   limit of 2^31 nodes at the cost of twice the memory. */
+#if defined(WQU_WIDE_IDS)
+typedef size_t wqu_id;
+#else
+typedef uint32_t wqu_id;
+#endif
 
-struct wqu_node {	
-	size_t id;
-	size_t size; // number of nodes of the component this node is connected to
-};
+#define WQU_MAX_NODES ((size_t)((wqu_id)-1 >> 1))
+
+/* WQU_UNDOABLE skips path compression, so that every union only changes
+   the root it attaches and can be logged and undone in O(1). Union by rank
+   keeps the trees O(log n) deep without compression. */
+enum wqu_mode { WQU_PATH_COMPRESSION = 0, WQU_UNDOABLE };
 
+/* Structure of arrays: the parent ids that every find walks are packed
+   together, and the rank, which only matters at roots, sits in a separate
+   byte array. */
 struct wqu_uf {
-	struct wqu_node *nodes;
+	wqu_id *parent;
+	uint8_t *rank; // upper bound on the tree height, roots only
 	size_t size;
 	size_t count;
+	enum wqu_mode mode;
+	wqu_id *undo_log; // roots attached by each union, WQU_UNDOABLE only
+	size_t undo_len;
 };
 
 int w_quickunion_init(struct wqu_uf *uf, size_t size);
 
+int w_quickunion_init_undoable(struct wqu_uf *uf, size_t size);
+
+/* Sets uf up over `size` ids and `size` rank bytes that the caller owns,
+   such as a slot of an arena, and resets it. It compresses paths, and is
+   not to be passed to w_quickunion_destroy(). */
+void w_quickunion_init_in(struct wqu_uf *uf,
+                          wqu_id *parent,
+                          uint8_t *rank,
+                          size_t size);
+
+void w_quickunion_reset(struct wqu_uf *uf);
+
+/* Copies the components (and undo log) of src into dst, which must have the
+   same mode. Only the nodes both of them have are copied. */
+void w_quickunion_copy(struct wqu_uf *dst, const struct wqu_uf *src);
+
 void w_quickunion_destroy(struct wqu_uf *uf);
 
 bool w_quickunion_is_connected(struct wqu_uf *uf, size_t p, size_t q);
 
+/* The root of p's component, which names the component until its next
+   union. */
+size_t w_quickunion_find(struct wqu_uf *uf, size_t p);
+
 void w_quickunion_union(struct wqu_uf *uf, size_t p, size_t q);
 
+/* A point to roll back to. WQU_UNDOABLE only. */
+size_t w_quickunion_checkpoint(const struct wqu_uf *uf);
+
+/* Undoes every union made since `checkpoint`, in O(1) per union. */
+void w_quickunion_rollback(struct wqu_uf *uf, size_t checkpoint);
+
 #endif /* WEIGHTED_QUICK_UNION_H */